@@ -2,6 +2,11 @@
 #include "zrun_core.h"
 #include <QThread>
 #include <QMetaType>
+#include <QMetaMethod>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <map>
+#include <mutex>
 
 // 静态编译定义
 #if defined(ZRUN_STATIC)
@@ -10,9 +15,51 @@
 #define ZRUNQT_API Q_DECL_IMPORT
 #endif
 
+namespace {
+// 输出信号的最小间隔，限制大量输出时 GUI 线程处理信号的频率
+constexpr int kFlushIntervalMs = 50;
+
+// 以完整 UTF-8 字符结尾的前缀长度，未完成的多字节序列留到下一批
+int completeUtf8Length(const QByteArray& data) {
+    int size = data.size();
+    for (int i = 1; i <= 3 && i <= size; ++i) {
+        unsigned char c = static_cast<unsigned char>(data[size - i]);
+        if ((c & 0xC0) == 0x80) {
+            continue; // 续字节
+        }
+        int length = (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 1;
+        return length > i ? size - i : size;
+    }
+    return size;
+}
+
+ZRunQt::CommandResult toQtResult(const Zrun::CommandResult& result) {
+    ZRunQt::CommandResult qtResult;
+    qtResult.exitCode = result.exitCode;
+    qtResult.output = QString::fromStdString(result.output);
+    qtResult.error = QString::fromStdString(result.error);
+    qtResult.executionTime = result.executionTime;
+    qtResult.timedOut = result.timedOut;
+    return qtResult;
+}
+}
+
 // 只在实现文件中注册元类型，不重复声明
 class ZRunQt::Impl {
 public:
+    // 后台线程累积、等待发出的输出
+    struct PendingOutput {
+        QByteArray data[2]; // stdout, stderr
+    };
+
+    std::mutex mutex;
+    std::map<int, PendingOutput> pending;
+    bool flushScheduled = false;
+
+    QTimer* flushTimer = nullptr;
+    QElapsedTimer lastFlush;
+
+    // 最后声明：先于上面的成员销毁，销毁时仍可能回调
     Zrun::CoreImpl core;
 };
 
@@ -20,6 +67,11 @@ ZRunQt::ZRunQt(QObject *parent)
     : QObject(parent), m_impl(new Impl()) {
     qRegisterMetaType<ZRunQt::CommandResult>();
     qRegisterMetaType<ZRunQt::AsyncState>();
+
+    m_impl->flushTimer = new QTimer(this);
+    m_impl->flushTimer->setSingleShot(true);
+    connect(m_impl->flushTimer, &QTimer::timeout, this, &ZRunQt::flushOutput);
+    m_impl->lastFlush.start();
 }
 
 ZRunQt::~ZRunQt() {
@@ -38,15 +90,7 @@ ZRunQt::CommandResult ZRunQt::executeSync(const QString &command,
     }
 
     auto result = m_impl->core.executeSync(command.toStdString(), type, timeoutMs);
-
-    CommandResult qtResult;
-    qtResult.exitCode = result.exitCode;
-    qtResult.output = QString::fromStdString(result.output);
-    qtResult.error = QString::fromStdString(result.error);
-    qtResult.executionTime = result.executionTime;
-    qtResult.timedOut = result.timedOut;
-
-    return qtResult;
+    return toQtResult(result);
 }
 
 int ZRunQt::executeAsync(const QString &command,
@@ -60,17 +104,31 @@ int ZRunQt::executeAsync(const QString &command,
     default: type = Zrun::ShellType::PowerShell;
     }
 
-    auto outputCallback = [this](const std::string& output, bool isError) {
-        QMetaObject::invokeMethod(this, "onAsyncOutput", Qt::QueuedConnection,
-                                  Q_ARG(int, -1),
-                                  Q_ARG(QString, QString::fromStdString(output)),
-                                  Q_ARG(bool, isError));
+    auto operation = m_impl->core.createAsync(command.toStdString(),
+                                              Zrun::CommandOptions(type, timeoutMs));
+    int asyncId = operation->id;
+    // 回调执行期间命令对象一定存活
+    Zrun::AsyncOperation* op = operation.get();
+
+    // 在事件循环线程中只追加字节，由 GUI 线程按间隔合并发出
+    operation->chunkCallback = [this, asyncId, op](std::string_view data, bool isError) {
+        if (op->state != Zrun::AsyncState::Running) {
+            return; // 已取消，asyncFinished 已经发出
+        }
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->pending[asyncId].data[isError ? 1 : 0].append(
+            data.data(), static_cast<int>(data.size()));
+        if (!m_impl->flushScheduled) {
+            m_impl->flushScheduled = true;
+            QMetaObject::invokeMethod(this, "scheduleFlush", Qt::QueuedConnection);
+        }
     };
+    operation->addListener([this, asyncId]() {
+        QMetaObject::invokeMethod(this, "onAsyncFinished", Qt::QueuedConnection,
+                                  Q_ARG(int, asyncId));
+    });
 
-    int asyncId = m_impl->core.executeAsync(
-        command.toStdString(), type, timeoutMs, outputCallback
-        );
-
+    m_impl->core.startAsync(operation);
     return asyncId;
 }
 
@@ -82,6 +140,7 @@ ZRunQt::AsyncState ZRunQt::getAsyncStatus(int asyncId) {
     case Zrun::AsyncState::Failed: return Failed;
     case Zrun::AsyncState::TimedOut: return TimedOut;
     case Zrun::AsyncState::Cancelled: return Cancelled;
+    case Zrun::AsyncState::ResourceExceeded: return ResourceExceeded;
     default: return Failed;
     }
 }
@@ -89,13 +148,7 @@ ZRunQt::AsyncState ZRunQt::getAsyncStatus(int asyncId) {
 ZRunQt::CommandResult ZRunQt::getAsyncResult(int asyncId) {
     Zrun::CommandResult result;
     if (m_impl->core.getAsyncResult(asyncId, result)) {
-        CommandResult qtResult;
-        qtResult.exitCode = result.exitCode;
-        qtResult.output = QString::fromStdString(result.output);
-        qtResult.error = QString::fromStdString(result.error);
-        qtResult.executionTime = result.executionTime;
-        qtResult.timedOut = result.timedOut;
-        return qtResult;
+        return toQtResult(result);
     }
 
     return CommandResult();
@@ -117,10 +170,74 @@ void ZRunQt::setExecutionPolicy(const QString &policy) {
     m_impl->core.setExecutionPolicy(policy.toStdString());
 }
 
-void ZRunQt::onAsyncOutput(int asyncId, const QString &output, bool isError) {
-    emit asyncOutputReady(asyncId, output, isError);
+void ZRunQt::scheduleFlush() {
+    if (m_impl->flushTimer->isActive()) {
+        return;
+    }
+    qint64 wait = kFlushIntervalMs - m_impl->lastFlush.elapsed();
+    m_impl->flushTimer->start(static_cast<int>(qMax<qint64>(0, wait)));
+}
+
+void ZRunQt::flushOutput() {
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->flushScheduled = false;
+    }
+    m_impl->lastFlush.restart();
+    emitOutput(-1, false);
 }
 
-void ZRunQt::onAsyncFinished(int asyncId, const CommandResult &result) {
+void ZRunQt::onAsyncFinished(int asyncId) {
+    // 先发出该命令剩余的输出，再通知结束
+    emitOutput(asyncId, true);
+
+    CommandResult result;
+    AsyncState state = getAsyncStatus(asyncId);
+    if (state != Cancelled) {
+        result = getAsyncResult(asyncId);
+    }
     emit asyncFinished(asyncId, result);
 }
+
+void ZRunQt::emitOutput(int asyncId, bool final) {
+    // 取出待发出的数据；非最终批次时保留末尾未完成的 UTF-8 序列
+    std::map<int, Impl::PendingOutput> batch;
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        for (auto it = m_impl->pending.begin(); it != m_impl->pending.end();) {
+            if (asyncId != -1 && it->first != asyncId) {
+                ++it;
+                continue;
+            }
+            Impl::PendingOutput& output = batch[it->first];
+            for (int i = 0; i < 2; ++i) {
+                QByteArray& data = it->second.data[i];
+                int length = final ? data.size() : completeUtf8Length(data);
+                QByteArray rest = data.mid(length);
+                data.truncate(length);
+                output.data[i].swap(data);
+                data = rest;
+            }
+            if (final || (it->second.data[0].isEmpty() && it->second.data[1].isEmpty())) {
+                it = m_impl->pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // 没有连接文本信号时不做解码
+    bool wantText = isSignalConnected(QMetaMethod::fromSignal(&ZRunQt::asyncOutputReady));
+    for (const auto& pair : batch) {
+        for (int i = 0; i < 2; ++i) {
+            const QByteArray& data = pair.second.data[i];
+            if (data.isEmpty()) {
+                continue;
+            }
+            emit asyncOutputBytesReady(pair.first, data, i == 1);
+            if (wantText) {
+                emit asyncOutputReady(pair.first, QString::fromUtf8(data), i == 1);
+            }
+        }
+    }
+}
@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include <QString>
+#include <QByteArray>
 #include <QMap>
 
 // 静态编译定义
@@ -29,7 +30,8 @@ public:
         Completed,
         Failed,
         TimedOut,
-        Cancelled
+        Cancelled,
+        ResourceExceeded
     };
     Q_ENUM(AsyncState)
 
@@ -77,14 +79,21 @@ public:
     void setExecutionPolicy(const QString &policy);
 
 signals:
+    // 输出在后台累积，按固定间隔合并发出；只有连接了该信号时才做 UTF-8 解码
     void asyncOutputReady(int asyncId, const QString &output, bool isError);
+    // 同上，未解码的原始字节
+    void asyncOutputBytesReady(int asyncId, const QByteArray &output, bool isError);
+    // 命令结束，在该命令的全部输出信号之后发出
     void asyncFinished(int asyncId, const ZRunQt::CommandResult &result);
 
 private slots:
-    void onAsyncOutput(int asyncId, const QString &output, bool isError);
-    void onAsyncFinished(int asyncId, const CommandResult &result);
+    void scheduleFlush();
+    void flushOutput();
+    void onAsyncFinished(int asyncId);
 
 private:
+    void emitOutput(int asyncId, bool final);
+
     class Impl;
     Impl* m_impl;
 };
@@ -0,0 +1,162 @@
+// I/O 后端基准：比较 epoll、io_uring、poll 事件循环与旧版轮询循环
+// 用法: io_backend_bench [命令数量] [并发数]
+
+#include "zrun.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+using namespace Zrun;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Workload {
+    const char* name;
+    const char* command;
+};
+
+const Workload kWorkloads[] = {
+    {"true", "true"},
+    {"small", "echo hello; echo world 1>&2"},
+    {"1MiB", "head -c 1048576 /dev/zero"},
+};
+
+#ifndef _WIN32
+// 旧版实现：每条命令一个线程，每 10ms 轮询一次 waitpid 和管道
+CommandResult legacyExecute(const std::string& command, int timeoutMs) {
+    CommandResult result;
+    auto startTime = Clock::now();
+
+    int stdoutPipe[2];
+    int stderrPipe[2];
+    if (pipe(stdoutPipe) == -1 || pipe(stderrPipe) == -1) {
+        result.exitCode = -1;
+        return result;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(stdoutPipe[1], STDOUT_FILENO);
+        dup2(stderrPipe[1], STDERR_FILENO);
+        close(stdoutPipe[0]);
+        close(stdoutPipe[1]);
+        close(stderrPipe[0]);
+        close(stderrPipe[1]);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    close(stdoutPipe[1]);
+    close(stderrPipe[1]);
+    fcntl(stdoutPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(stderrPipe[0], F_SETFL, O_NONBLOCK);
+
+    auto readFromPipe = [](int fd, std::string& output) {
+        char buffer[4096];
+        ssize_t bytesRead;
+        while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0) {
+            output.append(buffer, bytesRead);
+        }
+    };
+
+    int status = 0;
+    bool processDone = false;
+    auto timeoutTime = startTime + std::chrono::milliseconds(timeoutMs);
+    while (!processDone) {
+        if (Clock::now() > timeoutTime) {
+            kill(pid, SIGTERM);
+            result.timedOut = true;
+            break;
+        }
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            processDone = true;
+            result.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        }
+        readFromPipe(stdoutPipe[0], result.output);
+        readFromPipe(stderrPipe[0], result.error);
+        usleep(10000);
+    }
+    readFromPipe(stdoutPipe[0], result.output);
+    readFromPipe(stderrPipe[0], result.error);
+    close(stdoutPipe[0]);
+    close(stderrPipe[0]);
+    if (!processDone) {
+        waitpid(pid, &status, 0);
+    }
+    return result;
+}
+
+double runLegacy(const Workload& workload, int count, int concurrency) {
+    auto start = Clock::now();
+    for (int done = 0; done < count; done += concurrency) {
+        std::vector<std::thread> threads;
+        for (int i = done; i < count && i < done + concurrency; ++i) {
+            threads.emplace_back([&]() { legacyExecute(workload.command, 30000); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+#endif
+
+double runBackend(IoBackendType type, const Workload& workload, int count, int concurrency,
+                  std::string& backendName) {
+    ZRun zrun;
+    zrun.setIoBackend(type);
+    backendName = zrun.ioBackendName();
+
+    auto start = Clock::now();
+    for (int done = 0; done < count; done += concurrency) {
+        std::vector<int> ids;
+        for (int i = done; i < count && i < done + concurrency; ++i) {
+            ids.push_back(zrun.executeAsync(workload.command, ShellType::Sh, 30000));
+        }
+        for (int id : ids) {
+            zrun.getAsyncResult(id);
+        }
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(const char* workload, const std::string& backend, int count, double seconds) {
+    std::printf("%-8s %-10s %8.3f s %10.1f cmd/s\n", workload, backend.c_str(), seconds,
+                count / seconds);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int count = argc > 1 ? std::atoi(argv[1]) : 500;
+    int concurrency = argc > 2 ? std::atoi(argv[2]) : 64;
+    if (count <= 0 || concurrency <= 0) {
+        std::fprintf(stderr, "usage: %s [count] [concurrency]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("commands=%d concurrency=%d\n", count, concurrency);
+    for (const auto& workload : kWorkloads) {
+        for (IoBackendType type : {IoBackendType::Epoll, IoBackendType::IoUring,
+                                   IoBackendType::Poll}) {
+            std::string backendName;
+            double seconds = runBackend(type, workload, count, concurrency, backendName);
+            report(workload.name, backendName, count, seconds);
+        }
+#ifndef _WIN32
+        report(workload.name, "legacy", count, runLegacy(workload, count, concurrency));
+#endif
+    }
+    return 0;
+}
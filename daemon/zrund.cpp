@@ -0,0 +1,66 @@
+// zrund：本机执行守护进程，客户端通过 ZRun::connectDaemon / zrun_connect_daemon 把命令交给它执行
+// 用法: zrund [--socket 路径] [--max-concurrency N]
+
+#include "zrun_core.h"
+#include "zrun_daemon.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <signal.h>
+
+using namespace Zrun;
+
+namespace {
+
+DaemonServer* g_server = nullptr;
+
+void handleSignal(int) {
+    if (g_server) {
+        g_server->stop();
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string path = defaultDaemonSocketPath();
+    int maxConcurrency = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (std::strcmp(argv[i], "--max-concurrency") == 0 && i + 1 < argc) {
+            maxConcurrency = std::atoi(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--socket PATH] [--max-concurrency N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    CoreImpl core;
+    if (maxConcurrency > 0) {
+        core.setMaxConcurrency(maxConcurrency);
+    }
+
+    DaemonServer server(core);
+    std::string error;
+    if (!server.listen(path, error)) {
+        std::fprintf(stderr, "zrund: %s\n", error.c_str());
+        return 1;
+    }
+
+    g_server = &server;
+    struct sigaction action = {};
+    action.sa_handler = handleSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    // 客户端断开时的写入错误由返回值处理
+    signal(SIGPIPE, SIG_IGN);
+
+    std::fprintf(stderr, "zrund: listening on %s\n", path.c_str());
+    server.run();
+    g_server = nullptr;
+    return 0;
+}
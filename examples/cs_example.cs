@@ -18,6 +18,25 @@ public class Zrun
                                                ZrunShellType shellType, int timeoutMs,
                                                OutputCallback callback, IntPtr userData);
     
+    // 完成队列：在自己的线程或事件循环中批量取回异步结果
+    [DllImport("zrun.dll", CallingConvention = CallingConvention.Cdecl)]
+    private static extern IntPtr zrun_cq_create();
+
+    [DllImport("zrun.dll", CallingConvention = CallingConvention.Cdecl)]
+    private static extern void zrun_cq_destroy(IntPtr cq);
+
+    [DllImport("zrun.dll", CallingConvention = CallingConvention.Cdecl)]
+    private static extern int zrun_cq_next(IntPtr cq, [Out] ZrunCqEvent[] events,
+                                         int maxEvents, int timeoutMs);
+
+    [DllImport("zrun.dll", CallingConvention = CallingConvention.Cdecl)]
+    private static extern IntPtr zrun_cq_event_handle(IntPtr cq);
+
+    [DllImport("zrun.dll", CallingConvention = CallingConvention.Cdecl)]
+    private static extern int zrun_execute_async_cq(IntPtr instance, string command,
+                                                  ZrunShellType shellType, int timeoutMs,
+                                                  IntPtr cq, int flags, IntPtr userData);
+
     // 其他函数声明...
     
     private IntPtr instance;
@@ -61,4 +80,29 @@ public struct ZrunResult
     public string Error => Marshal.PtrToStringAnsi(error);
 }
 
+[StructLayout(LayoutKind.Sequential)]
+public struct ZrunCqEvent
+{
+    public int type;            // 0 = 完成, 1 = 输出块
+    public int asyncId;
+    public IntPtr userData;
+    public int isError;
+    public IntPtr data;
+    public long dataLength;
+    public int state;
+    public ZrunResultView result;
+}
+
+[StructLayout(LayoutKind.Sequential)]
+public struct ZrunResultView
+{
+    public int exitCode;
+    public IntPtr output;
+    public long outputLength;
+    public IntPtr error;
+    public long errorLength;
+    public long executionTime;
+    public int timedOut;
+}
+
 public delegate void OutputCallback(IntPtr output, int isError, IntPtr userData);
\ No newline at end of file
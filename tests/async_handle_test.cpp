@@ -0,0 +1,135 @@
+// 句柄方式提交的命令：whenAny 返回后不留下监听器、不登记到异步表、
+// 实例析构时仍被取消
+// 用法: async_handle_test
+
+#include "zrun.hpp"
+#include "zrun_core.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+size_t listenerCount(AsyncOperation& operation) {
+    std::lock_guard<std::mutex> lock(operation.mutex);
+    return operation.listeners.size();
+}
+
+// 反复以短超时轮询不会在命令上累积监听器
+void testWhenAnyPolling() {
+    auto first = std::make_shared<AsyncOperation>(1, "first", CommandOptions(), nullptr);
+    auto second = std::make_shared<AsyncOperation>(2, "second", CommandOptions(), nullptr);
+    std::vector<AsyncHandle> handles;
+    handles.emplace_back(first);
+    handles.emplace_back(second);
+    for (int i = 0; i < 10000; ++i) {
+        CHECK(whenAny(handles, 0) == -1);
+    }
+    CHECK(whenAny(handles, 5) == -1);
+    CHECK(listenerCount(*first) == 0);
+    CHECK(listenerCount(*second) == 0);
+
+    // then() 注册的监听器不受影响
+    bool called = false;
+    handles[1].then([&](AsyncState, const CommandResult&) { called = true; });
+    CHECK(whenAny(handles, 0) == -1);
+    CHECK(listenerCount(*second) == 1);
+    second->cancel();
+    CHECK(called);
+    CHECK(whenAny(handles, 0) == 1);
+    CHECK(listenerCount(*first) == 0);
+}
+
+void testWhenAnyCompletes() {
+    ZRun zrun;
+    CommandOptions options(ShellType::Sh, 30000);
+    std::vector<AsyncHandle> handles;
+    handles.push_back(zrun.submit("sleep 30", options));
+    handles.push_back(zrun.submit("exit 0", options));
+    int index = -1;
+    for (int i = 0; i < 5000 && index == -1; ++i) {
+        index = whenAny(handles, 1);
+    }
+    CHECK(index == 1);
+    CHECK(handles[1].state() == AsyncState::Completed);
+    CHECK(handles[0].cancel());
+}
+
+// 句柄命令不能按 id 查询或终止，只能通过句柄
+void testNotInTable() {
+    ZRun zrun;
+    AsyncHandle handle = zrun.submit("sleep 30", CommandOptions(ShellType::Sh, 30000));
+    CHECK(handle.state() == AsyncState::Running);
+    CHECK(!zrun.terminateAsync(handle.id()));
+    CHECK(handle.state() == AsyncState::Running);
+    CHECK(handle.cancel());
+    CHECK(handle.waitFor(5000));
+    CHECK(handle.state() == AsyncState::Cancelled);
+
+    // 多个线程同时提交，各分片的链表保持一致
+    std::vector<std::thread> threads;
+    std::vector<std::vector<AsyncHandle>> submitted(4);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&zrun, &submitted, t]() {
+            for (int i = 0; i < 50; ++i) {
+                submitted[t].push_back(zrun.submit("true", CommandOptions(ShellType::Sh, 30000)));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto& handles : submitted) {
+        CHECK(whenAll(handles, 30000));
+        for (auto& h : handles) {
+            CHECK(h.state() == AsyncState::Completed);
+        }
+    }
+}
+
+// 实例析构时仍在运行的句柄命令被取消
+void testCancelledOnDestruction() {
+    std::vector<AsyncHandle> handles;
+    auto start = std::chrono::steady_clock::now();
+    {
+        ZRun zrun;
+        for (int i = 0; i < 8; ++i) {
+            handles.push_back(zrun.submit("sleep 30", CommandOptions(ShellType::Sh, 60000)));
+        }
+        CommandOptions retry(ShellType::Sh, 60000);
+        retry.retry.maxAttempts = 5;
+        retry.retry.initialBackoffMs = 20000;
+        handles.push_back(zrun.submit("exit 1", retry));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    for (auto& handle : handles) {
+        CHECK(handle.waitFor(0));
+        CHECK(handle.state() == AsyncState::Cancelled);
+    }
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+}
+
+} // namespace
+
+int main() {
+    testWhenAnyPolling();
+    testWhenAnyCompletes();
+    testNotInTable();
+    testCancelledOnDestruction();
+    std::printf("async_handle_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+// ChildReaper 测试：宿主忽略 SIGCHLD 时不接管，登记的子进程得到退出状态，
+// 未登记的子进程留给宿主回收，宿主原有的处理函数仍被调用
+// 用法: child_reaper_test
+
+#include "zrun_reaper.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+std::atomic<int> g_hostSignals{0};
+
+void hostHandler(int) {
+    ++g_hostSignals;
+}
+
+pid_t spawnExit(int code, int delayMs = 0) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (delayMs > 0) {
+            usleep(delayMs * 1000);
+        }
+        _exit(code);
+    }
+    CHECK(pid > 0);
+    return pid;
+}
+
+bool processExists(pid_t pid) {
+    struct stat info;
+    return stat(("/proc/" + std::to_string(pid)).c_str(), &info) == 0;
+}
+
+// 宿主设置 SIG_IGN：回收器不启动，内核仍自动回收宿主的子进程
+void testIgnoredByHost() {
+    struct sigaction ignore;
+    std::memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    CHECK(sigaction(SIGCHLD, &ignore, nullptr) == 0);
+
+    pid_t watched = spawnExit(0, 50);
+    CHECK(!ChildReaper::instance().watch(watched, [](int) {}));
+    struct sigaction current;
+    CHECK(sigaction(SIGCHLD, nullptr, &current) == 0);
+    CHECK(!(current.sa_flags & SA_SIGINFO) && current.sa_handler == SIG_IGN);
+
+    pid_t own = spawnExit(0);
+    bool reaped = false;
+    for (int i = 0; i < 300 && !reaped; ++i) {
+        reaped = !processExists(own) && !processExists(watched);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(reaped);
+}
+
+// 恢复为宿主自己的处理函数后可以启动，并继续调用宿主的处理函数
+void testWatch() {
+    struct sigaction host;
+    std::memset(&host, 0, sizeof(host));
+    host.sa_handler = hostHandler;
+    sigemptyset(&host.sa_mask);
+    CHECK(sigaction(SIGCHLD, &host, nullptr) == 0);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int status = -2;
+    pid_t watched = spawnExit(7, 100);
+    CHECK(ChildReaper::instance().watch(watched, [&](int value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        status = value;
+        cv.notify_all();
+    }));
+
+    // 未登记的子进程不被回收
+    pid_t own = spawnExit(3, 20);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        CHECK(cv.wait_for(lock, std::chrono::seconds(5), [&]() { return status != -2; }));
+    }
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 7);
+
+    int ownStatus = 0;
+    CHECK(waitpid(own, &ownStatus, 0) == own);
+    CHECK(WIFEXITED(ownStatus) && WEXITSTATUS(ownStatus) == 3);
+    CHECK(g_hostSignals > 0);
+
+    // 登记之前就已退出的子进程
+    pid_t early = spawnExit(5);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    int earlyStatus = -2;
+    CHECK(ChildReaper::instance().watch(early, [&](int value) { earlyStatus = value; }));
+    CHECK(WIFEXITED(earlyStatus) && WEXITSTATUS(earlyStatus) == 5);
+}
+
+} // namespace
+
+int main() {
+    testIgnoredByHost();
+    testWatch();
+    std::printf("child_reaper_test: ok\n");
+    return 0;
+}
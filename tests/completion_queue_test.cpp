@@ -0,0 +1,147 @@
+// C 接口完成队列测试：完成事件和输出块、fd 的可读状态、终止命令、
+// 销毁队列时仍在运行的命令
+// 用法: completion_queue_test
+
+#include "zrun.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <poll.h>
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+bool readable(int fd, int timeoutMs) {
+    pollfd entry = {fd, POLLIN, 0};
+    return poll(&entry, 1, timeoutMs) == 1 && (entry.revents & POLLIN);
+}
+
+// 每条命令的 user_data 指向一个 Record
+struct Record {
+    std::string output;
+    std::string streamed;
+    int completions = 0;
+    zrun_async_state state = ZRUN_ASYNC_RUNNING;
+    int exitCode = -2;
+};
+
+// 用 poll 等待 fd，直到 count 条命令结束
+void drain(void* cq, int count) {
+    zrun_cq_event events[4];
+    int completed = 0;
+    while (completed < count) {
+        CHECK(readable(zrun_cq_fd(cq), 10000));
+        int n = zrun_cq_next(cq, events, 4, 0);
+        CHECK(n > 0 && n <= 4);
+        for (int i = 0; i < n; ++i) {
+            Record* record = static_cast<Record*>(events[i].user_data);
+            if (events[i].type == ZRUN_CQ_OUTPUT) {
+                CHECK(record->completions == 0);
+                record->streamed.append(events[i].data,
+                                        static_cast<size_t>(events[i].data_length));
+            } else {
+                ++record->completions;
+                ++completed;
+                record->state = events[i].state;
+                record->exitCode = events[i].result.exit_code;
+                record->output.assign(events[i].result.output,
+                                      static_cast<size_t>(events[i].result.output_length));
+            }
+        }
+    }
+    // 取空之后 fd 不再可读
+    CHECK(zrun_cq_next(cq, events, 4, 0) == 0);
+    CHECK(!readable(zrun_cq_fd(cq), 0));
+}
+
+void testCompletions() {
+    void* zrun = zrun_create();
+    void* cq = zrun_cq_create();
+    CHECK(zrun && cq);
+    CHECK(zrun_cq_fd(cq) >= 0);
+    CHECK(!readable(zrun_cq_fd(cq), 0));
+
+    std::map<int, Record> records;
+    for (int i = 0; i < 20; ++i) {
+        std::string command = "echo out" + std::to_string(i) + "; exit " + std::to_string(i % 3);
+        int id = zrun_execute_async_cq(zrun, command.c_str(), ZRUN_SHELL_SH, 10000, cq, 0,
+                                       &records[i]);
+        CHECK(id > 0);
+    }
+    drain(cq, 20);
+    for (auto& pair : records) {
+        const Record& record = pair.second;
+        CHECK(record.completions == 1);
+        CHECK(record.state == ZRUN_ASYNC_COMPLETED || record.state == ZRUN_ASYNC_FAILED);
+        CHECK(record.exitCode == pair.first % 3);
+        CHECK(record.output == "out" + std::to_string(pair.first) + "\n");
+        CHECK(record.streamed.empty());
+    }
+
+    // 输出块在完成事件之前投递
+    Record streamed;
+    const char* lines = "echo line1; sleep 0.05; echo line2; sleep 0.05; echo line3";
+    CHECK(zrun_execute_async_cq(zrun, lines, ZRUN_SHELL_SH, 10000, cq, ZRUN_CQ_STREAM_OUTPUT,
+                                &streamed) > 0);
+    drain(cq, 1);
+    CHECK(streamed.streamed == "line1\nline2\nline3\n");
+    CHECK(streamed.exitCode == 0);
+
+    Record terminal;
+    CHECK(zrun_execute_async_cq(zrun, "test -t 1 && echo tty; echo err >&2", ZRUN_SHELL_SH,
+                                10000, cq, ZRUN_CQ_TERMINAL, &terminal) > 0);
+    drain(cq, 1);
+    CHECK(terminal.output.find("tty") != std::string::npos);
+    CHECK(terminal.output.find("err") != std::string::npos);
+
+    // 终止的命令同样投递完成事件
+    Record cancelled;
+    int id = zrun_execute_async_cq(zrun, "sleep 30", ZRUN_SHELL_SH, 60000, cq, 0, &cancelled);
+    CHECK(id > 0);
+    CHECK(zrun_terminate_async(zrun, id) == 1);
+    drain(cq, 1);
+    CHECK(cancelled.state == ZRUN_ASYNC_CANCELLED);
+
+    CHECK(zrun_execute_async_cq(zrun, "true", ZRUN_SHELL_SH, 1000, nullptr, 0, nullptr) == -1);
+    zrun_cq_event event;
+    CHECK(zrun_cq_next(nullptr, &event, 1, 0) == -1);
+    CHECK(zrun_cq_next(cq, &event, 0, 0) == -1);
+
+    zrun_cq_destroy(cq);
+    zrun_destroy(zrun);
+}
+
+// 先销毁队列，命令之后结束时事件被丢弃
+void testDestroyQueueFirst() {
+    void* zrun = zrun_create();
+    void* cq = zrun_cq_create();
+    for (int i = 0; i < 4; ++i) {
+        CHECK(zrun_execute_async_cq(zrun, "sleep 0.2; echo done", ZRUN_SHELL_SH, 10000, cq,
+                                    ZRUN_CQ_STREAM_OUTPUT, nullptr) > 0);
+    }
+    zrun_cq_destroy(cq);
+    zrun_command_result result = zrun_execute_sync(zrun, "sleep 0.5", ZRUN_SHELL_SH, 10000);
+    CHECK(result.exit_code == 0);
+    zrun_free_result(result);
+    zrun_destroy(zrun);
+}
+
+} // namespace
+
+int main() {
+    testCompletions();
+    testDestroyQueueFirst();
+    std::printf("completion_queue_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,209 @@
+// zrund 客户端模式的测试：大量输出完整送达、不读取结果的客户端不阻塞其他客户端、
+// 客户端拒绝其他用户的守护进程
+// 用法: daemon_test
+
+#include "zrun.hpp"
+#include "zrun_core.h"
+#include "zrun_daemon.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+#ifndef _WIN32
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 在子进程中运行守护进程（在创建任何线程之前调用）。uid 不为 -1 时先切换用户
+pid_t startDaemon(const std::string& path, int uid = -1) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGPIPE, SIG_IGN);
+        if (uid != -1 && setuid(static_cast<uid_t>(uid)) != 0) {
+            _exit(2);
+        }
+        CoreImpl core;
+        DaemonServer server(core);
+        std::string error;
+        if (!server.listen(path, error)) {
+            std::fprintf(stderr, "listen: %s\n", error.c_str());
+            _exit(3);
+        }
+        server.run();
+        _exit(0);
+    }
+    for (int i = 0; i < 500 && access(path.c_str(), F_OK) != 0; ++i) {
+        usleep(10000);
+    }
+    return pid;
+}
+
+void stopDaemon(pid_t pid) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(std::string& out, const std::string& value) {
+    put(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+// 按协议手工编码的 Execute 帧，不传 fd，输出由守护进程放在 Result 帧中
+std::string executeFrame(uint32_t requestId, const std::string& command) {
+    std::string payload;
+    put(payload, requestId);
+    put(payload, static_cast<uint8_t>(ShellType::Sh));
+    put(payload, static_cast<int32_t>(30000));
+    put(payload, static_cast<uint8_t>(CommandPriority::Normal));
+    put(payload, static_cast<int32_t>(-1));
+    put(payload, static_cast<uint8_t>(0));
+    put(payload, static_cast<uint16_t>(80));
+    put(payload, static_cast<uint16_t>(24));
+    putString(payload, command);
+    putString(payload, "/");
+    putString(payload, "");
+    put(payload, static_cast<uint32_t>(0));
+
+    std::string frame;
+    put(frame, static_cast<uint32_t>(payload.size()));
+    put(frame, static_cast<uint8_t>(1));
+    return frame + payload;
+}
+
+void largeOutput(const std::string& path) {
+    ZRun zrun;
+    std::string error;
+    CHECK(zrun.connectDaemon(path, &error));
+
+    // 分块回调较慢时守护进程要等待客户端的管道，而不是丢弃输出
+    const long long size = 8 * 1024 * 1024;
+    std::atomic<bool> done{false};
+    std::atomic<long long> chunked{0};
+    AsyncState state = AsyncState::Running;
+    size_t captured = 0;
+    zrun.executeAsync("head -c " + std::to_string(size) + " /dev/zero",
+                      CommandOptions(ShellType::Sh, 60000),
+                      [&](std::string_view data, bool) {
+                          chunked += static_cast<long long>(data.size());
+                          std::this_thread::sleep_for(std::chrono::microseconds(200));
+                      },
+                      [&](AsyncState finalState, CommandResult& result) {
+                          state = finalState;
+                          captured = result.output.size();
+                          done = true;
+                      });
+    while (!done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::printf("slow consumer: state=%d captured=%zu chunked=%lld\n", static_cast<int>(state),
+                captured, chunked.load());
+    CHECK(state == AsyncState::Completed);
+    CHECK(static_cast<long long>(captured) == size);
+    CHECK(chunked.load() == size);
+
+    CommandResult result = zrun.executeSync("head -c 50000000 /dev/zero",
+                                            CommandOptions(ShellType::Sh, 60000));
+    std::printf("sync: exit=%d captured=%zu\n", result.exitCode, result.output.size());
+    CHECK(result.exitCode == 0 && result.output.size() == 50000000);
+}
+
+void stalledClient(const std::string& path) {
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK(fd != -1);
+    CHECK(connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0);
+
+    // 这个客户端从不读取，结果很快填满套接字缓冲区
+    std::string frames;
+    for (uint32_t id = 1; id <= 8; ++id) {
+        frames += executeFrame(id, "head -c 4000000 /dev/zero");
+    }
+    CHECK(send(fd, frames.data(), frames.size(), MSG_NOSIGNAL) ==
+          static_cast<ssize_t>(frames.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    ZRun zrun;
+    std::string error;
+    CHECK(zrun.connectDaemon(path, &error));
+    auto start = Clock::now();
+    for (int i = 0; i < 5; ++i) {
+        CommandResult result = zrun.executeSync("echo hi", CommandOptions(ShellType::Sh, 10000));
+        CHECK(result.output == "hi\n");
+    }
+    double elapsed = secondsSince(start);
+    std::printf("other client with a stalled peer: %.3fs\n", elapsed);
+    CHECK(elapsed < 2);
+    close(fd);
+}
+
+void foreignDaemon() {
+    if (getuid() != 0) {
+        std::printf("foreign daemon: skipped (needs root)\n");
+        return;
+    }
+    // 其他用户的守护进程监听在可以被当前用户连接的路径上
+    const std::string path = "/tmp/zrund-test-foreign.sock";
+    unlink(path.c_str());
+    pid_t pid = startDaemon(path, 65534);
+    ZRun zrun;
+    std::string error;
+    bool connected = zrun.connectDaemon(path, &error);
+    std::printf("foreign daemon: connected=%d (%s)\n", connected ? 1 : 0, error.c_str());
+    stopDaemon(pid);
+    unlink(path.c_str());
+    CHECK(!connected);
+}
+
+} // namespace
+#endif
+
+int main() {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+    const std::string path = "/tmp/zrund-test-" + std::to_string(getpid()) + ".sock";
+    pid_t pid = startDaemon(path);
+    largeOutput(path);
+    stalledClient(path);
+    stopDaemon(pid);
+    unlink(path.c_str());
+    foreignDaemon();
+#endif
+    std::printf("OK\n");
+    return 0;
+}
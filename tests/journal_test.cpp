@@ -0,0 +1,255 @@
+// 执行日志测试：重新打开后恢复已结束和仍在运行的命令、校验和不符的记录及其之后的数据被丢弃、
+// 写到一半的尾部记录、不是日志文件或已被锁定时的处理
+// 用法: journal_test
+
+#include "zrun.hpp"
+#include "zrun_journal.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+const std::string kPath = "/tmp/zrun_journal_test." + std::to_string(getpid());
+// 与 zrun_journal.cpp 中的文件格式一致：8 字节魔数，u64 used，
+// 然后是记录（u32 总长度, u8 类型, 内容, u32 校验和）
+const size_t kHeaderSize = 16;
+
+JournalConfig config() {
+    JournalConfig result;
+    result.path = kPath;
+    result.syncIntervalMs = 0;
+    return result;
+}
+
+std::vector<Journal::Recovered> reopen(Journal& journal, const JournalConfig& settings = config()) {
+    std::vector<Journal::Recovered> recovered;
+    std::string error;
+    CHECK(journal.open(settings, recovered, error));
+    CHECK(error.empty());
+    return recovered;
+}
+
+CommandResult makeResult(int exitCode, const std::string& output) {
+    CommandResult result;
+    result.exitCode = exitCode;
+    result.output = output;
+    result.error = "err";
+    result.executionTime = 42;
+    result.attempts = 2;
+    result.timedOut = exitCode == 124;
+    return result;
+}
+
+void complete(Journal& journal, int id, const std::string& output) {
+    journal.recordSubmit(id, "cmd" + std::to_string(id));
+    journal.recordComplete(id, AsyncState::Completed, makeResult(0, output));
+}
+
+std::string readFile() {
+    std::ifstream file(kPath, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& data) {
+    std::ofstream(kPath, std::ios::binary | std::ios::trunc) << data;
+}
+
+uint64_t usedOf(const std::string& file) {
+    uint64_t used = 0;
+    std::memcpy(&used, file.data() + 8, sizeof(used));
+    return used;
+}
+
+std::vector<size_t> recordOffsets(const std::string& file) {
+    std::vector<size_t> offsets;
+    size_t offset = kHeaderSize;
+    while (offset < usedOf(file)) {
+        offsets.push_back(offset);
+        uint32_t size = 0;
+        std::memcpy(&size, file.data() + offset, sizeof(size));
+        CHECK(size > 0);
+        offset += size;
+    }
+    CHECK(offset == usedOf(file));
+    return offsets;
+}
+
+void testRecovery() {
+    std::remove(kPath.c_str());
+    pid_t exited = fork();
+    if (exited == 0) {
+        _exit(0);
+    }
+    CHECK(waitpid(exited, nullptr, 0) == exited);
+    {
+        Journal journal;
+        JournalConfig settings = config();
+        settings.maxOutputBytes = 8;
+        CHECK(reopen(journal, settings).empty());
+        journal.recordSubmit(1, "echo finished");
+        journal.recordStart(1, exited);
+        journal.recordComplete(1, AsyncState::Failed, makeResult(124, "0123456789abcdef"));
+        journal.recordSubmit(2, "sleep running");
+        journal.recordStart(2, getpid());
+        journal.recordStart(2, exited);
+        complete(journal, 3, "taken");
+        journal.recordForget(3);
+        // 没有提交记录的 id 不被记录
+        journal.recordStart(4, getpid());
+        journal.recordComplete(4, AsyncState::Completed, makeResult(0, "x"));
+    }
+
+    Journal journal;
+    std::vector<Journal::Recovered> recovered = reopen(journal);
+    CHECK(recovered.size() == 2);
+    const Journal::Recovered& finished = recovered[0];
+    CHECK(finished.id == 1 && finished.command == "echo finished");
+    CHECK(finished.finished && finished.state == AsyncState::Failed);
+    CHECK(finished.processes.empty());
+    CHECK(finished.result.exitCode == 124 && finished.result.timedOut);
+    CHECK(finished.result.output == "01234567");
+    CHECK(finished.result.error == "err");
+    CHECK(finished.result.executionTime == 42 && finished.result.attempts == 2);
+
+    const Journal::Recovered& running = recovered[1];
+    CHECK(running.id == 2 && !running.finished);
+    CHECK(running.processes.size() == 2);
+    CHECK(running.processes[0].pid == getpid());
+    CHECK(running.processes[0].startTime == Journal::startTimeOf(getpid()));
+    CHECK(Journal::alive(running.processes[0]));
+    CHECK(!Journal::alive(running.processes[1]));
+    // pid 相同但启动时间不同：已被复用
+    Journal::Process reused = running.processes[0];
+    reused.startTime += 1;
+    CHECK(!Journal::alive(reused));
+}
+
+// 写入损坏的文件，重新打开后只恢复损坏之前的记录，之后追加的记录仍能读回
+void checkDamaged(const std::string& damaged, size_t keptCommands, bool keptFinished) {
+    writeFile(damaged);
+    {
+        Journal journal;
+        std::vector<Journal::Recovered> recovered = reopen(journal);
+        CHECK(recovered.size() == keptCommands);
+        for (size_t i = 0; i < recovered.size(); ++i) {
+            CHECK(recovered[i].id == static_cast<int>(i) + 1);
+            bool last = i + 1 == recovered.size();
+            CHECK(recovered[i].finished == (!last || keptFinished));
+        }
+        complete(journal, 10, "appended");
+    }
+    Journal journal;
+    std::vector<Journal::Recovered> recovered = reopen(journal);
+    CHECK(recovered.size() == keptCommands + 1);
+    CHECK(recovered.back().id == 10 && recovered.back().result.output == "appended");
+    recordOffsets(readFile());
+}
+
+void testChecksum() {
+    std::remove(kPath.c_str());
+    {
+        Journal journal;
+        reopen(journal);
+        for (int id = 1; id <= 3; ++id) {
+            complete(journal, id, "output" + std::to_string(id));
+        }
+    }
+    const std::string original = readFile();
+    std::vector<size_t> offsets = recordOffsets(original);
+    CHECK(offsets.size() == 6);
+
+    // 命令 2 的 Complete 记录中的一个字节被改动：它和之后的记录都被丢弃
+    std::string flipped = original;
+    flipped[offsets[3] + 12] ^= 0x20;
+    checkDamaged(flipped, 2, false);
+
+    // 校验和本身被改动
+    std::string badSum = original;
+    badSum[offsets[2] - 1] ^= 0x01;
+    checkDamaged(badSum, 1, false);
+
+    // used 已包含最后一条记录，但记录的内容还没有落盘
+    std::string zeroed = original;
+    std::memset(&zeroed[offsets[5]], 0, usedOf(original) - offsets[5]);
+    checkDamaged(zeroed, 3, false);
+
+    // 长度字段越过 used
+    std::string oversized = original;
+    uint32_t huge = 1u << 30;
+    std::memcpy(&oversized[offsets[4]], &huge, sizeof(huge));
+    checkDamaged(oversized, 2, true);
+}
+
+void testUnusableFile() {
+    std::remove(kPath.c_str());
+    Journal owner;
+    reopen(owner);
+    Journal other;
+    std::vector<Journal::Recovered> recovered;
+    std::string error;
+    CHECK(!other.open(config(), recovered, error));
+    CHECK(!error.empty() && !other.isOpen());
+    owner.close();
+
+    writeFile(std::string(4096, 'x'));
+    error.clear();
+    CHECK(!other.open(config(), recovered, error));
+    CHECK(!error.empty());
+    CHECK(readFile() == std::string(4096, 'x'));
+    std::remove(kPath.c_str());
+}
+
+// 上一个实例结束的命令在新的实例中按 id 取得结果
+void testEndToEnd() {
+    std::remove(kPath.c_str());
+    int id;
+    {
+        ZRun zrun;
+        CHECK(zrun.enableJournal(config()));
+        id = zrun.executeAsync("echo journaled; exit 3", ShellType::Sh, 10000);
+        CHECK(id > 0);
+        for (int i = 0; i < 500 && zrun.getAsyncStatus(id) == AsyncState::Running; ++i) {
+            usleep(10 * 1000);
+        }
+        CHECK(zrun.getAsyncStatus(id) != AsyncState::Running);
+    }
+    ZRun zrun;
+    std::string error;
+    CHECK(zrun.enableJournal(config(), &error));
+    CHECK(zrun.getAsyncStatus(id) != AsyncState::Running);
+    CommandResult result = zrun.getAsyncResult(id);
+    CHECK(result.exitCode == 3);
+    CHECK(result.output == "journaled\n");
+    std::remove(kPath.c_str());
+}
+
+} // namespace
+
+int main() {
+    testRecovery();
+    testChecksum();
+    testUnusableFile();
+    testEndToEnd();
+    std::remove(kPath.c_str());
+    std::printf("journal_test: ok\n");
+    return 0;
+}
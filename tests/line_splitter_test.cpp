@@ -0,0 +1,192 @@
+// 分行测试：findNewline 在向量宽度边界上的结果、跨 feed() 调用的行、最大行长度
+// 用法: line_splitter_test [随机种子]
+
+#include "zrun.hpp"
+#include "zrun_lines.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+// 参考实现：按 '\n' 分行，每行再按 maxLength 拆分
+std::vector<std::string> referenceLines(const std::string& data, size_t maxLength) {
+    std::vector<std::string> lines;
+    auto split = [&](const std::string& line) {
+        if (line.empty() || maxLength == 0) {
+            lines.push_back(line);
+            return;
+        }
+        for (size_t offset = 0; offset < line.size(); offset += maxLength) {
+            lines.push_back(line.substr(offset, maxLength));
+        }
+    };
+    size_t begin = 0;
+    while (true) {
+        size_t newline = data.find('\n', begin);
+        if (newline == std::string::npos) {
+            break;
+        }
+        split(data.substr(begin, newline - begin));
+        begin = newline + 1;
+    }
+    if (begin < data.size()) {
+        split(data.substr(begin));
+    }
+    return lines;
+}
+
+std::vector<std::string> splitInChunks(const std::string& data, const std::vector<size_t>& cuts,
+                                       size_t maxLength) {
+    LineSplitter splitter(maxLength);
+    std::vector<std::string> lines;
+    auto onLine = [&](std::string_view line) { lines.emplace_back(line); };
+    size_t begin = 0;
+    for (size_t cut : cuts) {
+        splitter.feed(std::string_view(data).substr(begin, cut - begin), onLine);
+        CHECK(maxLength == 0 || splitter.partial().size() <= maxLength);
+        begin = cut;
+    }
+    splitter.feed(std::string_view(data).substr(begin), onLine);
+    splitter.finish(onLine);
+    return lines;
+}
+
+// 每个偏移和对齐上的 '\n'，覆盖 16/32 字节向量的边界和剩余部分
+void testFindNewline() {
+    std::vector<char> buffer(256 + 64, 'x');
+    for (size_t align = 0; align < 32; ++align) {
+        for (size_t length = 0; length <= 200; ++length) {
+            char* begin = buffer.data() + align;
+            std::memset(buffer.data(), 'x', buffer.size());
+            CHECK(findNewline(begin, begin + length) == begin + length);
+            for (size_t offset : {size_t(0), size_t(1), size_t(15), size_t(16), size_t(17),
+                                  size_t(31), size_t(32), size_t(33), size_t(63), size_t(64),
+                                  length / 2, length ? length - 1 : 0}) {
+                if (offset >= length) {
+                    continue;
+                }
+                std::memset(buffer.data(), 'x', buffer.size());
+                begin[offset] = '\n';
+                // 第二个换行符不影响结果
+                if (offset + 1 < length) {
+                    begin[length - 1] = '\n';
+                }
+                CHECK(findNewline(begin, begin + length) == begin + offset);
+            }
+            // 范围之外的换行符不被读到
+            std::memset(buffer.data(), 'x', buffer.size());
+            begin[length] = '\n';
+            CHECK(findNewline(begin, begin + length) == begin + length);
+        }
+    }
+}
+
+void testBoundaries() {
+    for (size_t offset : {15, 16, 31, 32}) {
+        std::string data(offset, 'a');
+        data += '\n';
+        data += std::string(offset, 'b');
+        data += '\n';
+        data += "tail";
+        // 在每个位置把数据拆成两次 feed
+        for (size_t cut = 0; cut <= data.size(); ++cut) {
+            auto lines = splitInChunks(data, {cut}, 0);
+            CHECK(lines == referenceLines(data, 0));
+            CHECK(lines.size() == 3 && lines[0].size() == offset && lines[2] == "tail");
+        }
+    }
+}
+
+void testRandom(unsigned seed) {
+    std::mt19937 random(seed);
+    for (int round = 0; round < 2000; ++round) {
+        size_t size = random() % 400;
+        std::string data(size, 'x');
+        for (auto& c : data) {
+            c = random() % 8 == 0 ? '\n' : static_cast<char>('a' + random() % 26);
+        }
+        std::vector<size_t> cuts;
+        size_t position = 0;
+        while (position < size) {
+            position += 1 + random() % 40;
+            if (position < size) {
+                cuts.push_back(position);
+            }
+        }
+        size_t maxLength = random() % 3 == 0 ? 0 : 1 + random() % 40;
+        CHECK(splitInChunks(data, cuts, maxLength) == referenceLines(data, maxLength));
+    }
+}
+
+// 没有换行符的大量输出：暂存的数据不超过上限
+void testUnbounded() {
+    const size_t maxLength = 1 << 20;
+    LineSplitter splitter(maxLength);
+    std::string chunk(64 * 1024, 'a');
+    size_t lines = 0;
+    size_t bytes = 0;
+    for (int i = 0; i < 1024; ++i) {
+        splitter.feed(chunk, [&](std::string_view line) {
+            CHECK(line.size() == maxLength);
+            ++lines;
+            bytes += line.size();
+        });
+        CHECK(splitter.partial().size() <= maxLength);
+    }
+    // 恰好达到上限的最后一段在结束时交出
+    splitter.finish([&](std::string_view line) {
+        ++lines;
+        bytes += line.size();
+    });
+    CHECK(lines == 64);
+    CHECK(bytes == 64u << 20);
+}
+
+#ifndef _WIN32
+void testLineCallback() {
+    ZRun zrun;
+    CommandOptions options(ShellType::Sh, 30000);
+    options.maxLineLength = 4096;
+    std::vector<size_t> lengths;
+    options.lineCallback = [&](std::string_view line, bool) { lengths.push_back(line.size()); };
+    CommandResult result = zrun.executeSync(
+        "head -c 1000000 /dev/zero | tr '\\0' a; echo; echo end", options);
+    CHECK(result.exitCode == 0);
+    CHECK(lengths.size() == 246);
+    for (size_t i = 0; i < 244; ++i) {
+        CHECK(lengths[i] == 4096);
+    }
+    CHECK(lengths[244] == 1000000 - 244 * 4096);
+    CHECK(lengths[245] == 3);
+}
+#endif
+
+} // namespace
+
+int main(int argc, char** argv) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 1;
+    testFindNewline();
+    testBoundaries();
+    testRandom(seed);
+    testUnbounded();
+#ifndef _WIN32
+    testLineCallback();
+#endif
+    std::printf("line_splitter_test: ok\n");
+    return 0;
+}
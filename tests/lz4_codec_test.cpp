@@ -0,0 +1,200 @@
+// LZ4 块压缩测试：各种数据的往返、标准格式的块、损坏的输入、分块保存的文本
+// 用法: lz4_codec_test [随机种子]
+
+#include "zrun.hpp"
+#include "zrun_compress.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+std::string compress(const std::string& data) {
+    std::string out;
+    lz4Compress(data.data(), data.size(), out);
+    return out;
+}
+
+bool decompress(const std::string& block, size_t size, std::string& out) {
+    out.assign(size, '\0');
+    return lz4Decompress(block.data(), block.size(), &out[0], out.size());
+}
+
+void checkRoundTrip(const std::string& data) {
+    std::string block = compress(data);
+    std::string restored;
+    CHECK(decompress(block, data.size(), restored));
+    CHECK(restored == data);
+    // 长度不符时失败
+    if (!data.empty()) {
+        CHECK(!decompress(block, data.size() - 1, restored));
+    }
+    CHECK(!decompress(block, data.size() + 1, restored));
+}
+
+std::string randomText(std::mt19937& random, size_t size, int alphabet) {
+    std::string data(size, '\0');
+    for (auto& c : data) {
+        c = static_cast<char>('a' + random() % alphabet);
+    }
+    return data;
+}
+
+void testRoundTrip(unsigned seed) {
+    std::mt19937 random(seed);
+    for (size_t size : {0, 1, 4, 5, 12, 13, 16, 64, 255, 256, 4096, 70000, 300000}) {
+        checkRoundTrip(std::string(size, 'a'));
+        checkRoundTrip(std::string(size, '\0'));
+        checkRoundTrip(randomText(random, size, 256));
+        checkRoundTrip(randomText(random, size, 4));
+        std::string pattern;
+        while (pattern.size() < size) {
+            pattern += "ab";
+        }
+        checkRoundTrip(pattern.substr(0, size));
+    }
+    // 重复距离超过 64 KB 的数据
+    std::string chunk = randomText(random, 80000, 256);
+    checkRoundTrip(chunk + chunk);
+    // 重复的日志行
+    std::string log;
+    for (int i = 0; i < 5000; ++i) {
+        log += "[info] request " + std::to_string(i % 97) + " completed in " +
+               std::to_string(i % 13) + " ms\n";
+    }
+    checkRoundTrip(log);
+    CHECK(compress(log).size() < log.size() / 4);
+    for (int round = 0; round < 300; ++round) {
+        checkRoundTrip(randomText(random, random() % 3000, 1 + random() % 6));
+    }
+}
+
+// 按格式手工构造的块：字面量 'a'，偏移 1 长度 14 的重叠匹配，最后 5 个字面量
+void testStandardBlock() {
+    const std::string block = std::string("\x1a" "a" "\x01\x00", 4) + "\x50" "aaaaa";
+    std::string out;
+    CHECK(decompress(block, 20, out));
+    CHECK(out == std::string(20, 'a'));
+
+    // 字面量长度 15 + 额外字节
+    std::string literals(300, 'x');
+    std::string longLiterals = "\xf0";
+    longLiterals += static_cast<char>(255);
+    longLiterals += static_cast<char>(300 - 15 - 255);
+    longLiterals += literals;
+    CHECK(decompress(longLiterals, 300, out));
+    CHECK(out == literals);
+}
+
+void testCorrupt(unsigned seed) {
+    std::string out;
+    // 偏移为 0、偏移超出已解压的数据、截断的块
+    CHECK(!decompress(std::string("\x1a" "a" "\x00\x00" "\x50" "aaaaa", 10), 20, out));
+    CHECK(!decompress(std::string("\x1a" "a" "\x02\x00" "\x50" "aaaaa", 10), 20, out));
+    CHECK(!decompress(std::string("\x1a" "a" "\x01", 3), 20, out));
+    CHECK(!decompress(std::string("\xf0", 1), 300, out));
+    CHECK(!decompress(std::string(), 1, out));
+
+    // 随机修改的块：可以失败，但不能越界读写
+    std::mt19937 random(seed);
+    std::string data;
+    for (int i = 0; i < 400; ++i) {
+        data += "line " + std::to_string(i % 23) + "\n";
+    }
+    std::string block = compress(data);
+    for (int round = 0; round < 2000; ++round) {
+        std::string damaged = block;
+        for (int i = 0; i < 3; ++i) {
+            damaged[random() % damaged.size()] = static_cast<char>(random());
+        }
+        if (random() % 4 == 0) {
+            damaged.resize(random() % damaged.size());
+        }
+        decompress(damaged, data.size(), out);
+    }
+}
+
+void testCompressedText(unsigned seed) {
+    std::mt19937 random(seed);
+    std::string expected;
+    CompressedText text;
+    while (expected.size() < 5 * CompressedText::kBlockSize) {
+        std::string piece = random() % 5 == 0 ? randomText(random, random() % 20000, 256) :
+                                                randomText(random, random() % 20000, 3);
+        text.append(piece);
+        expected += piece;
+    }
+    // 尚未压缩的部分也可以读取
+    std::string restored;
+    CHECK(text.decompressTo(restored));
+    CHECK(restored == expected);
+    text.finish();
+    CHECK(text.size() == expected.size());
+    CHECK(text.compressedSize() < expected.size());
+
+    restored.clear();
+    size_t chunks = 0;
+    CHECK(text.forEachChunk([&](std::string_view data) {
+        CHECK(data.size() <= CompressedText::kBlockSize);
+        restored.append(data.data(), data.size());
+        ++chunks;
+    }));
+    CHECK(restored == expected);
+    const size_t blockSize = CompressedText::kBlockSize;
+    CHECK(chunks == (expected.size() + blockSize - 1) / blockSize);
+
+    // 无法压缩的数据原样保存，压缩后不变大
+    std::string noise = randomText(random, 3 * CompressedText::kBlockSize, 256);
+    std::string copy = noise;
+    auto stored = compressText(copy);
+    CHECK(copy.empty());
+    CHECK(stored->compressedSize() == noise.size());
+    restored.clear();
+    CHECK(stored->decompressTo(restored));
+    CHECK(restored == noise);
+}
+
+#ifndef _WIN32
+void testCapture() {
+    ZRun zrun;
+    CommandOptions options(ShellType::Sh, 30000);
+    options.compressOutput = true;
+    CommandResult result = zrun.executeSync("yes 'compressed line' | head -n 100000; echo e >&2",
+                                            options);
+    CHECK(result.exitCode == 0);
+    CHECK(result.compressedOutput && result.output.empty());
+    CHECK(result.compressedOutput->size() == 100000 * 16);
+    CHECK(result.compressedOutput->compressedSize() < 100000);
+    result.inflate();
+    CHECK(result.output.size() == 100000 * 16);
+    CHECK(result.output.compare(0, 32, "compressed line\ncompressed line\n") == 0);
+    CHECK(result.error == "e\n");
+}
+#endif
+
+} // namespace
+
+int main(int argc, char** argv) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 1;
+    testRoundTrip(seed);
+    testStandardBlock();
+    testCorrupt(seed);
+    testCompressedText(seed);
+#ifndef _WIN32
+    testCapture();
+#endif
+    std::printf("lz4_codec_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,108 @@
+// 输出过滤测试：正则表达式在超长行上不会耗尽栈，过滤语义（锚点、反向匹配、行数上限）不变
+// 用法: output_filter_test
+
+#include "zrun.hpp"
+#include "zrun_filter.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+std::string filtered(const OutputFilter& filter, std::string data, long long* matches = nullptr,
+                     size_t maxLineLength = LineSplitter::kDefaultMaxLineLength) {
+    long long count = applyFilter(filter, data, maxLineLength);
+    if (matches) {
+        *matches = count;
+    }
+    return data;
+}
+
+void testSemantics() {
+    const std::string text = "alpha 1\nbeta 22\ngamma 333\nalphabet\n";
+    CHECK(filtered(OutputFilter::regex("^alpha"), text) == "alpha 1\nalphabet\n");
+    CHECK(filtered(OutputFilter::regex("\\balpha\\b"), text) == "alpha 1\n");
+    CHECK(filtered(OutputFilter::regex("[0-9]{2}$"), text) == "beta 22\ngamma 333\n");
+    CHECK(filtered(OutputFilter::regex("a$|^g"), text) == "gamma 333\n");
+    CHECK(filtered(OutputFilter::regex("1|bet", true), text) == "gamma 333\n");
+    CHECK(filtered(OutputFilter::regex("(a)\\1"), "aa\nab\n") == "aa\n");
+    CHECK(filtered(OutputFilter::literal("ta 2"), text) == "beta 22\n");
+    OutputFilter limited = OutputFilter::regex("a");
+    limited.maxMatches = 2;
+    long long matches = 0;
+    CHECK(filtered(limited, text, &matches) == "alpha 1\nbeta 22\n");
+    CHECK(matches == 4);
+    // 没有换行符的最后一行
+    CHECK(filtered(OutputFilter::regex("end"), "x\nthe end") == "the end");
+
+    bool failed = false;
+    try {
+        StreamFilter invalid(OutputFilter::regex("a("));
+    } catch (const std::regex_error&) {
+        failed = true;
+    }
+    CHECK(failed);
+}
+
+// 单行 1 MB，不拆分，直接交给正则表达式（递归匹配约 10 KB 时就会栈溢出）
+void testLongLine() {
+    const size_t size = 1 << 20;
+    std::string line(size, 'a');
+    std::string data = line + "foo\nshort foo\n" + line + "\n";
+    long long matches = 0;
+    std::string result = filtered(OutputFilter::regex("(a|b)*foo$"), data, &matches, 0);
+    CHECK(matches == 2);
+    CHECK(result.size() == size + 4 + 10);
+    CHECK(filtered(OutputFilter::regex(".*x"), data, &matches, 0).empty());
+    CHECK(matches == 0);
+    CHECK(filtered(OutputFilter::regex("^a+$"), data, &matches, 0).size() == size + 1);
+
+    // 反向引用只能递归匹配，超过 maxRegexLineLength 的行视为不匹配
+    OutputFilter backref = OutputFilter::regex("(o)\\1");
+    CHECK(filtered(backref, data, &matches, 0) == "short foo\n");
+    CHECK(matches == 1);
+}
+
+#ifndef _WIN32
+// 在事件循环线程中过滤：超长行不会终止进程
+void testReactor() {
+    ZRun zrun;
+    CommandOptions options(ShellType::Sh, 60000);
+    options.maxLineLength = 0;
+    options.stdoutFilter = OutputFilter::regex("a+foo$");
+    CommandResult result = zrun.executeSync(
+        "head -c 2000000 /dev/zero | tr '\\0' a; echo foo; echo bar", options);
+    CHECK(result.exitCode == 0);
+    CHECK(result.outputMatches == 1);
+    CHECK(result.output.size() == 2000004);
+
+    options.maxLineLength = 1 << 20;
+    result = zrun.executeSync("head -c 2000000 /dev/zero | tr '\\0' a; echo foo", options);
+    CHECK(result.exitCode == 0);
+    CHECK(result.outputMatches == 1);
+    CHECK(result.output.size() == 2000003 - (1 << 20) + 1);
+}
+#endif
+
+} // namespace
+
+int main() {
+    testSemantics();
+    testLongLine();
+#ifndef _WIN32
+    testReactor();
+#endif
+    std::printf("output_filter_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+// parallelMap 测试：按输入顺序或完成顺序回调、并发上限、stopOnFailure 终止其余命令
+// 用法: parallel_map_test
+
+#include "zrun.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+// 输入是秒数：sleep 之后输出 {index}，输入为 fail 时立即以 3 退出
+const PreparedCommand kCommand("sh", {"-c",
+                                      "[ \"$1\" = fail ] && exit 3; sleep \"$1\"; echo {index}",
+                                      "sh", "{input}"});
+
+ParallelMapOptions options(int concurrency, bool ordered) {
+    ParallelMapOptions result;
+    result.concurrency = concurrency;
+    result.ordered = ordered;
+    result.command = CommandOptions(ShellType::Sh, 30000);
+    return result;
+}
+
+// 后面的输入先结束，仍按输入顺序回调
+void testOrdered() {
+    ZRun zrun;
+    std::vector<std::string> inputs = {"0.4", "0.3", "0.2", "0.1", "0"};
+    std::vector<size_t> order;
+    auto collect = [&](size_t index, CommandResult& result) {
+        CHECK(result.exitCode == 0);
+        CHECK(result.output == std::to_string(index) + "\n");
+        order.push_back(index);
+    };
+    ParallelMapSummary summary = zrun.parallelMap(kCommand, inputs, options(5, true), collect);
+    CHECK((order == std::vector<size_t>{0, 1, 2, 3, 4}));
+    CHECK(summary.started == 5 && summary.succeeded == 5);
+    CHECK(summary.failed == 0 && summary.skipped == 0 && !summary.stopped);
+    // 并发执行，总时间接近最慢的一条
+    CHECK(summary.elapsedMs < 1500);
+    CHECK(summary.totalExecutionMs >= 900);
+}
+
+void testUnordered() {
+    ZRun zrun;
+    std::vector<std::string> inputs = {"0.6", "0.3", "0"};
+    std::vector<size_t> order;
+    ParallelMapSummary summary = zrun.parallelMap(
+        kCommand, inputs, options(3, false),
+        [&](size_t index, CommandResult&) { order.push_back(index); });
+    CHECK((order == std::vector<size_t>{2, 1, 0}));
+    CHECK(summary.succeeded == 3);
+}
+
+// 并发上限为 2：四条 0.3 秒的命令分两批
+void testConcurrency() {
+    ZRun zrun;
+    std::vector<std::string> inputs(4, "0.3");
+    size_t calls = 0;
+    ParallelMapSummary summary = zrun.parallelMap(
+        kCommand, inputs, options(2, true), [&](size_t, CommandResult&) { ++calls; });
+    CHECK(calls == 4);
+    CHECK(summary.succeeded == 4);
+    CHECK(summary.elapsedMs >= 550);
+}
+
+void testStopOnFailure() {
+    ZRun zrun;
+    std::vector<std::string> inputs = {"20", "20", "fail", "20", "20", "20"};
+    ParallelMapOptions stop = options(3, true);
+    stop.stopOnFailure = true;
+    std::vector<size_t> delivered;
+    auto start = std::chrono::steady_clock::now();
+    ParallelMapSummary summary =
+        zrun.parallelMap(kCommand, inputs, stop, [&](size_t index, CommandResult& result) {
+            delivered.push_back(index);
+            CHECK(result.exitCode == 3);
+        });
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+    CHECK(summary.stopped);
+    CHECK(summary.started == 3);
+    CHECK(summary.failed == 1 && summary.succeeded == 0);
+    // 两条被终止，三条没有启动
+    CHECK(summary.skipped == 5);
+    CHECK((delivered == std::vector<size_t>{2}));
+
+    // 不设置 stopOnFailure 时失败不影响其余输入
+    std::vector<std::string> mixed = {"0", "fail", "0", "fail", "0"};
+    summary = zrun.parallelMap(kCommand, mixed, options(2, true));
+    CHECK(!summary.stopped);
+    CHECK(summary.succeeded == 3 && summary.failed == 2 && summary.skipped == 0);
+}
+
+} // namespace
+
+int main() {
+    testOrdered();
+    testUnordered();
+    testConcurrency();
+    testStopOnFailure();
+    std::printf("parallel_map_test: ok\n");
+    return 0;
+}
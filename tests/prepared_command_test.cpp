@@ -0,0 +1,112 @@
+// PreparedCommand 测试：参数模板展开，相对路径按命令的工作目录查找，
+// 工作目录改变时不复用另一个目录中的查找结果
+// 用法: prepared_command_test
+
+#include "zrun.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+const std::string kRoot = "/tmp/zrun_prepared_command_test." + std::to_string(getpid());
+
+// 在 directory 中创建输出 name 的脚本 tool 和 bin/tool
+void makeTools(const std::string& directory, const std::string& name) {
+    CHECK(mkdir(directory.c_str(), 0755) == 0);
+    CHECK(mkdir((directory + "/bin").c_str(), 0755) == 0);
+    for (const std::string& path : {directory + "/tool", directory + "/bin/tool"}) {
+        std::ofstream(path) << "#!/bin/sh\necho " << name << " \"$@\"\n";
+        CHECK(chmod(path.c_str(), 0755) == 0);
+    }
+}
+
+void testExpand() {
+    PreparedCommand command("echo", {"{a}", "x{b}y", "{{a}}"});
+    std::vector<std::string> argv;
+    std::string error;
+    CHECK(command.expand({{"a", "1"}, {"b", "2"}}, argv, error));
+    CHECK((argv == std::vector<std::string>{"echo", "1", "x2y", "{a}"}));
+    CHECK(!command.expand({{"a", "1"}}, argv, error));
+    CHECK(!error.empty());
+
+    ZRun zrun;
+    CommandResult result = zrun.executeSync(command, {{"a", "1 2"}, {"b", "$HOME"}});
+    CHECK(result.exitCode == 0);
+    CHECK(result.output == "1 2 x$HOMEy {a}\n");
+    result = zrun.executeSync(PreparedCommand("zrun-no-such-program"));
+    CHECK(result.exitCode == -1);
+    CHECK(!result.error.empty());
+}
+
+// 当前目录中没有 tool，只有工作目录中有
+void testWorkingDirectory() {
+    const std::string first = kRoot + "/first";
+    const std::string second = kRoot + "/second";
+    CHECK(mkdir(kRoot.c_str(), 0755) == 0);
+    makeTools(first, "first");
+    makeTools(second, "second");
+
+    ZRun zrun;
+    PreparedCommand relative("./tool", {"{x}"});
+    PreparedCommand nested("bin/tool");
+    PreparedCommand searched("tool");
+
+    zrun.setWorkingDirectory(first);
+    CHECK(zrun.executeSync(relative, {{"x", "1"}}).output == "first 1\n");
+    CHECK(zrun.executeSync(nested).output == "first\n");
+    zrun.setEnvironment("PATH", ":/usr/bin:/bin");
+    CHECK(zrun.executeSync(searched).output == "first\n");
+    zrun.setEnvironment("PATH", "bin:/usr/bin:/bin");
+    CHECK(zrun.executeSync(searched).output == "first\n");
+
+    // 同一个 PreparedCommand 换一个工作目录
+    zrun.setWorkingDirectory(second);
+    CHECK(zrun.executeSync(relative, {{"x", "2"}}).output == "second 2\n");
+    CHECK(zrun.executeSync(nested).output == "second\n");
+    CHECK(zrun.executeSync(searched).output == "second\n");
+    zrun.setEnvironment("PATH", ".:/usr/bin:/bin");
+    CHECK(zrun.executeSync(searched).output == "second\n");
+
+    // 工作目录中没有时找不到，不使用之前的结果
+    zrun.setWorkingDirectory(kRoot);
+    CommandResult result = zrun.executeSync(relative, {{"x", "3"}});
+    CHECK(result.exitCode == -1);
+    CHECK(!result.error.empty());
+
+    // 相对的工作目录相对当前目录
+    char current[4096];
+    CHECK(getcwd(current, sizeof(current)) != nullptr);
+    CHECK(chdir(kRoot.c_str()) == 0);
+    zrun.setWorkingDirectory("first");
+    result = zrun.executeSync(relative, {{"x", "4"}});
+    CHECK(chdir(current) == 0);
+    CHECK(result.output == "first 4\n");
+
+    std::system(("rm -rf " + kRoot).c_str());
+}
+
+} // namespace
+
+int main() {
+    testExpand();
+    testWorkingDirectory();
+    std::printf("prepared_command_test: ok\n");
+    return 0;
+}
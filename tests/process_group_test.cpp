@@ -0,0 +1,141 @@
+// 进程组测试：超时、取消和实例析构时，shell 启动的子进程随 shell 一起终止
+// 用法: process_group_test
+
+#include "zrun.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+#include <signal.h>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+const std::string kPidFile = "/tmp/zrun_process_group_test." + std::to_string(getpid());
+
+// 后台启动 sleep 并记录其 pid，然后等待它
+std::string command(bool ignoreTerm) {
+    return std::string(ignoreTerm ? "trap '' TERM; " : "") + "sleep 30 & echo $! > " +
+           kPidFile + "; wait";
+}
+
+pid_t readPid() {
+    for (int i = 0; i < 500; ++i) {
+        std::ifstream file(kPidFile);
+        pid_t pid = 0;
+        if (file >> pid && pid > 0) {
+            return pid;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return 0;
+}
+
+// 进程已退出（不存在或只剩僵尸，沙箱中可能没有进程回收孤儿）
+bool gone(pid_t pid) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string pidField, name, state;
+    if (!(stat >> pidField >> name >> state)) {
+        return kill(pid, 0) == -1;
+    }
+    return state == "Z" || state == "X";
+}
+
+bool goneWithin(pid_t pid, int ms) {
+    for (int i = 0; i < ms / 10; ++i) {
+        if (gone(pid)) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return gone(pid);
+}
+
+void cleanup(pid_t pid) {
+    if (pid > 0 && !gone(pid)) {
+        kill(pid, SIGKILL);
+    }
+    std::remove(kPidFile.c_str());
+}
+
+void testTimeout(bool terminal, bool ignoreTerm) {
+    std::remove(kPidFile.c_str());
+    ZRun zrun;
+    CommandOptions options(ShellType::Bash, 500);
+    options.terminal.enabled = terminal;
+    CommandResult result = zrun.executeSync(command(ignoreTerm), options);
+    CHECK(result.timedOut);
+    pid_t child = readPid();
+    CHECK(child > 0);
+    bool ok = goneWithin(child, 3000);
+    cleanup(child);
+    CHECK(ok);
+}
+
+void testCancel() {
+    std::remove(kPidFile.c_str());
+    ZRun zrun;
+    AsyncHandle handle = zrun.submit(command(false), CommandOptions(ShellType::Bash, 60000));
+    pid_t child = readPid();
+    CHECK(child > 0);
+    CHECK(handle.cancel());
+    bool ok = goneWithin(child, 3000);
+    cleanup(child);
+    CHECK(ok);
+}
+
+void testDestruction() {
+    std::remove(kPidFile.c_str());
+    pid_t child;
+    {
+        ZRun zrun;
+        zrun.executeAsync(command(false), ShellType::Bash, 60000);
+        child = readPid();
+        CHECK(child > 0);
+    }
+    bool ok = goneWithin(child, 3000);
+    cleanup(child);
+    CHECK(ok);
+}
+
+// 正常结束的命令留在后台的进程不受影响
+void testBackgroundSurvives() {
+    std::remove(kPidFile.c_str());
+    ZRun zrun;
+    CommandResult result = zrun.executeSync("(sleep 30 & echo $! > " + kPidFile + ") >/dev/null",
+                                            CommandOptions(ShellType::Bash, 5000));
+    CHECK(result.exitCode == 0);
+    pid_t child = readPid();
+    CHECK(child > 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    bool alive = !gone(child);
+    cleanup(child);
+    CHECK(alive);
+}
+
+} // namespace
+
+int main() {
+    testTimeout(false, false);
+    testTimeout(false, true);
+    testTimeout(true, false);
+    testCancel();
+    testDestruction();
+    testBackgroundSurvives();
+    std::printf("process_group_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,276 @@
+// 结果缓存持久化测试：重新打开后读回条目、过期和依赖变化、写到一半的尾部记录、
+// 文件被占用和不是缓存文件时的处理、重写文件
+// 用法: result_cache_test
+
+#include "zrun.hpp"
+#include "zrun_cache.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+const std::string kPath = "/tmp/zrun_result_cache_test." + std::to_string(getpid());
+// 与 zrun_cache.cpp 中的文件格式一致：8 字节魔数，u64 used，然后是记录（u32 总长度开头）
+const size_t kHeaderSize = 16;
+
+ResultCacheConfig persistent() {
+    ResultCacheConfig config;
+    config.persistPath = kPath;
+    config.defaultTtlMs = -1;
+    return config;
+}
+
+CommandResult makeResult(const std::string& output, int exitCode = 0) {
+    CommandResult result;
+    result.exitCode = exitCode;
+    result.output = output;
+    result.error = "err:" + output;
+    return result;
+}
+
+void store(ResultCache& cache, const std::string& key, const std::string& output,
+           long long ttlMs = 0, const std::vector<std::string>& dependencies = {}) {
+    CachePolicy policy;
+    policy.enabled = true;
+    policy.ttlMs = ttlMs;
+    policy.dependencies = dependencies;
+    cache.store(key, policy, ResultCache::snapshot(dependencies), makeResult(output));
+}
+
+bool lookup(ResultCache& cache, const std::string& key, std::string* output = nullptr) {
+    CommandResult result;
+    if (!cache.lookup(key, result)) {
+        return false;
+    }
+    CHECK(result.fromCache);
+    CHECK(result.error == "err:" + result.output);
+    if (output) {
+        *output = result.output;
+    }
+    return true;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& path, const std::string& data) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << data;
+}
+
+uint64_t usedOf(const std::string& file) {
+    uint64_t used = 0;
+    std::memcpy(&used, file.data() + 8, sizeof(used));
+    return used;
+}
+
+// 各条记录在文件中的起始位置
+std::vector<size_t> recordOffsets(const std::string& file) {
+    std::vector<size_t> offsets;
+    size_t offset = kHeaderSize;
+    while (offset < usedOf(file)) {
+        offsets.push_back(offset);
+        uint32_t size = 0;
+        std::memcpy(&size, file.data() + offset, sizeof(size));
+        CHECK(size > 0);
+        offset += size;
+    }
+    CHECK(offset == usedOf(file));
+    return offsets;
+}
+
+void testReload() {
+    std::remove(kPath.c_str());
+    const std::string dependency = kPath + ".dep";
+    writeFile(dependency, "v1");
+    {
+        ResultCache cache;
+        CHECK(cache.configure(persistent()));
+        store(cache, "a", "first");
+        store(cache, "b", std::string(100000, 'b'));
+        store(cache, "a", "second");
+        store(cache, "short", "gone", 1);
+        store(cache, "dep", "dependent", 0, {dependency});
+        CHECK(lookup(cache, "a"));
+    }
+    usleep(20 * 1000);
+    writeFile(dependency + ".new", "v2 longer");
+    {
+        ResultCache cache;
+        CHECK(cache.configure(persistent()));
+        std::string output;
+        CHECK(lookup(cache, "a", &output) && output == "second");
+        CHECK(lookup(cache, "b", &output) && output == std::string(100000, 'b'));
+        CHECK(!lookup(cache, "short"));
+        CHECK(lookup(cache, "dep", &output) && output == "dependent");
+        Metrics metrics;
+        cache.fillMetrics(metrics);
+        CHECK(metrics.cacheEntries == 3);
+    }
+    // 依赖文件改变之后读回的条目失效
+    CHECK(std::rename((dependency + ".new").c_str(), dependency.c_str()) == 0);
+    {
+        ResultCache cache;
+        CHECK(cache.configure(persistent()));
+        CHECK(!lookup(cache, "dep"));
+        CHECK(lookup(cache, "a"));
+    }
+    std::remove(dependency.c_str());
+}
+
+// 文件头的 used 已经包含最后一条记录，但记录本身没有写完整
+void testTornTail() {
+    std::remove(kPath.c_str());
+    {
+        ResultCache cache;
+        CHECK(cache.configure(persistent()));
+        for (int i = 0; i < 5; ++i) {
+            store(cache, "k" + std::to_string(i), "value" + std::to_string(i));
+        }
+    }
+    const std::string original = readFile(kPath);
+    std::vector<size_t> offsets = recordOffsets(original);
+    CHECK(offsets.size() == 5);
+    size_t last = offsets.back();
+
+    std::vector<std::string> torn;
+    // 最后一条记录全为零
+    std::string zeroed = original;
+    std::memset(&zeroed[last], 0, usedOf(original) - last);
+    torn.push_back(zeroed);
+    // 长度字段越过 used
+    std::string oversized = original;
+    uint32_t huge = 1u << 30;
+    std::memcpy(&oversized[last], &huge, sizeof(huge));
+    torn.push_back(oversized);
+    // 键的长度与记录长度不一致
+    std::string mismatched = original;
+    mismatched[last + 4 + 8 + 4] ^= 0x7f;
+    torn.push_back(mismatched);
+
+    for (const std::string& data : torn) {
+        writeFile(kPath, data);
+        {
+            ResultCache cache;
+            CHECK(cache.configure(persistent()));
+            for (int i = 0; i < 4; ++i) {
+                std::string output;
+                CHECK(lookup(cache, "k" + std::to_string(i), &output));
+                CHECK(output == "value" + std::to_string(i));
+            }
+            CHECK(!lookup(cache, "k4"));
+            // 新记录写在最后一条有效记录之后
+            store(cache, "new", "appended");
+        }
+        std::string reloaded = readFile(kPath);
+        CHECK(usedOf(reloaded) < usedOf(original) + 64);
+        CHECK(recordOffsets(reloaded).size() == 5);
+        ResultCache cache;
+        CHECK(cache.configure(persistent()));
+        CHECK(lookup(cache, "new") && lookup(cache, "k3"));
+    }
+}
+
+void testUnusableFile() {
+    std::remove(kPath.c_str());
+    ResultCache owner;
+    CHECK(owner.configure(persistent()));
+    store(owner, "a", "owned");
+
+    // 已被锁定：只在内存中缓存
+    ResultCache other;
+    CHECK(!other.configure(persistent()));
+    CHECK(other.enabled());
+    store(other, "b", "memory");
+    CHECK(lookup(other, "b"));
+    other.disable();
+    owner.disable();
+
+    // 不是缓存文件时不覆盖
+    writeFile(kPath, std::string(4096, 'x'));
+    ResultCache cache;
+    CHECK(!cache.configure(persistent()));
+    store(cache, "a", "memory");
+    cache.disable();
+    CHECK(readFile(kPath) == std::string(4096, 'x'));
+    std::remove(kPath.c_str());
+}
+
+// 反复覆盖同一个键，无效记录足够多时重写文件
+void testCompaction() {
+    std::remove(kPath.c_str());
+    const std::string big(200000, 'c');
+    {
+        ResultCache cache;
+        CHECK(cache.configure(persistent()));
+        for (int i = 0; i < 20; ++i) {
+            store(cache, "same", big + std::to_string(i));
+        }
+        store(cache, "other", "kept");
+    }
+    struct stat info;
+    CHECK(stat(kPath.c_str(), &info) == 0);
+    CHECK(info.st_size < 2 * 1024 * 1024);
+    CHECK(recordOffsets(readFile(kPath)).size() <= 4);
+    ResultCache cache;
+    CHECK(cache.configure(persistent()));
+    std::string output;
+    CHECK(lookup(cache, "same", &output) && output == big + "19");
+    CHECK(lookup(cache, "other"));
+    cache.disable();
+    std::remove(kPath.c_str());
+}
+
+void testEndToEnd() {
+    std::remove(kPath.c_str());
+    CommandOptions options(ShellType::Sh, 10000);
+    options.cache.enabled = true;
+    const std::string command = "date +%s%N";
+    std::string first;
+    {
+        ZRun zrun;
+        CHECK(zrun.enableResultCache(persistent()));
+        CommandResult result = zrun.executeSync(command, options);
+        CHECK(result.exitCode == 0 && !result.fromCache);
+        first = result.output;
+    }
+    ZRun zrun;
+    CHECK(zrun.enableResultCache(persistent()));
+    CommandResult result = zrun.executeSync(command, options);
+    CHECK(result.fromCache);
+    CHECK(result.output == first);
+    zrun.disableResultCache();
+    std::remove(kPath.c_str());
+}
+
+} // namespace
+
+int main() {
+    testReload();
+    testTornTail();
+    testUnusableFile();
+    testCompaction();
+    testEndToEnd();
+    std::printf("result_cache_test: ok\n");
+    return 0;
+}
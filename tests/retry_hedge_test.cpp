@@ -0,0 +1,211 @@
+// 重试和对冲测试：可重试的失败、退避时间、次数用尽、等待重试时取消；
+// 对冲副本在延迟后启动并采用先结束的结果，延迟取最近执行时间的分位数
+// 用法: retry_hedge_test
+
+#include "zrun.hpp"
+#include "zrun_retry.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+const std::string kCounter = "/tmp/zrun_retry_hedge_test." + std::to_string(getpid());
+
+// 第几次执行（从 0 开始）保存在 n 中
+std::string counted(const std::string& body) {
+    return "n=$(cat " + kCounter + " 2>/dev/null | wc -l); echo >> " + kCounter + "; " + body;
+}
+
+long long elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start).count();
+}
+
+CommandOptions retryOptions(int maxAttempts, int backoffMs) {
+    CommandOptions options(ShellType::Bash, 10000);
+    options.retry.maxAttempts = maxAttempts;
+    options.retry.initialBackoffMs = backoffMs;
+    options.retry.jitter = 0;
+    return options;
+}
+
+void testPolicy() {
+    RetryPolicy policy;
+    CommandResult result;
+    result.exitCode = 0;
+    CHECK(!retryable(policy, result));
+    result.exitCode = 1;
+    CHECK(retryable(policy, result));
+    result.exitCode = -1;
+    CHECK(retryable(policy, result));
+    result.limitExceeded = ResourceLimitKind::Memory;
+    CHECK(!retryable(policy, result));
+    result.limitExceeded = ResourceLimitKind::None;
+
+    policy.retryExitCodes = {75};
+    CHECK(!retryable(policy, result));
+    result.exitCode = 75;
+    CHECK(retryable(policy, result));
+    result.timedOut = true;
+    CHECK(retryable(policy, result));
+    policy.retryOnTimeout = false;
+    CHECK(!retryable(policy, result));
+
+    policy.initialBackoffMs = 100;
+    policy.backoffMultiplier = 3.0;
+    policy.maxBackoffMs = 1000;
+    policy.jitter = 0;
+    CHECK(retryBackoffMs(policy, 1) == 100);
+    CHECK(retryBackoffMs(policy, 2) == 300);
+    CHECK(retryBackoffMs(policy, 3) == 900);
+    CHECK(retryBackoffMs(policy, 4) == 1000);
+    policy.jitter = 0.5;
+    for (int i = 0; i < 100; ++i) {
+        int delay = retryBackoffMs(policy, 2);
+        CHECK(delay >= 150 && delay <= 450);
+    }
+}
+
+void testRetry() {
+    ZRun zrun;
+    // 前两次失败，第三次成功
+    std::remove(kCounter.c_str());
+    auto start = std::chrono::steady_clock::now();
+    CommandResult result =
+        zrun.executeSync(counted("echo run$n; [ $n -ge 2 ]"), retryOptions(5, 50));
+    CHECK(result.exitCode == 0);
+    CHECK(result.attempts == 3);
+    CHECK(result.output == "run2\n");
+    // 退避 50 + 100 毫秒
+    CHECK(elapsedMs(start) >= 140);
+    CHECK(zrun.metrics().retries == 2);
+
+    // 次数用尽，返回最后一次的结果
+    std::remove(kCounter.c_str());
+    result = zrun.executeSync(counted("echo run$n; exit 75"), retryOptions(3, 10));
+    CHECK(result.exitCode == 75 && result.attempts == 3);
+    CHECK(result.output == "run2\n");
+
+    // 不在列表中的退出码不重试
+    std::remove(kCounter.c_str());
+    CommandOptions listed = retryOptions(3, 10);
+    listed.retry.retryExitCodes = {75};
+    result = zrun.executeSync(counted("exit 1"), listed);
+    CHECK(result.exitCode == 1 && result.attempts == 1);
+
+    // 超时的执行按 retryOnTimeout 处理
+    CommandOptions timeout = retryOptions(3, 10);
+    timeout.timeoutMs = 100;
+    timeout.retry.retryOnTimeout = false;
+    result = zrun.executeSync("sleep 5", timeout);
+    CHECK(result.timedOut && result.attempts == 1);
+
+    // 异步命令同样重试
+    std::remove(kCounter.c_str());
+    AsyncHandle handle = zrun.submit(counted("[ $n -ge 1 ]"), retryOptions(3, 10));
+    CHECK(handle.waitFor(10000));
+    CHECK(handle.state() == AsyncState::Completed);
+    CHECK(handle.result().attempts == 2);
+}
+
+// 等待下一次重试时取消，不再启动新的进程
+void testCancelDuringBackoff() {
+    std::remove(kCounter.c_str());
+    ZRun zrun;
+    AsyncHandle handle = zrun.submit(counted("exit 1"), retryOptions(5, 20000));
+    for (int i = 0; i < 500 && access(kCounter.c_str(), F_OK) != 0; ++i) {
+        usleep(10 * 1000);
+    }
+    usleep(200 * 1000);
+    auto start = std::chrono::steady_clock::now();
+    CHECK(handle.cancel());
+    CHECK(handle.waitFor(5000));
+    CHECK(handle.state() == AsyncState::Cancelled);
+    CHECK(elapsedMs(start) < 2000);
+    CommandResult result =
+        zrun.executeSync("wc -l < " + kCounter, CommandOptions(ShellType::Sh, 5000));
+    CHECK(result.output == "1\n");
+}
+
+CommandOptions hedgeOptions(int delayMs) {
+    CommandOptions options(ShellType::Bash, 30000);
+    options.hedge.enabled = true;
+    options.hedge.delayMs = delayMs;
+    return options;
+}
+
+void testHedge() {
+    ZRun zrun;
+    // 第一份很慢，延迟 100 毫秒后启动的副本先结束
+    std::remove(kCounter.c_str());
+    auto start = std::chrono::steady_clock::now();
+    CommandResult result = zrun.executeSync(
+        counted("if [ $n -eq 0 ]; then sleep 10; fi; echo copy$n"), hedgeOptions(100));
+    CHECK(result.exitCode == 0);
+    CHECK(result.hedged && result.attempts == 2);
+    CHECK(result.output == "copy1\n");
+    CHECK(elapsedMs(start) < 5000);
+    Metrics metrics = zrun.metrics();
+    CHECK(metrics.hedgesLaunched == 1 && metrics.hedgeWins == 1);
+
+    // 在延迟之前结束时不对冲
+    result = zrun.executeSync("echo fast", hedgeOptions(2000));
+    CHECK(!result.hedged && result.attempts == 1);
+    CHECK(zrun.metrics().hedgesLaunched == 1);
+
+    // 异步命令：第一份先结束时副本被终止
+    std::remove(kCounter.c_str());
+    AsyncHandle handle = zrun.submit(
+        counted("if [ $n -eq 0 ]; then sleep 0.3; else sleep 10; fi; echo copy$n"),
+        hedgeOptions(100));
+    CHECK(handle.waitFor(5000));
+    CHECK(handle.result().output == "copy0\n");
+    CHECK(!handle.result().hedged && handle.result().attempts == 2);
+}
+
+// 没有固定延迟时，有足够样本后按最近执行时间的分位数对冲
+void testHedgePercentile() {
+    ZRun zrun;
+    std::remove(kCounter.c_str());
+    CommandOptions options = hedgeOptions(-1);
+    options.hedge.minSamples = 3;
+    options.hedge.percentile = 0.9;
+    const std::string command = counted("if [ $n -eq 3 ]; then sleep 10; else sleep 0.05; fi");
+    for (int i = 0; i < 3; ++i) {
+        CommandResult result = zrun.executeSync(command, options);
+        CHECK(result.exitCode == 0 && !result.hedged);
+    }
+    CHECK(zrun.metrics().hedgesLaunched == 0);
+    auto start = std::chrono::steady_clock::now();
+    CommandResult result = zrun.executeSync(command, options);
+    CHECK(result.exitCode == 0 && result.hedged);
+    CHECK(elapsedMs(start) < 5000);
+    std::remove(kCounter.c_str());
+}
+
+} // namespace
+
+int main() {
+    testPolicy();
+    testRetry();
+    testCancelDuringBackoff();
+    testHedge();
+    testHedgePercentile();
+    std::printf("retry_hedge_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,295 @@
+// 准入调度测试：优先级顺序、tag 权重和并发上限、排队超时、排队中取消、关闭
+// 用法: scheduler_test
+
+#include "zrun.hpp"
+#include "zrun_core.h"
+#include "zrun_scheduler.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+// 记录启动和拒绝的命令；拒绝可能来自调度器的后台线程
+struct Recorder {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::shared_ptr<AsyncOperation>> launched;
+    std::vector<std::pair<std::shared_ptr<AsyncOperation>, CommandResult>> rejected;
+
+    AdmissionScheduler make() {
+        return AdmissionScheduler(
+            [this](const std::shared_ptr<AsyncOperation>& operation) {
+                std::lock_guard<std::mutex> lock(mutex);
+                launched.push_back(operation);
+            },
+            [this](const std::shared_ptr<AsyncOperation>& operation, CommandResult& result) {
+                std::lock_guard<std::mutex> lock(mutex);
+                rejected.emplace_back(operation, result);
+                cv.notify_all();
+            });
+    }
+
+    size_t launchedCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return launched.size();
+    }
+
+    bool waitRejected(size_t count, int timeoutMs) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cv.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                           [&]() { return rejected.size() >= count; });
+    }
+};
+
+std::shared_ptr<AsyncOperation> makeOperation(int id, const std::string& tag = std::string(),
+                                              CommandPriority priority = CommandPriority::Normal,
+                                              int queueTimeoutMs = -1) {
+    CommandOptions options;
+    options.tag = tag;
+    options.priority = priority;
+    options.queueTimeoutMs = queueTimeoutMs;
+    return std::make_shared<AsyncOperation>(id, "cmd" + std::to_string(id), options, nullptr);
+}
+
+// 结束最近启动的命令，返回因此启动的命令
+std::shared_ptr<AsyncOperation> releaseLast(AdmissionScheduler& scheduler, Recorder& recorder) {
+    size_t before = recorder.launchedCount();
+    std::shared_ptr<AsyncOperation> last;
+    {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        last = recorder.launched.back();
+    }
+    scheduler.release(*last);
+    std::lock_guard<std::mutex> lock(recorder.mutex);
+    CHECK(recorder.launched.size() <= before + 1);
+    return recorder.launched.size() == before + 1 ? recorder.launched.back() : nullptr;
+}
+
+void testPriority() {
+    Recorder recorder;
+    AdmissionScheduler scheduler = recorder.make();
+    scheduler.setMaxConcurrency(1);
+    scheduler.submit(makeOperation(0));
+    CHECK(recorder.launchedCount() == 1);
+
+    scheduler.submit(makeOperation(1, "", CommandPriority::Low));
+    scheduler.submit(makeOperation(2, "", CommandPriority::Normal));
+    scheduler.submit(makeOperation(3, "", CommandPriority::High));
+    scheduler.submit(makeOperation(4, "", CommandPriority::Low));
+    scheduler.submit(makeOperation(5, "other", CommandPriority::High));
+    CHECK(recorder.launchedCount() == 1);
+
+    std::vector<int> order;
+    while (auto next = releaseLast(scheduler, recorder)) {
+        CHECK(next->admitted);
+        order.push_back(next->id);
+    }
+    // 同一优先级内各 tag 公平，同一 tag 内先进先出
+    CHECK(order.size() == 5);
+    CHECK((order[0] == 3 && order[1] == 5) || (order[0] == 5 && order[1] == 3));
+    CHECK(order[2] == 2 && order[3] == 1 && order[4] == 4);
+
+    Metrics metrics;
+    scheduler.fillMetrics(metrics);
+    CHECK(metrics.admittedImmediately == 1);
+    CHECK(metrics.admittedFromQueue == 5);
+    CHECK(metrics.commandsRunning == 0 && metrics.commandsQueued == 0);
+}
+
+// 权重 3:1 的两个 tag 同时排队，准入次数按权重分配
+void testTagWeights() {
+    Recorder recorder;
+    AdmissionScheduler scheduler = recorder.make();
+    scheduler.setMaxConcurrency(1);
+    scheduler.setTagPolicy("heavy", 0, 3);
+    scheduler.setTagPolicy("light", 0, 1);
+    scheduler.submit(makeOperation(0));
+    for (int i = 0; i < 20; ++i) {
+        scheduler.submit(makeOperation(100 + i, "heavy"));
+        scheduler.submit(makeOperation(200 + i, "light"));
+    }
+
+    int heavy = 0;
+    int light = 0;
+    int lastHeavy = 99;
+    int lastLight = 199;
+    for (int i = 0; i < 16; ++i) {
+        auto next = releaseLast(scheduler, recorder);
+        CHECK(next);
+        if (next->options.tag == "heavy") {
+            ++heavy;
+            CHECK(next->id == ++lastHeavy);
+        } else {
+            ++light;
+            CHECK(next->id == ++lastLight);
+        }
+    }
+    CHECK(heavy == 12 && light == 4);
+
+    Metrics metrics;
+    scheduler.fillMetrics(metrics);
+    CHECK(metrics.tags["heavy"].admitted == 12);
+    CHECK(metrics.tags["light"].queued == 16);
+    scheduler.shutdown();
+}
+
+// tag 的并发上限不影响其他 tag
+void testTagLimit() {
+    Recorder recorder;
+    AdmissionScheduler scheduler = recorder.make();
+    scheduler.setTagPolicy("limited", 1, 1);
+    auto first = makeOperation(1, "limited");
+    scheduler.submit(first);
+    scheduler.submit(makeOperation(2, "limited"));
+    scheduler.submit(makeOperation(3, "limited"));
+    CHECK(recorder.launchedCount() == 1);
+    scheduler.submit(makeOperation(4));
+    CHECK(recorder.launchedCount() == 2);
+
+    scheduler.release(*first);
+    CHECK(recorder.launchedCount() == 3);
+    CHECK(recorder.launched.back()->id == 2);
+    // 放宽上限后剩余的命令立即准入
+    scheduler.setTagPolicy("limited", 0, 1);
+    CHECK(recorder.launchedCount() == 4);
+    CHECK(recorder.launched.back()->id == 3);
+}
+
+void testQueueTimeout() {
+    Recorder recorder;
+    AdmissionScheduler scheduler = recorder.make();
+    scheduler.setMaxConcurrency(1);
+    scheduler.submit(makeOperation(0));
+    auto start = std::chrono::steady_clock::now();
+    scheduler.submit(makeOperation(1, "", CommandPriority::Normal, 100));
+    scheduler.submit(makeOperation(2));
+    scheduler.submit(makeOperation(3, "", CommandPriority::Normal, 5000));
+
+    CHECK(recorder.waitRejected(1, 5000));
+    auto waited = std::chrono::steady_clock::now() - start;
+    CHECK(waited >= std::chrono::milliseconds(90));
+    {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        CHECK(recorder.rejected.size() == 1);
+        CHECK(recorder.rejected[0].first->id == 1);
+        CHECK(recorder.rejected[0].second.timedOut);
+        CHECK(recorder.rejected[0].second.exitCode == -1);
+        CHECK(!recorder.rejected[0].first->admitted);
+    }
+
+    // 超时的命令不再占用队列位置
+    auto next = releaseLast(scheduler, recorder);
+    CHECK(next && next->id == 2);
+    next = releaseLast(scheduler, recorder);
+    CHECK(next && next->id == 3);
+
+    Metrics metrics;
+    scheduler.fillMetrics(metrics);
+    CHECK(metrics.queueTimeouts == 1);
+    CHECK(metrics.admittedFromQueue == 2);
+}
+
+void testQueuedCancel() {
+    Recorder recorder;
+    AdmissionScheduler scheduler = recorder.make();
+    scheduler.setMaxConcurrency(1);
+    scheduler.submit(makeOperation(0));
+    auto cancelled = makeOperation(1);
+    scheduler.submit(cancelled);
+    scheduler.submit(makeOperation(2));
+
+    CHECK(cancelled->cancel());
+    CHECK(recorder.waitRejected(1, 5000));
+    {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        CHECK(recorder.rejected[0].first == cancelled);
+        CHECK(!recorder.rejected[0].second.timedOut);
+        CHECK(recorder.rejected[0].second.error == "Cancelled while queued");
+    }
+    auto next = releaseLast(scheduler, recorder);
+    CHECK(next && next->id == 2);
+
+    // 提交之前已经取消的命令同样被拒绝
+    auto early = makeOperation(3);
+    CHECK(early->cancel());
+    scheduler.submit(early);
+    CHECK(recorder.waitRejected(2, 5000));
+
+    Metrics metrics;
+    scheduler.fillMetrics(metrics);
+    CHECK(metrics.queueCancellations == 2);
+    CHECK(metrics.commandsQueued == 0);
+}
+
+// 关闭时排队的命令按取消处理，之后提交的命令立即被拒绝
+void testShutdown() {
+    Recorder recorder;
+    AdmissionScheduler scheduler = recorder.make();
+    scheduler.setMaxConcurrency(1);
+    scheduler.submit(makeOperation(0));
+    auto queued = makeOperation(1);
+    scheduler.submit(queued);
+    scheduler.shutdown();
+    CHECK(recorder.rejected.size() == 1);
+    CHECK(queued->state == AsyncState::Cancelled);
+    scheduler.submit(makeOperation(2));
+    CHECK(recorder.rejected.size() == 2);
+    CHECK(recorder.launchedCount() == 1);
+}
+
+#ifndef _WIN32
+void testEndToEnd() {
+    ZRun zrun;
+    zrun.setMaxConcurrency(1);
+    AsyncHandle running = zrun.submit("sleep 0.5", CommandOptions(ShellType::Sh, 30000));
+    CommandOptions timeout(ShellType::Sh, 30000);
+    timeout.queueTimeoutMs = 50;
+    AsyncHandle expired = zrun.submit("echo never", timeout);
+    CommandOptions high(ShellType::Sh, 30000);
+    high.priority = CommandPriority::High;
+    AsyncHandle low = zrun.submit("echo low", CommandOptions(ShellType::Sh, 30000));
+    AsyncHandle urgent = zrun.submit("echo high", high);
+
+    expired.wait();
+    CHECK(expired.result().timedOut);
+    CHECK(expired.result().output.empty());
+    CHECK(running.state() == AsyncState::Running);
+    low.wait();
+    CHECK(urgent.ready());
+    CHECK(urgent.result().output == "high\n");
+    CHECK(low.result().output == "low\n");
+}
+#endif
+
+} // namespace
+
+int main() {
+    testPriority();
+    testTagWeights();
+    testTagLimit();
+    testQueueTimeout();
+    testQueuedCancel();
+    testShutdown();
+#ifndef _WIN32
+    testEndToEnd();
+#endif
+    std::printf("scheduler_test: ok\n");
+    return 0;
+}
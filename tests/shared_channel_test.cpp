@@ -0,0 +1,196 @@
+// 共享内存通道测试：子程序通过 zrun_shm.h 写入，Capture 模式读取全部数据和写满时丢弃，
+// Stream 模式下写入方等待读取方取走数据，重用通道，没有通道时写入端打开失败
+// 用法: shared_channel_test
+//      shared_channel_test write <总字节数> <每次写入的字节数>    (作为子程序)
+
+#include "zrun.hpp"
+#include "zrun_channel.h"
+#include "zrun_shm.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+std::string g_self;
+
+char patternAt(size_t position) {
+    return static_cast<char>('a' + position % 26);
+}
+
+std::string pattern(size_t begin, size_t size) {
+    std::string result(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        result[i] = patternAt(begin + i);
+    }
+    return result;
+}
+
+// 子程序：按块写入 total 字节，输出每块的结果；通道打不开时退出码为 2，有写入失败时为 3
+int writeChannel(size_t total, size_t chunk) {
+    zrun_shm_writer writer;
+    if (zrun_shm_open(&writer) != 0) {
+        std::printf("no channel\n");
+        return 2;
+    }
+    std::printf("fd %s\n", std::getenv(ZRUN_SHM_ENV));
+    int failures = 0;
+    for (size_t written = 0; written < total; written += chunk) {
+        size_t size = std::min(chunk, total - written);
+        std::string data = pattern(written, size);
+        if (zrun_shm_write(&writer, data.data(), data.size()) != 0) {
+            std::printf("failed %s\n", errno == ENOSPC ? "ENOSPC" : std::strerror(errno));
+            ++failures;
+        }
+    }
+    zrun_shm_close(&writer);
+    return failures ? 3 : 0;
+}
+
+std::string writerCommand(size_t total, size_t chunk) {
+    return "'" + g_self + "' write " + std::to_string(total) + " " + std::to_string(chunk);
+}
+
+CommandOptions channelOptions(const std::shared_ptr<SharedChannel>& channel) {
+    CommandOptions options(ShellType::Sh, 10000);
+    options.sharedChannel = channel;
+    return options;
+}
+
+std::shared_ptr<SharedChannel> makeChannel(size_t capacity, SharedChannel::Mode mode) {
+    std::string error;
+    std::shared_ptr<SharedChannel> channel = SharedChannel::create(capacity, mode, error);
+    CHECK(channel && error.empty());
+    return channel;
+}
+
+void testCapture() {
+    ZRun zrun;
+    std::shared_ptr<SharedChannel> channel = makeChannel(1 << 20, SharedChannel::Mode::Capture);
+    CHECK(channel->capacity() >= (1 << 20));
+    CHECK(channel->capacity() % 4096 == 0);
+    CHECK(channel->view().empty());
+
+    CommandResult result = zrun.executeSync(writerCommand(300000, 7000), channelOptions(channel));
+    CHECK(result.exitCode == 0);
+    // 数据不经过标准输出
+    CHECK(result.output == "fd 3\n");
+    CHECK(channel->written() == 300000 && !channel->overflowed());
+    CHECK(channel->view() == pattern(0, 300000));
+
+    // 预先准备的命令和设置了环境变量时同样可用
+    zrun.setEnvironment("ZRUN_SHARED_CHANNEL_TEST", "1");
+    channel->reset();
+    CHECK(channel->written() == 0 && channel->view().empty());
+    PreparedCommand prepared(g_self, {"write", "{total}", "1000"});
+    result = zrun.executeSync(prepared, {{"total", "5000"}}, channelOptions(channel));
+    CHECK(result.exitCode == 0);
+    CHECK(channel->view() == pattern(0, 5000));
+    channel->consume(2000);
+    CHECK(channel->consumed() == 2000);
+    CHECK(channel->view() == pattern(2000, 3000));
+}
+
+// 写满之后的写入整段丢弃
+void testOverflow() {
+    ZRun zrun;
+    std::shared_ptr<SharedChannel> channel = makeChannel(4096, SharedChannel::Mode::Capture);
+    CHECK(channel->capacity() == 4096);
+    CommandResult result = zrun.executeSync(writerCommand(5000, 2500), channelOptions(channel));
+    CHECK(result.exitCode == 3);
+    CHECK(result.output == "fd 3\nfailed ENOSPC\n");
+    CHECK(channel->overflowed());
+    CHECK(channel->view() == pattern(0, 2500));
+    channel->reset();
+    CHECK(!channel->overflowed() && channel->written() == 0);
+}
+
+// 比通道大得多的数据在读取方取走之后继续写入
+void testStream() {
+    ZRun zrun;
+    std::shared_ptr<SharedChannel> channel = makeChannel(4096, SharedChannel::Mode::Stream);
+    const size_t total = 2 * 1024 * 1024;
+    AsyncHandle handle = zrun.submit(writerCommand(total, 10000), channelOptions(channel));
+
+    // 不读取时写入方停在通道写满的位置
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CHECK(!handle.ready());
+    CHECK(channel->written() == channel->capacity());
+
+    std::string received;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    while (received.size() < total && std::chrono::steady_clock::now() < deadline) {
+        std::string_view first, second;
+        channel->peek(first, second);
+        if (first.empty()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        received.append(first.data(), first.size());
+        received.append(second.data(), second.size());
+        channel->consume(first.size() + second.size());
+    }
+    CHECK(handle.waitFor(10000));
+    CHECK(handle.result().exitCode == 0);
+    CHECK(received.size() == total);
+    CHECK(received == pattern(0, total));
+    CHECK(channel->written() == total && channel->consumed() == total);
+}
+
+void testWithoutChannel() {
+    ZRun zrun;
+    CommandResult result =
+        zrun.executeSync(writerCommand(10, 10), CommandOptions(ShellType::Sh, 10000));
+    CHECK(result.exitCode == 2);
+    CHECK(result.output == "no channel\n");
+
+    // 使用通道的命令不缓存结果
+    std::shared_ptr<SharedChannel> channel = makeChannel(4096, SharedChannel::Mode::Capture);
+    CHECK(zrun.enableResultCache(ResultCacheConfig()));
+    CommandOptions options = channelOptions(channel);
+    options.cache.enabled = true;
+    for (int i = 0; i < 2; ++i) {
+        channel->reset();
+        result = zrun.executeSync(writerCommand(100, 100), options);
+        CHECK(result.exitCode == 0 && !result.fromCache);
+        CHECK(channel->view() == pattern(0, 100));
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc == 4 && std::strcmp(argv[1], "write") == 0) {
+        return writeChannel(std::strtoul(argv[2], nullptr, 10),
+                            std::strtoul(argv[3], nullptr, 10));
+    }
+    char path[PATH_MAX];
+    CHECK(realpath(argv[0], path));
+    g_self = path;
+
+    testCapture();
+    testOverflow();
+    testStream();
+    testWithoutChannel();
+    std::printf("shared_channel_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,192 @@
+// 合并执行测试：相同的命令只启动一次进程，每个请求得到结果和之后的输出块；
+// 不同的命令或环境不合并；部分请求取消不影响其他请求，全部取消时进程被终止
+// 用法: single_flight_test
+
+#include "zrun.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+const std::string kRuns = "/tmp/zrun_single_flight_test." + std::to_string(getpid());
+
+// 每次执行向 kRuns 追加一行
+std::string command(const std::string& name, double seconds) {
+    return "echo " + name + " >> " + kRuns + "; echo start; sleep " + std::to_string(seconds) +
+           "; echo " + name + "; echo err >&2";
+}
+
+int runCount() {
+    std::ifstream file(kRuns);
+    int count = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        ++count;
+    }
+    return count;
+}
+
+CommandOptions flightOptions() {
+    CommandOptions options(ShellType::Sh, 30000);
+    options.singleFlight = true;
+    return options;
+}
+
+// 一个请求收到的输出块和结果
+struct Request {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::string chunks;
+    bool done = false;
+    AsyncState state = AsyncState::Running;
+    CommandResult result;
+
+    void submit(ZRun& zrun, const std::string& text, const CommandOptions& options) {
+        int id = zrun.executeAsync(
+            text, options,
+            [this](std::string_view data, bool isError) {
+                if (!isError) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    chunks.append(data.data(), data.size());
+                }
+            },
+            [this](AsyncState value, CommandResult& completed) {
+                std::lock_guard<std::mutex> lock(mutex);
+                state = value;
+                result = completed;
+                done = true;
+                cv.notify_all();
+            });
+        CHECK(id > 0);
+    }
+
+    bool wait(int timeoutMs = 10000) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return done; });
+    }
+};
+
+void testMerged() {
+    std::remove(kRuns.c_str());
+    ZRun zrun;
+    const std::string text = command("merged", 0.4);
+    std::vector<Request> requests(6);
+    for (auto& request : requests) {
+        request.submit(zrun, text, flightOptions());
+    }
+    for (auto& request : requests) {
+        CHECK(request.wait());
+        CHECK(request.state == AsyncState::Completed);
+        CHECK(request.result.exitCode == 0);
+        CHECK(request.result.output == "start\nmerged\n");
+        CHECK(request.result.error == "err\n");
+        // 加入时进程可能已经输出了 start
+        CHECK(request.chunks == "start\nmerged\n" || request.chunks == "merged\n");
+    }
+    CHECK(runCount() == 1);
+    CHECK(zrun.metrics().singleFlightJoined == 5);
+
+    // 执行结束之后的相同请求重新执行
+    Request again;
+    again.submit(zrun, text, flightOptions());
+    CHECK(again.wait());
+    CHECK(runCount() == 2);
+}
+
+void testNotMerged() {
+    std::remove(kRuns.c_str());
+    ZRun zrun;
+    Request first, otherCommand, otherShell, unflagged, otherEnvironment;
+    first.submit(zrun, command("a", 0.3), flightOptions());
+    otherCommand.submit(zrun, command("b", 0.3), flightOptions());
+    CommandOptions bash = flightOptions();
+    bash.shellType = ShellType::Bash;
+    otherShell.submit(zrun, command("a", 0.3), bash);
+    unflagged.submit(zrun, command("a", 0.3), CommandOptions(ShellType::Sh, 30000));
+    zrun.setEnvironment("ZRUN_SINGLE_FLIGHT_TEST", "1");
+    otherEnvironment.submit(zrun, command("a", 0.3), flightOptions());
+    for (Request* request : {&first, &otherCommand, &otherShell, &unflagged, &otherEnvironment}) {
+        CHECK(request->wait());
+        CHECK(request->result.exitCode == 0);
+    }
+    CHECK(runCount() == 5);
+    CHECK(zrun.metrics().singleFlightJoined == 0);
+
+    // 不能合并的选项（分行回调）不合并
+    std::remove(kRuns.c_str());
+    CommandOptions lines = flightOptions();
+    lines.lineCallback = [](std::string_view, bool) {};
+    Request firstLines, secondLines;
+    firstLines.submit(zrun, command("c", 0.3), lines);
+    secondLines.submit(zrun, command("c", 0.3), lines);
+    CHECK(firstLines.wait() && secondLines.wait());
+    CHECK(runCount() == 2);
+}
+
+void testCancel() {
+    std::remove(kRuns.c_str());
+    ZRun zrun;
+    const std::string text = command("cancel", 0.4);
+    AsyncHandle cancelled = zrun.submit(text, flightOptions());
+    AsyncHandle kept = zrun.submit(text, flightOptions());
+    CHECK(cancelled.cancel());
+    CHECK(cancelled.state() == AsyncState::Cancelled);
+    CHECK(kept.waitFor(10000));
+    CHECK(kept.state() == AsyncState::Completed);
+    CHECK(kept.result().output == "start\ncancel\n");
+    CHECK(runCount() == 1);
+
+    // 所有请求都取消时合并被撤销，之后的相同请求重新执行
+    std::remove(kRuns.c_str());
+    const std::string slow = "echo slow >> " + kRuns + "; sleep 30";
+    auto waitRuns = [](int count) {
+        for (int i = 0; i < 500 && runCount() < count; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return runCount() == count;
+    };
+    std::vector<AsyncHandle> handles;
+    for (int i = 0; i < 3; ++i) {
+        handles.push_back(zrun.submit(slow, flightOptions()));
+    }
+    CHECK(waitRuns(1));
+    for (auto& handle : handles) {
+        CHECK(handle.cancel());
+    }
+    AsyncHandle fresh = zrun.submit(slow, flightOptions());
+    CHECK(waitRuns(2));
+    CHECK(fresh.state() == AsyncState::Running);
+    CHECK(fresh.cancel());
+    CHECK(zrun.metrics().singleFlightJoined == 3);
+    std::remove(kRuns.c_str());
+}
+
+} // namespace
+
+int main() {
+    testMerged();
+    testNotMerged();
+    testCancel();
+    std::printf("single_flight_test: ok\n");
+    return 0;
+}
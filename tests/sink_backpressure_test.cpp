@@ -0,0 +1,122 @@
+// 输出目标写满时的回归测试：读取很慢的管道作为 stdout 的去向时，
+// 输出不能丢失，事件循环也不能空转
+// 用法: sink_backpressure_test
+
+#include "zrun.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#endif
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+#ifndef _WIN32
+namespace {
+
+constexpr long long kOutputSize = 1024 * 1024;
+
+double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// 每次读取 4 KiB 后停顿，整个输出大约需要 1 秒才能读完
+long long readSlowly(int fd) {
+    char buffer[4096];
+    long long total = 0;
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        total += n;
+        std::this_thread::sleep_for(std::chrono::microseconds(4000));
+    }
+    return total;
+}
+
+void slowPipeSink(IoBackendType backend, bool alsoCapture) {
+    ZRun zrun;
+    zrun.setIoBackend(backend);
+
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    std::atomic<long long> received{0};
+    std::thread reader([&] { received = readSlowly(fds[0]); });
+
+    CommandOptions options(ShellType::Sh, 30000);
+    options.stdoutSink = OutputSink::toFd(fds[1], alsoCapture);
+    auto wallStart = std::chrono::steady_clock::now();
+    double cpuStart = cpuSeconds();
+    CommandResult result = zrun.executeSync("head -c " + std::to_string(kOutputSize) +
+                                            " /dev/zero", options);
+    double cpu = cpuSeconds() - cpuStart;
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                wallStart).count();
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+
+    std::printf("%s capture=%d: exit=%d outputBytes=%lld received=%lld wall=%.2fs cpu=%.2fs\n",
+                zrun.ioBackendName().c_str(), alsoCapture ? 1 : 0, result.exitCode,
+                result.outputBytes, received.load(), wall, cpu);
+    CHECK(result.exitCode == 0);
+    CHECK(result.outputBytes == kOutputSize);
+    CHECK(received.load() == kOutputSize);
+    CHECK(static_cast<long long>(result.output.size()) == (alsoCapture ? kOutputSize : 0));
+    // 等待目标可写期间不应占用 CPU
+    CHECK(cpu < wall / 2);
+}
+
+// 目标一直不被读取时，命令在超时后结束
+void stalledPipeSink() {
+    ZRun zrun;
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+
+    CommandOptions options(ShellType::Sh, 500);
+    options.stdoutSink = OutputSink::toFd(fds[1]);
+    auto start = std::chrono::steady_clock::now();
+    CommandResult result = zrun.executeSync("head -c " + std::to_string(kOutputSize) +
+                                            " /dev/zero", options);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                start).count();
+    close(fds[0]);
+    close(fds[1]);
+
+    std::printf("stalled: timedOut=%d wall=%.2fs\n", result.timedOut ? 1 : 0, wall);
+    CHECK(result.timedOut);
+    CHECK(wall < 5);
+}
+
+} // namespace
+#endif
+
+int main() {
+#ifndef _WIN32
+    for (IoBackendType backend : {IoBackendType::Epoll, IoBackendType::IoUring,
+                                  IoBackendType::Poll}) {
+        slowPipeSink(backend, false);
+        slowPipeSink(backend, true);
+    }
+    stalledPipeSink();
+#endif
+    std::printf("OK\n");
+    return 0;
+}
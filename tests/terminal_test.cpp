@@ -0,0 +1,124 @@
+// 伪终端模式测试：子进程的标准输入/输出/错误是终端、窗口大小、标准错误合并到输出、
+// 换行不转换为 \r\n、按行缓冲的工具立即输出、大量输出不丢失、超时终止
+// 用法: terminal_test
+
+#include "zrun.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace Zrun;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+CommandOptions terminalOptions(unsigned short columns = 80, unsigned short rows = 24) {
+    CommandOptions options(ShellType::Sh, 10000);
+    options.terminal.enabled = true;
+    options.terminal.columns = columns;
+    options.terminal.rows = rows;
+    return options;
+}
+
+long long elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start).count();
+}
+
+void testTerminal() {
+    ZRun zrun;
+    CommandResult result =
+        zrun.executeSync("test -t 0 && test -t 1 && test -t 2 && tty", terminalOptions());
+    CHECK(result.exitCode == 0);
+    CHECK(result.output.compare(0, 5, "/dev/") == 0);
+
+    // 管道模式下不是终端
+    result = zrun.executeSync("test -t 1", CommandOptions(ShellType::Sh, 10000));
+    CHECK(result.exitCode == 1);
+
+    result = zrun.executeSync("stty size", terminalOptions());
+    CHECK(result.output == "24 80\n");
+    result = zrun.executeSync("stty size", terminalOptions(132, 50));
+    CHECK(result.output == "50 132\n");
+}
+
+void testOutput() {
+    ZRun zrun;
+    CommandResult result =
+        zrun.executeSync("echo out; echo err >&2; printf 'a\\nb\\n'; exit 4", terminalOptions());
+    CHECK(result.exitCode == 4);
+    CHECK(result.output == "out\nerr\na\nb\n");
+    CHECK(result.error.empty());
+
+    // 子进程结束后主设备返回 EIO，之前的输出都已读出
+    const std::string command = "seq 1 50000";
+    CommandResult piped = zrun.executeSync(command, CommandOptions(ShellType::Sh, 10000));
+    for (int i = 0; i < 5; ++i) {
+        result = zrun.executeSync(command, terminalOptions());
+        CHECK(result.exitCode == 0);
+        CHECK(result.output.size() == piped.output.size());
+        CHECK(result.output == piped.output);
+    }
+}
+
+// sed 的输出是终端时按行缓冲，第一行在命令结束之前就交给分行回调
+void testLineBuffered() {
+    ZRun zrun;
+    std::mutex mutex;
+    std::vector<std::pair<std::string, long long>> lines;
+    auto start = std::chrono::steady_clock::now();
+    CommandOptions options = terminalOptions();
+    options.lineCallback = [&](std::string_view line, bool isError) {
+        CHECK(!isError);
+        std::lock_guard<std::mutex> lock(mutex);
+        lines.emplace_back(std::string(line), elapsedMs(start));
+    };
+    CommandResult result =
+        zrun.executeSync("(echo first; sleep 1; echo second) | sed 's/^/x/'", options);
+    CHECK(result.exitCode == 0);
+    CHECK(result.output == "xfirst\nxsecond\n");
+    std::lock_guard<std::mutex> lock(mutex);
+    CHECK(lines.size() == 2);
+    CHECK(lines[0].first == "xfirst" && lines[1].first == "xsecond");
+    CHECK(lines[0].second < 700);
+    CHECK(lines[1].second >= 900);
+}
+
+void testTimeout() {
+    ZRun zrun;
+    CommandOptions options = terminalOptions();
+    options.timeoutMs = 200;
+    auto start = std::chrono::steady_clock::now();
+    CommandResult result = zrun.executeSync("echo started; sleep 10", options);
+    CHECK(result.timedOut);
+    CHECK(result.output == "started\n");
+    CHECK(elapsedMs(start) < 5000);
+
+    // 异步命令同样支持
+    AsyncHandle handle = zrun.submit("echo async; echo err >&2", terminalOptions());
+    CHECK(handle.waitFor(10000));
+    CHECK(handle.state() == AsyncState::Completed);
+    CHECK(handle.result().output == "async\nerr\n");
+}
+
+} // namespace
+
+int main() {
+    testTerminal();
+    testOutput();
+    testLineBuffered();
+    testTimeout();
+    std::printf("terminal_test: ok\n");
+    return 0;
+}
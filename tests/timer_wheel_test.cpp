@@ -0,0 +1,182 @@
+// 时间轮测试：与按到期时间排序的参考模型比较到期顺序和 nextTimeoutMs，
+// 包括从各层边界之前开始、跨过边界的情况
+// 用法: timer_wheel_test [随机种子]
+
+#include "zrun_timer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace Zrun;
+using Clock = TimerWheel::Clock;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if (!(condition)) {                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                            \
+            std::exit(1);                                                        \
+        }                                                                        \
+    } while (0)
+
+namespace {
+
+constexpr uint64_t kLevelSpans[] = {64, 4096, 262144, 16777216};
+
+struct Timer {
+    TimerWheel::Node node;
+    // 参考模型中的到期时刻，0 表示未安排
+    uint64_t expires = 0;
+};
+
+// 从 startMs 开始运行一段随机操作，时间以毫秒计
+void run(uint64_t startMs, unsigned seed, int steps) {
+    const Clock::time_point origin = Clock::time_point() + std::chrono::hours(24);
+    auto at = [&](uint64_t ms) { return origin + std::chrono::milliseconds(ms); };
+
+    TimerWheel wheel(origin);
+    uint64_t now = startMs;
+    wheel.expire(at(now), [](TimerWheel::Node&) { CHECK(false); });
+
+    std::mt19937_64 random(seed);
+    std::vector<Timer> timers(256);
+    std::multimap<uint64_t, Timer*> model;
+    for (auto& timer : timers) {
+        timer.node.context = &timer;
+    }
+    auto unschedule = [&](Timer& timer) {
+        auto range = model.equal_range(timer.expires);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == &timer) {
+                model.erase(it);
+                break;
+            }
+        }
+        timer.expires = 0;
+    };
+    // 大多数定时器在几秒内到期，少数跨越高层或超出时间轮范围
+    auto randomDelay = [&]() -> uint64_t {
+        switch (random() % 8) {
+        case 0: return random() % 64;
+        case 1: return random() % 4096;
+        case 2: return random() % 262144;
+        case 3: return random() % (uint64_t(1) << 26);
+        default: return random() % 5000;
+        }
+    };
+
+    for (int step = 0; step < steps; ++step) {
+        Timer& timer = timers[random() % timers.size()];
+        unsigned op = random() % 10;
+        if (op < 4) {
+            if (timer.expires) {
+                unschedule(timer);
+            }
+            // 当前毫秒已经处理过，最早在下一毫秒到期
+            timer.expires = now + std::max<uint64_t>(randomDelay(), 1);
+            wheel.schedule(timer.node, at(timer.expires));
+            model.emplace(timer.expires, &timer);
+        } else if (op < 5) {
+            if (timer.expires) {
+                unschedule(timer);
+            }
+            wheel.cancel(timer.node);
+        } else {
+            // 推进到下一个到期时刻附近、任意一层的边界，或者随机的距离
+            uint64_t target;
+            unsigned how = random() % 4;
+            if (how == 0 && !model.empty()) {
+                target = model.begin()->first + random() % 3;
+            } else if (how == 1) {
+                // 最高层的边界相隔约 4.6 小时，逐槽推进过去较慢，少选一些
+                unsigned level = random() % 16 == 0 ? 3 : random() % 3;
+                uint64_t span = kLevelSpans[level];
+                target = (now / span + 1) * span - random() % 2;
+            } else {
+                target = now + random() % 3000;
+            }
+            if (target < now) {
+                target = now;
+            }
+
+            // 等待时长不能晚于最早的到期时刻
+            int timeout = wheel.nextTimeoutMs(at(now));
+            if (model.empty()) {
+                CHECK(timeout == -1);
+            } else {
+                CHECK(timeout >= 0);
+                uint64_t earliest = model.begin()->first;
+                if (earliest > now && now + static_cast<uint64_t>(timeout) > earliest) {
+                    std::fprintf(stderr, "now=%llu timeout=%d earliest=%llu\n",
+                                 static_cast<unsigned long long>(now), timeout,
+                                 static_cast<unsigned long long>(earliest));
+                    CHECK(false);
+                }
+            }
+
+            now = target;
+            std::vector<Timer*> fired;
+            wheel.expire(at(now), [&](TimerWheel::Node& node) {
+                fired.push_back(static_cast<Timer*>(node.context));
+            });
+            size_t due = 0;
+            for (auto it = model.begin(); it != model.end() && it->first <= now; ++it) {
+                ++due;
+            }
+            for (Timer* expired : fired) {
+                if (expired->expires == 0 || expired->expires > now) {
+                    std::fprintf(stderr, "fired early: expires=%llu now=%llu\n",
+                                 static_cast<unsigned long long>(expired->expires),
+                                 static_cast<unsigned long long>(now));
+                    CHECK(false);
+                }
+                unschedule(*expired);
+            }
+            CHECK(fired.size() == due);
+        }
+        CHECK(wheel.size() == model.size());
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 1;
+
+    // 最高层边界之前安排、跨过边界到期的定时器按时到期
+    {
+        const Clock::time_point origin = Clock::time_point() + std::chrono::hours(24);
+        TimerWheel wheel(origin);
+        uint64_t start = (uint64_t(1) << 24) - 100;
+        wheel.expire(origin + std::chrono::milliseconds(start), [](TimerWheel::Node&) {});
+        TimerWheel::Node node;
+        wheel.schedule(node, origin + std::chrono::milliseconds(start + 150));
+        int timeout = wheel.nextTimeoutMs(origin + std::chrono::milliseconds(start));
+        std::printf("boundary: nextTimeoutMs=%d\n", timeout);
+        CHECK(timeout >= 0 && timeout <= 150);
+        bool fired = false;
+        wheel.expire(origin + std::chrono::milliseconds(start + 149),
+                     [&](TimerWheel::Node&) { fired = true; });
+        CHECK(!fired);
+        wheel.expire(origin + std::chrono::milliseconds(start + 150),
+                     [&](TimerWheel::Node&) { fired = true; });
+        CHECK(fired);
+    }
+
+    // 从 0 和每层边界之前开始的随机操作
+    const uint64_t starts[] = {0, 64 - 3, 4096 - 50, 262144 - 100, (uint64_t(1) << 24) - 100,
+                               (uint64_t(1) << 25) - 7, (uint64_t(1) << 32) + 12345};
+    for (uint64_t start : starts) {
+        for (unsigned round = 0; round < 4; ++round) {
+            run(start, seed * 1000 + round, 10000);
+        }
+        std::printf("start=%llu ok\n", static_cast<unsigned long long>(start));
+    }
+    std::printf("OK\n");
+    return 0;
+}
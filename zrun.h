@@ -33,7 +33,8 @@ typedef enum {
     ZRUN_ASYNC_COMPLETED = 1,
     ZRUN_ASYNC_FAILED = 2,
     ZRUN_ASYNC_TIMED_OUT = 3,
-    ZRUN_ASYNC_CANCELLED = 4
+    ZRUN_ASYNC_CANCELLED = 4,
+    ZRUN_ASYNC_RESOURCE_EXCEEDED = 5
 } zrun_async_state;
 
 typedef struct {
@@ -44,8 +45,72 @@ typedef struct {
     int timed_out;
 } zrun_command_result;
 
+// 结果视图：指向 Zrun 持有的缓冲区，带长度，可包含二进制数据和 NUL。
+// output/error 末尾另有一个 NUL，可直接当作 C 字符串使用
+typedef struct {
+    int exit_code;
+    const char* output;
+    int64_t output_length;
+    const char* error;
+    int64_t error_length;
+    int64_t execution_time;
+    int timed_out;
+} zrun_result_view;
+
+// CPU/NUMA 放置方式 (仅 Linux)
+typedef enum {
+    ZRUN_PLACEMENT_INHERIT = 0,           // 不修改
+    ZRUN_PLACEMENT_CPUS = 1,              // 绑定到列出的 CPU
+    ZRUN_PLACEMENT_NUMA_NODE = 2,         // 绑定到 numa_node 的 CPU，优先在该节点分配内存
+    ZRUN_PLACEMENT_ROUND_ROBIN_CORE = 3,  // 每条命令依次绑定到一个 CPU（列表为空时按节点交错）
+    ZRUN_PLACEMENT_ROUND_ROBIN_NODE = 4   // 每条命令依次绑定到一个 NUMA 节点
+} zrun_placement_mode;
+
 typedef void (*zrun_output_callback)(const char* output, int is_error, void* user_data);
 
+// 运行统计
+typedef struct {
+    int64_t commands_completed;
+    // 压缩保存的捕获输出：原始字节数和压缩后的字节数
+    int64_t compressed_raw_bytes;
+    int64_t compressed_bytes;
+    double compression_ratio;
+    // 准入调度
+    int64_t commands_running;
+    int64_t commands_queued;
+    int64_t admitted_immediately;
+    int64_t admitted_from_queue;
+    int64_t queue_timeouts;
+    int64_t queue_cancellations;
+    int64_t total_queue_wait_ms;
+    int64_t max_queue_wait_ms;
+} zrun_metrics;
+
+// 完成队列事件类型
+typedef enum {
+    ZRUN_CQ_COMPLETION = 0,     // 命令结束
+    ZRUN_CQ_OUTPUT = 1          // 一块输出（需要 ZRUN_CQ_STREAM_OUTPUT）
+} zrun_cq_event_type;
+
+// zrun_execute_async_cq 的标志
+#define ZRUN_CQ_STREAM_OUTPUT 0x1   // 运行期间把输出块投递到队列
+#define ZRUN_CQ_TERMINAL 0x2        // 在伪终端中执行，标准错误合并到输出（仅 Unix）
+
+// 完成队列事件。data 与 result 指向队列持有的内存，
+// 在下一次对同一队列调用 zrun_cq_next 或 zrun_cq_destroy 之前有效
+typedef struct {
+    zrun_cq_event_type type;
+    int async_id;
+    void* user_data;
+    // ZRUN_CQ_OUTPUT
+    int is_error;
+    const char* data;
+    int64_t data_length;
+    // ZRUN_CQ_COMPLETION
+    zrun_async_state state;
+    zrun_result_view result;
+} zrun_cq_event;
+
 // 创建和销毁实例
 ZRUN_API void* zrun_create(void);
 ZRUN_API void zrun_destroy(void* instance);
@@ -59,20 +124,85 @@ ZRUN_API int zrun_execute_async(void* instance, const char* command,
                                 zrun_shell_type shell_type, int timeout_ms,
                                 zrun_output_callback callback, void* user_data);
 
+// 预先准备的命令：不经过 shell，可执行文件只按 PATH 查找一次（PATH 改变时重新查找）。
+// args 中的 {name} 在执行时替换为参数值；失败返回 NULL，用 zrun_prepared_free 释放
+ZRUN_API void* zrun_prepare(const char* program, const char* const* args, int arg_count);
+ZRUN_API void zrun_prepared_free(void* prepared);
+// 执行预先准备的命令，names/values 为 param_count 个参数（可为 NULL）
+ZRUN_API zrun_command_result zrun_execute_prepared(void* instance, void* prepared,
+                                                   const char* const* names,
+                                                   const char* const* values,
+                                                   int param_count, int timeout_ms);
+
+// zrun_parallel_map 的标志
+#define ZRUN_MAP_ORDERED 0x1            // 按输入顺序回调
+#define ZRUN_MAP_STOP_ON_FAILURE 0x2    // 第一条命令失败后停止启动并终止其余命令
+
+// 并行映射的结果回调，在调用 zrun_parallel_map 的线程中执行；result 只在回调期间有效
+typedef void (*zrun_map_callback)(int index, const zrun_result_view* result, void* user_data);
+
+// 对每个输入执行一次预先准备的命令（{input} 为输入，{index} 为下标），最多同时执行
+// concurrency 条（<= 0 表示 CPU 数）。阻塞到全部结束，返回失败的命令数，参数无效返回 -1
+ZRUN_API int zrun_parallel_map(void* instance, void* prepared, const char* const* inputs,
+                               int input_count, int concurrency, int timeout_ms, int flags,
+                               zrun_map_callback callback, void* user_data);
+
 // 异步命令管理
 ZRUN_API zrun_async_state zrun_get_async_status(void* instance, int async_id);
 ZRUN_API int zrun_get_async_result(void* instance, int async_id, zrun_command_result* result);
 ZRUN_API int zrun_terminate_async(void* instance, int async_id);
 
+// 完成队列：适合接入外部事件循环，每批事件只唤醒一次
+ZRUN_API void* zrun_cq_create(void);
+// 销毁队列；仍在运行、投递到该队列的命令的事件将被丢弃
+ZRUN_API void zrun_cq_destroy(void* cq);
+// 取出最多 max_events 个事件；timeout_ms < 0 无限等待，0 不等待。返回事件数，出错返回 -1
+ZRUN_API int zrun_cq_next(void* cq, zrun_cq_event* events, int max_events, int timeout_ms);
+// 队列非空时可读的 fd，可加入 poll/epoll（仅 Unix，否则返回 -1）
+ZRUN_API int zrun_cq_fd(void* cq);
+// 队列非空时有信号的事件句柄（仅 Windows，否则返回 NULL）
+ZRUN_API void* zrun_cq_event_handle(void* cq);
+
+// 异步执行命令，结果（以及可选的输出块）投递到完成队列；返回异步 id，失败返回 -1。
+// 命令结束后不能再用 zrun_get_async_result 获取结果
+ZRUN_API int zrun_execute_async_cq(void* instance, const char* command,
+                                   zrun_shell_type shell_type, int timeout_ms,
+                                   void* cq, int flags, void* user_data);
+
 // 配置
 ZRUN_API void zrun_set_working_directory(void* instance, const char* directory);
 ZRUN_API void zrun_set_environment(void* instance, const char* key, const char* value);
 ZRUN_API void zrun_set_execution_policy(void* instance, const char* policy);
 ZRUN_API void zrun_clear_environment(void* instance);
+// 异步命令的最大并发数，超出的命令排队等待；0 表示不限制
+ZRUN_API void zrun_set_max_concurrency(void* instance, int limit);
+// 之后启动的命令的默认 CPU 放置；cpus 可为 NULL。成功返回 0
+ZRUN_API int zrun_set_default_placement(void* instance, zrun_placement_mode mode,
+                                        const int* cpus, int cpu_count, int numa_node);
+
+// 启用执行日志（仅 Unix），恢复上一个实例的异步命令；sync_interval_ms 为批量 fsync 的间隔，
+// 0 表示每条记录立即 fsync。成功返回 0
+ZRUN_API int zrun_enable_journal(void* instance, const char* path, int sync_interval_ms);
+
+// 客户端模式：连接 zrund 守护进程（仅 Unix），socket_path 为 NULL 时使用默认路径。
+// 之后能够转发的命令由守护进程执行。成功返回 0
+ZRUN_API int zrun_connect_daemon(void* instance, const char* socket_path);
+
+// 获取运行统计，成功返回 0
+ZRUN_API int zrun_get_metrics(void* instance, zrun_metrics* metrics);
 
 // 资源清理
 ZRUN_API void zrun_free_result(zrun_command_result result);
 
+// 结果句柄：输出从内部结果中移出而不拷贝，view 指向句柄持有的缓冲区，
+// 用 zrun_release_result 一次释放。失败时返回 NULL
+ZRUN_API void* zrun_execute_sync_view(void* instance, const char* command,
+                                      zrun_shell_type shell_type, int timeout_ms,
+                                      zrun_result_view* view);
+// 等待异步命令结束并取走结果，之后该 id 不再可用
+ZRUN_API void* zrun_take_async_result(void* instance, int async_id, zrun_result_view* view);
+ZRUN_API void zrun_release_result(void* result_handle);
+
 #ifdef __cplusplus
 }
 #endif
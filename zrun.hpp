@@ -2,11 +2,68 @@
 #define ZRUN_CPP_H
 
 #include "zrun_types.h"
+#include "zrun_prepared.h"
+#include "zrun_channel.h"
 #include <memory>
 #include <map>
+#include <vector>
 
 namespace Zrun {
 
+struct AsyncOperation;
+
+// 异步命令句柄（类似 std::future，只能移动）。直接引用命令本身，
+// 查询和等待都不经过按 id 查找的异步表
+class AsyncHandle {
+public:
+    using Continuation = std::function<void(AsyncState state, const CommandResult& result)>;
+
+    AsyncHandle() = default;
+    explicit AsyncHandle(std::shared_ptr<AsyncOperation> operation);
+
+    AsyncHandle(AsyncHandle&&) noexcept = default;
+    AsyncHandle& operator=(AsyncHandle&&) noexcept = default;
+    AsyncHandle(const AsyncHandle&) = delete;
+    AsyncHandle& operator=(const AsyncHandle&) = delete;
+
+    bool valid() const { return m_operation != nullptr; }
+    int id() const;
+    AsyncState state() const;
+    bool ready() const { return state() != AsyncState::Running; }
+
+    // 等待命令结束
+    void wait() const;
+
+    // 最多等待 timeoutMs 毫秒，结束时返回 true
+    bool waitFor(int timeoutMs) const;
+
+    // 等待结束并返回结果（取消的命令结果为空）
+    const CommandResult& result() const;
+
+    // 终止命令，已经结束时返回 false
+    bool cancel();
+
+    // 命令结束后调用 continuation：已经结束时在当前线程立即调用，
+    // 否则在完成命令的线程（Unix 上为事件循环线程）中调用
+    AsyncHandle& then(Continuation continuation);
+
+private:
+    friend int whenAny(std::vector<AsyncHandle>& handles, int timeoutMs);
+
+    std::shared_ptr<AsyncOperation> m_operation;
+};
+
+// 等待所有命令结束；timeoutMs < 0 表示无限等待，超时返回 false
+bool whenAll(std::vector<AsyncHandle>& handles, int timeoutMs = -1);
+
+// 等待任意一条命令结束，返回其下标；超时或没有有效句柄时返回 -1
+int whenAny(std::vector<AsyncHandle>& handles, int timeoutMs = -1);
+
+#ifdef __cpp_impl_coroutine
+class RunAwaitable;
+class OutputStream;
+#endif
+
 class ZRun {
 public:
     ZRun();
@@ -20,12 +77,50 @@ public:
     CommandResult executeSync(const std::string& command,
                               ShellType shellType = ShellType::PowerShell,
                               int timeoutMs = 30000);
+    CommandResult executeSync(const std::string& command, const CommandOptions& options);
 
     // 异步执行命令
     int executeAsync(const std::string& command,
                      ShellType shellType = ShellType::PowerShell,
                      int timeoutMs = 30000,
                      OutputCallback callback = nullptr);
+    int executeAsync(const std::string& command, const CommandOptions& options,
+                     OutputCallback callback = nullptr);
+
+    // 执行预先准备的命令：不经过 shell，可执行文件的查找结果和环境变量列表被复用，
+    // 每次只替换参数模板中的 {name} 并启动进程。options 中的 shellType 不起作用
+    CommandResult executeSync(const PreparedCommand& command,
+                              const CommandParameters& parameters = CommandParameters(),
+                              const CommandOptions& options = CommandOptions());
+    int executeAsync(const PreparedCommand& command, const CommandParameters& parameters,
+                     const CommandOptions& options, OutputCallback callback = nullptr);
+
+    // 并行映射（类似 xargs -P）：对每个输入执行一次 command，参数 {input} 替换为输入，
+    // {index} 替换为下标。最多同时执行 options.concurrency 条，结果按 options.ordered
+    // 指定的顺序在当前线程中交给 callback；阻塞到全部结束，返回统计。
+    // 需要 shell 时可以写成 PreparedCommand("sh", {"-c", "gzip -k \"$1\"", "sh", "{input}"})
+    ParallelMapSummary parallelMap(const PreparedCommand& command,
+                                   const std::vector<std::string>& inputs,
+                                   const ParallelMapOptions& options = ParallelMapOptions(),
+                                   ParallelResultCallback callback = nullptr);
+
+    // 流式异步执行：输出按块转发给 chunkCallback（可为空），结束时调用 completionCallback。
+    // 回调在 Zrun 的事件循环线程中执行；命令结束后不能再用 id 查询结果
+    int executeAsync(const std::string& command, const CommandOptions& options,
+                     ChunkCallback chunkCallback, CompletionCallback completionCallback);
+
+#ifdef __cpp_impl_coroutine
+    // 协程接口，定义在 zrun_coro.hpp 中：
+    // co_await run(...) 得到结果，stream(...) 逐块 co_await 输出
+    inline RunAwaitable run(const std::string& command,
+                            const CommandOptions& options = CommandOptions());
+    inline OutputStream stream(const std::string& command,
+                               const CommandOptions& options = CommandOptions());
+#endif
+
+    // 异步执行命令并返回句柄；命令不登记到按 id 查询的异步表中，只能通过句柄查询和取消
+    AsyncHandle submit(const std::string& command, const CommandOptions& options,
+                       OutputCallback callback = nullptr);
 
     // 获取异步命令状态
     AsyncState getAsyncStatus(int asyncId);
@@ -49,6 +144,43 @@ public:
     // 清除所有环境变量设置
     void clearEnvironment();
 
+    // 选择 I/O 后端 (仅 Unix)：Default 在 Linux 上为 epoll，IoUring 不可用时自动回退
+    void setIoBackend(IoBackendType type);
+
+    // 当前使用的 I/O 后端名称 ("epoll"、"io_uring"、"poll")
+    std::string ioBackendName();
+
+    // 异步命令的准入调度：全局最大并发数 (0 表示不限制)，
+    // 以及每个 tag 的最大并发数和公平分配的权重
+    void setMaxConcurrency(int limit);
+    void setTagPolicy(const std::string& tag, int maxConcurrency, int weight = 1);
+
+    // 默认的 CPU/NUMA 放置 (仅 Linux)，作用于 CommandOptions::placement 为 Inherit 的命令。
+    // 例如 CpuPlacement::roundRobinCores() 把批量提交的命令依次分散到各节点的 CPU 上
+    void setDefaultPlacement(const CpuPlacement& placement);
+
+    // 启用结果缓存：设置了 CommandOptions::cache 的同步命令在键（命令、shell、工作目录、
+    // 环境变量和依赖文件列表）相同且未过期时直接返回上次的结果。
+    // 设置了 persistPath 但文件无法使用时返回 false，此时只在内存中缓存
+    bool enableResultCache(const ResultCacheConfig& config = ResultCacheConfig());
+    void disableResultCache();
+
+    // 启用执行日志（仅 Unix）：executeAsync 返回的命令的提交、进程和结果记录在 config.path 中，
+    // 批量 fsync。进程崩溃或重启后，新实例用同一个文件启用时可以继续按原来的 id 查询结果；
+    // 仍在运行的进程被接管（结束后只能得到退出码 -1）或按 config.killOrphans 终止。
+    // 应当在提交命令之前调用，文件无法使用时返回 false
+    bool enableJournal(const JournalConfig& config, std::string* error = nullptr);
+
+    // 客户端模式（仅 Unix）：连接本机的 zrund 守护进程（socketPath 为空时使用默认路径），
+    // 之后的 shell 命令由守护进程执行，省去每个进程各自的事件循环和线程。
+    // 捕获的输出经由管道、写入 fd 或文件的输出以 fd 的形式交给守护进程，不经过套接字。
+    // 带有分行回调、过滤器、压缩、资源限制、CPU 放置、缓存、合并、重试/对冲或共享内存通道的命令，
+    // PreparedCommand，以及连接断开之后的命令仍在本地执行。应当在提交命令之前调用
+    bool connectDaemon(const std::string& socketPath = std::string(), std::string* error = nullptr);
+
+    // 运行统计，包括压缩保存的输出的压缩比和准入调度情况
+    Metrics metrics() const;
+
 private:
     class Impl;
     std::unique_ptr<Impl> m_impl;
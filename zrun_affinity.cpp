@@ -0,0 +1,247 @@
+#include "zrun_affinity.h"
+
+#ifndef _WIN32
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/syscall.h>
+#endif
+
+namespace Zrun {
+
+namespace {
+#ifdef __linux__
+constexpr int kMaxCpus = 4096;
+constexpr size_t kBitsPerWord = sizeof(unsigned long) * 8;
+
+void setBit(std::vector<unsigned long>& mask, int bit) {
+    size_t word = static_cast<size_t>(bit) / kBitsPerWord;
+    if (mask.size() <= word) {
+        mask.resize(word + 1, 0);
+    }
+    mask[word] |= 1UL << (static_cast<size_t>(bit) % kBitsPerWord);
+}
+
+std::string readFile(const std::string& path) {
+    std::string content;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return content;
+    }
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        content.append(buffer, static_cast<size_t>(count));
+    }
+    close(fd);
+    return content;
+}
+
+// 解析 "0-3,8,10-11" 格式的 CPU 列表
+std::vector<int> parseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    const char* cursor = text.c_str();
+    while (*cursor) {
+        char* end = nullptr;
+        long first = std::strtol(cursor, &end, 10);
+        if (end == cursor) {
+            break;
+        }
+        long last = first;
+        cursor = end;
+        if (*cursor == '-') {
+            last = std::strtol(cursor + 1, &end, 10);
+            cursor = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < kMaxCpus; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        if (*cursor == ',') {
+            ++cursor;
+        } else {
+            break;
+        }
+    }
+    return cpus;
+}
+
+bool validCpus(const std::vector<int>& cpus, std::string& error) {
+    if (cpus.empty()) {
+        error = "Invalid CPU placement: no CPUs available";
+        return false;
+    }
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= kMaxCpus) {
+            error = "Invalid CPU placement: CPU " + std::to_string(cpu) + " out of range";
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+}
+
+CpuPlacer::Topology::Topology() {
+#ifdef __linux__
+    std::vector<unsigned long> mask(kMaxCpus / kBitsPerWord, 0);
+    long bytes = syscall(SYS_sched_getaffinity, 0, mask.size() * sizeof(unsigned long),
+                         mask.data());
+    for (long bit = 0; bytes > 0 && bit < bytes * 8; ++bit) {
+        if (mask[bit / kBitsPerWord] & (1UL << (bit % kBitsPerWord))) {
+            available.push_back(static_cast<int>(bit));
+        }
+    }
+
+    if (DIR* directory = opendir("/sys/devices/system/node")) {
+        while (struct dirent* entry = readdir(directory)) {
+            int node;
+            char trailing;
+            if (std::sscanf(entry->d_name, "node%d%c", &node, &trailing) != 1 || node < 0) {
+                continue;
+            }
+            std::vector<int> cpus = parseCpuList(readFile(
+                "/sys/devices/system/node/" + std::string(entry->d_name) + "/cpulist"));
+            if (nodes.size() <= static_cast<size_t>(node)) {
+                nodes.resize(static_cast<size_t>(node) + 1);
+            }
+            for (int cpu : cpus) {
+                if (std::find(available.begin(), available.end(), cpu) != available.end()) {
+                    nodes[static_cast<size_t>(node)].push_back(cpu);
+                }
+            }
+        }
+        closedir(directory);
+    }
+#endif
+    if (available.empty()) {
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < std::max(count, 1L); ++cpu) {
+            available.push_back(static_cast<int>(cpu));
+        }
+    }
+    if (nodeCount() == 0) {
+        nodes.assign(1, available);
+    }
+
+    for (size_t node = 0; node < nodes.size(); ++node) {
+        std::sort(nodes[node].begin(), nodes[node].end());
+        for (int cpu : nodes[node]) {
+            if (nodeOf.size() <= static_cast<size_t>(cpu)) {
+                nodeOf.resize(static_cast<size_t>(cpu) + 1, -1);
+            }
+            nodeOf[static_cast<size_t>(cpu)] = static_cast<int>(node);
+        }
+    }
+
+    // 依次从每个节点取一个 CPU
+    for (size_t round = 0; interleaved.size() < available.size(); ++round) {
+        bool any = false;
+        for (const auto& cpus : nodes) {
+            if (round < cpus.size()) {
+                interleaved.push_back(cpus[round]);
+                any = true;
+            }
+        }
+        if (!any) {
+            break;
+        }
+    }
+}
+
+int CpuPlacer::Topology::nodeCount() const {
+    return static_cast<int>(std::count_if(nodes.begin(), nodes.end(),
+                                          [](const std::vector<int>& cpus) {
+                                              return !cpus.empty();
+                                          }));
+}
+
+const CpuPlacer::Topology& CpuPlacer::topology() {
+    static const Topology topology;
+    return topology;
+}
+
+void CpuPlacer::setDefault(const CpuPlacement& placement) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_default = placement;
+}
+
+bool CpuPlacer::resolve(const CpuPlacement& requested, SpawnPlacement& out,
+                        std::string& error) {
+    out = SpawnPlacement();
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const CpuPlacement& placement = requested.active() ? requested : m_default;
+    if (!placement.active()) {
+        return true;
+    }
+
+    const Topology& topo = topology();
+    std::vector<int> cpus;
+    int memoryNode = -1;
+    switch (placement.mode) {
+    case CpuPlacement::Mode::Cpus:
+        cpus = placement.cpus;
+        break;
+    case CpuPlacement::Mode::NumaNode:
+        if (placement.numaNode < 0 || placement.numaNode >= static_cast<int>(topo.nodes.size()) ||
+            topo.nodes[static_cast<size_t>(placement.numaNode)].empty()) {
+            error = "Invalid CPU placement: NUMA node " + std::to_string(placement.numaNode) +
+                    " has no available CPUs";
+            return false;
+        }
+        cpus = topo.nodes[static_cast<size_t>(placement.numaNode)];
+        memoryNode = placement.numaNode;
+        break;
+    case CpuPlacement::Mode::RoundRobinCore: {
+        const std::vector<int>& candidates =
+            placement.cpus.empty() ? topo.interleaved : placement.cpus;
+        if (!validCpus(candidates, error)) {
+            return false;
+        }
+        int cpu = candidates[m_nextCore++ % candidates.size()];
+        cpus.push_back(cpu);
+        if (static_cast<size_t>(cpu) < topo.nodeOf.size()) {
+            memoryNode = topo.nodeOf[static_cast<size_t>(cpu)];
+        }
+        break;
+    }
+    case CpuPlacement::Mode::RoundRobinNode: {
+        std::vector<int> candidates;
+        for (size_t node = 0; node < topo.nodes.size(); ++node) {
+            if (!topo.nodes[node].empty()) {
+                candidates.push_back(static_cast<int>(node));
+            }
+        }
+        memoryNode = candidates[m_nextNode++ % candidates.size()];
+        cpus = topo.nodes[static_cast<size_t>(memoryNode)];
+        break;
+    }
+    default:
+        return true;
+    }
+
+    if (!validCpus(cpus, error)) {
+        return false;
+    }
+    for (int cpu : cpus) {
+        setBit(out.cpuMask, cpu);
+    }
+    // 只有一个节点时内存策略没有意义
+    if (memoryNode >= 0 && topo.nodeCount() > 1) {
+        setBit(out.memoryNodes, memoryNode);
+        out.strictMemory = placement.strictMemory;
+    }
+#else
+    (void)requested;
+    (void)error;
+#endif
+    return true;
+}
+
+} // namespace Zrun
+
+#endif // _WIN32
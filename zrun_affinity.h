@@ -0,0 +1,52 @@
+#ifndef ZRUN_AFFINITY_H
+#define ZRUN_AFFINITY_H
+
+#include "zrun_types.h"
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include "zrun_spawn.h"
+
+namespace Zrun {
+
+// 把 CpuPlacement 解析为具体的 CPU 和内存节点掩码，并维护轮转位置。
+// CPU 拓扑（可用 CPU 和各 NUMA 节点的 CPU）在第一次使用时从 /sys 读取
+class CpuPlacer {
+public:
+    // 没有单独指定放置的命令使用的默认值
+    void setDefault(const CpuPlacement& placement);
+
+    // 解析一条命令的放置，Inherit 时 out 为空。放置无效时返回 false 并设置 error
+    bool resolve(const CpuPlacement& placement, SpawnPlacement& out, std::string& error);
+
+private:
+    struct Topology {
+        // 当前进程允许使用的 CPU
+        std::vector<int> available;
+        // 每个节点上可用的 CPU，下标为节点编号（没有 CPU 的节点为空）
+        std::vector<std::vector<int>> nodes;
+        // 每个 CPU 所在的节点
+        std::vector<int> nodeOf;
+        // 按节点交错排列的可用 CPU，轮转时相邻的命令落在不同节点
+        std::vector<int> interleaved;
+
+        Topology();
+        int nodeCount() const;
+    };
+
+    static const Topology& topology();
+
+    std::mutex m_mutex;
+    CpuPlacement m_default;
+    size_t m_nextCore = 0;
+    size_t m_nextNode = 0;
+};
+
+} // namespace Zrun
+
+#endif // _WIN32
+
+#endif // ZRUN_AFFINITY_H
@@ -1,6 +1,10 @@
 #include "zrun.h"
 #include "zrun_core.h"
+#include "zrun_cq.h"
+#include <cstring>
+#include <memory>
 #include <string>
+#include <vector>
 
 // 确保在编译 DLL 时正确导出函数
 #if defined(_WIN32) && defined(ZRUN_BUILD_DLL)
@@ -14,6 +18,18 @@ struct ZRunInstance {
     Zrun::CoreImpl impl;
 };
 
+// 预先准备的命令包装器
+struct ZRunPrepared {
+    Zrun::PreparedCommand command;
+};
+
+// 完成队列包装器：命令回调持有队列的共享引用，用户销毁后不再投递事件
+struct ZRunCompletionQueue {
+    std::shared_ptr<Zrun::CompletionQueue> queue = std::make_shared<Zrun::CompletionQueue>();
+    // 最近一次 zrun_cq_next 取出的事件，C 端的指针指向这里
+    std::vector<Zrun::CompletionQueue::Event> delivered;
+};
+
 // 辅助函数：将C字符串转换为std::string
 static std::string toStdString(const char* str) {
     return str ? std::string(str) : std::string();
@@ -22,10 +38,15 @@ static std::string toStdString(const char* str) {
 // 辅助函数：将std::string转换为C字符串（需要调用者释放）
 static char* toCString(const std::string& str) {
     char* cstr = new char[str.size() + 1];
-    std::strcpy(cstr, str.c_str());
+    std::memcpy(cstr, str.c_str(), str.size() + 1);
     return cstr;
 }
 
+// 结果句柄：持有从 CommandResult 移出的缓冲区
+struct ZRunResultHandle {
+    Zrun::CommandResult result;
+};
+
 // 辅助函数：将CommandResult转换为zrun_command_result
 static zrun_command_result toCResult(const Zrun::CommandResult& result) {
     zrun_command_result cresult;
@@ -37,6 +58,28 @@ static zrun_command_result toCResult(const Zrun::CommandResult& result) {
     return cresult;
 }
 
+// 辅助函数：构造指向 result 内部数据的视图（不分配内存）
+static zrun_result_view toResultView(const Zrun::CommandResult& result) {
+    zrun_result_view view;
+    view.exit_code = result.exitCode;
+    view.output = result.output.c_str();
+    view.output_length = static_cast<int64_t>(result.output.size());
+    view.error = result.error.c_str();
+    view.error_length = static_cast<int64_t>(result.error.size());
+    view.execution_time = result.executionTime;
+    view.timed_out = result.timedOut ? 1 : 0;
+    return view;
+}
+
+// 辅助函数：把结果移入新句柄并填写视图
+static void* toResultHandle(Zrun::CommandResult&& result, zrun_result_view* view) {
+    ZRunResultHandle* handle = new ZRunResultHandle{std::move(result)};
+    if (view) {
+        *view = toResultView(handle->result);
+    }
+    return handle;
+}
+
 // 辅助函数：将zrun_shell_type转换为Zrun::ShellType
 static Zrun::ShellType toCppShellType(zrun_shell_type shell_type) {
     switch (shell_type) {
@@ -56,6 +99,7 @@ static zrun_async_state toCAsyncState(Zrun::AsyncState state) {
     case Zrun::AsyncState::Failed: return ZRUN_ASYNC_FAILED;
     case Zrun::AsyncState::TimedOut: return ZRUN_ASYNC_TIMED_OUT;
     case Zrun::AsyncState::Cancelled: return ZRUN_ASYNC_CANCELLED;
+    case Zrun::AsyncState::ResourceExceeded: return ZRUN_ASYNC_RESOURCE_EXCEEDED;
     default: return ZRUN_ASYNC_FAILED;
     }
 }
@@ -139,6 +183,93 @@ ZRUN_API int zrun_execute_async(void* instance, const char* command,
     }
 }
 
+ZRUN_API void* zrun_prepare(const char* program, const char* const* args, int arg_count) {
+    if (!program || arg_count < 0 || (arg_count > 0 && !args)) {
+        return nullptr;
+    }
+    try {
+        std::vector<std::string> arguments;
+        arguments.reserve(arg_count);
+        for (int i = 0; i < arg_count; ++i) {
+            arguments.push_back(toStdString(args[i]));
+        }
+        return new ZRunPrepared{Zrun::PreparedCommand(program, std::move(arguments))};
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+ZRUN_API void zrun_prepared_free(void* prepared) {
+    delete static_cast<ZRunPrepared*>(prepared);
+}
+
+ZRUN_API zrun_command_result zrun_execute_prepared(void* instance, void* prepared,
+                                                   const char* const* names,
+                                                   const char* const* values,
+                                                   int param_count, int timeout_ms) {
+    zrun_command_result failure;
+    failure.exit_code = -1;
+    failure.execution_time = 0;
+    failure.timed_out = 0;
+    if (!instance || !prepared || param_count < 0 ||
+        (param_count > 0 && (!names || !values))) {
+        failure.output = toCString("");
+        failure.error = toCString("Invalid arguments");
+        return failure;
+    }
+
+    try {
+        Zrun::CommandParameters parameters;
+        for (int i = 0; i < param_count; ++i) {
+            parameters[toStdString(names[i])] = toStdString(values[i]);
+        }
+        Zrun::CommandOptions options;
+        options.timeoutMs = timeout_ms;
+        ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+        return toCResult(zrun->impl.executeSync(static_cast<ZRunPrepared*>(prepared)->command,
+                                                parameters, options));
+    } catch (const std::exception& e) {
+        failure.output = toCString("");
+        failure.error = toCString(std::string("Exception: ") + e.what());
+        return failure;
+    }
+}
+
+ZRUN_API int zrun_parallel_map(void* instance, void* prepared, const char* const* inputs,
+                               int input_count, int concurrency, int timeout_ms, int flags,
+                               zrun_map_callback callback, void* user_data) {
+    if (!instance || !prepared || input_count < 0 || (input_count > 0 && !inputs)) {
+        return -1;
+    }
+
+    try {
+        std::vector<std::string> values;
+        values.reserve(input_count);
+        for (int i = 0; i < input_count; ++i) {
+            values.push_back(toStdString(inputs[i]));
+        }
+        Zrun::ParallelMapOptions options;
+        options.concurrency = concurrency;
+        options.ordered = (flags & ZRUN_MAP_ORDERED) != 0;
+        options.stopOnFailure = (flags & ZRUN_MAP_STOP_ON_FAILURE) != 0;
+        options.command.timeoutMs = timeout_ms;
+
+        Zrun::ParallelResultCallback resultCallback;
+        if (callback) {
+            resultCallback = [callback, user_data](size_t index, Zrun::CommandResult& result) {
+                zrun_result_view view = toResultView(result);
+                callback(static_cast<int>(index), &view, user_data);
+            };
+        }
+        ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+        Zrun::ParallelMapSummary summary = zrun->impl.parallelMap(
+            static_cast<ZRunPrepared*>(prepared)->command, values, options, resultCallback);
+        return static_cast<int>(summary.failed);
+    } catch (...) {
+        return -1;
+    }
+}
+
 ZRUN_API zrun_async_state zrun_get_async_status(void* instance, int async_id) {
     if (!instance) {
         return ZRUN_ASYNC_FAILED;
@@ -186,6 +317,114 @@ ZRUN_API int zrun_terminate_async(void* instance, int async_id) {
     }
 }
 
+ZRUN_API void* zrun_cq_create(void) {
+    try {
+        return new ZRunCompletionQueue();
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+ZRUN_API void zrun_cq_destroy(void* cq) {
+    if (cq) {
+        ZRunCompletionQueue* queue = static_cast<ZRunCompletionQueue*>(cq);
+        queue->queue->shutdown();
+        delete queue;
+    }
+}
+
+ZRUN_API int zrun_cq_next(void* cq, zrun_cq_event* events, int max_events, int timeout_ms) {
+    if (!cq || !events || max_events <= 0) {
+        return -1;
+    }
+
+    try {
+        ZRunCompletionQueue* queue = static_cast<ZRunCompletionQueue*>(cq);
+        queue->delivered.clear();
+        size_t count = queue->queue->next(queue->delivered, static_cast<size_t>(max_events),
+                                          timeout_ms);
+
+        for (size_t i = 0; i < count; ++i) {
+            auto& event = queue->delivered[i];
+            zrun_cq_event& cevent = events[i];
+            std::memset(&cevent, 0, sizeof(cevent));
+            cevent.async_id = event.asyncId;
+            cevent.user_data = event.userData;
+            if (event.type == Zrun::CompletionQueue::Event::Type::Output) {
+                cevent.type = ZRUN_CQ_OUTPUT;
+                cevent.is_error = event.isError ? 1 : 0;
+                cevent.data = event.data.c_str();
+                cevent.data_length = static_cast<int64_t>(event.data.size());
+            } else {
+                cevent.type = ZRUN_CQ_COMPLETION;
+                cevent.state = toCAsyncState(event.state);
+                cevent.result = toResultView(event.result);
+            }
+        }
+        return static_cast<int>(count);
+    } catch (...) {
+        return -1;
+    }
+}
+
+ZRUN_API int zrun_cq_fd(void* cq) {
+    return cq ? static_cast<ZRunCompletionQueue*>(cq)->queue->fd() : -1;
+}
+
+ZRUN_API void* zrun_cq_event_handle(void* cq) {
+    return cq ? static_cast<ZRunCompletionQueue*>(cq)->queue->eventHandle() : nullptr;
+}
+
+ZRUN_API int zrun_execute_async_cq(void* instance, const char* command,
+                                   zrun_shell_type shell_type, int timeout_ms,
+                                   void* cq, int flags, void* user_data) {
+    if (!instance || !command || !cq) {
+        return -1;
+    }
+
+    try {
+        ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+        std::shared_ptr<Zrun::CompletionQueue> queue =
+            static_cast<ZRunCompletionQueue*>(cq)->queue;
+        // 回调可能在启动函数返回前触发，因此先创建命令取得 id，再设置回调并启动
+        Zrun::CommandOptions options(toCppShellType(shell_type), timeout_ms);
+        options.terminal.enabled = (flags & ZRUN_CQ_TERMINAL) != 0;
+        auto operation = zrun->impl.createAsync(toStdString(command), options);
+        int asyncId = operation->id;
+
+        Zrun::ChunkCallback chunkCallback;
+        if (flags & ZRUN_CQ_STREAM_OUTPUT) {
+            chunkCallback = [queue, asyncId, user_data](std::string_view data, bool isError) {
+                Zrun::CompletionQueue::Event event;
+                event.type = Zrun::CompletionQueue::Event::Type::Output;
+                event.asyncId = asyncId;
+                event.userData = user_data;
+                event.isError = isError;
+                event.data.assign(data.data(), data.size());
+                queue->post(std::move(event));
+            };
+        }
+
+        Zrun::CompletionCallback completionCallback =
+            [queue, asyncId, user_data](Zrun::AsyncState state, Zrun::CommandResult& result) {
+                Zrun::CompletionQueue::Event event;
+                event.type = Zrun::CompletionQueue::Event::Type::Completion;
+                event.asyncId = asyncId;
+                event.userData = user_data;
+                event.state = state;
+                event.result = std::move(result);
+                queue->post(std::move(event));
+            };
+
+        operation->chunkCallback = std::move(chunkCallback);
+        operation->completionCallback = std::move(completionCallback);
+        operation->keepInTable = false;
+        return zrun->impl.startAsync(operation);
+    } catch (...) {
+        return -1;
+    }
+}
+
 ZRUN_API void zrun_set_working_directory(void* instance, const char* directory) {
     if (instance && directory) {
         ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
@@ -214,9 +453,122 @@ ZRUN_API void zrun_clear_environment(void* instance) {
     }
 }
 
+ZRUN_API void zrun_set_max_concurrency(void* instance, int limit) {
+    if (instance) {
+        ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+        zrun->impl.setMaxConcurrency(limit);
+    }
+}
+
+ZRUN_API int zrun_set_default_placement(void* instance, zrun_placement_mode mode,
+                                        const int* cpus, int cpu_count, int numa_node) {
+    if (!instance || cpu_count < 0 || (cpu_count > 0 && !cpus)) {
+        return -1;
+    }
+    Zrun::CpuPlacement placement;
+    switch (mode) {
+    case ZRUN_PLACEMENT_INHERIT: placement.mode = Zrun::CpuPlacement::Mode::Inherit; break;
+    case ZRUN_PLACEMENT_CPUS: placement.mode = Zrun::CpuPlacement::Mode::Cpus; break;
+    case ZRUN_PLACEMENT_NUMA_NODE: placement.mode = Zrun::CpuPlacement::Mode::NumaNode; break;
+    case ZRUN_PLACEMENT_ROUND_ROBIN_CORE:
+        placement.mode = Zrun::CpuPlacement::Mode::RoundRobinCore;
+        break;
+    case ZRUN_PLACEMENT_ROUND_ROBIN_NODE:
+        placement.mode = Zrun::CpuPlacement::Mode::RoundRobinNode;
+        break;
+    default: return -1;
+    }
+    if (cpu_count > 0) {
+        placement.cpus.assign(cpus, cpus + cpu_count);
+    }
+    placement.numaNode = numa_node;
+
+    ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+    zrun->impl.setDefaultPlacement(placement);
+    return 0;
+}
+
+ZRUN_API int zrun_enable_journal(void* instance, const char* path, int sync_interval_ms) {
+    if (!instance || !path || sync_interval_ms < 0) {
+        return -1;
+    }
+    Zrun::JournalConfig config;
+    config.path = path;
+    config.syncIntervalMs = sync_interval_ms;
+    ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+    return zrun->impl.enableJournal(config) ? 0 : -1;
+}
+
+ZRUN_API int zrun_connect_daemon(void* instance, const char* socket_path) {
+    if (!instance) {
+        return -1;
+    }
+    ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+    return zrun->impl.connectDaemon(socket_path ? socket_path : "") ? 0 : -1;
+}
+
+ZRUN_API int zrun_get_metrics(void* instance, zrun_metrics* metrics) {
+    if (!instance || !metrics) {
+        return -1;
+    }
+    ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+    Zrun::Metrics snapshot = zrun->impl.metrics();
+    metrics->commands_completed = snapshot.commandsCompleted;
+    metrics->compressed_raw_bytes = snapshot.compressedRawBytes;
+    metrics->compressed_bytes = snapshot.compressedBytes;
+    metrics->compression_ratio = snapshot.compressionRatio();
+    metrics->commands_running = snapshot.commandsRunning;
+    metrics->commands_queued = snapshot.commandsQueued;
+    metrics->admitted_immediately = snapshot.admittedImmediately;
+    metrics->admitted_from_queue = snapshot.admittedFromQueue;
+    metrics->queue_timeouts = snapshot.queueTimeouts;
+    metrics->queue_cancellations = snapshot.queueCancellations;
+    metrics->total_queue_wait_ms = snapshot.totalQueueWaitMs;
+    metrics->max_queue_wait_ms = snapshot.maxQueueWaitMs;
+    return 0;
+}
+
 ZRUN_API void zrun_free_result(zrun_command_result result) {
     delete[] result.output;
     delete[] result.error;
 }
 
+ZRUN_API void* zrun_execute_sync_view(void* instance, const char* command,
+                                      zrun_shell_type shell_type, int timeout_ms,
+                                      zrun_result_view* view) {
+    if (!instance || !command) {
+        return nullptr;
+    }
+
+    try {
+        ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+        return toResultHandle(
+            zrun->impl.executeSync(toStdString(command), toCppShellType(shell_type), timeout_ms),
+            view);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+ZRUN_API void* zrun_take_async_result(void* instance, int async_id, zrun_result_view* view) {
+    if (!instance) {
+        return nullptr;
+    }
+
+    try {
+        ZRunInstance* zrun = static_cast<ZRunInstance*>(instance);
+        Zrun::CommandResult result;
+        if (!zrun->impl.takeAsyncResult(async_id, result)) {
+            return nullptr;
+        }
+        return toResultHandle(std::move(result), view);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+ZRUN_API void zrun_release_result(void* result_handle) {
+    delete static_cast<ZRunResultHandle*>(result_handle);
+}
+
 } // extern "C"
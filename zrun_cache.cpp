@@ -0,0 +1,583 @@
+#include "zrun_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#endif
+
+namespace Zrun {
+
+namespace {
+// 持久化文件格式：文件头之后依次追加记录，文件头中的 used 之后的数据无效
+// （写到一半时进程退出留下的部分记录会被忽略）
+constexpr char kMagic[8] = {'Z', 'R', 'U', 'N', 'R', 'C', '1', '\0'};
+constexpr size_t kHeaderSize = 16;
+// 记录：u32 总长度, i64 过期时间, i32 退出码, u32 键/输出/错误长度, u32 依赖数，
+// 每个依赖为 u32 路径长度, i64 mtime, i64 size, 路径；最后是键、输出、错误
+constexpr size_t kRecordFixed = 4 + 8 + 4 + 4 * 4;
+constexpr size_t kDependencyFixed = 4 + 8 + 8;
+constexpr size_t kMinMapSize = 64 * 1024;
+// 文件中无效记录超过这个大小且多于有效记录的两倍时重写
+constexpr size_t kCompactThreshold = 1024 * 1024;
+
+template <typename T>
+void put(char*& out, T value) {
+    std::memcpy(out, &value, sizeof(value));
+    out += sizeof(value);
+}
+
+void putBytes(char*& out, const std::string& value) {
+    std::memcpy(out, value.data(), value.size());
+    out += value.size();
+}
+
+// 带边界检查的读取
+struct Reader {
+    const char* cursor;
+    const char* end;
+
+    template <typename T>
+    bool get(T& value) {
+        if (static_cast<size_t>(end - cursor) < sizeof(value)) {
+            return false;
+        }
+        std::memcpy(&value, cursor, sizeof(value));
+        cursor += sizeof(value);
+        return true;
+    }
+
+    bool getBytes(std::string& value, uint32_t length) {
+        if (static_cast<size_t>(end - cursor) < length) {
+            return false;
+        }
+        value.assign(cursor, length);
+        cursor += length;
+        return true;
+    }
+};
+
+void appendField(std::string& key, const std::string& value) {
+    key += std::to_string(value.size());
+    key += ':';
+    key += value;
+}
+
+ResultCache::Dependency statDependency(const std::string& path) {
+    ResultCache::Dependency dependency;
+    dependency.path = path;
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path.c_str(), &info) == 0) {
+        dependency.mtimeNs = static_cast<long long>(info.st_mtime) * 1000000000LL;
+        dependency.size = static_cast<long long>(info.st_size);
+    }
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0) {
+#ifdef __APPLE__
+        const struct timespec& mtime = info.st_mtimespec;
+#else
+        const struct timespec& mtime = info.st_mtim;
+#endif
+        dependency.mtimeNs = static_cast<long long>(mtime.tv_sec) * 1000000000LL + mtime.tv_nsec;
+        dependency.size = static_cast<long long>(info.st_size);
+    }
+#endif
+    return dependency;
+}
+}
+
+ResultCache::~ResultCache() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    closeStore();
+}
+
+bool ResultCache::configure(const ResultCacheConfig& config) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool reopen = !m_enabled || config.persistPath != m_config.persistPath;
+    m_config = config;
+    m_enabled = true;
+
+    bool ok = true;
+    if (reopen) {
+        closeStore();
+        if (!m_config.persistPath.empty()) {
+            ok = openStore(m_config.persistPath);
+            if (ok) {
+                loadStore();
+            }
+        }
+    }
+    enforceLimits();
+    return ok;
+}
+
+void ResultCache::disable() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    closeStore();
+    m_enabled = false;
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+    m_config = ResultCacheConfig();
+}
+
+bool ResultCache::enabled() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_enabled;
+}
+
+bool ResultCache::cacheable(const CommandOptions& options) {
+    return options.stdoutSink.type == OutputSink::Type::Capture &&
+           options.stderrSink.type == OutputSink::Type::Capture &&
+           !options.stdoutFilter.active() && !options.stderrFilter.active() &&
+           !options.lineCallback && !options.compressOutput && !options.sharedChannel;
+}
+
+std::string ResultCache::makeKey(const std::string& command, const CommandOptions& options,
+                                 const std::string& workingDirectory,
+                                 const std::map<std::string, std::string>& environment,
+                                 const std::string& executionPolicy) {
+    // 每个字段带长度前缀，不同的组合不会拼出相同的键
+    std::string key = std::to_string(static_cast<int>(options.shellType));
+    key += '|';
+    if (options.terminal.enabled) {
+        // 伪终端中的输出合并了标准错误，窗口大小也会影响输出
+        key += "pty" + std::to_string(options.terminal.columns) + 'x' +
+               std::to_string(options.terminal.rows) + '|';
+    }
+    appendField(key, command);
+    appendField(key, workingDirectory);
+    appendField(key, executionPolicy);
+    key += std::to_string(environment.size());
+    key += '|';
+    for (const auto& pair : environment) {
+        appendField(key, pair.first);
+        appendField(key, pair.second);
+    }
+    key += std::to_string(options.cache.dependencies.size());
+    key += '|';
+    for (const auto& path : options.cache.dependencies) {
+        appendField(key, path);
+    }
+    return key;
+}
+
+std::vector<ResultCache::Dependency> ResultCache::snapshot(const std::vector<std::string>& paths) {
+    std::vector<Dependency> dependencies;
+    dependencies.reserve(paths.size());
+    for (const auto& path : paths) {
+        dependencies.push_back(statDependency(path));
+    }
+    return dependencies;
+}
+
+long long ResultCache::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool ResultCache::dependenciesCurrent(const Entry& entry) {
+    for (const auto& dependency : entry.dependencies) {
+        Dependency current = statDependency(dependency.path);
+        if (current.mtimeNs != dependency.mtimeNs || current.size != dependency.size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ResultCache::lookup(const std::string& key, CommandResult& result) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_enabled) {
+        return false;
+    }
+    auto found = m_index.find(key);
+    if (found == m_index.end()) {
+        ++m_misses;
+        return false;
+    }
+
+    auto it = found->second;
+    if ((it->expiresAtMs >= 0 && it->expiresAtMs <= nowMs()) || !dependenciesCurrent(*it)) {
+        erase(it);
+        ++m_evictions;
+        ++m_misses;
+        return false;
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, it);
+    ++m_hits;
+    result = CommandResult();
+    result.exitCode = it->exitCode;
+    result.output = it->output;
+    result.error = it->error;
+    result.outputBytes = static_cast<long long>(it->output.size());
+    result.errorBytes = static_cast<long long>(it->error.size());
+    result.fromCache = true;
+    result.attempts = 0;
+    return true;
+}
+
+void ResultCache::store(std::string key, const CachePolicy& policy,
+                        std::vector<Dependency> dependencies, const CommandResult& result) {
+    if (result.timedOut || result.limitExceeded != ResourceLimitKind::None ||
+        result.exitCode == -1 || (result.exitCode != 0 && !policy.cacheFailures)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_enabled) {
+        return;
+    }
+    long long ttlMs = policy.ttlMs != 0 ? policy.ttlMs : m_config.defaultTtlMs;
+
+    Entry entry;
+    entry.key = std::move(key);
+    entry.expiresAtMs = ttlMs < 0 ? -1 : nowMs() + ttlMs;
+    entry.exitCode = result.exitCode;
+    entry.output = result.output;
+    entry.error = result.error;
+    entry.dependencies = std::move(dependencies);
+    if (entry.bytes() > m_config.maxBytes) {
+        return;
+    }
+    insert(std::move(entry), true);
+    enforceLimits();
+}
+
+void ResultCache::fillMetrics(Metrics& metrics) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    metrics.cacheHits = m_hits;
+    metrics.cacheMisses = m_misses;
+    metrics.cacheEvictions = m_evictions;
+    metrics.cacheEntries = static_cast<long long>(m_entries.size());
+    metrics.cacheBytes = static_cast<long long>(m_bytes);
+}
+
+void ResultCache::insert(Entry entry, bool persist) {
+    auto found = m_index.find(entry.key);
+    if (found != m_index.end()) {
+        erase(found->second);
+    }
+    if (persist) {
+        entry.persisted = appendRecord(entry);
+    }
+    m_bytes += entry.bytes();
+    m_entries.push_front(std::move(entry));
+    m_index[m_entries.front().key] = m_entries.begin();
+}
+
+void ResultCache::erase(EntryList::iterator it) {
+    m_bytes -= it->bytes();
+    if (it->persisted) {
+        m_liveRecordBytes -= recordSize(*it);
+    }
+    m_index.erase(it->key);
+    m_entries.erase(it);
+}
+
+void ResultCache::enforceLimits() {
+    while (!m_entries.empty() &&
+           (m_entries.size() > m_config.maxEntries || m_bytes > m_config.maxBytes)) {
+        erase(std::prev(m_entries.end()));
+        ++m_evictions;
+    }
+    compactStore();
+}
+
+size_t ResultCache::recordSize(const Entry& entry) {
+    size_t size = kRecordFixed + entry.key.size() + entry.output.size() + entry.error.size();
+    for (const auto& dependency : entry.dependencies) {
+        size += kDependencyFixed + dependency.path.size();
+    }
+    return size;
+}
+
+void ResultCache::encodeRecord(const Entry& entry, char* out) {
+    put<uint32_t>(out, static_cast<uint32_t>(recordSize(entry)));
+    put<int64_t>(out, entry.expiresAtMs);
+    put<int32_t>(out, entry.exitCode);
+    put<uint32_t>(out, static_cast<uint32_t>(entry.key.size()));
+    put<uint32_t>(out, static_cast<uint32_t>(entry.output.size()));
+    put<uint32_t>(out, static_cast<uint32_t>(entry.error.size()));
+    put<uint32_t>(out, static_cast<uint32_t>(entry.dependencies.size()));
+    for (const auto& dependency : entry.dependencies) {
+        put<uint32_t>(out, static_cast<uint32_t>(dependency.path.size()));
+        put<int64_t>(out, dependency.mtimeNs);
+        put<int64_t>(out, dependency.size);
+        putBytes(out, dependency.path);
+    }
+    putBytes(out, entry.key);
+    putBytes(out, entry.output);
+    putBytes(out, entry.error);
+}
+
+#ifdef _WIN32
+
+bool ResultCache::openStore(const std::string& path) {
+    (void)path;
+    return false;
+}
+
+void ResultCache::closeStore() {}
+void ResultCache::loadStore() {}
+bool ResultCache::reserve(size_t bytes) {
+    (void)bytes;
+    return false;
+}
+bool ResultCache::appendRecord(const Entry& entry) {
+    (void)entry;
+    return false;
+}
+void ResultCache::compactStore() {}
+
+#else
+
+namespace {
+size_t roundMapSize(size_t bytes) {
+    return std::max(kMinMapSize, (bytes + kMinMapSize - 1) / kMinMapSize * kMinMapSize);
+}
+
+// 打开并独占锁定持久化文件
+int openLocked(const std::string& path, int flags) {
+    int fd = open(path.c_str(), flags | O_RDWR | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+}
+
+bool ResultCache::openStore(const std::string& path) {
+    int fd = openLocked(path, O_CREAT);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        close(fd);
+        return false;
+    }
+
+    size_t fileSize = static_cast<size_t>(info.st_size);
+    if (fileSize == 0) {
+        fileSize = kMinMapSize;
+        if (ftruncate(fd, static_cast<off_t>(fileSize)) == -1) {
+            close(fd);
+            return false;
+        }
+    } else if (fileSize < kHeaderSize) {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    char* data = static_cast<char*>(map);
+    uint64_t used = 0;
+    if (info.st_size == 0) {
+        std::memcpy(data, kMagic, sizeof(kMagic));
+        used = kHeaderSize;
+        std::memcpy(data + sizeof(kMagic), &used, sizeof(used));
+    } else {
+        std::memcpy(&used, data + sizeof(kMagic), sizeof(used));
+        // 不是缓存文件时不覆盖
+        if (std::memcmp(data, kMagic, sizeof(kMagic)) != 0 || used < kHeaderSize ||
+            used > fileSize) {
+            munmap(map, fileSize);
+            close(fd);
+            return false;
+        }
+    }
+
+    m_fd = fd;
+    m_map = data;
+    m_mapSize = fileSize;
+    m_used = static_cast<size_t>(used);
+    m_liveRecordBytes = 0;
+    return true;
+}
+
+void ResultCache::closeStore() {
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+        m_map = nullptr;
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_mapSize = 0;
+    m_used = 0;
+    m_liveRecordBytes = 0;
+}
+
+void ResultCache::loadStore() {
+    long long now = nowMs();
+    Reader reader{m_map + kHeaderSize, m_map + m_used};
+    while (reader.cursor < reader.end) {
+        const char* start = reader.cursor;
+        uint32_t size = 0;
+        int64_t expiresAtMs = 0;
+        int32_t exitCode = 0;
+        uint32_t keyLength = 0, outputLength = 0, errorLength = 0, dependencyCount = 0;
+        if (!reader.get(size) || size < kRecordFixed ||
+            size > static_cast<size_t>(reader.end - start) ||
+            !reader.get(expiresAtMs) || !reader.get(exitCode) || !reader.get(keyLength) ||
+            !reader.get(outputLength) || !reader.get(errorLength) ||
+            !reader.get(dependencyCount)) {
+            reader.cursor = start;
+            break;
+        }
+        // 后续字段不能越过本条记录
+        Reader record{reader.cursor, start + size};
+        Entry entry;
+        entry.expiresAtMs = expiresAtMs;
+        entry.exitCode = exitCode;
+        bool valid = dependencyCount <= size / kDependencyFixed;
+        for (uint32_t i = 0; valid && i < dependencyCount; ++i) {
+            Dependency dependency;
+            uint32_t pathLength = 0;
+            int64_t mtimeNs = 0, fileSize = 0;
+            valid = record.get(pathLength) && record.get(mtimeNs) && record.get(fileSize) &&
+                    record.getBytes(dependency.path, pathLength);
+            dependency.mtimeNs = mtimeNs;
+            dependency.size = fileSize;
+            entry.dependencies.push_back(std::move(dependency));
+        }
+        valid = valid && record.getBytes(entry.key, keyLength) &&
+                record.getBytes(entry.output, outputLength) &&
+                record.getBytes(entry.error, errorLength) && record.cursor == record.end;
+        if (!valid) {
+            reader.cursor = start;
+            break;
+        }
+        reader.cursor = start + size;
+
+        if (entry.expiresAtMs >= 0 && entry.expiresAtMs <= now) {
+            continue;
+        }
+        if (entry.bytes() <= m_config.maxBytes) {
+            entry.persisted = true;
+            insert(std::move(entry), false);
+            m_liveRecordBytes += size;
+        }
+    }
+    // 截掉无法解析的尾部，之后的记录从最后一条有效记录之后开始写
+    m_used = static_cast<size_t>(reader.cursor - m_map);
+    uint64_t used = m_used;
+    std::memcpy(m_map + sizeof(kMagic), &used, sizeof(used));
+}
+
+bool ResultCache::reserve(size_t bytes) {
+    if (m_used + bytes <= m_mapSize) {
+        return true;
+    }
+    size_t newSize = roundMapSize(std::max(m_mapSize * 2, m_used + bytes));
+    if (ftruncate(m_fd, static_cast<off_t>(newSize)) == -1) {
+        return false;
+    }
+    void* map = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    munmap(m_map, m_mapSize);
+    m_map = static_cast<char*>(map);
+    m_mapSize = newSize;
+    return true;
+}
+
+bool ResultCache::appendRecord(const Entry& entry) {
+    if (!m_map) {
+        return false;
+    }
+    size_t size = recordSize(entry);
+    if (size > UINT32_MAX || !reserve(size)) {
+        return false;
+    }
+    encodeRecord(entry, m_map + m_used);
+    // 记录写完之后才更新 used
+    m_used += size;
+    uint64_t used = m_used;
+    std::memcpy(m_map + sizeof(kMagic), &used, sizeof(used));
+    m_liveRecordBytes += size;
+    return true;
+}
+
+void ResultCache::compactStore() {
+    if (!m_map) {
+        return;
+    }
+    size_t garbage = m_used - kHeaderSize - m_liveRecordBytes;
+    if (garbage < kCompactThreshold || garbage < 2 * m_liveRecordBytes) {
+        return;
+    }
+
+    // 写入临时文件后替换，最久未使用的在前，读回时保持原来的顺序
+    std::string temporary = m_config.persistPath + ".tmp";
+    int fd = openLocked(temporary, O_CREAT | O_TRUNC);
+    if (fd == -1) {
+        return;
+    }
+    size_t live = 0;
+    for (const auto& entry : m_entries) {
+        live += recordSize(entry);
+    }
+    size_t fileSize = roundMapSize(kHeaderSize + live);
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(fileSize)) == 0) {
+        map = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        close(fd);
+        unlink(temporary.c_str());
+        return;
+    }
+
+    char* data = static_cast<char*>(map);
+    size_t used = kHeaderSize;
+    for (auto it = m_entries.rbegin(); it != m_entries.rend(); ++it) {
+        encodeRecord(*it, data + used);
+        used += recordSize(*it);
+    }
+    std::memcpy(data, kMagic, sizeof(kMagic));
+    uint64_t header = used;
+    std::memcpy(data + sizeof(kMagic), &header, sizeof(header));
+
+    if (rename(temporary.c_str(), m_config.persistPath.c_str()) == -1) {
+        munmap(map, fileSize);
+        close(fd);
+        unlink(temporary.c_str());
+        return;
+    }
+    closeStore();
+    for (auto& entry : m_entries) {
+        entry.persisted = true;
+    }
+    m_fd = fd;
+    m_map = data;
+    m_mapSize = fileSize;
+    m_used = used;
+    m_liveRecordBytes = live;
+}
+
+#endif // _WIN32
+
+} // namespace Zrun
@@ -0,0 +1,118 @@
+#ifndef ZRUN_CACHE_H
+#define ZRUN_CACHE_H
+
+#include "zrun_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Zrun {
+
+// 确定性命令的结果缓存：按最近使用淘汰，受条目数和字节数限制。
+// 可选地把条目追加到内存映射文件，启用时读回未过期的条目；
+// 文件中的无效记录超过有效记录时整体重写
+class ResultCache {
+public:
+    // 依赖文件在某一时刻的状态，文件不存在时 mtime 和 size 为 -1
+    struct Dependency {
+        std::string path;
+        long long mtimeNs = -1;
+        long long size = -1;
+    };
+
+    ResultCache() = default;
+    ~ResultCache();
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // 启用或重新配置缓存。持久化文件无法打开或已被其他进程锁定时返回 false，
+    // 此时仍在内存中缓存
+    bool configure(const ResultCacheConfig& config);
+    // 停用并清空内存中的条目（持久化文件保留）
+    void disable();
+    bool enabled() const;
+
+    // 选项是否允许使用缓存（输出全部捕获，没有过滤器、分行回调或压缩）
+    static bool cacheable(const CommandOptions& options);
+
+    // 缓存键：命令、shell、工作目录、环境变量、执行策略和依赖文件列表
+    static std::string makeKey(const std::string& command, const CommandOptions& options,
+                               const std::string& workingDirectory,
+                               const std::map<std::string, std::string>& environment,
+                               const std::string& executionPolicy);
+
+    // 记录依赖文件的当前状态，在执行命令之前调用
+    static std::vector<Dependency> snapshot(const std::vector<std::string>& paths);
+
+    // 命中时填充 result 并返回 true；过期或依赖已变化的条目被移除
+    bool lookup(const std::string& key, CommandResult& result);
+
+    // 按 policy 决定是否保存 result，dependencies 为执行前的 snapshot
+    void store(std::string key, const CachePolicy& policy, std::vector<Dependency> dependencies,
+               const CommandResult& result);
+
+    void fillMetrics(Metrics& metrics) const;
+
+private:
+    struct Entry {
+        std::string key;
+        // system_clock 的毫秒数，-1 表示永不过期
+        long long expiresAtMs = -1;
+        int exitCode = 0;
+        std::string output;
+        std::string error;
+        std::vector<Dependency> dependencies;
+        // 在持久化文件中有对应的记录
+        bool persisted = false;
+
+        size_t bytes() const { return key.size() + output.size() + error.size(); }
+    };
+    using EntryList = std::list<Entry>;
+
+    static long long nowMs();
+    static bool dependenciesCurrent(const Entry& entry);
+    void insert(Entry entry, bool persist);
+    void erase(EntryList::iterator it);
+    void enforceLimits();
+
+    // 持久化，在 m_mutex 内调用
+    bool openStore(const std::string& path);
+    void closeStore();
+    void loadStore();
+    bool reserve(size_t bytes);
+    bool appendRecord(const Entry& entry);
+    void compactStore();
+    static size_t recordSize(const Entry& entry);
+    static void encodeRecord(const Entry& entry, char* out);
+
+    mutable std::mutex m_mutex;
+    ResultCacheConfig m_config;
+    bool m_enabled = false;
+
+    // 最近使用的在前
+    EntryList m_entries;
+    std::unordered_map<std::string, EntryList::iterator> m_index;
+    size_t m_bytes = 0;
+
+    long long m_hits = 0;
+    long long m_misses = 0;
+    long long m_evictions = 0;
+
+    // 内存映射的持久化文件
+    int m_fd = -1;
+    char* m_map = nullptr;
+    size_t m_mapSize = 0;
+    size_t m_used = 0;
+    // 文件中仍对应内存条目的记录字节数
+    size_t m_liveRecordBytes = 0;
+};
+
+} // namespace Zrun
+
+#endif // ZRUN_CACHE_H
@@ -0,0 +1,320 @@
+#include "zrun_capture.h"
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#endif
+
+namespace Zrun {
+
+namespace {
+// 每个级别缓存的空闲分块总量上限
+constexpr size_t kPoolBytesPerClass = 16 * 1024 * 1024;
+}
+
+ChunkPool& ChunkPool::instance() {
+    static ChunkPool pool;
+    return pool;
+}
+
+ChunkPool::~ChunkPool() {
+    for (auto& list : m_free) {
+        for (char* chunk : list) {
+            delete[] chunk;
+        }
+    }
+}
+
+size_t ChunkPool::chunkSize(int sizeClass) {
+    return kMinChunkSize << (2 * sizeClass);
+}
+
+char* ChunkPool::acquire(int sizeClass) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& list = m_free[sizeClass];
+        if (!list.empty()) {
+            char* chunk = list.back();
+            list.pop_back();
+            return chunk;
+        }
+    }
+    return new char[chunkSize(sizeClass)];
+}
+
+void ChunkPool::release(char* chunk, int sizeClass) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& list = m_free[sizeClass];
+        if (list.size() * chunkSize(sizeClass) < kPoolBytesPerClass) {
+            list.push_back(chunk);
+            return;
+        }
+    }
+    delete[] chunk;
+}
+
+CaptureBuffer::~CaptureBuffer() {
+    releaseAll();
+}
+
+CaptureBuffer::CaptureBuffer(CaptureBuffer&& other) noexcept
+    : m_chunks(std::move(other.m_chunks)), m_spares(std::move(other.m_spares)),
+    m_spareWanted(other.m_spareWanted), m_size(other.m_size),
+    m_nextClass(other.m_nextClass), m_flat(std::move(other.m_flat)),
+    m_flatValid(other.m_flatValid) {
+    other.m_chunks.clear();
+    other.m_spares.clear();
+    other.m_size = 0;
+    other.m_flatValid = false;
+}
+
+CaptureBuffer& CaptureBuffer::operator=(CaptureBuffer&& other) noexcept {
+    if (this != &other) {
+        releaseAll();
+        m_chunks = std::move(other.m_chunks);
+        m_spares = std::move(other.m_spares);
+        m_spareWanted = other.m_spareWanted;
+        m_size = other.m_size;
+        m_nextClass = other.m_nextClass;
+        m_flat = std::move(other.m_flat);
+        m_flatValid = other.m_flatValid;
+        other.m_chunks.clear();
+        other.m_spares.clear();
+        other.m_size = 0;
+        other.m_flatValid = false;
+    }
+    return *this;
+}
+
+size_t CaptureBuffer::tailSpace() const {
+    if (m_chunks.empty()) {
+        return 0;
+    }
+    const Chunk& tail = m_chunks.back();
+    return ChunkPool::chunkSize(tail.sizeClass) - tail.used;
+}
+
+CaptureBuffer::Chunk CaptureBuffer::newChunk() {
+    Chunk chunk;
+    chunk.sizeClass = m_nextClass;
+    chunk.data = ChunkPool::instance().acquire(chunk.sizeClass);
+    // 输出越多，后续分块越大
+    if (m_nextClass < ChunkPool::kClassCount - 1) {
+        ++m_nextClass;
+    }
+    return chunk;
+}
+
+void CaptureBuffer::releaseAll() {
+    ChunkPool& pool = ChunkPool::instance();
+    for (auto& chunk : m_chunks) {
+        pool.release(chunk.data, chunk.sizeClass);
+    }
+    for (auto& chunk : m_spares) {
+        pool.release(chunk.data, chunk.sizeClass);
+    }
+    m_chunks.clear();
+    m_spares.clear();
+}
+
+#ifndef _WIN32
+long CaptureBuffer::readFrom(int fd, size_t maxBytes) {
+    struct iovec iov[kMaxIovecs];
+    int count = prepareRead(iov, maxBytes);
+    if (count == 0) {
+        return 0;
+    }
+
+    ssize_t bytesRead;
+    do {
+        bytesRead = readv(fd, iov, count);
+    } while (bytesRead == -1 && errno == EINTR);
+
+    if (bytesRead > 0) {
+        commitRead(static_cast<size_t>(bytesRead));
+    }
+    return static_cast<long>(bytesRead);
+}
+
+int CaptureBuffer::prepareRead(struct iovec* iov, size_t maxBytes) {
+    while (m_spares.size() < m_spareWanted) {
+        m_spares.push_back(newChunk());
+    }
+
+    int count = 0;
+    size_t total = 0;
+
+    size_t space = std::min(tailSpace(), maxBytes);
+    if (space > 0) {
+        Chunk& tail = m_chunks.back();
+        iov[count].iov_base = tail.data + tail.used;
+        iov[count].iov_len = space;
+        total += space;
+        ++count;
+    }
+    for (const auto& spare : m_spares) {
+        if (total >= maxBytes || count >= kMaxIovecs) {
+            break;
+        }
+        iov[count].iov_base = spare.data;
+        iov[count].iov_len = std::min(ChunkPool::chunkSize(spare.sizeClass), maxBytes - total);
+        total += iov[count].iov_len;
+        ++count;
+    }
+
+    m_preparedTail = space;
+    m_preparedTotal = total;
+    m_preparedLimit = maxBytes;
+    return count;
+}
+
+void CaptureBuffer::commitRead(size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+
+    size_t remaining = bytes;
+    m_size += remaining;
+    m_flatValid = false;
+
+    if (m_preparedTail > 0) {
+        size_t used = std::min(m_preparedTail, remaining);
+        m_chunks.back().used += used;
+        remaining -= used;
+    }
+
+    // 被填充的预备分块并入链中
+    size_t consumed = 0;
+    while (remaining > 0 && consumed < m_spares.size()) {
+        Chunk chunk = m_spares[consumed++];
+        chunk.used = std::min(ChunkPool::chunkSize(chunk.sizeClass), remaining);
+        remaining -= chunk.used;
+        m_chunks.push_back(chunk);
+    }
+    m_spares.erase(m_spares.begin(), m_spares.begin() + consumed);
+
+    // 一次读满说明输出量大，下次预备更多分块
+    if (bytes == m_preparedTotal && m_preparedTotal < m_preparedLimit &&
+        m_spareWanted < static_cast<size_t>(kMaxIovecs - 1)) {
+        m_spareWanted *= 2;
+    }
+    m_preparedTail = 0;
+    m_preparedTotal = 0;
+}
+
+long CaptureBuffer::drain(int fd) {
+    long bytesRead;
+    while ((bytesRead = readFrom(fd)) > 0) {
+    }
+    return bytesRead;
+}
+#endif
+
+char* CaptureBuffer::prepare(size_t& available) {
+    if (tailSpace() == 0) {
+        if (!m_spares.empty()) {
+            m_chunks.push_back(m_spares.front());
+            m_spares.erase(m_spares.begin());
+        } else {
+            m_chunks.push_back(newChunk());
+        }
+    }
+    Chunk& tail = m_chunks.back();
+    available = tailSpace();
+    return tail.data + tail.used;
+}
+
+void CaptureBuffer::commit(size_t bytes) {
+    if (bytes == 0 || m_chunks.empty()) {
+        return;
+    }
+    m_chunks.back().used += bytes;
+    m_size += bytes;
+    m_flatValid = false;
+}
+
+void CaptureBuffer::append(const char* data, size_t size) {
+    while (size > 0) {
+        size_t available = 0;
+        char* dest = prepare(available);
+        size_t n = std::min(available, size);
+        std::memcpy(dest, data, n);
+        commit(n);
+        data += n;
+        size -= n;
+    }
+}
+
+std::string_view CaptureBuffer::view() {
+    if (m_chunks.empty()) {
+        return std::string_view();
+    }
+    if (m_chunks.size() == 1) {
+        return std::string_view(m_chunks.front().data, m_chunks.front().used);
+    }
+    if (!m_flatValid) {
+        m_flat.clear();
+        m_flat.reserve(m_size);
+        forEachChunk([this](std::string_view piece) {
+            m_flat.append(piece.data(), piece.size());
+        });
+        m_flatValid = true;
+    }
+    return m_flat;
+}
+
+void CaptureBuffer::moveTo(std::string& out) {
+    if (m_flatValid && m_flat.size() == m_size) {
+        out = std::move(m_flat);
+    } else {
+        out.clear();
+        out.reserve(m_size);
+        forEachChunk([&out](std::string_view piece) {
+            out.append(piece.data(), piece.size());
+        });
+    }
+    clear();
+}
+
+void CaptureBuffer::clear() {
+    releaseAll();
+    m_size = 0;
+    m_nextClass = 0;
+    m_spareWanted = 1;
+    m_flat.clear();
+    m_flat.shrink_to_fit();
+    m_flatValid = false;
+}
+
+#ifndef _WIN32
+int tunePipe(int fd, int desiredSize) {
+#ifdef F_SETPIPE_SZ
+    int current = fcntl(fd, F_GETPIPE_SZ);
+    if (current >= desiredSize) {
+        return current;
+    }
+    // 超出 pipe-max-size 时逐级减半重试
+    for (int size = desiredSize; size > current; size /= 2) {
+        int result = fcntl(fd, F_SETPIPE_SZ, size);
+        if (result != -1) {
+            return result;
+        }
+        if (errno != EPERM && errno != EBUSY) {
+            break;
+        }
+    }
+    return current;
+#else
+    (void)fd;
+    (void)desiredSize;
+    return -1;
+#endif
+}
+#endif
+
+} // namespace Zrun
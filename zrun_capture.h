@@ -0,0 +1,136 @@
+#ifndef ZRUN_CAPTURE_H
+#define ZRUN_CAPTURE_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+struct iovec;
+#endif
+
+namespace Zrun {
+
+// 分块缓冲区池：按大小分级缓存，避免大输出时反复分配
+class ChunkPool {
+public:
+    // 分块大小级别：16K / 64K / 256K / 1M
+    static constexpr int kClassCount = 4;
+    static constexpr size_t kMinChunkSize = 16 * 1024;
+
+    static ChunkPool& instance();
+
+    static size_t chunkSize(int sizeClass);
+
+    char* acquire(int sizeClass);
+    void release(char* chunk, int sizeClass);
+
+private:
+    ChunkPool() = default;
+    ~ChunkPool();
+
+    std::mutex m_mutex;
+    std::vector<char*> m_free[kClassCount];
+};
+
+// 输出捕获缓冲区：由池化分块组成的链，读取时使用 readv 一次填充多个分块，
+// 只有在调用方需要连续内存时才合并
+class CaptureBuffer {
+public:
+    CaptureBuffer() = default;
+    ~CaptureBuffer();
+
+    CaptureBuffer(const CaptureBuffer&) = delete;
+    CaptureBuffer& operator=(const CaptureBuffer&) = delete;
+    CaptureBuffer(CaptureBuffer&& other) noexcept;
+    CaptureBuffer& operator=(CaptureBuffer&& other) noexcept;
+
+#ifndef _WIN32
+    // 单次读取最多使用的 iovec 数
+    static constexpr int kMaxIovecs = 5;
+
+    // 从非阻塞 fd 读取到缓冲区，最多读取 maxBytes 字节，返回值语义同 read(2)
+    long readFrom(int fd, size_t maxBytes = static_cast<size_t>(-1));
+
+    // 拆分的读取接口：供异步 I/O（如 io_uring）在提交前准备 iovec，完成后提交。
+    // 两次调用之间不得对缓冲区做其他修改
+    int prepareRead(struct iovec* iov, size_t maxBytes = static_cast<size_t>(-1));
+    void commitRead(size_t bytes);
+
+    // 读取直到 EAGAIN 或 EOF，返回最后一次 read 的结果
+    long drain(int fd);
+#endif
+
+    // 获取可直接写入的空间（用于 ReadFile 等无 readv 的平台）
+    char* prepare(size_t& available);
+    void commit(size_t bytes);
+
+    // 直接追加数据
+    void append(const char* data, size_t size);
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    // 连续视图：单分块时零拷贝，多分块时合并一次并缓存
+    std::string_view view();
+
+    // 一次性按精确大小拷贝到字符串并释放所有分块
+    void moveTo(std::string& out);
+
+    void clear();
+
+    // 按顺序遍历每个分块中的有效数据
+    template <typename F>
+    void forEachChunk(F&& f) const {
+        forEachChunkFrom(0, std::forward<F>(f));
+    }
+
+    // 从第 offset 字节开始遍历，用于增量地转发新读到的数据
+    template <typename F>
+    void forEachChunkFrom(size_t offset, F&& f) const {
+        for (const auto& chunk : m_chunks) {
+            if (offset >= chunk.used) {
+                offset -= chunk.used;
+                continue;
+            }
+            f(std::string_view(chunk.data + offset, chunk.used - offset));
+            offset = 0;
+        }
+    }
+
+private:
+    struct Chunk {
+        char* data = nullptr;
+        size_t used = 0;
+        int sizeClass = 0;
+    };
+
+    size_t tailSpace() const;
+    Chunk newChunk();
+    void releaseAll();
+
+    std::vector<Chunk> m_chunks;
+    // 预先取得、尚未写入数据的分块，供下一次 readv 使用
+    std::vector<Chunk> m_spares;
+    size_t m_spareWanted = 1;
+    // prepareRead 记录的尾部可用空间与总容量
+    size_t m_preparedTail = 0;
+    size_t m_preparedTotal = 0;
+    size_t m_preparedLimit = 0;
+    size_t m_size = 0;
+    int m_nextClass = 0;
+    std::string m_flat;
+    bool m_flatValid = false;
+};
+
+#ifndef _WIN32
+// 增大管道容量 (F_SETPIPE_SZ)，失败时保持默认大小，返回最终容量
+int tunePipe(int fd, int desiredSize);
+#endif
+
+} // namespace Zrun
+
+#endif // ZRUN_CAPTURE_H
@@ -0,0 +1,125 @@
+#include "zrun_cgroup.h"
+
+#ifndef _WIN32
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+namespace Zrun {
+
+namespace {
+// 删除子组时等待被终止的进程退出的最长时间
+constexpr auto kRemoveTimeout = std::chrono::milliseconds(100);
+
+std::atomic<unsigned> s_nextCgroupId(1);
+
+bool writeFile(const std::string& path, const std::string& value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    ssize_t written = write(fd, value.data(), value.size());
+    int savedErrno = errno;
+    close(fd);
+    errno = savedErrno;
+    return written == static_cast<ssize_t>(value.size());
+}
+
+std::string readFile(const std::string& path) {
+    std::string content;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return content;
+    }
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        content.append(buffer, static_cast<size_t>(count));
+    }
+    close(fd);
+    return content;
+}
+}
+
+std::unique_ptr<CommandCgroup> CommandCgroup::create(const ResourceLimits& limits,
+                                                     std::string& error) {
+#ifdef __linux__
+    std::string path = limits.cgroupParent;
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    path += "/zrun-" + std::to_string(getpid()) + "-" + std::to_string(s_nextCgroupId++);
+
+    if (mkdir(path.c_str(), 0755) == -1) {
+        error = "Failed to create cgroup " + path + ": " + std::string(strerror(errno));
+        return nullptr;
+    }
+    std::unique_ptr<CommandCgroup> cgroup(new CommandCgroup(path));
+
+    if (limits.cpuQuotaMicros >= 0) {
+        std::string value = std::to_string(limits.cpuQuotaMicros) + " " +
+                            std::to_string(limits.cpuPeriodMicros);
+        if (!writeFile(path + "/cpu.max", value)) {
+            error = "Failed to set cpu.max: " + std::string(strerror(errno));
+            return nullptr;
+        }
+    }
+    if (limits.memoryMaxBytes >= 0) {
+        if (!writeFile(path + "/memory.max", std::to_string(limits.memoryMaxBytes))) {
+            error = "Failed to set memory.max: " + std::string(strerror(errno));
+            return nullptr;
+        }
+        // 不允许用交换空间绕过内存上限（没有启用 swap 控制器时忽略）
+        writeFile(path + "/memory.swap.max", "0");
+    }
+
+    cgroup->m_procsFd = open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if (cgroup->m_procsFd == -1) {
+        error = "Failed to open cgroup.procs: " + std::string(strerror(errno));
+        return nullptr;
+    }
+    return cgroup;
+#else
+    (void)limits;
+    error = "cgroup placement is only supported on Linux";
+    return nullptr;
+#endif
+}
+
+CommandCgroup::~CommandCgroup() {
+    if (m_procsFd != -1) {
+        close(m_procsFd);
+    }
+    if (rmdir(m_path.c_str()) == 0 || errno != EBUSY) {
+        return;
+    }
+
+    // 仍有孙进程留在组内
+    killAll();
+    auto giveUp = std::chrono::steady_clock::now() + kRemoveTimeout;
+    while (rmdir(m_path.c_str()) == -1 && errno == EBUSY &&
+           std::chrono::steady_clock::now() < giveUp) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool CommandCgroup::oomKilled() const {
+    std::string events = readFile(m_path + "/memory.events");
+    size_t position = events.find("oom_kill ");
+    return position != std::string::npos &&
+           std::strtoll(events.c_str() + position + 9, nullptr, 10) > 0;
+}
+
+void CommandCgroup::killAll() {
+    writeFile(m_path + "/cgroup.kill", "1");
+}
+
+} // namespace Zrun
+
+#endif // _WIN32
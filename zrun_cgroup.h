@@ -0,0 +1,44 @@
+#ifndef ZRUN_CGROUP_H
+#define ZRUN_CGROUP_H
+
+#include "zrun_types.h"
+#include <memory>
+#include <string>
+
+#ifndef _WIN32
+
+namespace Zrun {
+
+// 为单条命令创建的 cgroup v2 子组（仅 Linux）。子进程在 exec 之前通过 procsFd()
+// 把自己写入 cgroup.procs，析构时终止组内剩余的进程并删除子组
+class CommandCgroup {
+public:
+    // 在 limits.cgroupParent 下创建子组并写入 cpu.max/memory.max，失败时返回空并设置 error
+    static std::unique_ptr<CommandCgroup> create(const ResourceLimits& limits, std::string& error);
+
+    ~CommandCgroup();
+
+    CommandCgroup(const CommandCgroup&) = delete;
+    CommandCgroup& operator=(const CommandCgroup&) = delete;
+
+    // 已打开的 cgroup.procs，子进程向其写入 "0" 加入该组
+    int procsFd() const { return m_procsFd; }
+
+    // 组内是否发生过 OOM 终止（memory.events 中的 oom_kill）
+    bool oomKilled() const;
+
+    // 终止组内所有进程，包括已脱离进程组的孙进程（cgroup.kill，需要 5.14 以上内核）
+    void killAll();
+
+private:
+    explicit CommandCgroup(std::string path) : m_path(std::move(path)) {}
+
+    std::string m_path;
+    int m_procsFd = -1;
+};
+
+} // namespace Zrun
+
+#endif // _WIN32
+
+#endif // ZRUN_CGROUP_H
@@ -0,0 +1,159 @@
+#include "zrun_channel.h"
+#include "zrun_shm.h"
+
+#ifndef _WIN32
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace Zrun {
+
+#ifdef _WIN32
+std::shared_ptr<SharedChannel> SharedChannel::create(size_t, Mode, std::string& error) {
+    error = "Shared channels are not supported on Windows";
+    return nullptr;
+}
+
+SharedChannel::~SharedChannel() = default;
+uint64_t SharedChannel::written() const { return 0; }
+uint64_t SharedChannel::consumed() const { return 0; }
+bool SharedChannel::overflowed() const { return false; }
+void SharedChannel::peek(std::string_view& first, std::string_view& second) const {
+    first = second = std::string_view();
+}
+void SharedChannel::consume(size_t) {}
+std::string_view SharedChannel::view() const { return std::string_view(); }
+void SharedChannel::reset() {}
+#else
+
+namespace {
+int createSharedMemory(std::string& error) {
+#if defined(__linux__) && defined(SYS_memfd_create)
+    // MFD_CLOEXEC = 1；启动命令时在子进程中复制为固定编号
+    int memfd = static_cast<int>(syscall(SYS_memfd_create, "zrun-shm", 1u));
+    if (memfd != -1) {
+        return memfd;
+    }
+#endif
+    // 没有 memfd 时使用立即删除的 POSIX 共享内存对象
+    static std::atomic<unsigned> counter{0};
+    std::string name = "/zrun-shm-" + std::to_string(getpid()) + "-" +
+                       std::to_string(counter.fetch_add(1));
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        error = "Failed to create shared memory: " + std::string(strerror(errno));
+        return -1;
+    }
+    shm_unlink(name.c_str());
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+zrun_shm_header* headerOf(void* memory) {
+    return static_cast<zrun_shm_header*>(memory);
+}
+}
+
+std::shared_ptr<SharedChannel> SharedChannel::create(size_t capacity, Mode mode,
+                                                     std::string& error) {
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pageSize = page > 0 ? static_cast<size_t>(page) : 4096;
+    capacity = (std::max<size_t>(capacity, 1) + pageSize - 1) / pageSize * pageSize;
+
+    int fd = createSharedMemory(error);
+    if (fd == -1) {
+        return nullptr;
+    }
+    size_t mappedSize = ZRUN_SHM_HEADER_SIZE + capacity;
+    if (ftruncate(fd, static_cast<off_t>(mappedSize)) == -1) {
+        error = "Failed to size shared memory: " + std::string(strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    void* memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        error = "Failed to map shared memory: " + std::string(strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    zrun_shm_header* header = headerOf(memory);
+    std::memset(header, 0, sizeof(zrun_shm_header));
+    header->magic = ZRUN_SHM_MAGIC;
+    header->version = ZRUN_SHM_VERSION;
+    header->capacity = capacity;
+    header->flags = mode == Mode::Stream ? ZRUN_SHM_BLOCKING : 0;
+
+    std::shared_ptr<SharedChannel> channel(new SharedChannel());
+    channel->m_fd = fd;
+    channel->m_mode = mode;
+    channel->m_capacity = capacity;
+    channel->m_mappedSize = mappedSize;
+    channel->m_memory = memory;
+    channel->m_data = static_cast<char*>(memory) + ZRUN_SHM_HEADER_SIZE;
+    return channel;
+}
+
+SharedChannel::~SharedChannel() {
+    if (m_memory) {
+        // 仍在等待空间的写入方不再等待
+        __atomic_store_n(&headerOf(m_memory)->closed, 1, __ATOMIC_RELEASE);
+        munmap(m_memory, m_mappedSize);
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+uint64_t SharedChannel::written() const {
+    return __atomic_load_n(&headerOf(m_memory)->head, __ATOMIC_ACQUIRE);
+}
+
+uint64_t SharedChannel::consumed() const {
+    return __atomic_load_n(&headerOf(m_memory)->tail, __ATOMIC_ACQUIRE);
+}
+
+bool SharedChannel::overflowed() const {
+    return __atomic_load_n(&headerOf(m_memory)->overflow, __ATOMIC_RELAXED) != 0;
+}
+
+void SharedChannel::peek(std::string_view& first, std::string_view& second) const {
+    uint64_t head = written();
+    uint64_t tail = consumed();
+    // 写入方是不受信任的子进程，越界的 head 按缓冲区已满处理
+    uint64_t size = head - tail > m_capacity ? m_capacity : head - tail;
+    size_t offset = static_cast<size_t>(tail % m_capacity);
+    size_t contiguous = std::min(static_cast<size_t>(size), m_capacity - offset);
+    first = std::string_view(m_data + offset, contiguous);
+    second = std::string_view(m_data, static_cast<size_t>(size) - contiguous);
+}
+
+void SharedChannel::consume(size_t bytes) {
+    zrun_shm_header* header = headerOf(m_memory);
+    uint64_t head = written();
+    uint64_t tail = consumed();
+    uint64_t next = tail + std::min<uint64_t>(bytes, head - tail);
+    __atomic_store_n(&header->tail, next, __ATOMIC_RELEASE);
+}
+
+std::string_view SharedChannel::view() const {
+    std::string_view first, second;
+    peek(first, second);
+    return second.empty() ? first : std::string_view();
+}
+
+void SharedChannel::reset() {
+    zrun_shm_header* header = headerOf(m_memory);
+    __atomic_store_n(&header->head, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->tail, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->overflow, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->closed, 0, __ATOMIC_RELEASE);
+}
+#endif
+
+} // namespace Zrun
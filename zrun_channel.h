@@ -0,0 +1,63 @@
+#ifndef ZRUN_CHANNEL_H
+#define ZRUN_CHANNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace Zrun {
+
+// 共享内存输出通道（仅 Unix）：子程序按 zrun_shm.h 的协议直接写入，调用方原地读取，
+// 数据不经过管道，也不拷贝到 CommandResult。标准输出和错误仍照常通过管道捕获。
+// 通过 CommandOptions::sharedChannel 交给命令，同一时间只应有一个命令写入
+class SharedChannel {
+public:
+    enum class Mode {
+        Capture,    // 写满后丢弃之后的写入（overflowed() 为 true），结束后用 view() 读取全部数据
+        Stream      // 写满后子程序等待调用方用 peek/consume 取走数据
+    };
+
+    // capacity 为数据区字节数（按页向上取整，只在写入时占用内存），失败时返回 nullptr
+    static std::shared_ptr<SharedChannel> create(size_t capacity, Mode mode, std::string& error);
+
+    ~SharedChannel();
+
+    SharedChannel(const SharedChannel&) = delete;
+    SharedChannel& operator=(const SharedChannel&) = delete;
+
+    int fd() const { return m_fd; }
+    Mode mode() const { return m_mode; }
+    size_t capacity() const { return m_capacity; }
+
+    // 累计写入和读取的字节数
+    uint64_t written() const;
+    uint64_t consumed() const;
+    bool overflowed() const;
+
+    // 尚未读取的数据，跨越环的末尾时分为两段（第二段可能为空）。
+    // 在 consume 之前有效，可以在命令运行时从任意一个线程读取
+    void peek(std::string_view& first, std::string_view& second) const;
+    void consume(size_t bytes);
+
+    // 尚未读取的数据为连续的一段时返回它（Capture 模式总是如此），否则返回空
+    std::string_view view() const;
+
+    // 清空数据和溢出标志，重新用于下一条命令；不能在有写入方时调用
+    void reset();
+
+private:
+    SharedChannel() = default;
+
+    int m_fd = -1;
+    Mode m_mode = Mode::Capture;
+    size_t m_capacity = 0;
+    size_t m_mappedSize = 0;
+    void* m_memory = nullptr;
+    char* m_data = nullptr;
+};
+
+} // namespace Zrun
+
+#endif // ZRUN_CHANNEL_H
@@ -0,0 +1,233 @@
+#include "zrun_compress.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Zrun {
+
+namespace {
+constexpr size_t kMinMatch = 4;
+// LZ4 格式约定：最后 5 个字节必须是字面量，最后一个匹配至少在结尾前 12 字节开始
+constexpr size_t kLastLiterals = 5;
+constexpr size_t kMatchFindLimit = 12;
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashLog = 12;
+
+inline uint32_t read32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t hash32(uint32_t value) {
+    return (value * 2654435761u) >> (32 - kHashLog);
+}
+
+void writeLength(std::string& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+void writeSequence(std::string& out, const char* literals, size_t literalLength,
+                   size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength - kMinMatch;
+    unsigned token = (literalLength >= 15 ? 15u : static_cast<unsigned>(literalLength)) << 4;
+    token |= matchCode >= 15 ? 15u : static_cast<unsigned>(matchCode);
+    out.push_back(static_cast<char>(token));
+    if (literalLength >= 15) {
+        writeLength(out, literalLength - 15);
+    }
+    out.append(literals, literalLength);
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (matchCode >= 15) {
+        writeLength(out, matchCode - 15);
+    }
+}
+
+void writeLastLiterals(std::string& out, const char* literals, size_t literalLength) {
+    unsigned token = (literalLength >= 15 ? 15u : static_cast<unsigned>(literalLength)) << 4;
+    out.push_back(static_cast<char>(token));
+    if (literalLength >= 15) {
+        writeLength(out, literalLength - 15);
+    }
+    out.append(literals, literalLength);
+}
+
+bool readLength(const unsigned char*& ip, const unsigned char* end, size_t& length) {
+    unsigned char byte;
+    do {
+        if (ip >= end) {
+            return false;
+        }
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+}
+
+void lz4Compress(const char* src, size_t srcSize, std::string& out) {
+    const char* end = src + srcSize;
+    const char* anchor = src;
+
+    if (srcSize > kMatchFindLimit) {
+        // 存放位置 + 1，0 表示空
+        std::vector<uint32_t> table(size_t(1) << kHashLog, 0);
+        const char* matchLimit = end - kLastLiterals;
+        const char* findLimit = end - kMatchFindLimit;
+        const char* ip = src;
+
+        while (ip < findLimit) {
+            uint32_t sequence = read32(ip);
+            uint32_t h = hash32(sequence);
+            uint32_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(ip - src) + 1;
+
+            const char* match = candidate ? src + candidate - 1 : nullptr;
+            if (!match || static_cast<size_t>(ip - match) > kMaxOffset ||
+                read32(match) != sequence) {
+                // 长时间找不到匹配时加快步进，不可压缩的数据不会拖慢太多
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && match > src && ip[-1] == match[-1]) {
+                --ip;
+                --match;
+            }
+            size_t length = kMinMatch;
+            while (ip + length < matchLimit && ip[length] == match[length]) {
+                ++length;
+            }
+
+            writeSequence(out, anchor, static_cast<size_t>(ip - anchor),
+                          static_cast<size_t>(ip - match), length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    writeLastLiterals(out, anchor, static_cast<size_t>(end - anchor));
+}
+
+bool lz4Decompress(const char* src, size_t srcSize, char* dst, size_t dstSize) {
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* end = ip + srcSize;
+    char* op = dst;
+    char* outEnd = dst + dstSize;
+
+    while (ip < end) {
+        unsigned token = *ip++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(ip, end, literalLength)) {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(end - ip) ||
+            literalLength > static_cast<size_t>(outEnd - op)) {
+            return false;
+        }
+        if (literalLength) {
+            std::memcpy(op, ip, literalLength);
+        }
+        ip += literalLength;
+        op += literalLength;
+
+        if (ip == end) {
+            // 最后一个序列只有字面量
+            return op == outEnd;
+        }
+
+        if (end - ip < 2) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) {
+            return false;
+        }
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, end, matchLength)) {
+            return false;
+        }
+        matchLength += kMinMatch;
+        if (matchLength > static_cast<size_t>(outEnd - op)) {
+            return false;
+        }
+
+        const char* match = op - offset;
+        if (offset >= matchLength) {
+            std::memcpy(op, match, matchLength);
+            op += matchLength;
+        } else {
+            // 重叠复制，按字节进行
+            for (size_t i = 0; i < matchLength; ++i) {
+                *op++ = match[i];
+            }
+        }
+    }
+    return false;
+}
+
+void CompressedText::append(std::string_view data) {
+    m_size += data.size();
+
+    if (!m_pending.empty()) {
+        size_t take = std::min(kBlockSize - m_pending.size(), data.size());
+        m_pending.append(data.data(), take);
+        data.remove_prefix(take);
+        if (m_pending.size() < kBlockSize) {
+            return;
+        }
+        compressBlock(m_pending.data(), m_pending.size());
+        m_pending.clear();
+    }
+
+    // 完整的块直接从输入压缩，不经过暂存区
+    while (data.size() >= kBlockSize) {
+        compressBlock(data.data(), kBlockSize);
+        data.remove_prefix(kBlockSize);
+    }
+    m_pending.append(data.data(), data.size());
+}
+
+void CompressedText::finish() {
+    if (!m_pending.empty()) {
+        compressBlock(m_pending.data(), m_pending.size());
+        m_pending.clear();
+        m_pending.shrink_to_fit();
+    }
+}
+
+bool CompressedText::decompressTo(std::string& out) const {
+    out.reserve(out.size() + m_size);
+    return forEachChunk([&](std::string_view chunk) { out.append(chunk.data(), chunk.size()); });
+}
+
+void CompressedText::compressBlock(const char* data, size_t size) {
+    Block block;
+    block.rawSize = static_cast<uint32_t>(size);
+    lz4Compress(data, size, block.data);
+    if (block.data.size() >= size) {
+        block.data.assign(data, size);
+        block.stored = true;
+    }
+    block.data.shrink_to_fit();
+    m_compressedSize += block.data.size();
+    m_blocks.push_back(std::move(block));
+}
+
+std::shared_ptr<const CompressedText> compressText(std::string& text) {
+    auto compressed = std::make_shared<CompressedText>();
+    compressed->append(text);
+    compressed->finish();
+    text.clear();
+    text.shrink_to_fit();
+    return compressed;
+}
+
+} // namespace Zrun
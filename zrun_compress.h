@@ -0,0 +1,78 @@
+#ifndef ZRUN_COMPRESS_H
+#define ZRUN_COMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Zrun {
+
+// LZ4 块格式的压缩/解压（不含帧头），用于压缩保存捕获的输出。
+// 压缩结果追加到 out；解压要求 dstSize 恰好为原始长度，数据损坏时返回 false
+void lz4Compress(const char* src, size_t srcSize, std::string& out);
+bool lz4Decompress(const char* src, size_t srcSize, char* dst, size_t dstSize);
+
+// 分块压缩保存的文本：按到达顺序追加，每满 kBlockSize 字节压缩一块。
+// 读取时逐块解压，不需要一次性还原全部数据
+class CompressedText {
+public:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    void append(std::string_view data);
+
+    // 压缩剩余不足一块的数据，之后不应再追加
+    void finish();
+
+    // 原始字节数 / 压缩后字节数（包括尚未压缩的部分）
+    size_t size() const { return m_size; }
+    size_t compressedSize() const { return m_compressedSize + m_pending.size(); }
+
+    // 按顺序逐块解压，data 只在回调期间有效；数据损坏时停止并返回 false
+    template <typename F>
+    bool forEachChunk(F&& f) const {
+        std::string buffer;
+        for (const Block& block : m_blocks) {
+            if (block.stored) {
+                f(std::string_view(block.data));
+                continue;
+            }
+            buffer.resize(block.rawSize);
+            if (!lz4Decompress(block.data.data(), block.data.size(), &buffer[0], buffer.size())) {
+                return false;
+            }
+            f(std::string_view(buffer));
+        }
+        if (!m_pending.empty()) {
+            f(std::string_view(m_pending));
+        }
+        return true;
+    }
+
+    // 解压全部数据追加到 out
+    bool decompressTo(std::string& out) const;
+
+private:
+    void compressBlock(const char* data, size_t size);
+
+    struct Block {
+        std::string data;
+        uint32_t rawSize = 0;
+        // 压缩后没有变小时原样保存
+        bool stored = false;
+    };
+
+    std::vector<Block> m_blocks;
+    std::string m_pending;
+    size_t m_size = 0;
+    size_t m_compressedSize = 0;
+};
+
+// 压缩整段文本并清空 text
+std::shared_ptr<const CompressedText> compressText(std::string& text);
+
+} // namespace Zrun
+
+#endif // ZRUN_COMPRESS_H
@@ -1,5 +1,20 @@
 #include "zrun_core.h"
+#include "zrun_sink.h"
+#include "zrun_lines.h"
+#include "zrun_filter.h"
+#ifndef _WIN32
+#include "zrun_reactor.h"
+#include "zrun_spawn.h"
+#include "zrun_cgroup.h"
+#include "zrun_channel.h"
+#include "zrun_shm.h"
+#include "zrun_daemon.h"
+#endif
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -9,82 +24,312 @@
 #include <tchar.h>
 #else
 #include <unistd.h>
-#include <sys/wait.h>
 #include <sys/types.h>
-#include <sys/select.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
 #endif
 
 namespace Zrun {
 
 std::atomic<int> CoreImpl::s_nextAsyncId(1);
 
-struct CoreImpl::AsyncCommand {
-    int id;
-    std::string command;
-    ShellType shellType;
-    int timeoutMs;
-    OutputCallback outputCallback;
-    std::thread thread;
-    std::atomic<AsyncState> state{AsyncState::Running};
-    CommandResult result;
-    std::mutex mutex;
-    std::condition_variable cv;
-    bool cancelled{false};
-
-    AsyncCommand(int id, std::string cmd, ShellType type, int timeout, OutputCallback cb)
-        : id(id), command(std::move(cmd)), shellType(type), timeoutMs(timeout),
-        outputCallback(std::move(cb)) {}
-
-    ~AsyncCommand() {
-        if (thread.joinable()) {
-            if (state == AsyncState::Running) {
-                cancelled = true;
-                // 给线程一点时间正常退出
-                if (thread.joinable()) {
-                    thread.detach();
-                }
-            } else {
-                thread.join();
+namespace {
+// 把结果中捕获的输出作为分块一次性转发
+void forwardChunks(const ChunkCallback& callback, const CommandResult& result) {
+    if (result.compressedOutput) {
+        result.compressedOutput->forEachChunk(
+            [&](std::string_view data) { callback(data, false); });
+    } else if (!result.output.empty()) {
+        callback(result.output, false);
+    }
+    if (result.compressedError) {
+        result.compressedError->forEachChunk(
+            [&](std::string_view data) { callback(data, true); });
+    } else if (!result.error.empty()) {
+        callback(result.error, true);
+    }
+}
+
+bool succeeded(const CommandResult& result) {
+    return result.exitCode == 0 && !result.timedOut &&
+           result.limitExceeded == ResourceLimitKind::None;
+}
+
+#ifndef _WIN32
+// 由完整的环境变量列表生成传给 execve 的指针数组
+std::shared_ptr<PreparedEnvironment> makePreparedEnvironment(std::vector<std::string> entries) {
+    auto environment = std::make_shared<PreparedEnvironment>();
+    environment->entries = std::move(entries);
+    environment->path = "/usr/bin:/bin";
+    environment->pointers.reserve(environment->entries.size() + 1);
+    for (auto& entry : environment->entries) {
+        if (entry.compare(0, 5, "PATH=") == 0) {
+            environment->path = entry.substr(5);
+        }
+        environment->pointers.push_back(&entry[0]);
+    }
+    environment->pointers.push_back(nullptr);
+    return environment;
+}
+#endif
+
+// 上一个实例留下的进程不是当前进程的子进程，只能轮询是否仍然存在
+constexpr int kOrphanPollMs = 100;
+constexpr int kOrphanKillGraceMs = 2000;
+}
+
+AsyncOperation::AsyncOperation(int id, std::string cmd, CommandOptions opts, OutputCallback cb)
+    : id(id), command(std::move(cmd)), options(std::move(opts)),
+    outputCallback(std::move(cb)) {}
+
+AsyncOperation::~AsyncOperation() {
+#ifdef _WIN32
+    if (thread.joinable()) {
+        if (thread.get_id() == std::this_thread::get_id()) {
+            // 最后一个引用在执行线程自身中释放
+            thread.detach();
+        } else if (state == AsyncState::Running) {
+            cancelled = true;
+            // 给线程一点时间正常退出
+            if (thread.joinable()) {
+                thread.detach();
             }
+        } else {
+            thread.join();
+        }
+    }
+#endif
+}
+
+bool AsyncOperation::wait(int timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto finished = [this]() { return state != AsyncState::Running; };
+    if (timeoutMs < 0) {
+        cv.wait(lock, finished);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), finished);
+}
+
+bool AsyncOperation::cancel() {
+    std::vector<std::pair<ListenerId, Listener>> pending;
+    std::function<void()> hook;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (state != AsyncState::Running) {
+            return false;
+        }
+        cancelled = true;
+        state = AsyncState::Cancelled;
+#ifndef _WIN32
+        // 终止仍在运行的子进程
+        if (execution && reactor) {
+            reactor->cancel(execution);
+        }
+#endif
+        pending.swap(listeners);
+        hook = onCancel;
+        cv.notify_all();
+    }
+    if (hook) {
+        hook();
+    }
+    for (auto& listener : pending) {
+        listener.second();
+    }
+    return true;
+}
+
+AsyncOperation::ListenerId AsyncOperation::addListener(Listener listener) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (state == AsyncState::Running) {
+            ListenerId id = ++nextListenerId;
+            listeners.emplace_back(id, std::move(listener));
+            return id;
         }
     }
-};
+    listener();
+    return 0;
+}
+
+void AsyncOperation::removeListener(ListenerId id) {
+    if (id == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+        if (it->first == id) {
+            listeners.erase(it);
+            return;
+        }
+    }
+}
 
-CoreImpl::CoreImpl() = default;
+CoreImpl::CoreImpl()
+    : m_scheduler(
+          [this](const std::shared_ptr<AsyncOperation>& cmd) { launchAsync(cmd); },
+          [this](const std::shared_ptr<AsyncOperation>& cmd, CommandResult& result) {
+              completeAsync(cmd, result);
+          }) {}
 
 CoreImpl::~CoreImpl() {
-    // 清理所有异步命令
-    std::lock_guard<std::mutex> lock(m_asyncMutex);
-    for (auto& pair : m_asyncCommands) {
-        if (pair.second->state == AsyncState::Running) {
-            pair.second->cancelled = true;
-            // 尝试正常终止
-            terminateAsync(pair.first);
+    // 先结束排队中的命令，之后释放的名额不再启动新命令
+    m_scheduler.shutdown();
+
+    // 清理所有异步命令（不能在持有 m_asyncMutex 时终止，完成回调需要该锁）
+    std::vector<std::shared_ptr<AsyncOperation>> running;
+    {
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        for (auto& pair : m_asyncCommands) {
+            if (pair.second->state == AsyncState::Running) {
+                running.push_back(pair.second);
+            }
+        }
+    }
+    for (auto& shard : m_untabled) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (AsyncOperation* cmd = shard.head; cmd; cmd = cmd->untabledNext) {
+            running.push_back(cmd->shared_from_this());
         }
     }
+    for (auto& cmd : running) {
+        // 尝试正常终止
+        cmd->cancel();
+    }
+#ifndef _WIN32
+    // 断开后守护进程终止其余的命令，仍在等待的命令以失败结束
+    m_daemon.reset();
+#endif
+    // 等待中的重试在取消时已经结束，剩下的延迟任务直接丢弃
+    m_delays.shutdown();
+
+    std::lock_guard<std::mutex> lock(m_asyncMutex);
     m_asyncCommands.clear();
 }
 
 CommandResult CoreImpl::executeSync(const std::string& command,
                                     ShellType shellType,
                                     int timeoutMs) {
+    return executeSync(command, CommandOptions(shellType, timeoutMs));
+}
+
+CommandResult CoreImpl::executeSync(const std::string& command, const CommandOptions& options) {
+    return runSync(command, options, nullptr);
+}
+
+CommandResult CoreImpl::executeSync(const PreparedCommand& command,
+                                    const CommandParameters& parameters,
+                                    const CommandOptions& options) {
+    auto launch = prepareLaunch(command, parameters);
+    std::string key = launch->key;
+    return runSync(key, options, std::move(launch));
+}
+
+CommandResult CoreImpl::runSync(const std::string& command, const CommandOptions& options,
+                                std::shared_ptr<const PreparedLaunch> launch) {
+#ifndef _WIN32
+    // 客户端模式下由守护进程执行，在这里等待结果
+    if (!launch && m_daemon && m_daemon->connected() && !m_daemon->inClientThread() &&
+        DaemonClient::forwardable(options)) {
+        auto cmd = submit(command, options);
+        cmd->wait();
+        std::lock_guard<std::mutex> lock(cmd->mutex);
+        return std::move(cmd->result);
+    }
+#endif
+    std::string cacheKey;
+    std::vector<ResultCache::Dependency> dependencies;
+    bool useCache = options.cache.enabled && ResultCache::cacheable(options) && m_cache.enabled();
+    if (useCache) {
+        cacheKey = ResultCache::makeKey(command, options, m_workingDirectory, m_environment,
+                                        m_executionPolicy);
+        CommandResult cached;
+        if (m_cache.lookup(cacheKey, cached)) {
+            return cached;
+        }
+        // 在执行之前记录依赖，执行期间的修改会使结果在下次查找时失效
+        dependencies = ResultCache::snapshot(options.cache.dependencies);
+    }
+
+    CommandResult result;
+    bool inLoop = false;
+#ifndef _WIN32
+    Reactor* loop = reactor();
+    inLoop = loop && loop->inLoopThread();
+#endif
+    if (options.hedge.enabled && !inLoop) {
+        // 对冲需要同时执行多份，借用异步命令的实现并等待它结束（每次执行各自计入统计）
+        auto operation = std::make_shared<AsyncOperation>(nextAsyncId(), command, options,
+                                                          nullptr);
+        operation->launch = std::move(launch);
+        operation->keepInTable = false;
+        startRetry(operation);
+        operation->wait();
+        std::lock_guard<std::mutex> lock(operation->mutex);
+        result = std::move(operation->result);
+    } else {
+        result = runAttempts(command, options, launch.get());
+    }
+
+    if (useCache) {
+        m_cache.store(std::move(cacheKey), options.cache, std::move(dependencies), result);
+    }
+    return result;
+}
+
+CommandResult CoreImpl::runAttempts(const std::string& command, const CommandOptions& options,
+                                    const PreparedLaunch* launch) {
+    CommandResult result;
+    int attempts = 0;
+    while (true) {
 #ifdef _WIN32
-    return executeSyncWindows(command, shellType, timeoutMs);
+        result = executeSyncWindows(command, options, launch);
 #else
-    return executeSyncUnix(command, shellType, timeoutMs);
+        result = executeSyncUnix(command, options, launch);
 #endif
+        recordResult(result);
+        ++attempts;
+        if (options.hedge.enabled && succeeded(result)) {
+            m_latency.record(command, result.executionTime);
+        }
+        if (attempts >= options.retry.maxAttempts || !retryable(options.retry, result)) {
+            break;
+        }
+        m_retries.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(retryBackoffMs(options.retry, attempts)));
+    }
+    result.attempts = attempts;
+    return result;
 }
 
 #ifdef _WIN32
 CommandResult CoreImpl::executeSyncWindows(const std::string& command,
-                                           ShellType shellType,
-                                           int timeoutMs) {
+                                           const CommandOptions& options,
+                                           const PreparedLaunch* launch) {
     CommandResult result;
     auto startTime = std::chrono::steady_clock::now();
+    const int timeoutMs = options.timeoutMs;
 
-    std::string fullCommand = buildShellCommand(command, shellType);
+    if (launch && !launch->error.empty()) {
+        result.exitCode = -1;
+        result.error = launch->error;
+        return result;
+    }
+    std::string fullCommand = launch ? launch->commandLine :
+                                       buildShellCommand(command, options.shellType);
+
+    // 打开输出去向
+    StreamPump stdoutPump(options.stdoutSink);
+    StreamPump stderrPump(options.stderrSink);
+    std::string sinkError;
+    if (!stdoutPump.open(sinkError) || !stderrPump.open(sinkError)) {
+        result.exitCode = -1;
+        result.error = sinkError;
+        return result;
+    }
 
     SECURITY_ATTRIBUTES sa;
     sa.nLength = sizeof(SECURITY_ATTRIBUTES);
@@ -178,25 +423,45 @@ CommandResult CoreImpl::executeSyncWindows(const std::string& command,
         result.exitCode = static_cast<int>(exitCode);
     }
 
-    // 读取输出
-    const int BUFFER_SIZE = 4096;
-    char buffer[BUFFER_SIZE];
-    DWORD bytesRead;
-
-    while (true) {
-        if (!ReadFile(hStdOutRd, buffer, BUFFER_SIZE - 1, &bytesRead, nullptr) || bytesRead == 0) {
-            break;
+    // 读取输出：直接读入捕获缓冲区的分块并写入各个去向
+    stdoutPump.pumpHandle(hStdOutRd);
+    stderrPump.pumpHandle(hStdErrRd);
+    stdoutPump.finish(result.output);
+    stderrPump.finish(result.error);
+    result.outputBytes = stdoutPump.bytes();
+    result.errorBytes = stderrPump.bytes();
+
+    // Windows 上在读取完成后统一分行
+    if (options.lineCallback) {
+        for (int i = 0; i < 2; ++i) {
+            bool isError = (i == 1);
+            LineSplitter lines(options.maxLineLength);
+            auto onLine = [&](std::string_view line) { options.lineCallback(line, isError); };
+            lines.feed(isError ? result.error : result.output, onLine);
+            lines.finish(onLine);
         }
-        buffer[bytesRead] = '\0';
-        result.output.append(buffer, bytesRead);
     }
-
-    while (true) {
-        if (!ReadFile(hStdErrRd, buffer, BUFFER_SIZE - 1, &bytesRead, nullptr) || bytesRead == 0) {
-            break;
+    // 过滤在读取完成后进行
+    try {
+        if (options.stdoutFilter.active() && options.stdoutSink.captures()) {
+            result.outputMatches = applyFilter(options.stdoutFilter, result.output,
+                                               options.maxLineLength);
+        }
+        if (options.stderrFilter.active() && options.stderrSink.captures()) {
+            result.errorMatches = applyFilter(options.stderrFilter, result.error,
+                                              options.maxLineLength);
+        }
+    } catch (const std::regex_error& e) {
+        result.exitCode = -1;
+        result.error = "Invalid output filter: " + std::string(e.what());
+    }
+    if (options.compressOutput) {
+        if (options.stdoutSink.captures()) {
+            result.compressedOutput = compressText(result.output);
+        }
+        if (options.stderrSink.captures()) {
+            result.compressedError = compressText(result.error);
         }
-        buffer[bytesRead] = '\0';
-        result.error.append(buffer, bytesRead);
     }
 
     // 清理资源
@@ -212,137 +477,274 @@ CommandResult CoreImpl::executeSyncWindows(const std::string& command,
     return result;
 }
 #else
-CommandResult CoreImpl::executeSyncUnix(const std::string& command,
-                                        ShellType shellType,
-                                        int timeoutMs) {
-    CommandResult result;
-    auto startTime = std::chrono::steady_clock::now();
-
-    std::string fullCommand = buildShellCommand(command, shellType);
-
-    int stdoutPipe[2] = {-1, -1};
-    int stderrPipe[2] = {-1, -1};
-
-    if (pipe(stdoutPipe) == -1 || pipe(stderrPipe) == -1) {
-        result.exitCode = -1;
-        result.error = "Failed to create pipe: " + std::string(strerror(errno));
-        return result;
+std::shared_ptr<Execution> CoreImpl::startExecution(const std::string& command,
+                                                    const CommandOptions& options,
+                                                    CommandResult& failure,
+                                                    const PreparedLaunch* launch) {
+    if (launch && !launch->error.empty()) {
+        failure.exitCode = -1;
+        failure.error = launch->error;
+        return nullptr;
     }
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        result.exitCode = -1;
-        result.error = "Fork failed: " + std::string(strerror(errno));
-        close(stdoutPipe[0]);
-        close(stdoutPipe[1]);
-        close(stderrPipe[0]);
-        close(stderrPipe[1]);
-        return result;
+    auto execution = std::make_shared<Execution>(options.stdoutSink, options.stderrSink);
+    execution->startTime = std::chrono::steady_clock::now();
+    execution->timeoutMs = options.timeoutMs;
+
+    // 伪终端模式只有合并后的一个输出流
+    bool terminal = options.terminal.enabled;
+    int streamCount = terminal ? 1 : 2;
+
+    // 创建过滤器和压缩
+    const OutputFilter* filters[2] = {&options.stdoutFilter, &options.stderrFilter};
+    const OutputSink* sinks[2] = {&options.stdoutSink, &options.stderrSink};
+    for (int i = 0; i < streamCount; ++i) {
+        execution->streams[i].lines = LineSplitter(options.maxLineLength);
+        if (filters[i]->active() && sinks[i]->captures()) {
+            try {
+                execution->streams[i].filter =
+                    std::make_unique<StreamFilter>(*filters[i], options.maxLineLength);
+            } catch (const std::regex_error& e) {
+                failure.exitCode = -1;
+                failure.error = "Invalid output filter: " + std::string(e.what());
+                return nullptr;
+            }
+        } else if (options.compressOutput && sinks[i]->captures()) {
+            execution->streams[i].compressed = std::make_unique<CompressedText>();
+        }
+    }
+    execution->compressOutput = options.compressOutput;
+
+    // 为命令创建 cgroup 子组
+    if (options.limits.usesCgroup()) {
+        std::string cgroupError;
+        execution->cgroup = CommandCgroup::create(options.limits, cgroupError);
+        if (!execution->cgroup) {
+            failure.exitCode = -1;
+            failure.error = cgroupError;
+            return nullptr;
+        }
+    }
+    execution->cpuLimited = options.limits.cpuSeconds >= 0;
+
+    // 解析 CPU 放置（轮转策略在这里前进一步）
+    SpawnPlacement placement;
+    std::string placementError;
+    if (!m_placer.resolve(options.placement, placement, placementError)) {
+        failure.exitCode = -1;
+        failure.error = placementError;
+        return nullptr;
     }
 
-    if (pid == 0) { // 子进程
-        // 关闭读端
-        close(stdoutPipe[0]);
-        close(stderrPipe[0]);
-
-        // 重定向标准输出和错误
-        dup2(stdoutPipe[1], STDOUT_FILENO);
-        dup2(stderrPipe[1], STDERR_FILENO);
-
-        // 关闭写端（已经重定向）
-        close(stdoutPipe[1]);
-        close(stderrPipe[1]);
+    // 打开输出去向
+    std::string error;
+    if (!execution->streams[0].pump.open(error) ||
+        (!terminal && !execution->streams[1].pump.open(error))) {
+        failure.exitCode = -1;
+        failure.error = error;
+        return nullptr;
+    }
 
-        // 设置工作目录
-        if (!m_workingDirectory.empty() &&
-            chdir(m_workingDirectory.c_str()) == -1) {
-            exit(127);
+    int stdoutPipe[2] = {-1, -1};
+    int stderrPipe[2] = {-1, -1};
+    // 管道和伪终端都带 FD_CLOEXEC，避免并发启动的其他子进程继承写端
+    if (terminal) {
+        // 伪终端的主设备作为合并的输出流，标准错误的流不打开
+        if (!openTerminal(stdoutPipe[0], stdoutPipe[1], options.terminal.columns,
+                          options.terminal.rows, error)) {
+            failure.exitCode = -1;
+            failure.error = error;
+            return nullptr;
+        }
+    } else if (!createPipe(stdoutPipe) || !createPipe(stderrPipe)) {
+        failure.exitCode = -1;
+        failure.error = "Failed to create pipe: " + std::string(strerror(errno));
+        for (int fd : {stdoutPipe[0], stdoutPipe[1], stderrPipe[0], stderrPipe[1]}) {
+            if (fd != -1) {
+                close(fd);
+            }
         }
+        return nullptr;
+    }
 
-        // 设置环境变量
+    SpawnRequest request;
+    if (launch) {
+        // 可执行文件和环境变量都已准备好，直接启动
+        request.path = launch->executable;
+        request.argv = launch->argv;
+        if (launch->environment) {
+            request.inheritEnvironment = false;
+            request.envp = launch->environment->pointers.data();
+        }
+    } else {
+        request.path = "/bin/sh";
+        request.argv = {"sh", "-c", buildShellCommand(command, options.shellType)};
         if (!m_environment.empty()) {
-            for (const auto& pair : m_environment) {
-                setenv(pair.first.c_str(), pair.second.c_str(), 1);
+            request.inheritEnvironment = false;
+            request.environment = mergeEnvironment(m_environment);
+        }
+    }
+    if (options.sharedChannel) {
+        // 把通道的 fd 编号加入子进程的环境变量
+        std::vector<std::string> environment;
+        if (request.envp) {
+            for (char* const* entry = request.envp; *entry; ++entry) {
+                environment.emplace_back(*entry);
             }
+        } else if (request.inheritEnvironment) {
+            environment = mergeEnvironment({});
+        } else {
+            environment = std::move(request.environment);
         }
-
-        // 执行命令
-        execl("/bin/sh", "sh", "-c", fullCommand.c_str(), (char*)nullptr);
-        exit(127); // execl失败
+        static const std::string prefix = std::string(ZRUN_SHM_ENV) + "=";
+        environment.erase(std::remove_if(environment.begin(), environment.end(),
+                                         [](const std::string& entry) {
+                                             return entry.compare(0, prefix.size(), prefix) == 0;
+                                         }),
+                          environment.end());
+        environment.push_back(prefix + std::to_string(ZRUN_SHM_CHILD_FD));
+        request.inheritEnvironment = false;
+        request.envp = nullptr;
+        request.environment = std::move(environment);
+        request.sharedFd = options.sharedChannel->fd();
+    }
+    request.workingDirectory = launch && !launch->workingDirectory.empty() ?
+                                   launch->workingDirectory : m_workingDirectory;
+    if (terminal) {
+        request.terminalFd = stdoutPipe[1];
+    } else {
+        request.stdoutFd = stdoutPipe[1];
+        request.stderrFd = stderrPipe[1];
+    }
+    if (options.limits.active()) {
+        request.limits = &options.limits;
+    }
+    if (execution->cgroup) {
+        request.cgroupProcsFd = execution->cgroup->procsFd();
+    }
+    if (!placement.empty()) {
+        request.placement = &placement;
     }
 
-    // 父进程
-    // 关闭写端
+    pid_t pid = spawnProcess(request, error);
+
+    // 关闭写端（伪终端的从设备），子进程退出后读取端才能得到 EOF/EIO
     close(stdoutPipe[1]);
-    close(stderrPipe[1]);
+    if (!terminal) {
+        close(stderrPipe[1]);
+    }
 
-    // 设置非阻塞
-    fcntl(stdoutPipe[0], F_SETFL, O_NONBLOCK);
-    fcntl(stderrPipe[0], F_SETFL, O_NONBLOCK);
+    if (pid == -1) {
+        failure.exitCode = -1;
+        failure.error = error;
+        close(stdoutPipe[0]);
+        if (!terminal) {
+            close(stderrPipe[0]);
+        }
+        return nullptr;
+    }
 
-    auto readFromPipe = [](int fd, std::string& output) {
-        char buffer[4096];
-        ssize_t bytesRead;
-        while ((bytesRead = read(fd, buffer, sizeof(buffer) - 1)) > 0) {
-            buffer[bytesRead] = '\0';
-            output.append(buffer, bytesRead);
+    int readEnds[2] = {stdoutPipe[0], stderrPipe[0]};
+    for (int i = 0; i < streamCount; ++i) {
+        Execution::Stream& stream = execution->streams[i];
+        stream.io.fd = readEnds[i];
+        stream.open = true;
+        // 设置非阻塞
+        fcntl(readEnds[i], F_SETFL, fcntl(readEnds[i], F_GETFL) | O_NONBLOCK);
+        // 伪终端在从设备关闭后以 EIO 结束，只按可读事件处理，由 pump 的读取报告
+        if (stream.pump.directRead() && !terminal) {
+            stream.io.directTarget = &stream.pump.capture();
         }
-        return bytesRead;
-    };
+    }
 
-    int status;
-    bool processDone = false;
-    auto timeoutTime = startTime + std::chrono::milliseconds(timeoutMs);
+    execution->pid = pid;
+    execution->process.pidfd = openPidfd(pid);
+    execution->onLine = options.lineCallback;
+    return execution;
+}
 
-    while (!processDone) {
-        // 检查超时
-        if (std::chrono::steady_clock::now() > timeoutTime) {
-            kill(pid, SIGTERM);
-            result.timedOut = true;
-            break;
-        }
+CommandResult CoreImpl::executeSyncUnix(const std::string& command,
+                                        const CommandOptions& options,
+                                        const PreparedLaunch* launch) {
+    CommandResult result;
 
-        // 检查进程状态
-        pid_t waitResult = waitpid(pid, &status, WNOHANG);
-        if (waitResult == pid) {
-            processDone = true;
-            if (WIFEXITED(status)) {
-                result.exitCode = WEXITSTATUS(status);
-            } else {
-                result.exitCode = -1;
-            }
-        } else if (waitResult == -1 && errno != ECHILD) {
-            result.exitCode = -1;
-            result.error = "waitpid failed: " + std::string(strerror(errno));
-            break;
-        }
+    Reactor* loop = reactor();
+    if (!loop) {
+        result.exitCode = -1;
+        result.error = "No I/O backend available";
+        return result;
+    }
 
-        // 读取可用输出
-        readFromPipe(stdoutPipe[0], result.output);
-        readFromPipe(stderrPipe[0], result.error);
+    auto execution = startExecution(command, options, result, launch);
+    if (!execution) {
+        return result;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    execution->onComplete = [&](CommandResult& completed) {
+        std::lock_guard<std::mutex> lock(mutex);
+        result = std::move(completed);
+        done = true;
+        cv.notify_all();
+    };
 
-        // 短暂休眠
-        usleep(10000); // 10ms
+    if (loop->inLoopThread()) {
+        // 在事件循环回调中同步执行：用临时的内联事件循环，避免等待自己
+        Reactor inlineLoop(m_ioBackendType, false);
+        inlineLoop.submit(execution);
+        inlineLoop.runUntilComplete(execution);
+        return result;
     }
 
-    // 读取剩余输出
-    readFromPipe(stdoutPipe[0], result.output);
-    readFromPipe(stderrPipe[0], result.error);
+    loop->submit(execution);
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return done; });
+    return result;
+}
 
-    // 关闭管道
-    close(stdoutPipe[0]);
-    close(stderrPipe[0]);
+void CoreImpl::startAsyncUnix(std::shared_ptr<AsyncOperation> cmd) {
+    CommandResult failure;
+    Reactor* loop = reactor();
+    std::shared_ptr<Execution> execution;
+    if (loop) {
+        execution = startExecution(cmd->command, cmd->options, failure, cmd->launch.get());
+    } else {
+        failure.exitCode = -1;
+        failure.error = "No I/O backend available";
+    }
 
-    // 确保进程结束
-    if (!processDone) {
-        waitpid(pid, &status, 0);
+    if (!execution) {
+        completeAsync(cmd, failure);
+        return;
+    }
+    if (cmd->journalId) {
+        m_journal.recordStart(cmd->journalId, execution->pid);
     }
 
-    auto endTime = std::chrono::steady_clock::now();
-    result.executionTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-                               endTime - startTime).count();
+    execution->onComplete = [this, cmd](CommandResult& result) {
+        completeAsync(cmd, result);
+    };
+    if (cmd->chunkCallback) {
+        execution->onChunk = cmd->chunkCallback;
+    }
+    // 在锁内提交，保证之后的 cancel() 一定排在提交之后
+    std::lock_guard<std::mutex> lock(cmd->mutex);
+    cmd->execution = execution;
+    cmd->reactor = loop;
+    loop->submit(execution);
+    if (cmd->cancelled) {
+        loop->cancel(execution);
+    }
+}
 
-    return result;
+Reactor* CoreImpl::reactor() {
+    std::lock_guard<std::mutex> lock(m_reactorMutex);
+    if (!m_reactor) {
+        m_reactor = std::make_unique<Reactor>(m_ioBackendType);
+    }
+    return m_reactor->valid() ? m_reactor.get() : nullptr;
 }
 #endif
 
@@ -395,51 +797,947 @@ std::string CoreImpl::buildShellCommand(const std::string& command, ShellType sh
     return fullCommand;
 }
 
+#ifdef _WIN32
+namespace {
+// 按 CommandLineToArgvW 的规则给参数加引号
+void appendWindowsArgument(std::string& commandLine, const std::string& argument) {
+    if (!commandLine.empty()) {
+        commandLine += ' ';
+    }
+    if (!argument.empty() && argument.find_first_of(" \t\"") == std::string::npos) {
+        commandLine += argument;
+        return;
+    }
+    commandLine += '"';
+    size_t backslashes = 0;
+    for (char c : argument) {
+        if (c == '\\') {
+            ++backslashes;
+            continue;
+        }
+        // 引号前的反斜杠需要加倍
+        commandLine.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+        backslashes = 0;
+        commandLine += c;
+    }
+    commandLine.append(backslashes * 2, '\\');
+    commandLine += '"';
+}
+}
+#endif
+
+std::shared_ptr<const PreparedLaunch> CoreImpl::prepareLaunch(const PreparedCommand& command,
+                                                              const CommandParameters& parameters) {
+    auto launch = std::make_shared<PreparedLaunch>();
+    if (!command.expand(parameters, launch->argv, launch->error)) {
+        return launch;
+    }
+    // 键以 NUL 开头，不会与 shell 命令的文本相同
+    launch->key.assign(1, '\0');
+    for (const auto& arg : launch->argv) {
+        launch->key += std::to_string(arg.size());
+        launch->key += ':';
+        launch->key += arg;
+    }
+
+#ifdef _WIN32
+    for (const auto& arg : launch->argv) {
+        appendWindowsArgument(launch->commandLine, arg);
+    }
+    command.resolve(std::string(), m_workingDirectory, launch->executable, launch->error);
+#else
+    launch->environment = preparedEnvironment();
+    std::string path;
+    if (launch->environment) {
+        path = launch->environment->path;
+    } else {
+        const char* value = getenv("PATH");
+        path = value ? value : "/usr/bin:/bin";
+    }
+    command.resolve(path, m_workingDirectory, launch->executable, launch->error);
+#endif
+    return launch;
+}
+
+std::shared_ptr<const PreparedEnvironment> CoreImpl::preparedEnvironment() {
+#ifdef _WIN32
+    return nullptr;
+#else
+    std::lock_guard<std::mutex> lock(m_environmentMutex);
+    if (m_environment.empty()) {
+        return nullptr;
+    }
+    if (!m_preparedEnvironment) {
+        m_preparedEnvironment = makePreparedEnvironment(mergeEnvironment(m_environment));
+    }
+    return m_preparedEnvironment;
+#endif
+}
+
 int CoreImpl::executeAsync(const std::string& command,
                            ShellType shellType,
                            int timeoutMs,
                            OutputCallback outputCallback) {
-    int asyncId = nextAsyncId();
+    return executeAsync(command, CommandOptions(shellType, timeoutMs), std::move(outputCallback));
+}
+
+int CoreImpl::executeAsync(const std::string& command, const CommandOptions& options,
+                           OutputCallback outputCallback) {
+    return startAsync(std::make_shared<AsyncOperation>(
+        nextAsyncId(), command, options, std::move(outputCallback)));
+}
 
-    auto asyncCmd = std::make_shared<AsyncCommand>(
-        asyncId, command, shellType, timeoutMs, std::move(outputCallback)
-        );
+int CoreImpl::executeAsync(const std::string& command, const CommandOptions& options,
+                           ChunkCallback chunkCallback, CompletionCallback completionCallback) {
+    auto operation = createAsync(command, options);
+    operation->chunkCallback = std::move(chunkCallback);
+    operation->completionCallback = std::move(completionCallback);
+    operation->keepInTable = false;
+    return startAsync(std::move(operation));
+}
 
-    {
+int CoreImpl::executeAsync(const PreparedCommand& command, const CommandParameters& parameters,
+                           const CommandOptions& options, OutputCallback outputCallback) {
+    auto launch = prepareLaunch(command, parameters);
+    auto operation = std::make_shared<AsyncOperation>(nextAsyncId(), launch->key, options,
+                                                      std::move(outputCallback));
+    operation->launch = std::move(launch);
+    return startAsync(std::move(operation));
+}
+
+ParallelMapSummary CoreImpl::parallelMap(const PreparedCommand& command,
+                                         const std::vector<std::string>& inputs,
+                                         const ParallelMapOptions& options,
+                                         const ParallelResultCallback& callback) {
+    struct Completion {
+        size_t index;
+        bool cancelled;
+        CommandResult result;
+    };
+    // 完成回调在事件循环线程中执行，只把结果交给调用线程
+    struct Completions {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<Completion> done;
+    };
+
+    ParallelMapSummary summary;
+    auto startTime = std::chrono::steady_clock::now();
+    size_t concurrency = options.concurrency > 0 ?
+                             static_cast<size_t>(options.concurrency) :
+                             std::max(1u, std::thread::hardware_concurrency());
+    auto completions = std::make_shared<Completions>();
+    std::map<size_t, std::shared_ptr<AsyncOperation>> running;
+    // 按顺序回调时暂存的结果，已取消的为空
+    std::map<size_t, std::unique_ptr<CommandResult>> pending;
+    size_t next = 0;
+    size_t nextToDeliver = 0;
+    bool stopping = false;
+
+    while (true) {
+        while (!stopping && running.size() < concurrency && next < inputs.size()) {
+            size_t index = next++;
+            auto launch = prepareLaunch(command, {{"input", inputs[index]},
+                                                  {"index", std::to_string(index)}});
+            auto operation = std::make_shared<AsyncOperation>(nextAsyncId(), launch->key,
+                                                              options.command, nullptr);
+            operation->launch = std::move(launch);
+            operation->keepInTable = false;
+            operation->inTable = false;
+            operation->completionCallback = [completions, index](AsyncState state,
+                                                                 CommandResult& result) {
+                std::lock_guard<std::mutex> lock(completions->mutex);
+                completions->done.push_back(
+                    {index, state == AsyncState::Cancelled, std::move(result)});
+                completions->cv.notify_one();
+            };
+            running[index] = operation;
+            ++summary.started;
+            startAsync(std::move(operation));
+        }
+        if (running.empty()) {
+            break;
+        }
+
+        std::vector<Completion> batch;
+        {
+            std::unique_lock<std::mutex> lock(completions->mutex);
+            completions->cv.wait(lock, [&]() { return !completions->done.empty(); });
+            batch.swap(completions->done);
+        }
+
+        for (auto& completion : batch) {
+            running.erase(completion.index);
+            CommandResult& result = completion.result;
+            if (completion.cancelled) {
+                ++summary.skipped;
+                if (options.ordered) {
+                    pending.emplace(completion.index, nullptr);
+                }
+                continue;
+            }
+
+            summary.totalExecutionMs += result.executionTime;
+            if (succeeded(result)) {
+                ++summary.succeeded;
+            } else {
+                ++summary.failed;
+                if (options.stopOnFailure && !stopping) {
+                    stopping = true;
+                    summary.stopped = true;
+                    for (auto& pair : running) {
+                        pair.second->cancel();
+                    }
+                }
+            }
+
+            if (!options.ordered) {
+                if (callback) {
+                    callback(completion.index, result);
+                }
+            } else {
+                pending.emplace(completion.index,
+                                std::make_unique<CommandResult>(std::move(result)));
+            }
+        }
+
+        // 依次交出已经连续完成的结果
+        while (!pending.empty() && pending.begin()->first == nextToDeliver) {
+            if (pending.begin()->second && callback) {
+                callback(nextToDeliver, *pending.begin()->second);
+            }
+            pending.erase(pending.begin());
+            ++nextToDeliver;
+        }
+    }
+
+    summary.skipped += inputs.size() - next;
+    summary.elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - startTime).count();
+    return summary;
+}
+
+std::shared_ptr<AsyncOperation> CoreImpl::submit(const std::string& command,
+                                                 const CommandOptions& options,
+                                                 OutputCallback outputCallback) {
+    auto operation = createAsync(command, options);
+    operation->outputCallback = std::move(outputCallback);
+    operation->keepInTable = false;
+    operation->inTable = false;
+    startAsync(operation);
+    return operation;
+}
+
+std::shared_ptr<AsyncOperation> CoreImpl::createAsync(const std::string& command,
+                                                      const CommandOptions& options) {
+    return std::make_shared<AsyncOperation>(nextAsyncId(), command, options, nullptr);
+}
+
+int CoreImpl::startAsync(std::shared_ptr<AsyncOperation> asyncCmd) {
+    int asyncId = asyncCmd->id;
+    // 只记录之后能按 id 查询的命令
+    if (asyncCmd->keepInTable && m_journal.isOpen()) {
+        asyncCmd->journalId = asyncId;
+        m_journal.recordSubmit(asyncId, asyncCmd->command);
+    }
+
+    if (asyncCmd->inTable) {
         std::lock_guard<std::mutex> lock(m_asyncMutex);
         m_asyncCommands[asyncId] = asyncCmd;
+    } else {
+        linkUntabled(asyncCmd);
     }
 
-    // 启动线程执行命令
-    asyncCmd->thread = std::thread(&CoreImpl::asyncExecutionThread, this, asyncCmd);
+    if (asyncCmd->options.singleFlight && joinSingleFlight(asyncCmd)) {
+        return asyncId;
+    }
 
+    dispatchAsync(asyncCmd);
     return asyncId;
 }
 
-void CoreImpl::asyncExecutionThread(std::shared_ptr<AsyncCommand> cmd) {
-    CommandResult result = executeSync(cmd->command, cmd->shellType, cmd->timeoutMs);
+void CoreImpl::linkUntabled(const std::shared_ptr<AsyncOperation>& cmd) {
+    UntabledShard& shard = m_untabled[static_cast<unsigned>(cmd->id) % kUntabledShards];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        cmd->untabledNext = shard.head;
+        if (shard.head) {
+            shard.head->untabledPrev = cmd.get();
+        }
+        shard.head = cmd.get();
+    }
+    // 取消和完成都会调用监听器；已经结束时立即移除
+    AsyncOperation* raw = cmd.get();
+    cmd->addListener([this, raw]() { unlinkUntabled(raw); });
+}
 
-    std::lock_guard<std::mutex> lock(cmd->mutex);
-    if (cmd->cancelled) {
-        cmd->state = AsyncState::Cancelled;
+void CoreImpl::unlinkUntabled(AsyncOperation* cmd) {
+    UntabledShard& shard = m_untabled[static_cast<unsigned>(cmd->id) % kUntabledShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (cmd->untabledPrev) {
+        cmd->untabledPrev->untabledNext = cmd->untabledNext;
+    } else {
+        shard.head = cmd->untabledNext;
+    }
+    if (cmd->untabledNext) {
+        cmd->untabledNext->untabledPrev = cmd->untabledPrev;
+    }
+    cmd->untabledPrev = nullptr;
+    cmd->untabledNext = nullptr;
+}
+
+void CoreImpl::dispatchAsync(const std::shared_ptr<AsyncOperation>& cmd) {
+#ifndef _WIN32
+    if (!cmd->launch && m_daemon && m_daemon->connected() &&
+        DaemonClient::forwardable(cmd->options)) {
+        auto environment = preparedEnvironment();
+        m_daemon->submit(cmd, environment ? environment->entries : mergeEnvironment({}),
+                         m_workingDirectory);
+        return;
+    }
+#endif
+    if (cmd->options.retry.active() || cmd->options.hedge.enabled) {
+        startRetry(cmd);
+        return;
+    }
+    // 经过准入调度，有空闲名额时立即启动
+    m_scheduler.submit(cmd);
+}
+
+void CoreImpl::startRetry(const std::shared_ptr<AsyncOperation>& cmd) {
+    auto run = std::make_shared<RetryRun>();
+    run->outer = cmd;
+    run->latencyKey = cmd->command;
+    {
+        std::lock_guard<std::mutex> lock(cmd->mutex);
+        cmd->onCancel = [this, weak = std::weak_ptr<RetryRun>(run)]() {
+            if (auto run = weak.lock()) {
+                cancelRetry(run);
+            }
+        };
+    }
+    launchAttempt(run, false);
+    // 设置钩子之前已被取消
+    if (cmd->state != AsyncState::Running) {
+        cancelRetry(run);
+    }
+}
+
+void CoreImpl::launchAttempt(const std::shared_ptr<RetryRun>& run, bool hedge) {
+    const auto& outer = run->outer;
+    // 每次执行本身不再重试、对冲或合并，输出在采用后才转发给 outer
+    CommandOptions options = outer->options;
+    options.retry = RetryPolicy();
+    options.hedge = HedgePolicy();
+    options.singleFlight = false;
+    auto attempt = std::make_shared<AsyncOperation>(nextAsyncId(), outer->command,
+                                                    std::move(options), nullptr);
+    attempt->launch = outer->launch;
+    attempt->keepInTable = false;
+    attempt->journalId = outer->journalId;
+    AsyncOperation* self = attempt.get();
+    attempt->completionCallback = [this, run, self, hedge](AsyncState, CommandResult& result) {
+        onAttemptDone(run, self, hedge, result);
+    };
+
+    bool retry;
+    {
+        std::lock_guard<std::mutex> lock(run->mutex);
+        if (run->finished) {
+            return;
+        }
+        run->live.push_back(attempt);
+        ++run->launched;
+        if (!hedge) {
+            ++run->rounds;
+        }
+        retry = !hedge && run->rounds > 1;
+    }
+    if (hedge) {
+        m_hedgesLaunched.fetch_add(1, std::memory_order_relaxed);
+    } else if (retry) {
+        m_retries.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    m_scheduler.submit(attempt);
+    scheduleHedge(run);
+}
+
+void CoreImpl::scheduleHedge(const std::shared_ptr<RetryRun>& run) {
+    const HedgePolicy& policy = run->outer->options.hedge;
+    // 两份副本不能同时写入同一个共享通道
+    if (!policy.enabled || run->outer->options.sharedChannel) {
+        return;
+    }
+    long long delay = m_latency.percentile(run->latencyKey, policy.percentile,
+                                           policy.minSamples);
+    if (delay < 0) {
+        delay = policy.delayMs;
+    }
+    {
+        std::lock_guard<std::mutex> lock(run->mutex);
+        if (delay < 0 || run->finished || run->hedgeTimer != 0 ||
+            static_cast<int>(run->live.size()) >= std::max(policy.maxCopies, 1)) {
+            return;
+        }
+    }
+
+    DelayQueue::Id id = m_delays.schedule(static_cast<int>(std::min(delay, 24LL * 3600 * 1000)),
+                                          [this, run]() { onHedgeTimer(run); });
+    bool stale = false;
+    {
+        std::lock_guard<std::mutex> lock(run->mutex);
+        if (run->finished || run->hedgeTimer != 0) {
+            stale = true;
+        } else {
+            run->hedgeTimer = id;
+        }
+    }
+    if (stale) {
+        m_delays.cancel(id);
+    }
+}
+
+void CoreImpl::onHedgeTimer(const std::shared_ptr<RetryRun>& run) {
+    {
+        std::lock_guard<std::mutex> lock(run->mutex);
+        run->hedgeTimer = 0;
+        if (run->finished || run->live.empty() || run->outer->state != AsyncState::Running) {
+            return;
+        }
+    }
+    launchAttempt(run, true);
+}
+
+void CoreImpl::onAttemptDone(const std::shared_ptr<RetryRun>& run, AsyncOperation* attempt,
+                             bool hedge, CommandResult& result) {
+    const auto& outer = run->outer;
+    const RetryPolicy& policy = outer->options.retry;
+    if (outer->options.hedge.enabled && succeeded(result)) {
+        m_latency.record(run->latencyKey, result.executionTime);
+    }
+
+    std::vector<std::shared_ptr<AsyncOperation>> losers;
+    DelayQueue::Id hedgeTimer;
+    DelayQueue::Id backoffTimer = 0;
+    int attempts;
+    bool finish = false;
+    {
+        std::lock_guard<std::mutex> lock(run->mutex);
+        if (run->finished) {
+            // 已经采用了其他执行的结果，这是被终止的副本
+            return;
+        }
+        auto& live = run->live;
+        live.erase(std::remove_if(live.begin(), live.end(),
+                                  [attempt](const std::shared_ptr<AsyncOperation>& cmd) {
+                                      return cmd.get() == attempt;
+                                  }),
+                   live.end());
+
+        if (outer->state != AsyncState::Running || !retryable(policy, result)) {
+            finish = true;
+        } else if (!live.empty()) {
+            // 还有其他副本在执行，等待它们的结果
+            return;
+        } else if (run->rounds < policy.maxAttempts) {
+            int delay = retryBackoffMs(policy, run->rounds);
+            run->backoffTimer = m_delays.schedule(delay, [this, run]() {
+                {
+                    std::lock_guard<std::mutex> lock(run->mutex);
+                    run->backoffTimer = 0;
+                }
+                launchAttempt(run, false);
+            });
+            // 已经停止时不再重试
+            finish = run->backoffTimer == 0;
+        } else {
+            finish = true;
+        }
+
+        hedgeTimer = run->hedgeTimer;
+        run->hedgeTimer = 0;
+        if (finish) {
+            run->finished = true;
+            losers.swap(live);
+            backoffTimer = run->backoffTimer;
+            run->backoffTimer = 0;
+        }
+        attempts = run->launched;
+    }
+
+    // 新的一轮重新计算对冲的时机
+    if (hedgeTimer != 0) {
+        m_delays.cancel(hedgeTimer);
+    }
+    if (!finish) {
+        return;
+    }
+    if (backoffTimer != 0) {
+        m_delays.cancel(backoffTimer);
+    }
+    for (const auto& loser : losers) {
+        loser->cancel();
+    }
+
+    result.attempts = attempts;
+    result.hedged = hedge;
+    if (hedge) {
+        m_hedgeWins.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (outer->chunkCallback && outer->state == AsyncState::Running) {
+        forwardChunks(outer->chunkCallback, result);
+    }
+    completeAsync(outer, result, false);
+}
+
+void CoreImpl::cancelRetry(const std::shared_ptr<RetryRun>& run) {
+    std::vector<std::shared_ptr<AsyncOperation>> live;
+    DelayQueue::Id hedgeTimer = 0;
+    DelayQueue::Id backoffTimer = 0;
+    int attempts = 0;
+    {
+        std::lock_guard<std::mutex> lock(run->mutex);
+        if (run->finished) {
+            return;
+        }
+        live = run->live;
+        if (live.empty()) {
+            // 正在等待下一次重试，直接结束
+            run->finished = true;
+            hedgeTimer = run->hedgeTimer;
+            backoffTimer = run->backoffTimer;
+            run->hedgeTimer = 0;
+            run->backoffTimer = 0;
+            attempts = run->launched;
+        }
+    }
+
+    // 执行中的副本结束时 onAttemptDone 发现 outer 已取消，再结束 outer
+    for (const auto& attempt : live) {
+        attempt->cancel();
+    }
+    if (!live.empty()) {
+        return;
+    }
+    for (DelayQueue::Id id : {hedgeTimer, backoffTimer}) {
+        if (id != 0) {
+            m_delays.cancel(id);
+        }
+    }
+    CommandResult result;
+    result.exitCode = -1;
+    result.error = "Cancelled while waiting to retry";
+    result.attempts = attempts;
+    completeAsync(run->outer, result, false);
+}
+
+bool CoreImpl::joinSingleFlight(const std::shared_ptr<AsyncOperation>& cmd) {
+    if (!ResultCache::cacheable(cmd->options)) {
+        return false;
+    }
+    std::string key = ResultCache::makeKey(cmd->command, cmd->options, m_workingDirectory,
+                                           m_environment, m_executionPolicy);
+
+    std::shared_ptr<SingleFlight> flight;
+    std::shared_ptr<AsyncOperation> runner;
+    {
+        std::lock_guard<std::mutex> lock(m_flightMutex);
+        std::shared_ptr<SingleFlight>& slot = m_flights[key];
+        if (!slot) {
+            slot = std::make_shared<SingleFlight>();
+            slot->key = key;
+            runner = std::make_shared<AsyncOperation>(nextAsyncId(), cmd->command,
+                                                      cmd->options, nullptr);
+            runner->launch = cmd->launch;
+            runner->keepInTable = false;
+            runner->journalId = cmd->journalId;
+            std::weak_ptr<SingleFlight> weak = slot;
+            runner->chunkCallback = [weak](std::string_view data, bool isError) {
+                auto flight = weak.lock();
+                if (!flight) {
+                    return;
+                }
+                std::vector<std::shared_ptr<AsyncOperation>> members;
+                {
+                    std::lock_guard<std::mutex> memberLock(flight->mutex);
+                    members = flight->members;
+                }
+                for (const auto& member : members) {
+                    if (member->chunkCallback) {
+                        member->chunkCallback(data, isError);
+                    }
+                }
+            };
+            runner->completionCallback = [this, weak](AsyncState, CommandResult& result) {
+                if (auto flight = weak.lock()) {
+                    finishSingleFlight(flight, result);
+                }
+            };
+            slot->runner = runner;
+        }
+        flight = slot;
+
+        AsyncOperation* member = cmd.get();
+        {
+            std::lock_guard<std::mutex> memberLock(cmd->mutex);
+            cmd->onCancel = [this, weak = std::weak_ptr<SingleFlight>(flight), member]() {
+                if (auto flight = weak.lock()) {
+                    leaveSingleFlight(flight, member);
+                }
+            };
+        }
+        std::lock_guard<std::mutex> memberLock(flight->mutex);
+        flight->members.push_back(cmd);
+    }
+
+    if (runner) {
+        dispatchAsync(runner);
     } else {
-        cmd->result = std::move(result);
-        cmd->state = cmd->result.timedOut ? AsyncState::TimedOut :
-                         (cmd->result.exitCode == 0 ? AsyncState::Completed : AsyncState::Failed);
+        m_singleFlightJoined.fetch_add(1, std::memory_order_relaxed);
+    }
+    // 加入之前已被取消
+    if (cmd->state != AsyncState::Running) {
+        leaveSingleFlight(flight, cmd.get());
+    }
+    return true;
+}
+
+void CoreImpl::leaveSingleFlight(const std::shared_ptr<SingleFlight>& flight,
+                                 AsyncOperation* member) {
+    std::shared_ptr<AsyncOperation> runner;
+    {
+        std::lock_guard<std::mutex> lock(m_flightMutex);
+        std::lock_guard<std::mutex> memberLock(flight->mutex);
+        auto& members = flight->members;
+        members.erase(std::remove_if(members.begin(), members.end(),
+                                     [member](const std::shared_ptr<AsyncOperation>& cmd) {
+                                         return cmd.get() == member;
+                                     }),
+                      members.end());
+        if (!members.empty() || !flight->runner) {
+            return;
+        }
+        // 最后一个请求离开，新的相同请求需要重新执行
+        auto it = m_flights.find(flight->key);
+        if (it != m_flights.end() && it->second == flight) {
+            m_flights.erase(it);
+        }
+        runner = std::move(flight->runner);
+    }
+    runner->cancel();
+}
+
+void CoreImpl::finishSingleFlight(const std::shared_ptr<SingleFlight>& flight,
+                                  const CommandResult& result) {
+    std::vector<std::shared_ptr<AsyncOperation>> members;
+    {
+        std::lock_guard<std::mutex> lock(m_flightMutex);
+        auto it = m_flights.find(flight->key);
+        if (it != m_flights.end() && it->second == flight) {
+            m_flights.erase(it);
+        }
+        std::lock_guard<std::mutex> memberLock(flight->mutex);
+        members.swap(flight->members);
+        flight->runner.reset();
+    }
+    // 每个请求得到一份结果；进程只执行了一次，不重复计入统计
+    for (const auto& member : members) {
+        CommandResult copy = result;
+        completeAsync(member, copy, false);
+    }
+}
+
+void CoreImpl::launchAsync(const std::shared_ptr<AsyncOperation>& asyncCmd) {
+#ifdef _WIN32
+    // 启动线程执行命令
+    asyncCmd->thread = std::thread(&CoreImpl::asyncExecutionThread, this, asyncCmd);
+#else
+    // 交给事件循环执行
+    startAsyncUnix(asyncCmd);
+#endif
+}
+
+void CoreImpl::setMaxConcurrency(int limit) {
+    m_scheduler.setMaxConcurrency(limit);
+}
+
+void CoreImpl::setTagPolicy(const std::string& tag, int maxConcurrency, int weight) {
+    m_scheduler.setTagPolicy(tag, maxConcurrency, weight);
+}
+
+bool CoreImpl::enableResultCache(const ResultCacheConfig& config) {
+    return m_cache.configure(config);
+}
+
+void CoreImpl::disableResultCache() {
+    m_cache.disable();
+}
+
+bool CoreImpl::connectDaemon(const std::string& socketPath, std::string* error) {
+#ifdef _WIN32
+    (void)socketPath;
+    if (error) {
+        *error = "The daemon is not supported on Windows";
+    }
+    return false;
+#else
+    auto client = std::make_unique<DaemonClient>(
+        [this](const std::shared_ptr<AsyncOperation>& cmd, CommandResult& result) {
+            completeAsync(cmd, result);
+        });
+    std::string message;
+    if (!client->connect(socketPath, message)) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+    m_daemon = std::move(client);
+    return true;
+#endif
+}
+
+#ifndef _WIN32
+std::shared_ptr<AsyncOperation> CoreImpl::createRemoteAsync(const std::string& command,
+                                                            const CommandOptions& options,
+                                                            std::vector<std::string> environment,
+                                                            const std::string& workingDirectory) {
+    auto launch = std::make_shared<PreparedLaunch>();
+    launch->executable = "/bin/sh";
+    launch->argv = {"sh", "-c", buildShellCommand(command, options.shellType)};
+    launch->environment = makePreparedEnvironment(std::move(environment));
+    launch->workingDirectory = workingDirectory;
+    auto cmd = createAsync(command, options);
+    cmd->launch = std::move(launch);
+    return cmd;
+}
+#endif
+
+bool CoreImpl::enableJournal(const JournalConfig& config, std::string* error) {
+    std::vector<Journal::Recovered> recovered;
+    std::string message;
+    if (!m_journal.open(config, recovered, message)) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    for (auto& entry : recovered) {
+        // 之后分配的 id 不能与恢复的命令重复
+        int next = s_nextAsyncId.load();
+        while (next <= entry.id && !s_nextAsyncId.compare_exchange_weak(next, entry.id + 1)) {
+        }
+
+        auto cmd = std::make_shared<AsyncOperation>(entry.id, std::move(entry.command),
+                                                    CommandOptions(), nullptr);
+        cmd->journalId = entry.id;
+        {
+            std::lock_guard<std::mutex> lock(m_asyncMutex);
+            // 启用之前提交的命令已经占用了这个 id
+            if (!m_asyncCommands.emplace(entry.id, cmd).second) {
+                continue;
+            }
+        }
+        if (entry.finished) {
+            std::lock_guard<std::mutex> lock(cmd->mutex);
+            cmd->result = std::move(entry.result);
+            cmd->state = entry.state;
+            continue;
+        }
+
+        std::vector<Journal::Process> processes;
+        for (const auto& process : entry.processes) {
+            if (Journal::alive(process)) {
+                processes.push_back(process);
+            }
+        }
+        if (processes.empty()) {
+            CommandResult result;
+            result.exitCode = -1;
+            result.error = "Interrupted by restart";
+            result.attempts = static_cast<int>(entry.processes.size());
+            completeAsync(cmd, result, false);
+            continue;
+        }
+
+#ifndef _WIN32
+        auto orphans = std::make_shared<std::vector<Journal::Process>>(processes);
+        {
+            std::lock_guard<std::mutex> lock(cmd->mutex);
+            cmd->onCancel = [this, orphans]() {
+                for (const auto& process : *orphans) {
+                    if (Journal::alive(process)) {
+                        signalProcessGroup(process.pid, SIGTERM);
+                    }
+                }
+                m_delays.schedule(kOrphanKillGraceMs, [orphans]() {
+                    for (const auto& process : *orphans) {
+                        if (Journal::alive(process)) {
+                            signalProcessGroup(process.pid, SIGKILL);
+                        }
+                    }
+                });
+            };
+        }
+        if (config.killOrphans) {
+            cmd->cancel();
+        }
+        watchOrphans(cmd, std::move(processes));
+#endif
+    }
+    return true;
+}
+
+void CoreImpl::watchOrphans(const std::shared_ptr<AsyncOperation>& cmd,
+                            std::vector<Journal::Process> processes) {
+    processes.erase(std::remove_if(processes.begin(), processes.end(),
+                                   [](const Journal::Process& process) {
+                                       return !Journal::alive(process);
+                                   }),
+                    processes.end());
+    if (processes.empty()) {
+        // 进程已被 init 回收，无法得到退出码
+        CommandResult result;
+        result.exitCode = -1;
+        result.error = "Process exited after restart; exit status unavailable";
+        completeAsync(cmd, result, false);
+        return;
+    }
+    m_delays.schedule(kOrphanPollMs, [this, cmd, processes]() {
+        watchOrphans(cmd, processes);
+    });
+}
+
+void CoreImpl::setDefaultPlacement(const CpuPlacement& placement) {
+#ifdef _WIN32
+    (void)placement;
+#else
+    m_placer.setDefault(placement);
+#endif
+}
+
+#ifdef _WIN32
+void CoreImpl::asyncExecutionThread(std::shared_ptr<AsyncOperation> cmd) {
+    CommandResult result = executeSyncWindows(cmd->command, cmd->options, cmd->launch.get());
+    // Windows 上没有事件循环，输出在结束时一次性转发
+    if (cmd->chunkCallback && !cmd->cancelled) {
+        forwardChunks(cmd->chunkCallback, result);
+    }
+    completeAsync(cmd, result);
+}
+#endif
+
+void CoreImpl::completeAsync(const std::shared_ptr<AsyncOperation>& cmd, CommandResult& result,
+                             bool record) {
+    bool cancelled;
+    {
+        std::lock_guard<std::mutex> lock(cmd->mutex);
+        cancelled = cmd->cancelled;
+    }
+
+    if (record) {
+        recordResult(result);
+    }
+    // 在结果被移走之前写入执行日志；取消的命令不保留结果
+    if (cmd->journalId == cmd->id) {
+        if (cancelled) {
+            m_journal.recordComplete(cmd->id, AsyncState::Cancelled, CommandResult());
+        } else {
+            m_journal.recordComplete(cmd->id, stateFor(false, result), result);
+        }
+    }
+
+    // 先调用回调（不持有锁），保证 getAsyncResult 返回时回调已经执行完
+    if (cmd->outputCallback && !cancelled) {
+        // 压缩保存时为回调临时解压
+        CommandResult inflated;
+        inflated.compressedOutput = result.compressedOutput;
+        inflated.compressedError = result.compressedError;
+        inflated.inflate();
+        const std::string& output = result.compressedOutput ? inflated.output : result.output;
+        const std::string& error = result.compressedError ? inflated.error : result.error;
+        if (!output.empty()) {
+            cmd->outputCallback(output, false);
+        }
+        if (!error.empty()) {
+            cmd->outputCallback(error, true);
+        }
     }
-    cmd->cv.notify_all();
 
-    // 如果设置了回调，调用它
-    if (cmd->outputCallback && !cmd->cancelled) {
-        if (!cmd->result.output.empty()) {
-            cmd->outputCallback(cmd->result.output, false);
+    std::vector<std::pair<AsyncOperation::ListenerId, AsyncOperation::Listener>> listeners;
+    {
+        std::lock_guard<std::mutex> lock(cmd->mutex);
+        if (cmd->state == AsyncState::Running) {
+            cmd->state = stateFor(cmd->cancelled, result);
+            listeners.swap(cmd->listeners);
         }
-        if (!cmd->result.error.empty()) {
-            cmd->outputCallback(cmd->result.error, true);
+        // 有完成回调时结果直接交给回调
+        if (!cmd->cancelled && !cmd->completionCallback) {
+            cmd->result = std::move(result);
+        }
+#ifndef _WIN32
+        cmd->execution.reset();
+#endif
+        cmd->cv.notify_all();
+    }
+
+    if (cmd->inTable && !cmd->keepInTable) {
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        m_asyncCommands.erase(cmd->id);
+    }
+
+    // 释放准入名额，可能在当前线程启动排队的命令
+    if (cmd->admitted) {
+        m_scheduler.release(*cmd);
+    }
+
+    for (auto& listener : listeners) {
+        listener.second();
+    }
+    if (cmd->completionCallback) {
+        cmd->completionCallback(cmd->state, result);
+    }
+}
+
+void CoreImpl::recordResult(const CommandResult& result) {
+    m_commandsCompleted.fetch_add(1, std::memory_order_relaxed);
+    for (const auto& compressed : {result.compressedOutput, result.compressedError}) {
+        if (compressed) {
+            m_compressedRawBytes.fetch_add(static_cast<long long>(compressed->size()),
+                                           std::memory_order_relaxed);
+            m_compressedBytes.fetch_add(static_cast<long long>(compressed->compressedSize()),
+                                        std::memory_order_relaxed);
         }
     }
 }
 
+Metrics CoreImpl::metrics() const {
+    Metrics metrics;
+    metrics.commandsCompleted = m_commandsCompleted.load(std::memory_order_relaxed);
+    metrics.compressedRawBytes = m_compressedRawBytes.load(std::memory_order_relaxed);
+    metrics.compressedBytes = m_compressedBytes.load(std::memory_order_relaxed);
+    metrics.singleFlightJoined = m_singleFlightJoined.load(std::memory_order_relaxed);
+    metrics.retries = m_retries.load(std::memory_order_relaxed);
+    metrics.hedgesLaunched = m_hedgesLaunched.load(std::memory_order_relaxed);
+    metrics.hedgeWins = m_hedgeWins.load(std::memory_order_relaxed);
+    m_scheduler.fillMetrics(metrics);
+    m_cache.fillMetrics(metrics);
+    return metrics;
+}
+
+AsyncState CoreImpl::stateFor(bool cancelled, const CommandResult& result) {
+    if (cancelled) {
+        return AsyncState::Cancelled;
+    }
+    if (result.limitExceeded != ResourceLimitKind::None) {
+        return AsyncState::ResourceExceeded;
+    }
+    return result.timedOut ? AsyncState::TimedOut :
+               (result.exitCode == 0 ? AsyncState::Completed : AsyncState::Failed);
+}
+
 AsyncState CoreImpl::getAsyncStatus(int asyncId) {
     std::lock_guard<std::mutex> lock(m_asyncMutex);
     auto it = m_asyncCommands.find(asyncId);
@@ -450,35 +1748,64 @@ AsyncState CoreImpl::getAsyncStatus(int asyncId) {
 }
 
 bool CoreImpl::getAsyncResult(int asyncId, CommandResult& result) {
-    std::lock_guard<std::mutex> lock(m_asyncMutex);
-    auto it = m_asyncCommands.find(asyncId);
-    if (it == m_asyncCommands.end()) {
-        return false;
+    std::shared_ptr<AsyncOperation> cmd;
+    {
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        auto it = m_asyncCommands.find(asyncId);
+        if (it == m_asyncCommands.end()) {
+            return false;
+        }
+        cmd = it->second;
     }
 
-    std::unique_lock<std::mutex> cmdLock(it->second->mutex);
-    if (it->second->state == AsyncState::Running) {
-        // 等待完成
-        it->second->cv.wait(cmdLock, [&]() {
-            return it->second->state != AsyncState::Running;
-        });
+    // 等待时不持有 m_asyncMutex，以免阻塞其他命令的提交和终止
+    cmd->wait();
+
+    std::lock_guard<std::mutex> cmdLock(cmd->mutex);
+    result = cmd->result;
+    return true;
+}
+
+bool CoreImpl::takeAsyncResult(int asyncId, CommandResult& result) {
+    std::shared_ptr<AsyncOperation> cmd;
+    {
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        auto it = m_asyncCommands.find(asyncId);
+        if (it == m_asyncCommands.end()) {
+            return false;
+        }
+        cmd = it->second;
     }
 
-    result = it->second->result;
+    cmd->wait();
+
+    {
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        // 并发的另一次 take 已经取走
+        if (!m_asyncCommands.erase(asyncId)) {
+            return false;
+        }
+    }
+    if (cmd->journalId == asyncId) {
+        m_journal.recordForget(asyncId);
+    }
+    std::lock_guard<std::mutex> cmdLock(cmd->mutex);
+    result = std::move(cmd->result);
     return true;
 }
 
 bool CoreImpl::terminateAsync(int asyncId) {
-    std::lock_guard<std::mutex> lock(m_asyncMutex);
-    auto it = m_asyncCommands.find(asyncId);
-    if (it == m_asyncCommands.end()) {
-        return false;
+    std::shared_ptr<AsyncOperation> cmd;
+    {
+        std::lock_guard<std::mutex> lock(m_asyncMutex);
+        auto it = m_asyncCommands.find(asyncId);
+        if (it == m_asyncCommands.end()) {
+            return false;
+        }
+        cmd = it->second;
     }
 
-    it->second->cancelled = true;
-    it->second->state = AsyncState::Cancelled;
-    it->second->cv.notify_all();
-
+    cmd->cancel();
     return true;
 }
 
@@ -488,10 +1815,14 @@ void CoreImpl::setWorkingDirectory(const std::string& directory) {
 
 void CoreImpl::setEnvironment(const std::string& key, const std::string& value) {
     m_environment[key] = value;
+    std::lock_guard<std::mutex> lock(m_environmentMutex);
+    m_preparedEnvironment.reset();
 }
 
 void CoreImpl::setEnvironment(const std::map<std::string, std::string>& environment) {
     m_environment = environment;
+    std::lock_guard<std::mutex> lock(m_environmentMutex);
+    m_preparedEnvironment.reset();
 }
 
 void CoreImpl::setExecutionPolicy(const std::string& policy) {
@@ -500,6 +1831,30 @@ void CoreImpl::setExecutionPolicy(const std::string& policy) {
 
 void CoreImpl::clearEnvironment() {
     m_environment.clear();
+    std::lock_guard<std::mutex> lock(m_environmentMutex);
+    m_preparedEnvironment.reset();
+}
+
+void CoreImpl::setIoBackend(IoBackendType type) {
+#ifndef _WIN32
+    std::lock_guard<std::mutex> lock(m_reactorMutex);
+    m_ioBackendType = type;
+    if (m_reactor) {
+        // 旧的事件循环继续处理其中在途的命令，直到实例销毁
+        m_retiredReactors.push_back(std::move(m_reactor));
+    }
+#else
+    (void)type;
+#endif
+}
+
+std::string CoreImpl::ioBackendName() {
+#ifndef _WIN32
+    Reactor* loop = reactor();
+    return loop ? loop->backendName() : "none";
+#else
+    return "none";
+#endif
 }
 
 int CoreImpl::nextAsyncId() {
@@ -2,12 +2,136 @@
 #define ZRUN_CORE_H
 
 #include "zrun_types.h"
+#include "zrun_scheduler.h"
+#include "zrun_cache.h"
+#include "zrun_prepared.h"
+#include "zrun_retry.h"
+#include "zrun_journal.h"
+#ifndef _WIN32
+#include "zrun_affinity.h"
+#endif
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <memory>
 #include <map>
+#include <thread>
+#include <vector>
 
 namespace Zrun {
 
+class Reactor;
+struct Execution;
+class DaemonClient;
+
+// 合并后的环境变量，供 PreparedCommand 直接传给 execve
+struct PreparedEnvironment {
+    std::vector<std::string> entries;
+    std::vector<char*> pointers;    // 指向 entries，以 nullptr 结尾
+    std::string path;               // 其中 PATH 的值
+};
+
+// PreparedCommand 按参数展开后的一次启动，不经过 shell
+struct PreparedLaunch {
+    std::string executable;
+    std::vector<std::string> argv;
+    // 为空时继承当前进程的环境
+    std::shared_ptr<const PreparedEnvironment> environment;
+    // Windows 上传给 CreateProcess 的命令行
+    std::string commandLine;
+    // 用于结果缓存和合并执行的键
+    std::string key;
+    // 展开或查找失败时的错误，启动时作为结果返回
+    std::string error;
+    // 可选，代替实例的工作目录（仅 Unix，守护进程按客户端的目录执行）
+    std::string workingDirectory;
+};
+
+// 一条异步命令的共享状态。AsyncHandle 直接持有它，不经过异步表查找
+struct AsyncOperation : std::enable_shared_from_this<AsyncOperation> {
+    using Listener = std::function<void()>;
+    // addListener 返回的标识，0 表示监听器已经被立即调用
+    using ListenerId = uint64_t;
+
+    int id;
+    std::string command;
+    CommandOptions options;
+    // 可选，PreparedCommand 的启动参数；为空时通过 shell 执行 command
+    std::shared_ptr<const PreparedLaunch> launch;
+    OutputCallback outputCallback;
+    ChunkCallback chunkCallback;
+    CompletionCallback completionCallback;
+    // 结束后是否仍保留在异步表中，供按 id 查询结果
+    bool keepInTable = true;
+    // 是否登记到异步表中。为 false 时只能通过状态对象查询和取消（submit、parallelMap、守护进程），
+    // 运行期间挂在 CoreImpl 的分片链表上，不经过 m_asyncMutex
+    bool inTable = true;
+    AsyncOperation* untabledPrev = nullptr;
+    AsyncOperation* untabledNext = nullptr;
+#ifdef _WIN32
+    std::thread thread;
+#else
+    // 由事件循环执行，不再占用独立线程
+    std::shared_ptr<Execution> execution;
+    Reactor* reactor = nullptr;
+#endif
+    std::atomic<AsyncState> state{AsyncState::Running};
+    CommandResult result;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool cancelled{false};
+    // 离开 Running 状态时调用一次
+    std::vector<std::pair<ListenerId, Listener>> listeners;
+    ListenerId nextListenerId = 0;
+    // 已通过准入调度，结束时需要释放名额
+    bool admitted = false;
+    // 可选，cancel() 在释放锁之后调用（排队中的命令通过它通知调度器）
+    std::function<void()> onCancel;
+    // 在执行日志中对应的命令 id，0 表示不记录。重试、对冲和合并执行的进程记在发起的命令下
+    int journalId = 0;
+
+    AsyncOperation(int id, std::string cmd, CommandOptions opts, OutputCallback cb);
+    ~AsyncOperation();
+
+    AsyncOperation(const AsyncOperation&) = delete;
+    AsyncOperation& operator=(const AsyncOperation&) = delete;
+
+    // 等待结束，timeoutMs < 0 表示无限等待，超时返回 false
+    bool wait(int timeoutMs = -1);
+
+    // 终止命令，已经结束时返回 false
+    bool cancel();
+
+    // 注册结束通知；已经结束时立即在当前线程调用并返回 0
+    ListenerId addListener(Listener listener);
+
+    // 移除尚未调用的监听器（已经调用或正在调用时无效果）
+    void removeListener(ListenerId id);
+};
+
+// 一组合并执行的相同命令：runner 实际执行（不在异步表中），结束时把结果交给每个 member。
+// 所有 member 都取消后 runner 也被取消
+struct SingleFlight {
+    std::string key;
+    std::shared_ptr<AsyncOperation> runner;
+    std::mutex mutex;
+    std::vector<std::shared_ptr<AsyncOperation>> members;
+};
+
+// 设置了重试或对冲的一条命令：outer 是调用方看到的命令，每次执行是一个不在异步表中的
+// attempt。所有执行结束（或被采用的执行结束）后 outer 才结束
+struct RetryRun {
+    std::shared_ptr<AsyncOperation> outer;
+    std::string latencyKey;
+    std::mutex mutex;
+    std::vector<std::shared_ptr<AsyncOperation>> live;  // 正在执行的副本
+    int rounds = 0;         // 已开始的轮数（对冲副本不算）
+    int launched = 0;       // 启动的执行总数
+    DelayQueue::Id hedgeTimer = 0;
+    DelayQueue::Id backoffTimer = 0;
+    bool finished = false;
+};
+
 class CoreImpl {
 public:
     CoreImpl();
@@ -21,12 +145,32 @@ public:
     CommandResult executeSync(const std::string& command,
                               ShellType shellType = ShellType::PowerShell,
                               int timeoutMs = 30000);
+    CommandResult executeSync(const std::string& command, const CommandOptions& options);
+    // 执行预先准备的命令，不经过 shell
+    CommandResult executeSync(const PreparedCommand& command, const CommandParameters& parameters,
+                              const CommandOptions& options);
 
     // 异步执行命令
     int executeAsync(const std::string& command,
                      ShellType shellType = ShellType::PowerShell,
                      int timeoutMs = 30000,
                      OutputCallback outputCallback = nullptr);
+    int executeAsync(const std::string& command, const CommandOptions& options,
+                     OutputCallback outputCallback = nullptr);
+    int executeAsync(const PreparedCommand& command, const CommandParameters& parameters,
+                     const CommandOptions& options, OutputCallback outputCallback = nullptr);
+
+    // 流式异步执行：输出按块转发，结束时调用 completionCallback。
+    // 回调在事件循环线程中执行；命令结束后即从异步表中移除，不能再用 id 查询结果
+    int executeAsync(const std::string& command, const CommandOptions& options,
+                     ChunkCallback chunkCallback, CompletionCallback completionCallback);
+
+    // 对每个输入执行一次 command（参数 {input} 为输入，{index} 为下标），最多同时执行
+    // options.concurrency 条，结果通过 callback 返回。阻塞到全部结束，不能在回调中调用
+    ParallelMapSummary parallelMap(const PreparedCommand& command,
+                                   const std::vector<std::string>& inputs,
+                                   const ParallelMapOptions& options,
+                                   const ParallelResultCallback& callback);
 
     // 检查异步命令状态
     AsyncState getAsyncStatus(int asyncId);
@@ -34,6 +178,9 @@ public:
     // 获取异步命令结果
     bool getAsyncResult(int asyncId, CommandResult& result);
 
+    // 等待结束后移出结果（不拷贝），并从异步表中移除该命令
+    bool takeAsyncResult(int asyncId, CommandResult& result);
+
     // 终止异步命令
     bool terminateAsync(int asyncId);
 
@@ -50,24 +197,155 @@ public:
     // 清除所有环境变量设置
     void clearEnvironment();
 
-private:
-    struct AsyncCommand;
+    // 选择 I/O 后端 (仅 Unix)，对之后提交的命令生效
+    void setIoBackend(IoBackendType type);
+
+    // 当前使用的 I/O 后端名称
+    std::string ioBackendName();
+
+    // 异步命令的准入调度：全局最大并发数 (0 表示不限制)，
+    // 以及每个 tag 的最大并发数和公平分配的权重
+    void setMaxConcurrency(int limit);
+    void setTagPolicy(const std::string& tag, int maxConcurrency, int weight = 1);
+
+    // 没有单独指定 CpuPlacement 的命令使用的默认放置 (仅 Linux)
+    void setDefaultPlacement(const CpuPlacement& placement);
+
+    // 启用同步命令的结果缓存（只用于设置了 CommandOptions::cache 的命令）。
+    // 持久化文件无法使用时返回 false，此时只在内存中缓存
+    bool enableResultCache(const ResultCacheConfig& config);
+    void disableResultCache();
+
+    // 启用执行日志：恢复文件中的命令，之后按 id 查询的异步命令都记录在其中。
+    // 已结束的命令恢复到异步表中；仍在运行的进程按 config.killOrphans 终止或继续等待其结束，
+    // 进程已经不存在的命令以失败结束。文件无法使用时返回 false
+    bool enableJournal(const JournalConfig& config, std::string* error = nullptr);
+
+    // 客户端模式：之后协议能够表达的命令（见 DaemonClient::forwardable）转发给 zrund 执行，
+    // 其余的命令和连接断开后的命令仍在本地执行。应当在提交命令之前调用，仅 Unix
+    bool connectDaemon(const std::string& socketPath, std::string* error = nullptr);
+
+#ifndef _WIN32
+    // 守护进程代客户端创建命令：使用客户端的完整环境变量和工作目录，之后用 startAsync 启动
+    std::shared_ptr<AsyncOperation> createRemoteAsync(const std::string& command,
+                                                      const CommandOptions& options,
+                                                      std::vector<std::string> environment,
+                                                      const std::string& workingDirectory);
+#endif
 
+    // 运行统计
+    Metrics metrics() const;
+
+    // 启动异步命令并直接返回其状态对象；不登记到异步表中
+    std::shared_ptr<AsyncOperation> submit(const std::string& command,
+                                           const CommandOptions& options,
+                                           OutputCallback outputCallback = nullptr);
+
+    // 分两步启动：先创建（已分配 id），设置回调后再调用 startAsync
+    std::shared_ptr<AsyncOperation> createAsync(const std::string& command,
+                                                const CommandOptions& options);
+    int startAsync(std::shared_ptr<AsyncOperation> operation);
+
+private:
     std::string buildShellCommand(const std::string& command, ShellType shellType);
-    void asyncExecutionThread(std::shared_ptr<AsyncCommand> cmd);
+    CommandResult runSync(const std::string& command, const CommandOptions& options,
+                          std::shared_ptr<const PreparedLaunch> launch);
+    CommandResult runAttempts(const std::string& command, const CommandOptions& options,
+                              const PreparedLaunch* launch);
+    std::shared_ptr<const PreparedLaunch> prepareLaunch(const PreparedCommand& command,
+                                                        const CommandParameters& parameters);
+    std::shared_ptr<const PreparedEnvironment> preparedEnvironment();
+    void launchAsync(const std::shared_ptr<AsyncOperation>& cmd);
+    void completeAsync(const std::shared_ptr<AsyncOperation>& cmd, CommandResult& result,
+                       bool record = true);
+    bool joinSingleFlight(const std::shared_ptr<AsyncOperation>& cmd);
+    void leaveSingleFlight(const std::shared_ptr<SingleFlight>& flight, AsyncOperation* member);
+    void finishSingleFlight(const std::shared_ptr<SingleFlight>& flight,
+                            const CommandResult& result);
+    // 有重试或对冲策略时由 startRetry 接管，否则交给准入调度
+    void dispatchAsync(const std::shared_ptr<AsyncOperation>& cmd);
+    void startRetry(const std::shared_ptr<AsyncOperation>& cmd);
+    void launchAttempt(const std::shared_ptr<RetryRun>& run, bool hedge);
+    void scheduleHedge(const std::shared_ptr<RetryRun>& run);
+    void onHedgeTimer(const std::shared_ptr<RetryRun>& run);
+    void onAttemptDone(const std::shared_ptr<RetryRun>& run, AsyncOperation* attempt, bool hedge,
+                       CommandResult& result);
+    void cancelRetry(const std::shared_ptr<RetryRun>& run);
+    void recordResult(const CommandResult& result);
+    // 等待上一个实例留下的进程结束（仅 Unix）
+    void watchOrphans(const std::shared_ptr<AsyncOperation>& cmd,
+                      std::vector<Journal::Process> processes);
+    // 不登记到异步表的命令在运行期间挂到分片链表上，离开 Running 状态时由监听器移除
+    void linkUntabled(const std::shared_ptr<AsyncOperation>& cmd);
+    void unlinkUntabled(AsyncOperation* cmd);
+    static AsyncState stateFor(bool cancelled, const CommandResult& result);
     static int nextAsyncId();
 
     // 平台特定的实现
-    CommandResult executeSyncWindows(const std::string& command, ShellType shellType, int timeoutMs);
-    CommandResult executeSyncUnix(const std::string& command, ShellType shellType, int timeoutMs);
+#ifdef _WIN32
+    void asyncExecutionThread(std::shared_ptr<AsyncOperation> cmd);
+    CommandResult executeSyncWindows(const std::string& command, const CommandOptions& options,
+                                     const PreparedLaunch* launch = nullptr);
+#else
+    std::shared_ptr<Execution> startExecution(const std::string& command,
+                                              const CommandOptions& options,
+                                              CommandResult& failure,
+                                              const PreparedLaunch* launch = nullptr);
+    CommandResult executeSyncUnix(const std::string& command, const CommandOptions& options,
+                                  const PreparedLaunch* launch = nullptr);
+    void startAsyncUnix(std::shared_ptr<AsyncOperation> cmd);
+    Reactor* reactor();
+#endif
 
     std::string m_workingDirectory;
     std::map<std::string, std::string> m_environment;
     std::string m_executionPolicy;
+    // 合并后的环境变量，修改环境变量设置时清空
+    std::shared_ptr<const PreparedEnvironment> m_preparedEnvironment;
+    std::mutex m_environmentMutex;
 
-    std::map<int, std::shared_ptr<AsyncCommand>> m_asyncCommands;
+    std::map<int, std::shared_ptr<AsyncOperation>> m_asyncCommands;
     std::mutex m_asyncMutex;
+    // 运行中且不在异步表中的命令，析构时据此取消。按 id 分片的侵入式链表，
+    // 提交和结束只锁其中一片，也不分配内存
+    struct UntabledShard {
+        std::mutex mutex;
+        AsyncOperation* head = nullptr;
+    };
+    static constexpr unsigned kUntabledShards = 16;
+    UntabledShard m_untabled[kUntabledShards];
     static std::atomic<int> s_nextAsyncId;
+
+    // 正在执行的合并命令，按 ResultCache::makeKey 的键查找
+    std::map<std::string, std::shared_ptr<SingleFlight>> m_flights;
+    std::mutex m_flightMutex;
+    std::atomic<long long> m_singleFlightJoined{0};
+
+    // 重试的退避和对冲的延迟，以及计算对冲延迟用的执行时间
+    DelayQueue m_delays;
+    LatencyTracker m_latency;
+    std::atomic<long long> m_retries{0};
+    std::atomic<long long> m_hedgesLaunched{0};
+    std::atomic<long long> m_hedgeWins{0};
+
+    std::atomic<long long> m_commandsCompleted{0};
+    std::atomic<long long> m_compressedRawBytes{0};
+    std::atomic<long long> m_compressedBytes{0};
+
+    mutable AdmissionScheduler m_scheduler;
+    ResultCache m_cache;
+    // 在事件循环之后销毁，完成回调仍会写入
+    Journal m_journal;
+
+#ifndef _WIN32
+    IoBackendType m_ioBackendType = IoBackendType::Default;
+    CpuPlacer m_placer;
+    std::unique_ptr<Reactor> m_reactor;
+    std::vector<std::unique_ptr<Reactor>> m_retiredReactors;
+    std::mutex m_reactorMutex;
+    // 客户端模式下与守护进程的连接
+    std::unique_ptr<DaemonClient> m_daemon;
+#endif
 };
 
 } // namespace Zrun
@@ -0,0 +1,183 @@
+#ifndef ZRUN_CORO_H
+#define ZRUN_CORO_H
+
+// C++20 协程接口（可选，仅头文件）：
+//
+//   CommandResult result = co_await zrun.run("make", options);
+//
+//   auto output = zrun.stream("tail -n 100 build.log", options);
+//   while (auto chunk = co_await output.next()) {
+//       handle(chunk->data, chunk->isError);
+//   }
+//
+// 命令由 Zrun 的事件循环执行，协程在事件循环线程中恢复，等待期间不占用任何线程。
+// 恢复后的协程不应长时间阻塞，否则会拖慢其他命令的输出处理。
+
+#include "zrun.hpp"
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace Zrun {
+
+// co_await 得到命令的最终结果
+class RunAwaitable {
+public:
+    RunAwaitable(ZRun& zrun, std::string command, CommandOptions options)
+        : m_zrun(zrun), m_command(std::move(command)), m_options(std::move(options)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        // 完成回调可能在 executeAsync 返回之前就恢复协程，之后不能再访问 this
+        m_zrun.executeAsync(m_command, m_options, nullptr,
+                            [this, handle](AsyncState, CommandResult& result) {
+                                m_result = std::move(result);
+                                handle.resume();
+                            });
+    }
+
+    CommandResult await_resume() { return std::move(m_result); }
+
+private:
+    ZRun& m_zrun;
+    std::string m_command;
+    CommandOptions m_options;
+    CommandResult m_result;
+};
+
+struct OutputChunk {
+    std::string data;
+    bool isError = false;
+};
+
+// 异步输出流：逐块 co_await 命令的输出。
+// 在命令结束前销毁时会终止命令
+class OutputStream {
+    struct State {
+        std::mutex mutex;
+        std::deque<OutputChunk> chunks;
+        std::coroutine_handle<> waiter;
+        bool finished = false;
+        CommandResult result;
+
+        // 取出等待者，由调用方在释放锁之后恢复
+        std::coroutine_handle<> takeWaiter() {
+            std::coroutine_handle<> handle = waiter;
+            waiter = nullptr;
+            return handle;
+        }
+    };
+
+public:
+    class NextAwaitable {
+    public:
+        explicit NextAwaitable(State& state) : m_state(state) {}
+
+        bool await_ready() {
+            std::lock_guard<std::mutex> lock(m_state.mutex);
+            return !m_state.chunks.empty() || m_state.finished;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> lock(m_state.mutex);
+            if (!m_state.chunks.empty() || m_state.finished) {
+                return false;
+            }
+            m_state.waiter = handle;
+            return true;
+        }
+
+        std::optional<OutputChunk> await_resume() {
+            std::lock_guard<std::mutex> lock(m_state.mutex);
+            if (m_state.chunks.empty()) {
+                return std::nullopt;
+            }
+            OutputChunk chunk = std::move(m_state.chunks.front());
+            m_state.chunks.pop_front();
+            return chunk;
+        }
+
+    private:
+        State& m_state;
+    };
+
+    OutputStream(ZRun& zrun, const std::string& command, const CommandOptions& options)
+        : m_zrun(&zrun), m_state(std::make_shared<State>()) {
+        std::shared_ptr<State> state = m_state;
+        m_asyncId = zrun.executeAsync(
+            command, options,
+            [state](std::string_view data, bool isError) {
+                std::coroutine_handle<> waiter;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->chunks.push_back(OutputChunk{std::string(data), isError});
+                    waiter = state->takeWaiter();
+                }
+                if (waiter) {
+                    waiter.resume();
+                }
+            },
+            [state](AsyncState, CommandResult& result) {
+                std::coroutine_handle<> waiter;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->result = std::move(result);
+                    state->finished = true;
+                    waiter = state->takeWaiter();
+                }
+                if (waiter) {
+                    waiter.resume();
+                }
+            });
+    }
+
+    ~OutputStream() {
+        if (m_state && !finished()) {
+            m_zrun->terminateAsync(m_asyncId);
+        }
+    }
+
+    OutputStream(OutputStream&& other) noexcept
+        : m_zrun(other.m_zrun), m_asyncId(other.m_asyncId), m_state(std::move(other.m_state)) {}
+    OutputStream(const OutputStream&) = delete;
+    OutputStream& operator=(const OutputStream&) = delete;
+    OutputStream& operator=(OutputStream&&) = delete;
+
+    // 下一块输出；命令结束且所有数据都已取出后返回空
+    NextAwaitable next() { return NextAwaitable(*m_state); }
+
+    bool finished() {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        return m_state->finished;
+    }
+
+    // 命令结果，在 next() 返回空之后有效（output/error 中仍包含完整的捕获数据）
+    CommandResult& result() { return m_state->result; }
+
+    int asyncId() const { return m_asyncId; }
+
+private:
+    ZRun* m_zrun;
+    int m_asyncId = 0;
+    std::shared_ptr<State> m_state;
+};
+
+inline RunAwaitable ZRun::run(const std::string& command, const CommandOptions& options) {
+    return RunAwaitable(*this, command, options);
+}
+
+inline OutputStream ZRun::stream(const std::string& command, const CommandOptions& options) {
+    return OutputStream(*this, command, options);
+}
+
+} // namespace Zrun
+
+#endif // __cpp_impl_coroutine
+
+#endif // ZRUN_CORO_H
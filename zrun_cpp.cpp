@@ -1,6 +1,10 @@
 #include "zrun.hpp"
 #include "zrun_core.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 
 namespace Zrun {
 
@@ -19,6 +23,23 @@ CommandResult ZRun::executeSync(const std::string& command,
     return m_impl->core.executeSync(command, shellType, timeoutMs);
 }
 
+CommandResult ZRun::executeSync(const std::string& command, const CommandOptions& options) {
+    return m_impl->core.executeSync(command, options);
+}
+
+CommandResult ZRun::executeSync(const PreparedCommand& command,
+                                const CommandParameters& parameters,
+                                const CommandOptions& options) {
+    return m_impl->core.executeSync(command, parameters, options);
+}
+
+ParallelMapSummary ZRun::parallelMap(const PreparedCommand& command,
+                                     const std::vector<std::string>& inputs,
+                                     const ParallelMapOptions& options,
+                                     ParallelResultCallback callback) {
+    return m_impl->core.parallelMap(command, inputs, options, callback);
+}
+
 int ZRun::executeAsync(const std::string& command,
                        ShellType shellType,
                        int timeoutMs,
@@ -26,6 +47,27 @@ int ZRun::executeAsync(const std::string& command,
     return m_impl->core.executeAsync(command, shellType, timeoutMs, callback);
 }
 
+int ZRun::executeAsync(const std::string& command, const CommandOptions& options,
+                       OutputCallback callback) {
+    return m_impl->core.executeAsync(command, options, callback);
+}
+
+int ZRun::executeAsync(const PreparedCommand& command, const CommandParameters& parameters,
+                       const CommandOptions& options, OutputCallback callback) {
+    return m_impl->core.executeAsync(command, parameters, options, callback);
+}
+
+int ZRun::executeAsync(const std::string& command, const CommandOptions& options,
+                       ChunkCallback chunkCallback, CompletionCallback completionCallback) {
+    return m_impl->core.executeAsync(command, options, std::move(chunkCallback),
+                                     std::move(completionCallback));
+}
+
+AsyncHandle ZRun::submit(const std::string& command, const CommandOptions& options,
+                         OutputCallback callback) {
+    return AsyncHandle(m_impl->core.submit(command, options, std::move(callback)));
+}
+
 AsyncState ZRun::getAsyncStatus(int asyncId) {
     return m_impl->core.getAsyncStatus(asyncId);
 }
@@ -60,4 +102,154 @@ void ZRun::clearEnvironment() {
     m_impl->core.clearEnvironment();
 }
 
+void ZRun::setIoBackend(IoBackendType type) {
+    m_impl->core.setIoBackend(type);
+}
+
+std::string ZRun::ioBackendName() {
+    return m_impl->core.ioBackendName();
+}
+
+void ZRun::setMaxConcurrency(int limit) {
+    m_impl->core.setMaxConcurrency(limit);
+}
+
+void ZRun::setTagPolicy(const std::string& tag, int maxConcurrency, int weight) {
+    m_impl->core.setTagPolicy(tag, maxConcurrency, weight);
+}
+
+void ZRun::setDefaultPlacement(const CpuPlacement& placement) {
+    m_impl->core.setDefaultPlacement(placement);
+}
+
+bool ZRun::enableResultCache(const ResultCacheConfig& config) {
+    return m_impl->core.enableResultCache(config);
+}
+
+void ZRun::disableResultCache() {
+    m_impl->core.disableResultCache();
+}
+
+bool ZRun::connectDaemon(const std::string& socketPath, std::string* error) {
+    return m_impl->core.connectDaemon(socketPath, error);
+}
+
+bool ZRun::enableJournal(const JournalConfig& config, std::string* error) {
+    return m_impl->core.enableJournal(config, error);
+}
+
+Metrics ZRun::metrics() const {
+    return m_impl->core.metrics();
+}
+
+AsyncHandle::AsyncHandle(std::shared_ptr<AsyncOperation> operation)
+    : m_operation(std::move(operation)) {}
+
+int AsyncHandle::id() const {
+    return m_operation ? m_operation->id : 0;
+}
+
+AsyncState AsyncHandle::state() const {
+    return m_operation ? m_operation->state.load() : AsyncState::Failed;
+}
+
+void AsyncHandle::wait() const {
+    if (m_operation) {
+        m_operation->wait();
+    }
+}
+
+bool AsyncHandle::waitFor(int timeoutMs) const {
+    return !m_operation || m_operation->wait(timeoutMs);
+}
+
+const CommandResult& AsyncHandle::result() const {
+    static const CommandResult empty;
+    if (!m_operation) {
+        return empty;
+    }
+    m_operation->wait();
+    return m_operation->result;
+}
+
+bool AsyncHandle::cancel() {
+    return m_operation && m_operation->cancel();
+}
+
+AsyncHandle& AsyncHandle::then(Continuation continuation) {
+    if (m_operation) {
+        // 只捕获裸指针：监听器由命令自身持有，结束后即被释放
+        AsyncOperation* operation = m_operation.get();
+        m_operation->addListener([operation, continuation]() {
+            continuation(operation->state, operation->result);
+        });
+    }
+    return *this;
+}
+
+bool whenAll(std::vector<AsyncHandle>& handles, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (auto& handle : handles) {
+        if (timeoutMs < 0) {
+            handle.wait();
+            continue;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             deadline - std::chrono::steady_clock::now()).count();
+        if (!handle.waitFor(static_cast<int>(std::max<long long>(0, remaining)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int whenAny(std::vector<AsyncHandle>& handles, int timeoutMs) {
+    struct Waiter {
+        std::mutex mutex;
+        std::condition_variable cv;
+        int index = -1;
+    };
+
+    // 每个命令注册一个监听器，第一个结束的写入下标，不需要轮询。返回前移除监听器，
+    // 反复以短超时调用时不会在命令上累积
+    auto waiter = std::make_shared<Waiter>();
+    std::vector<AsyncOperation::ListenerId> registered(handles.size(), 0);
+    bool any = false;
+    for (size_t i = 0; i < handles.size(); ++i) {
+        if (!handles[i].m_operation) {
+            continue;
+        }
+        any = true;
+        int index = static_cast<int>(i);
+        registered[i] = handles[i].m_operation->addListener([waiter, index]() {
+            std::lock_guard<std::mutex> lock(waiter->mutex);
+            if (waiter->index == -1) {
+                waiter->index = index;
+            }
+            waiter->cv.notify_all();
+        });
+    }
+    if (!any) {
+        return -1;
+    }
+
+    int index;
+    {
+        std::unique_lock<std::mutex> lock(waiter->mutex);
+        auto signalled = [&]() { return waiter->index != -1; };
+        if (timeoutMs < 0) {
+            waiter->cv.wait(lock, signalled);
+        } else {
+            waiter->cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), signalled);
+        }
+        index = waiter->index;
+    }
+    for (size_t i = 0; i < handles.size(); ++i) {
+        if (registered[i] != 0) {
+            handles[i].m_operation->removeListener(registered[i]);
+        }
+    }
+    return index;
+}
+
 } // namespace Zrun
@@ -0,0 +1,124 @@
+#include "zrun_cq.h"
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+namespace Zrun {
+
+CompletionQueue::CompletionQueue() {
+#ifdef _WIN32
+    // 手动重置事件：队列非空期间保持有信号
+    m_eventHandle = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+#elif defined(__linux__)
+    m_readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_writeFd = m_readFd;
+#else
+    int fds[2];
+    if (pipe(fds) == 0) {
+        for (int fd : fds) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        m_readFd = fds[0];
+        m_writeFd = fds[1];
+    }
+#endif
+}
+
+CompletionQueue::~CompletionQueue() {
+#ifdef _WIN32
+    if (m_eventHandle) {
+        CloseHandle(static_cast<HANDLE>(m_eventHandle));
+    }
+#else
+    if (m_readFd != -1) {
+        close(m_readFd);
+    }
+    if (m_writeFd != -1 && m_writeFd != m_readFd) {
+        close(m_writeFd);
+    }
+#endif
+}
+
+void CompletionQueue::post(Event event) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool wasEmpty = m_events.empty();
+    m_events.push_back(std::move(event));
+    if (wasEmpty) {
+        // 只在队列从空变为非空时唤醒
+        signal();
+        m_cv.notify_all();
+    }
+}
+
+size_t CompletionQueue::next(std::vector<Event>& out, size_t maxEvents, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto ready = [this]() { return !m_events.empty() || m_shutdown; };
+    if (timeoutMs < 0) {
+        m_cv.wait(lock, ready);
+    } else if (timeoutMs > 0) {
+        m_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready);
+    }
+
+    size_t count = 0;
+    while (count < maxEvents && !m_events.empty()) {
+        out.push_back(std::move(m_events.front()));
+        m_events.pop_front();
+        ++count;
+    }
+    if (m_events.empty()) {
+        clearSignal();
+    }
+    return count;
+}
+
+void CompletionQueue::shutdown() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shutdown = true;
+    m_cv.notify_all();
+}
+
+void CompletionQueue::signal() {
+#ifdef _WIN32
+    if (m_eventHandle) {
+        SetEvent(static_cast<HANDLE>(m_eventHandle));
+    }
+#elif defined(__linux__)
+    if (m_writeFd != -1) {
+        uint64_t one = 1;
+        ssize_t ignored = write(m_writeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+#else
+    if (m_writeFd != -1) {
+        char byte = 1;
+        ssize_t ignored = write(m_writeFd, &byte, 1);
+        (void)ignored;
+    }
+#endif
+}
+
+void CompletionQueue::clearSignal() {
+#ifdef _WIN32
+    if (m_eventHandle) {
+        ResetEvent(static_cast<HANDLE>(m_eventHandle));
+    }
+#else
+    if (m_readFd != -1) {
+        char buffer[64];
+        while (read(m_readFd, buffer, sizeof(buffer)) > 0) {
+        }
+    }
+#endif
+}
+
+} // namespace Zrun
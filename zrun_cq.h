@@ -0,0 +1,71 @@
+#ifndef ZRUN_CQ_H
+#define ZRUN_CQ_H
+
+#include "zrun_types.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Zrun {
+
+// 完成队列：异步命令的完成事件和输出块投递到这里，由调用方在自己的线程中批量取出。
+// 队列从空变为非空时，可等待的 fd（Windows 上为事件句柄）变为可读，
+// 每一批事件只唤醒一次
+class CompletionQueue {
+public:
+    struct Event {
+        enum class Type { Completion, Output };
+
+        Type type = Type::Completion;
+        int asyncId = 0;
+        void* userData = nullptr;
+        // Output
+        bool isError = false;
+        std::string data;
+        // Completion
+        AsyncState state = AsyncState::Completed;
+        CommandResult result;
+    };
+
+    CompletionQueue();
+    ~CompletionQueue();
+
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    // 投递事件，可在任意线程调用
+    void post(Event event);
+
+    // 取出最多 maxEvents 个事件追加到 out；timeoutMs < 0 表示无限等待，
+    // 0 表示不等待。返回取出的数量
+    size_t next(std::vector<Event>& out, size_t maxEvents, int timeoutMs);
+
+    // 唤醒所有在 next 中等待的线程，之后 next 不再等待
+    void shutdown();
+
+    // 可加入 poll/epoll 的 fd（仅 Unix，否则为 -1）
+    int fd() const { return m_readFd; }
+
+    // 可用于 WaitForSingleObject 的事件句柄（仅 Windows，否则为空）
+    void* eventHandle() const { return m_eventHandle; }
+
+private:
+    void signal();
+    void clearSignal();
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Event> m_events;
+    bool m_shutdown = false;
+
+    int m_readFd = -1;
+    int m_writeFd = -1;
+    void* m_eventHandle = nullptr;
+};
+
+} // namespace Zrun
+
+#endif // ZRUN_CQ_H
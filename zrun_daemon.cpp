@@ -0,0 +1,1035 @@
+#include "zrun_daemon.h"
+
+#ifndef _WIN32
+#include "zrun_spawn.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace Zrun {
+
+namespace {
+enum FrameType : uint8_t { kExecute = 1, kCancel = 2, kResult = 3 };
+
+// Execute 帧的标志
+constexpr uint8_t kHasStdoutFd = 0x1;
+constexpr uint8_t kHasStderrFd = 0x2;
+constexpr uint8_t kTerminal = 0x4;
+
+constexpr size_t kFrameHeader = 4 + 1;
+constexpr uint32_t kMaxFrame = 64 * 1024 * 1024;
+// 单次 recvmsg 最多接收的 fd 数
+constexpr int kMaxReceivedFds = 16;
+// 客户端捕获管道的容量，减少守护进程在管道写满时的等待
+constexpr int kCapturePipeSize = 1024 * 1024;
+// 客户端不读取结果时最多为它排队的字节数，超过后断开连接
+constexpr size_t kMaxOutbox = 256 * 1024 * 1024;
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(std::string& out, const std::string& value) {
+    put(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+// 带边界检查的读取
+struct Reader {
+    const char* cursor;
+    const char* end;
+
+    template <typename T>
+    bool get(T& value) {
+        if (static_cast<size_t>(end - cursor) < sizeof(value)) {
+            return false;
+        }
+        std::memcpy(&value, cursor, sizeof(value));
+        cursor += sizeof(value);
+        return true;
+    }
+
+    bool getString(std::string& value) {
+        uint32_t length = 0;
+        if (!get(length) || static_cast<size_t>(end - cursor) < length) {
+            return false;
+        }
+        value.assign(cursor, length);
+        cursor += length;
+        return true;
+    }
+};
+
+std::string makeFrame(FrameType type, const std::string& payload) {
+    std::string frame;
+    frame.reserve(kFrameHeader + payload.size());
+    put(frame, static_cast<uint32_t>(payload.size()));
+    put(frame, static_cast<uint8_t>(type));
+    frame += payload;
+    return frame;
+}
+
+// 发送整帧，fds 随第一段数据发送
+bool sendAll(int socketFd, const std::string& data, const int* fds, int fdCount) {
+    const char* cursor = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>(cursor);
+        iov.iov_len = left;
+        struct msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * 2)];
+        if (fdCount > 0) {
+            std::memset(control, 0, sizeof(control));
+            message.msg_control = control;
+            message.msg_controllen = CMSG_SPACE(sizeof(int) * fdCount);
+            struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int) * fdCount);
+            std::memcpy(CMSG_DATA(header), fds, sizeof(int) * fdCount);
+        }
+        ssize_t n = sendmsg(socketFd, &message, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        cursor += n;
+        left -= static_cast<size_t>(n);
+        fdCount = 0;
+    }
+    return true;
+}
+
+// 读取套接字中当前可读的数据，收到的 fd 按顺序追加到 fds。对端关闭或出错时返回 false
+bool receiveAvailable(int socketFd, std::string& buffer, std::deque<int>* fds) {
+    char data[64 * 1024];
+    while (true) {
+        struct iovec iov;
+        iov.iov_base = data;
+        iov.iov_len = sizeof(data);
+        struct msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxReceivedFds)];
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        int flags = MSG_DONTWAIT;
+#ifdef MSG_CMSG_CLOEXEC
+        flags |= MSG_CMSG_CLOEXEC;
+#endif
+        ssize_t n = recvmsg(socketFd, &message, flags);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header;
+             header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; ++i) {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+#ifndef MSG_CMSG_CLOEXEC
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+                if (fds) {
+                    fds->push_back(fd);
+                } else {
+                    close(fd);
+                }
+            }
+        }
+        // fd 被截断时无法与帧对应
+        if (message.msg_flags & MSG_CTRUNC) {
+            return false;
+        }
+        if (n == 0) {
+            return false;
+        }
+        buffer.append(data, static_cast<size_t>(n));
+    }
+}
+
+// 取出缓冲区开头的完整帧，没有完整帧时返回 false；帧过大时把 invalid 设为 true
+bool nextFrame(const std::string& buffer, size_t& offset, uint8_t& type, const char*& payload,
+               uint32_t& size, bool& invalid) {
+    if (buffer.size() - offset < kFrameHeader) {
+        return false;
+    }
+    std::memcpy(&size, buffer.data() + offset, sizeof(size));
+    if (size > kMaxFrame) {
+        invalid = true;
+        return false;
+    }
+    if (buffer.size() - offset - kFrameHeader < size) {
+        return false;
+    }
+    type = static_cast<uint8_t>(buffer[offset + 4]);
+    payload = buffer.data() + offset + kFrameHeader;
+    offset += kFrameHeader + size;
+    return true;
+}
+
+int unixSocket() {
+#ifdef SOCK_CLOEXEC
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd != -1) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+#ifdef SO_NOSIGPIPE
+    if (fd != -1) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+    return fd;
+}
+
+bool socketAddress(const std::string& path, struct sockaddr_un& address, std::string& error) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        error = "Invalid socket path: " + path;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// 只接受与守护进程相同用户的连接
+bool sameUser(int fd) {
+#ifdef SO_PEERCRED
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == -1) {
+        return false;
+    }
+    return credentials.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+// 没有 XDG_RUNTIME_DIR 时套接字所在的目录
+std::string privateSocketDirectory() {
+    return "/tmp/zrund-" + std::to_string(getuid());
+}
+
+// 创建或检查私有目录：属于当前用户、不是符号链接、其他用户无权访问
+bool preparePrivateDirectory(const std::string& directory, std::string& error) {
+    if (mkdir(directory.c_str(), 0700) == -1 && errno != EEXIST) {
+        error = "Failed to create " + directory + ": " + strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (lstat(directory.c_str(), &info) == -1 || !S_ISDIR(info.st_mode) ||
+        info.st_uid != getuid() || (info.st_mode & 077) != 0) {
+        error = "Socket directory " + directory + " is not private to the current user";
+        return false;
+    }
+    return true;
+}
+
+void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+void drainWake(int fd) {
+    char scratch[64];
+    while (read(fd, scratch, sizeof(scratch)) > 0) {
+    }
+}
+}
+
+std::string defaultDaemonSocketPath() {
+    const char* value = getenv(kDaemonSocketEnv);
+    if (value && *value) {
+        return value;
+    }
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) {
+        return std::string(runtime) + "/zrund.sock";
+    }
+    return privateSocketDirectory() + "/zrund.sock";
+}
+
+// ---------------------------------------------------------------------------
+// 守护进程
+
+struct DaemonServer::Connection {
+    int fd = -1;
+    std::string buffer;
+    // 已收到、还没有被 Execute 帧取走的 fd
+    std::deque<int> fds;
+    // 保护以下成员和套接字的写入
+    std::mutex mutex;
+    std::map<uint32_t, std::shared_ptr<AsyncOperation>> operations;
+    bool closed = false;
+    // 等待发送的结果帧
+    std::string outbox;
+    size_t outboxOffset = 0;
+
+    size_t queued() const { return outbox.size() - outboxOffset; }
+
+    // 在 mutex 内调用：非阻塞地发送排队的结果，出错时返回 false
+    bool flush() {
+        while (outboxOffset < outbox.size()) {
+            ssize_t n = send(fd, outbox.data() + outboxOffset, outbox.size() - outboxOffset,
+                             MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n > 0) {
+                outboxOffset += static_cast<size_t>(n);
+                continue;
+            }
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            return n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        outbox.clear();
+        outboxOffset = 0;
+        return true;
+    }
+
+    ~Connection() {
+        for (int fd : fds) {
+            close(fd);
+        }
+    }
+};
+
+DaemonServer::DaemonServer(CoreImpl& core) : m_core(core) {}
+
+DaemonServer::~DaemonServer() {
+    for (auto& pair : m_connections) {
+        disconnect(pair.second);
+    }
+    m_connections.clear();
+    if (m_listenFd != -1) {
+        close(m_listenFd);
+        unlink(m_path.c_str());
+    }
+    for (int fd : m_wakeFds) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+}
+
+bool DaemonServer::listen(const std::string& path, std::string& error) {
+    struct sockaddr_un address;
+    if (!socketAddress(path, address, error)) {
+        return false;
+    }
+    size_t slash = path.rfind('/');
+    if (slash != std::string::npos && path.substr(0, slash) == privateSocketDirectory() &&
+        !preparePrivateDirectory(path.substr(0, slash), error)) {
+        return false;
+    }
+    // 已有守护进程在监听时不抢占，残留的套接字文件直接删除
+    int probe = unixSocket();
+    if (probe != -1 &&
+        connect(probe, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0) {
+        close(probe);
+        error = "Another daemon is listening on " + path;
+        return false;
+    }
+    if (probe != -1) {
+        close(probe);
+    }
+    unlink(path.c_str());
+
+    int fd = unixSocket();
+    if (fd == -1 || bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == -1 ||
+        chmod(path.c_str(), 0600) == -1 || ::listen(fd, SOMAXCONN) == -1) {
+        error = "Failed to listen on " + path + ": " + strerror(errno);
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+    if (!createPipe(m_wakeFds)) {
+        error = "Failed to create pipe: " + std::string(strerror(errno));
+        close(fd);
+        return false;
+    }
+    setNonBlocking(m_wakeFds[0]);
+    setNonBlocking(m_wakeFds[1]);
+    setNonBlocking(fd);
+    m_listenFd = fd;
+    m_path = path;
+    return true;
+}
+
+void DaemonServer::stop() {
+    m_stopping = true;
+    wake();
+}
+
+void DaemonServer::wake() {
+    if (m_wakeFds[1] != -1) {
+        ssize_t ignored = write(m_wakeFds[1], "x", 1);
+        (void)ignored;
+    }
+}
+
+void DaemonServer::run() {
+    std::vector<struct pollfd> fds;
+    std::vector<std::shared_ptr<Connection>> polled;
+    while (!m_stopping && m_listenFd != -1) {
+        fds.clear();
+        polled.clear();
+        fds.push_back({m_wakeFds[0], POLLIN, 0});
+        fds.push_back({m_listenFd, POLLIN, 0});
+        for (const auto& pair : m_connections) {
+            short events = POLLIN;
+            {
+                std::lock_guard<std::mutex> lock(pair.second->mutex);
+                if (pair.second->queued() > 0) {
+                    events |= POLLOUT;
+                }
+            }
+            fds.push_back({pair.first, events, 0});
+            polled.push_back(pair.second);
+        }
+        if (poll(fds.data(), fds.size(), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents) {
+            drainWake(m_wakeFds[0]);
+        }
+        if (fds[1].revents & POLLIN) {
+            accept();
+        }
+        for (size_t i = 0; i < polled.size(); ++i) {
+            short revents = fds[i + 2].revents;
+            if (!revents) {
+                continue;
+            }
+            bool alive = true;
+            if (revents & POLLOUT) {
+                std::lock_guard<std::mutex> lock(polled[i]->mutex);
+                alive = polled[i]->flush();
+            }
+            if (alive && (revents & ~POLLOUT)) {
+                alive = receive(polled[i]);
+            }
+            if (!alive) {
+                disconnect(polled[i]);
+                m_connections.erase(fds[i + 2].fd);
+            }
+        }
+    }
+}
+
+void DaemonServer::accept() {
+    while (true) {
+        int fd = ::accept(m_listenFd, nullptr, nullptr);
+        if (fd == -1) {
+            return;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        // 结果以非阻塞方式发送，不读取的客户端不会阻塞事件循环线程
+        setNonBlocking(fd);
+        if (!sameUser(fd)) {
+            close(fd);
+            continue;
+        }
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        auto connection = std::make_shared<Connection>();
+        connection->fd = fd;
+        m_connections[fd] = std::move(connection);
+    }
+}
+
+bool DaemonServer::receive(const std::shared_ptr<Connection>& connection) {
+    bool open = receiveAvailable(connection->fd, connection->buffer, &connection->fds);
+
+    // 对端关闭前发出的完整帧仍然处理
+    size_t offset = 0;
+    uint8_t type = 0;
+    const char* payload = nullptr;
+    uint32_t size = 0;
+    bool invalid = false;
+    while (nextFrame(connection->buffer, offset, type, payload, size, invalid)) {
+        if (!handleFrame(connection, type, payload, size)) {
+            return false;
+        }
+    }
+    connection->buffer.erase(0, offset);
+    return open && !invalid;
+}
+
+bool DaemonServer::handleFrame(const std::shared_ptr<Connection>& connection, uint8_t type,
+                               const char* data, size_t size) {
+    Reader reader{data, data + size};
+    uint32_t requestId = 0;
+    if (!reader.get(requestId)) {
+        return false;
+    }
+
+    if (type == kCancel) {
+        std::shared_ptr<AsyncOperation> cmd;
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            auto it = connection->operations.find(requestId);
+            if (it != connection->operations.end()) {
+                cmd = it->second;
+            }
+        }
+        if (cmd) {
+            cmd->cancel();
+        }
+        return true;
+    }
+    if (type != kExecute) {
+        return false;
+    }
+
+    uint8_t shell = 0, priority = 0, flags = 0;
+    int32_t timeoutMs = 0, queueTimeoutMs = 0;
+    uint16_t columns = 0, rows = 0;
+    std::string command, workingDirectory, tag;
+    uint32_t environmentCount = 0;
+    if (!reader.get(shell) || !reader.get(timeoutMs) || !reader.get(priority) ||
+        !reader.get(queueTimeoutMs) || !reader.get(flags) || !reader.get(columns) ||
+        !reader.get(rows) || !reader.getString(command) || !reader.getString(workingDirectory) ||
+        !reader.getString(tag) || !reader.get(environmentCount) ||
+        environmentCount > size / sizeof(uint32_t) ||
+        shell > static_cast<uint8_t>(ShellType::Sh) ||
+        priority > static_cast<uint8_t>(CommandPriority::Low)) {
+        return false;
+    }
+    std::vector<std::string> environment(environmentCount);
+    for (auto& entry : environment) {
+        if (!reader.getString(entry)) {
+            return false;
+        }
+    }
+
+    // 取出随帧发送的输出 fd
+    int outputFds[2] = {-1, -1};
+    const uint8_t fdFlags[2] = {kHasStdoutFd, kHasStderrFd};
+    for (int i = 0; i < 2; ++i) {
+        if (!(flags & fdFlags[i])) {
+            continue;
+        }
+        if (connection->fds.empty()) {
+            if (outputFds[0] != -1) {
+                close(outputFds[0]);
+            }
+            return false;
+        }
+        outputFds[i] = connection->fds.front();
+        connection->fds.pop_front();
+    }
+
+    CommandOptions options;
+    options.shellType = static_cast<ShellType>(shell);
+    options.timeoutMs = timeoutMs;
+    options.priority = static_cast<CommandPriority>(priority);
+    options.queueTimeoutMs = queueTimeoutMs;
+    options.tag = std::move(tag);
+    options.terminal.enabled = (flags & kTerminal) != 0;
+    options.terminal.columns = columns;
+    options.terminal.rows = rows;
+    if (outputFds[0] != -1) {
+        options.stdoutSink = OutputSink::toFd(outputFds[0]);
+    }
+    if (outputFds[1] != -1) {
+        options.stderrSink = OutputSink::toFd(outputFds[1]);
+    }
+
+    auto cmd = m_core.createRemoteAsync(command, options, std::move(environment),
+                                        workingDirectory);
+    cmd->keepInTable = false;
+    cmd->inTable = false;
+    std::weak_ptr<Connection> weak = connection;
+    cmd->completionCallback = [this, weak, requestId, outputFds](AsyncState state,
+                                                                 CommandResult& result) {
+        // 输出已经全部送出，关闭后客户端的管道得到 EOF
+        for (int fd : outputFds) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+        auto connection = weak.lock();
+        if (!connection) {
+            return;
+        }
+        std::string payload;
+        put(payload, requestId);
+        put(payload, static_cast<uint8_t>(state));
+        put(payload, static_cast<int32_t>(result.exitCode));
+        put(payload, static_cast<int64_t>(result.executionTime));
+        put(payload, static_cast<uint8_t>(result.timedOut ? 1 : 0));
+        put(payload, static_cast<uint8_t>(result.limitExceeded));
+        put(payload, static_cast<int64_t>(result.outputBytes));
+        put(payload, static_cast<int64_t>(result.errorBytes));
+        putString(payload, result.output);
+        putString(payload, result.error);
+
+        // 在事件循环线程中只做非阻塞发送，剩余部分由 run() 在套接字可写时发送。
+        // 连接未关闭说明服务端还没有析构（析构时先在 mutex 内关闭所有连接）
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->operations.erase(requestId);
+        if (connection->closed) {
+            return;
+        }
+        connection->outbox += makeFrame(kResult, payload);
+        if (!connection->flush() || connection->queued() > kMaxOutbox) {
+            // 发送出错或客户端长期不读取结果，断开连接
+            shutdown(connection->fd, SHUT_RDWR);
+        } else if (connection->queued() > 0) {
+            wake();
+        }
+    };
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->operations[requestId] = cmd;
+    }
+    m_core.startAsync(cmd);
+    return true;
+}
+
+void DaemonServer::disconnect(const std::shared_ptr<Connection>& connection) {
+    std::map<uint32_t, std::shared_ptr<AsyncOperation>> operations;
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        if (connection->closed) {
+            return;
+        }
+        connection->closed = true;
+        close(connection->fd);
+        operations.swap(connection->operations);
+    }
+    // 客户端已经离开，终止它仍在执行的命令
+    for (auto& pair : operations) {
+        pair.second->cancel();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// 客户端
+
+struct DaemonClient::Pending {
+    std::shared_ptr<AsyncOperation> cmd;
+    // 捕获输出的管道读取端，读到 EOF 后为 -1
+    int pipes[2] = {-1, -1};
+    std::string output[2];
+    bool finished = false;
+    CommandResult result;
+};
+
+DaemonClient::DaemonClient(Completion onComplete) : m_onComplete(std::move(onComplete)) {}
+
+DaemonClient::~DaemonClient() {
+    m_stopping = true;
+    if (m_wakeFds[1] != -1) {
+        ssize_t ignored = write(m_wakeFds[1], "x", 1);
+        (void)ignored;
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    fail("Disconnected from daemon");
+    for (int fd : {m_fd, m_wakeFds[0], m_wakeFds[1]}) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+}
+
+bool DaemonClient::connect(const std::string& path, std::string& error) {
+    std::string target = path.empty() ? defaultDaemonSocketPath() : path;
+    struct sockaddr_un address;
+    if (!socketAddress(target, address, error)) {
+        return false;
+    }
+    int fd = unixSocket();
+    if (fd == -1 ||
+        ::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == -1) {
+        error = "Failed to connect to daemon at " + target + ": " + strerror(errno);
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+    // 命令、环境变量和输出 fd 只交给同一用户的守护进程
+    if (!sameUser(fd)) {
+        error = "Daemon at " + target + " is not owned by the current user";
+        close(fd);
+        return false;
+    }
+    if (!createPipe(m_wakeFds)) {
+        error = "Failed to create pipe: " + std::string(strerror(errno));
+        close(fd);
+        return false;
+    }
+    setNonBlocking(m_wakeFds[0]);
+    setNonBlocking(m_wakeFds[1]);
+    m_fd = fd;
+    m_connected = true;
+    m_thread = std::thread(&DaemonClient::threadMain, this);
+    return true;
+}
+
+bool DaemonClient::forwardable(const CommandOptions& options) {
+    auto sinkForwardable = [](const OutputSink& sink) {
+        return sink.type == OutputSink::Type::Capture || sink.type == OutputSink::Type::Fd ||
+               sink.type == OutputSink::Type::File;
+    };
+    return !options.lineCallback && !options.stdoutFilter.active() &&
+           !options.stderrFilter.active() && !options.compressOutput &&
+           !options.limits.active() && options.placement.mode == CpuPlacement::Mode::Inherit &&
+           !options.cache.enabled && !options.singleFlight && !options.retry.active() &&
+           !options.hedge.enabled && !options.sharedChannel &&
+           sinkForwardable(options.stdoutSink) && sinkForwardable(options.stderrSink);
+}
+
+void DaemonClient::submit(const std::shared_ptr<AsyncOperation>& cmd,
+                          const std::vector<std::string>& environment,
+                          const std::string& workingDirectory) {
+    const CommandOptions& options = cmd->options;
+    bool terminal = options.terminal.enabled;
+    int streamCount = terminal ? 1 : 2;
+    const OutputSink* sinks[2] = {&options.stdoutSink, &options.stderrSink};
+
+    // 每个输出流交给守护进程一个 fd：捕获的流为管道写端，其余为目标 fd 或文件
+    auto pending = std::make_shared<Pending>();
+    pending->cmd = cmd;
+    int sendFds[2] = {-1, -1};
+    bool ownsFd[2] = {false, false};
+    int fdCount = 0;
+    uint8_t flags = terminal ? kTerminal : 0;
+    std::string error;
+    for (int i = 0; i < streamCount && error.empty(); ++i) {
+        const OutputSink& sink = *sinks[i];
+        int fd = -1;
+        if (sink.type == OutputSink::Type::Capture) {
+            int pipeFds[2];
+            if (!createPipe(pipeFds)) {
+                error = "Failed to create pipe: " + std::string(strerror(errno));
+                break;
+            }
+#ifdef F_SETPIPE_SZ
+            fcntl(pipeFds[0], F_SETPIPE_SZ, kCapturePipeSize);
+#endif
+            setNonBlocking(pipeFds[0]);
+            pending->pipes[i] = pipeFds[0];
+            fd = pipeFds[1];
+            ownsFd[fdCount] = true;
+        } else if (sink.type == OutputSink::Type::Fd) {
+            fd = sink.fd;
+            if (fd < 0) {
+                error = "Invalid output fd: " + std::to_string(fd);
+                break;
+            }
+        } else {
+            // 与本地执行一样，文件由调用方按自己的当前目录打开。
+            // splice 不支持 O_APPEND 打开的文件，追加模式改为定位到末尾
+            fd = open(sink.path.c_str(),
+                      O_WRONLY | O_CREAT | O_CLOEXEC | (sink.append ? 0 : O_TRUNC), 0644);
+            if (fd == -1) {
+                error = "Failed to open output file " + sink.path + ": " + strerror(errno);
+                break;
+            }
+            if (sink.append) {
+                lseek(fd, 0, SEEK_END);
+            }
+            ownsFd[fdCount] = true;
+        }
+        sendFds[fdCount++] = fd;
+        flags |= i == 0 ? kHasStdoutFd : kHasStderrFd;
+    }
+
+    auto closeOwned = [&]() {
+        for (int i = 0; i < fdCount; ++i) {
+            if (ownsFd[i]) {
+                close(sendFds[i]);
+            }
+        }
+    };
+    auto closePipes = [&]() {
+        for (int& fd : pending->pipes) {
+            if (fd != -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    };
+    if (!error.empty()) {
+        closeOwned();
+        closePipes();
+        CommandResult failure;
+        failure.exitCode = -1;
+        failure.error = error;
+        m_onComplete(cmd, failure);
+        return;
+    }
+
+    uint32_t requestId;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        requestId = m_nextRequestId++;
+        m_pending[requestId] = pending;
+    }
+
+    std::string payload;
+    put(payload, requestId);
+    put(payload, static_cast<uint8_t>(options.shellType));
+    put(payload, static_cast<int32_t>(options.timeoutMs));
+    put(payload, static_cast<uint8_t>(options.priority));
+    put(payload, static_cast<int32_t>(options.queueTimeoutMs));
+    put(payload, flags);
+    put(payload, static_cast<uint16_t>(options.terminal.columns));
+    put(payload, static_cast<uint16_t>(options.terminal.rows));
+    putString(payload, cmd->command);
+    if (workingDirectory.empty()) {
+        char buffer[4096];
+        putString(payload, getcwd(buffer, sizeof(buffer)) ? std::string(buffer) : std::string());
+    } else {
+        putString(payload, workingDirectory);
+    }
+    putString(payload, options.tag);
+    put(payload, static_cast<uint32_t>(environment.size()));
+    for (const auto& entry : environment) {
+        putString(payload, entry);
+    }
+
+    bool sent = m_connected && send(makeFrame(kExecute, payload), sendFds, fdCount);
+    // 守护进程已持有副本；管道的写端必须关闭，否则读取端得不到 EOF
+    closeOwned();
+    if (!sent) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.erase(requestId);
+        }
+        closePipes();
+        CommandResult failure;
+        failure.exitCode = -1;
+        failure.error = "Failed to send command to daemon";
+        m_onComplete(cmd, failure);
+        return;
+    }
+
+    // 让后台线程开始读取新的管道
+    ssize_t ignored = write(m_wakeFds[1], "x", 1);
+    (void)ignored;
+
+    {
+        std::lock_guard<std::mutex> lock(cmd->mutex);
+        cmd->onCancel = [this, requestId]() { cancel(requestId); };
+    }
+    // 设置钩子之前已被取消
+    if (cmd->state != AsyncState::Running) {
+        cancel(requestId);
+    }
+}
+
+bool DaemonClient::send(const std::string& frame, const int* fds, int fdCount) {
+    std::lock_guard<std::mutex> lock(m_sendMutex);
+    return sendAll(m_fd, frame, fds, fdCount);
+}
+
+void DaemonClient::cancel(uint32_t requestId) {
+    std::string payload;
+    put(payload, requestId);
+    if (m_connected) {
+        send(makeFrame(kCancel, payload), nullptr, 0);
+    }
+}
+
+bool DaemonClient::drain(Pending& pending, int stream) {
+    char data[64 * 1024];
+    while (true) {
+        ssize_t n = read(pending.pipes[stream], data, sizeof(data));
+        if (n > 0) {
+            std::string_view chunk(data, static_cast<size_t>(n));
+            if (pending.cmd->chunkCallback) {
+                pending.cmd->chunkCallback(chunk, stream == 1);
+            }
+            pending.output[stream].append(data, static_cast<size_t>(n));
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        close(pending.pipes[stream]);
+        pending.pipes[stream] = -1;
+        return false;
+    }
+}
+
+void DaemonClient::threadMain() {
+    std::string buffer;
+    std::vector<struct pollfd> fds;
+    std::vector<std::pair<std::shared_ptr<Pending>, int>> streams;
+    while (!m_stopping) {
+        fds.clear();
+        streams.clear();
+        fds.push_back({m_wakeFds[0], POLLIN, 0});
+        if (m_connected) {
+            fds.push_back({m_fd, POLLIN, 0});
+        }
+        size_t firstStream = fds.size();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& pair : m_pending) {
+                for (int i = 0; i < 2; ++i) {
+                    if (pair.second->pipes[i] != -1) {
+                        fds.push_back({pair.second->pipes[i], POLLIN, 0});
+                        streams.emplace_back(pair.second, i);
+                    }
+                }
+            }
+        }
+        if (poll(fds.data(), fds.size(), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents) {
+            drainWake(m_wakeFds[0]);
+        }
+
+        // 先读输出再处理结果，同一轮中结束的命令不会丢掉最后的输出
+        for (size_t i = 0; i < streams.size(); ++i) {
+            if (fds[firstStream + i].revents) {
+                drain(*streams[i].first, streams[i].second);
+            }
+        }
+
+        if (m_connected && fds[1].revents) {
+            bool open = receiveAvailable(m_fd, buffer, nullptr);
+            size_t offset = 0;
+            uint8_t type = 0;
+            const char* payload = nullptr;
+            uint32_t size = 0;
+            bool invalid = false;
+            while (nextFrame(buffer, offset, type, payload, size, invalid)) {
+                Reader reader{payload, payload + size};
+                uint32_t requestId = 0;
+                uint8_t state = 0, timedOut = 0, limit = 0;
+                int32_t exitCode = 0;
+                int64_t executionTime = 0, outputBytes = 0, errorBytes = 0;
+                CommandResult result;
+                if (type != kResult || !reader.get(requestId) || !reader.get(state) ||
+                    !reader.get(exitCode) || !reader.get(executionTime) ||
+                    !reader.get(timedOut) || !reader.get(limit) || !reader.get(outputBytes) ||
+                    !reader.get(errorBytes) || !reader.getString(result.output) ||
+                    !reader.getString(result.error)) {
+                    invalid = true;
+                    break;
+                }
+                result.exitCode = exitCode;
+                result.executionTime = executionTime;
+                result.timedOut = timedOut != 0;
+                result.limitExceeded = static_cast<ResourceLimitKind>(limit);
+                result.outputBytes = outputBytes;
+                result.errorBytes = errorBytes;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = m_pending.find(requestId);
+                if (it != m_pending.end()) {
+                    it->second->result = std::move(result);
+                    it->second->finished = true;
+                }
+            }
+            buffer.erase(0, offset);
+            if (!open || invalid) {
+                fail("Lost connection to daemon");
+                continue;
+            }
+        }
+
+        // 结果已收到且管道都已读完的命令
+        std::vector<std::shared_ptr<Pending>> done;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto it = m_pending.begin(); it != m_pending.end();) {
+                const Pending& pending = *it->second;
+                if (pending.finished && pending.pipes[0] == -1 && pending.pipes[1] == -1) {
+                    done.push_back(it->second);
+                    it = m_pending.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (auto& pending : done) {
+            CommandResult& result = pending->result;
+            result.output = std::move(pending->output[0]) + result.output;
+            result.error = std::move(pending->output[1]) + result.error;
+            m_onComplete(pending->cmd, result);
+        }
+    }
+}
+
+void DaemonClient::fail(const std::string& error) {
+    m_connected = false;
+    std::map<uint32_t, std::shared_ptr<Pending>> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pending.swap(m_pending);
+    }
+    for (auto& pair : pending) {
+        Pending& entry = *pair.second;
+        for (int& fd : entry.pipes) {
+            if (fd != -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        CommandResult result;
+        if (entry.finished) {
+            result = std::move(entry.result);
+        } else {
+            result.exitCode = -1;
+            result.error = error;
+        }
+        m_onComplete(entry.cmd, result);
+    }
+}
+
+} // namespace Zrun
+
+#endif // _WIN32
@@ -0,0 +1,130 @@
+#ifndef ZRUN_DAEMON_H
+#define ZRUN_DAEMON_H
+
+#include "zrun_core.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+
+namespace Zrun {
+
+// 守护进程 zrund 的 Unix 套接字协议（仅 Unix，同一台机器上的同一用户）。
+// 每帧为 u32 内容长度, u8 类型, 内容；整数为本机字节序，字符串为 u32 长度加字节。
+//   Execute (客户端 -> 守护进程)：u32 请求 id, u8 shell, i32 超时, u8 优先级, i32 排队超时,
+//       u8 标志, u16 列, u16 行, 命令, 工作目录, tag, u32 环境变量数, "KEY=VALUE"...
+//       标志中声明的输出 fd（先 stdout 后 stderr）通过 SCM_RIGHTS 随该帧发送，
+//       子进程的输出由守护进程用 splice 直接送进这些 fd，不经过套接字
+//   Cancel (客户端 -> 守护进程)：u32 请求 id
+//   Result (守护进程 -> 客户端)：u32 请求 id, u8 状态, i32 退出码, i64 执行时间, u8 超时,
+//       u8 超出的资源限制, i64 stdout 字节数, i64 stderr 字节数, 输出, 错误
+//       （没有传入 fd 的输出流由守护进程捕获后放在这里）
+// 套接字路径依次取环境变量 ZRUND_SOCKET、$XDG_RUNTIME_DIR/zrund.sock、
+// /tmp/zrund-<uid>/zrund.sock（目录由守护进程以 0700 创建）
+constexpr const char* kDaemonSocketEnv = "ZRUND_SOCKET";
+
+std::string defaultDaemonSocketPath();
+
+// 在一个 CoreImpl 上为多个客户端执行命令。连接由 run() 所在的线程处理，
+// 结果按连接排队、以非阻塞方式发送，不读取结果的客户端不影响其他客户端；
+// 客户端断开时终止它仍在执行的命令
+class DaemonServer {
+public:
+    explicit DaemonServer(CoreImpl& core);
+    ~DaemonServer();
+
+    DaemonServer(const DaemonServer&) = delete;
+    DaemonServer& operator=(const DaemonServer&) = delete;
+
+    // 创建并监听套接字（权限 0600）。已有守护进程在监听时返回 false
+    bool listen(const std::string& path, std::string& error);
+
+    // 处理连接直到 stop()
+    void run();
+
+    // 让 run() 返回，可以在信号处理函数中调用
+    void stop();
+
+private:
+    struct Connection;
+
+    void accept();
+    // 读取并处理连接上的数据，连接已断开时返回 false
+    bool receive(const std::shared_ptr<Connection>& connection);
+    bool handleFrame(const std::shared_ptr<Connection>& connection, uint8_t type,
+                     const char* data, size_t size);
+    void disconnect(const std::shared_ptr<Connection>& connection);
+    void wake();
+
+    CoreImpl& m_core;
+    std::string m_path;
+    int m_listenFd = -1;
+    int m_wakeFds[2] = {-1, -1};
+    std::atomic<bool> m_stopping{false};
+    std::map<int, std::shared_ptr<Connection>> m_connections;
+};
+
+// 客户端模式：把命令转发给守护进程执行。输出按 CommandOptions 的去向交给守护进程：
+// 捕获的输出经由客户端创建的管道，写入 fd 或文件的输出直接把 fd 交给守护进程。
+// 一个后台线程读取这些管道和套接字，在其中调用分块回调和完成回调
+class DaemonClient {
+public:
+    using Completion = std::function<void(const std::shared_ptr<AsyncOperation>& cmd,
+                                          CommandResult& result)>;
+
+    explicit DaemonClient(Completion onComplete);
+    ~DaemonClient();
+
+    DaemonClient(const DaemonClient&) = delete;
+    DaemonClient& operator=(const DaemonClient&) = delete;
+
+    // 只连接属于当前用户的守护进程
+    bool connect(const std::string& path, std::string& error);
+    // 连接断开后为 false，之后的命令在本地执行
+    bool connected() const { return m_connected; }
+    // 当前线程是读取结果的后台线程（回调中的同步执行不能在这里等待）
+    bool inClientThread() const { return std::this_thread::get_id() == m_thread.get_id(); }
+
+    // 协议能够表达的选项：没有回调式的过滤/分行、压缩、资源限制、CPU 放置、缓存、合并、
+    // 重试/对冲和共享内存通道，输出去向不是 CaptureAnd*
+    static bool forwardable(const CommandOptions& options);
+
+    // 交给守护进程执行，结束（或失败）时调用 onComplete。
+    // environment 为完整的环境变量，workingDirectory 为空时使用客户端的当前目录
+    void submit(const std::shared_ptr<AsyncOperation>& cmd,
+                const std::vector<std::string>& environment, const std::string& workingDirectory);
+
+private:
+    struct Pending;
+
+    bool send(const std::string& frame, const int* fds, int fdCount);
+    void cancel(uint32_t requestId);
+    void threadMain();
+    // 读取管道，流结束时返回 false
+    bool drain(Pending& pending, int stream);
+    void fail(const std::string& error);
+
+    Completion m_onComplete;
+    int m_fd = -1;
+    int m_wakeFds[2] = {-1, -1};
+    std::atomic<bool> m_connected{false};
+    std::atomic<bool> m_stopping{false};
+    std::mutex m_sendMutex;
+    std::mutex m_mutex;
+    std::map<uint32_t, std::shared_ptr<Pending>> m_pending;
+    uint32_t m_nextRequestId = 1;
+    std::thread m_thread;
+};
+
+} // namespace Zrun
+
+#endif // _WIN32
+
+#endif // ZRUN_DAEMON_H
@@ -0,0 +1,135 @@
+#include "zrun_filter.h"
+#include <algorithm>
+
+namespace Zrun {
+
+namespace {
+#ifdef __GLIBCXX__
+// libstdc++ 的 regex_search 默认按字符递归回溯，约 10 KB 的行就会耗尽栈。没有反向引用的
+// 表达式改用按状态集合推进的执行器 (__polynomial)，加上 [\s\S]* 前缀后只从行首匹配一次，
+// 栈深度与行长度无关，时间与行长度成线性
+std::unique_ptr<std::regex> compileLinear(const std::string& pattern) {
+    try {
+        return std::make_unique<std::regex>("[\\s\\S]*(?:" + pattern + ")",
+                                            std::regex::ECMAScript | std::regex::optimize |
+                                                std::regex_constants::__polynomial);
+    } catch (const std::regex_error&) {
+        // 含反向引用，只能递归匹配
+        return nullptr;
+    }
+}
+#else
+std::unique_ptr<std::regex> compileLinear(const std::string&) {
+    return nullptr;
+}
+#endif
+} // namespace
+
+StreamFilter::StreamFilter(const OutputFilter& filter, size_t maxLineLength)
+    : m_filter(filter), m_lines(maxLineLength) {
+    if (m_filter.mode == OutputFilter::Mode::Regex) {
+        // 按原样编译，语法错误由这里报告
+        m_regex = std::make_unique<std::regex>(
+            m_filter.pattern, std::regex::ECMAScript | std::regex::optimize);
+        m_linearRegex = compileLinear(m_filter.pattern);
+    } else if (m_filter.mode == OutputFilter::Mode::Literal && !m_filter.pattern.empty()) {
+        const char* begin = m_filter.pattern.data();
+        m_searcher = std::make_unique<std::boyer_moore_horspool_searcher<const char*>>(
+            begin, begin + m_filter.pattern.size());
+    }
+    if (m_filter.count == 0 || m_filter.maxMatches == 0) {
+        m_done = true;
+    }
+}
+
+void StreamFilter::feed(std::string_view data) {
+    if (m_done || data.empty()) {
+        return;
+    }
+
+    if (m_filter.mode == OutputFilter::Mode::ByteRange) {
+        long long begin = std::max(m_filter.first, m_position);
+        long long end = m_position + static_cast<long long>(data.size());
+        if (m_filter.count >= 0) {
+            end = std::min(end, m_filter.first + m_filter.count);
+        }
+        if (begin < end) {
+            m_output.append(data.data() + (begin - m_position), static_cast<size_t>(end - begin));
+            m_matches += end - begin;
+        }
+        m_position += static_cast<long long>(data.size());
+        if (m_filter.count >= 0 && m_position >= m_filter.first + m_filter.count) {
+            m_done = true;
+        }
+        return;
+    }
+
+    m_lines.feed(data, [this](std::string_view line) {
+        if (!m_done) {
+            acceptLine(line, true);
+        }
+    });
+}
+
+void StreamFilter::finish() {
+    m_lines.finish([this](std::string_view line) {
+        if (!m_done) {
+            acceptLine(line, false);
+        }
+    });
+}
+
+void StreamFilter::acceptLine(std::string_view line, bool complete) {
+    long long index = m_position++;
+    bool keep;
+    if (m_filter.mode == OutputFilter::Mode::LineRange) {
+        keep = index >= m_filter.first;
+        if (m_filter.count >= 0 && index + 1 >= m_filter.first + m_filter.count) {
+            m_done = true;
+        }
+    } else {
+        keep = lineMatches(line) != m_filter.invert;
+    }
+    if (!keep) {
+        return;
+    }
+
+    ++m_matches;
+    if (m_filter.maxMatches >= 0 && m_matches > m_filter.maxMatches) {
+        return;
+    }
+    m_output.append(line.data(), line.size());
+    if (complete) {
+        m_output.push_back('\n');
+    }
+}
+
+bool StreamFilter::lineMatches(std::string_view line) const {
+    if (m_linearRegex) {
+        return std::regex_search(line.data(), line.data() + line.size(), *m_linearRegex,
+                                 std::regex_constants::match_continuous);
+    }
+    if (m_regex) {
+        if (m_filter.maxRegexLineLength >= 0 &&
+            static_cast<long long>(line.size()) > m_filter.maxRegexLineLength) {
+            return false;
+        }
+        return std::regex_search(line.data(), line.data() + line.size(), *m_regex);
+    }
+    if (!m_searcher) {
+        // 空字符串匹配所有行
+        return true;
+    }
+    const char* end = line.data() + line.size();
+    return std::search(line.data(), end, *m_searcher) != end;
+}
+
+long long applyFilter(const OutputFilter& filter, std::string& data, size_t maxLineLength) {
+    StreamFilter streamFilter(filter, maxLineLength);
+    streamFilter.feed(data);
+    streamFilter.finish();
+    data = std::move(streamFilter.output());
+    return streamFilter.matches();
+}
+
+} // namespace Zrun
@@ -0,0 +1,58 @@
+#ifndef ZRUN_FILTER_H
+#define ZRUN_FILTER_H
+
+#include "zrun_types.h"
+#include "zrun_lines.h"
+#include <functional>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+
+namespace Zrun {
+
+// 单个输出流的过滤状态：按到达顺序输入数据，只保留选中的部分。
+// 选中的范围结束后，后续数据不再扫描
+class StreamFilter {
+public:
+    // pattern 不是有效的正则表达式时抛出 std::regex_error。
+    // 按行过滤时超过 maxLineLength 的行拆成多行（见 LineSplitter）
+    explicit StreamFilter(const OutputFilter& filter,
+                          size_t maxLineLength = LineSplitter::kDefaultMaxLineLength);
+
+    StreamFilter(const StreamFilter&) = delete;
+    StreamFilter& operator=(const StreamFilter&) = delete;
+
+    void feed(std::string_view data);
+
+    // 输出结束：处理没有换行符的最后一行
+    void finish();
+
+    // 选中的数据，保留原有的换行符
+    std::string& output() { return m_output; }
+    long long matches() const { return m_matches; }
+
+private:
+    void acceptLine(std::string_view line, bool complete);
+    bool lineMatches(std::string_view line) const;
+
+    OutputFilter m_filter;
+    LineSplitter m_lines;
+    std::unique_ptr<std::regex> m_regex;
+    // 可选，m_regex 的非递归形式（见 zrun_filter.cpp），可用时代替 m_regex
+    std::unique_ptr<std::regex> m_linearRegex;
+    std::unique_ptr<std::boyer_moore_horspool_searcher<const char*>> m_searcher;
+    std::string m_output;
+    long long m_matches = 0;
+    // ByteRange 为已读字节数，其他模式为已读行数
+    long long m_position = 0;
+    bool m_done = false;
+};
+
+// 对已完整读取的输出应用过滤器，返回选中的数量
+long long applyFilter(const OutputFilter& filter, std::string& data,
+                      size_t maxLineLength = LineSplitter::kDefaultMaxLineLength);
+
+} // namespace Zrun
+
+#endif // ZRUN_FILTER_H
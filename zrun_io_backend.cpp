@@ -0,0 +1,334 @@
+#include "zrun_io_backend.h"
+
+#ifndef _WIN32
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace Zrun {
+
+namespace {
+
+// 指针最低位用于区分流和进程
+inline void* tagProcess(IoProcess* process) {
+    return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(process) | 1u);
+}
+
+inline bool isProcessTag(void* tagged) {
+    return (reinterpret_cast<uintptr_t>(tagged) & 1u) != 0;
+}
+
+inline IoProcess* untagProcess(void* tagged) {
+    return reinterpret_cast<IoProcess*>(reinterpret_cast<uintptr_t>(tagged) & ~uintptr_t(1));
+}
+
+inline IoEvent::Kind streamEventKind(void* stream) {
+    return static_cast<IoStream*>(stream)->writable ? IoEvent::Kind::Writable
+                                                    : IoEvent::Kind::Readable;
+}
+
+// 可移植的 poll(2) 后端，用于没有 epoll 的平台
+class PollBackend : public IoBackend {
+public:
+    PollBackend() = default;
+
+    ~PollBackend() override {
+        if (m_wakePipe[0] != -1) {
+            close(m_wakePipe[0]);
+            close(m_wakePipe[1]);
+        }
+    }
+
+    bool init(std::string& error) {
+        if (pipe(m_wakePipe) == -1) {
+            error = "Failed to create wake pipe: " + std::string(strerror(errno));
+            return false;
+        }
+        for (int fd : m_wakePipe) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        return true;
+    }
+
+    const char* name() const override { return "poll"; }
+
+    bool armStream(IoStream& stream) override {
+        if (!stream.registered) {
+            m_entries.push_back(Entry{stream.fd, &stream,
+                                      static_cast<short>(stream.writable ? POLLOUT : POLLIN)});
+            stream.registered = true;
+        }
+        return true;
+    }
+
+    void cancelStream(IoStream&) override {}
+
+    void removeStream(IoStream& stream) override {
+        removeEntry(&stream);
+        stream.registered = false;
+    }
+
+    bool watchProcess(IoProcess& process) override {
+        if (process.pidfd == -1) {
+            return false;
+        }
+        if (!process.registered) {
+            m_entries.push_back(Entry{process.pidfd, tagProcess(&process), POLLIN});
+            process.registered = true;
+        }
+        return true;
+    }
+
+    void removeProcess(IoProcess& process) override {
+        removeEntry(tagProcess(&process));
+        process.registered = false;
+    }
+
+    void wake() override {
+        char byte = 1;
+        ssize_t ignored = write(m_wakePipe[1], &byte, 1);
+        (void)ignored;
+    }
+
+    void wait(int timeoutMs, std::vector<IoEvent>& events) override {
+        m_pollFds.resize(m_entries.size() + 1);
+        m_pollFds[0].fd = m_wakePipe[0];
+        m_pollFds[0].events = POLLIN;
+        m_pollFds[0].revents = 0;
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            m_pollFds[i + 1].fd = m_entries[i].fd;
+            m_pollFds[i + 1].events = m_entries[i].events;
+            m_pollFds[i + 1].revents = 0;
+        }
+
+        int ready = poll(m_pollFds.data(), m_pollFds.size(), timeoutMs);
+        if (ready <= 0) {
+            return;
+        }
+
+        if (m_pollFds[0].revents) {
+            char buffer[64];
+            while (read(m_wakePipe[0], buffer, sizeof(buffer)) > 0) {
+            }
+        }
+
+        // 先收集再分派，分派时调用方可能修改注册表
+        for (size_t i = 1; i < m_pollFds.size(); ++i) {
+            if (!m_pollFds[i].revents) {
+                continue;
+            }
+            void* object = m_entries[i - 1].object;
+            if (isProcessTag(object)) {
+                events.push_back(IoEvent{IoEvent::Kind::ProcessExited, untagProcess(object), 0});
+            } else {
+                events.push_back(IoEvent{streamEventKind(object), object, 0});
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        int fd;
+        void* object;
+        short events;
+    };
+
+    void removeEntry(void* object) {
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            if (m_entries[i].object == object) {
+                m_entries[i] = m_entries.back();
+                m_entries.pop_back();
+                return;
+            }
+        }
+    }
+
+    int m_wakePipe[2] = {-1, -1};
+    std::vector<Entry> m_entries;
+    std::vector<struct pollfd> m_pollFds;
+};
+
+#ifdef __linux__
+// 水平触发的 epoll 后端
+class EpollBackend : public IoBackend {
+public:
+    EpollBackend() = default;
+
+    ~EpollBackend() override {
+        if (m_wakeFd != -1) {
+            close(m_wakeFd);
+        }
+        if (m_epollFd != -1) {
+            close(m_epollFd);
+        }
+    }
+
+    bool init(std::string& error) {
+        m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epollFd == -1) {
+            error = "epoll_create1 failed: " + std::string(strerror(errno));
+            return false;
+        }
+        m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_wakeFd == -1) {
+            error = "eventfd failed: " + std::string(strerror(errno));
+            return false;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev) == -1) {
+            error = "epoll_ctl failed: " + std::string(strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    const char* name() const override { return "epoll"; }
+
+    bool armStream(IoStream& stream) override {
+        if (stream.registered) {
+            return true;
+        }
+        struct epoll_event ev;
+        ev.events = stream.writable ? EPOLLOUT : EPOLLIN;
+        ev.data.ptr = &stream;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, stream.fd, &ev) == -1) {
+            return false;
+        }
+        stream.registered = true;
+        return true;
+    }
+
+    void cancelStream(IoStream&) override {}
+
+    void removeStream(IoStream& stream) override {
+        if (stream.registered) {
+            epoll_ctl(m_epollFd, EPOLL_CTL_DEL, stream.fd, nullptr);
+            stream.registered = false;
+        }
+    }
+
+    bool watchProcess(IoProcess& process) override {
+        if (process.pidfd == -1) {
+            return false;
+        }
+        if (process.registered) {
+            return true;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = tagProcess(&process);
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, process.pidfd, &ev) == -1) {
+            return false;
+        }
+        process.registered = true;
+        return true;
+    }
+
+    void removeProcess(IoProcess& process) override {
+        if (process.registered) {
+            epoll_ctl(m_epollFd, EPOLL_CTL_DEL, process.pidfd, nullptr);
+            process.registered = false;
+        }
+    }
+
+    void wake() override {
+        uint64_t one = 1;
+        ssize_t ignored = write(m_wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    void wait(int timeoutMs, std::vector<IoEvent>& events) override {
+        struct epoll_event ready[kMaxEvents];
+        int count = epoll_wait(m_epollFd, ready, kMaxEvents, timeoutMs);
+        for (int i = 0; i < count; ++i) {
+            void* object = ready[i].data.ptr;
+            if (!object) {
+                uint64_t value;
+                ssize_t ignored = read(m_wakeFd, &value, sizeof(value));
+                (void)ignored;
+            } else if (isProcessTag(object)) {
+                events.push_back(IoEvent{IoEvent::Kind::ProcessExited, untagProcess(object), 0});
+            } else {
+                events.push_back(IoEvent{streamEventKind(object), object, 0});
+            }
+        }
+    }
+
+private:
+    static constexpr int kMaxEvents = 256;
+
+    int m_epollFd = -1;
+    int m_wakeFd = -1;
+};
+#endif
+
+} // namespace
+
+std::unique_ptr<IoBackend> createPollBackend(std::string& error) {
+    auto backend = std::make_unique<PollBackend>();
+    if (!backend->init(error)) {
+        return nullptr;
+    }
+    return backend;
+}
+
+#ifdef __linux__
+std::unique_ptr<IoBackend> createEpollBackend(std::string& error) {
+    auto backend = std::make_unique<EpollBackend>();
+    if (!backend->init(error)) {
+        return nullptr;
+    }
+    return backend;
+}
+#endif
+
+std::unique_ptr<IoBackend> createIoBackend(IoBackendType type, std::string& note) {
+    std::unique_ptr<IoBackend> backend;
+    std::string error;
+
+#ifdef __linux__
+    if (type == IoBackendType::IoUring) {
+        backend = createIoUringBackend(error);
+        if (backend) {
+            return backend;
+        }
+        note = "io_uring unavailable (" + error + "), falling back to epoll";
+        type = IoBackendType::Epoll;
+    }
+    if (type == IoBackendType::Default || type == IoBackendType::Epoll) {
+        error.clear();
+        backend = createEpollBackend(error);
+        if (backend) {
+            return backend;
+        }
+        note += (note.empty() ? "" : "; ") + std::string("epoll unavailable (") + error +
+                "), falling back to poll";
+    }
+#else
+    if (type != IoBackendType::Default && type != IoBackendType::Poll) {
+        note = "requested I/O backend is not available on this platform, using poll";
+    }
+#endif
+
+    error.clear();
+    backend = createPollBackend(error);
+    if (!backend) {
+        note += (note.empty() ? "" : "; ") + error;
+    }
+    return backend;
+}
+
+} // namespace Zrun
+
+#endif // _WIN32
@@ -0,0 +1,95 @@
+#ifndef ZRUN_IO_BACKEND_H
+#define ZRUN_IO_BACKEND_H
+
+#include "zrun_types.h"
+#include "zrun_capture.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+
+namespace Zrun {
+
+// 后端关注的一个输出管道
+struct IoStream {
+    int fd = -1;
+    // 非空时后端可以直接读入该缓冲区（io_uring 提交 readv），否则只报告可读
+    CaptureBuffer* directTarget = nullptr;
+    // 为 true 时关注可写而不是可读（等待写满的输出目标）
+    bool writable = false;
+    void* context = nullptr;
+
+    // 以下字段由后端维护
+    bool registered = false;
+    bool inFlight = false;
+    bool waitReadable = false;
+    unsigned inFlightTag = 0;
+    struct iovec iov[CaptureBuffer::kMaxIovecs];
+};
+
+// 后端关注的一个子进程（pidfd）
+struct IoProcess {
+    int pidfd = -1;
+    void* context = nullptr;
+
+    // 以下字段由后端维护
+    bool registered = false;
+    bool inFlight = false;
+};
+
+struct IoEvent {
+    enum class Kind {
+        Readable,       // 流可读，由调用方自行读取
+        Writable,       // writable 的流可写
+        ReadCompleted,  // 后端已直接读入 directTarget，result 为字节数（0 表示 EOF，
+                        // 小于 0 表示没有读到数据，如被取消）
+        ProcessExited   // pidfd 可读，子进程已退出
+    };
+
+    Kind kind;
+    void* object;   // IoStream* 或 IoProcess*
+    long result;
+};
+
+// 事件循环使用的 I/O 后端。除 wake() 外的所有方法只能在事件循环线程调用
+class IoBackend {
+public:
+    virtual ~IoBackend() = default;
+
+    virtual const char* name() const = 0;
+
+    // 关注流的下一批数据；每次处理完该流的事件后都要重新调用
+    virtual bool armStream(IoStream& stream) = 0;
+
+    // 取消流上进行中的操作；inFlight 清零之前 stream 必须保持有效
+    virtual void cancelStream(IoStream& stream) = 0;
+
+    // 在关闭 fd 之前调用，此时流上不得有进行中的操作
+    virtual void removeStream(IoStream& stream) = 0;
+
+    virtual bool watchProcess(IoProcess& process) = 0;
+    virtual void removeProcess(IoProcess& process) = 0;
+
+    // 唤醒正在等待的事件循环，可在任意线程调用
+    virtual void wake() = 0;
+
+    // 等待事件，timeoutMs < 0 表示无限等待
+    virtual void wait(int timeoutMs, std::vector<IoEvent>& events) = 0;
+};
+
+// 创建后端；请求的后端不可用时按 io_uring -> epoll -> poll 回退，原因写入 note
+std::unique_ptr<IoBackend> createIoBackend(IoBackendType type, std::string& note);
+
+std::unique_ptr<IoBackend> createPollBackend(std::string& error);
+#ifdef __linux__
+std::unique_ptr<IoBackend> createEpollBackend(std::string& error);
+std::unique_ptr<IoBackend> createIoUringBackend(std::string& error);
+#endif
+
+} // namespace Zrun
+
+#endif // _WIN32
+
+#endif // ZRUN_IO_BACKEND_H
@@ -0,0 +1,459 @@
+#include "zrun_io_backend.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ZRUN_HAS_IO_URING 1
+#endif
+
+#ifdef ZRUN_HAS_IO_URING
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace Zrun {
+
+#ifdef ZRUN_HAS_IO_URING
+
+namespace {
+
+// user_data 低 3 位标记操作类型
+enum OpTag : uintptr_t {
+    kTagRead = 1,
+    kTagPoll = 2,
+    kTagProcess = 3,
+    kTagWake = 4,
+    kTagTimeout = 5,
+    kTagCancel = 6,
+    kTagMask = 7
+};
+
+inline uint64_t makeUserData(void* object, OpTag tag) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(object) | tag);
+}
+
+inline OpTag userDataTag(uint64_t data) {
+    return static_cast<OpTag>(data & kTagMask);
+}
+
+template <typename T>
+inline T* userDataObject(uint64_t data) {
+    return reinterpret_cast<T*>(static_cast<uintptr_t>(data & ~uint64_t(kTagMask)));
+}
+
+int sysIoUringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                                    nullptr, 0));
+}
+
+int sysIoUringRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+// 基于原始系统调用的 io_uring 后端：所有在途命令的读取、pidfd 等待和超时
+// 都作为 SQE 累积，在每次 wait() 时通过一次 io_uring_enter 批量提交
+class IoUringBackend : public IoBackend {
+public:
+    IoUringBackend() = default;
+
+    ~IoUringBackend() override {
+        if (m_sqes) {
+            munmap(m_sqes, m_sqesSize);
+        }
+        if (m_cqRing && m_cqRing != m_sqRing) {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        if (m_sqRing) {
+            munmap(m_sqRing, m_sqRingSize);
+        }
+        if (m_ringFd != -1) {
+            close(m_ringFd);
+        }
+        if (m_wakeFd != -1) {
+            close(m_wakeFd);
+        }
+    }
+
+    bool init(std::string& error) {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_ringFd = sysIoUringSetup(kRingEntries, &params);
+        if (m_ringFd == -1) {
+            error = "io_uring_setup failed: " + std::string(strerror(errno));
+            return false;
+        }
+        fcntl(m_ringFd, F_SETFD, FD_CLOEXEC);
+
+        if (!probeOps(error) || !mapRings(params, error)) {
+            return false;
+        }
+        m_currentPosition = (params.features & IORING_FEAT_RW_CUR_POS) != 0;
+
+        m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_wakeFd == -1) {
+            error = "eventfd failed: " + std::string(strerror(errno));
+            return false;
+        }
+        armWake();
+        return true;
+    }
+
+    const char* name() const override { return "io_uring"; }
+
+    bool armStream(IoStream& stream) override {
+        if (stream.inFlight) {
+            return true;
+        }
+        struct io_uring_sqe* sqe = nextSqe();
+        if (!sqe) {
+            return false;
+        }
+        if (stream.directTarget && !stream.waitReadable) {
+            int count = stream.directTarget->prepareRead(stream.iov);
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = stream.fd;
+            sqe->addr = reinterpret_cast<uint64_t>(stream.iov);
+            sqe->len = static_cast<unsigned>(count);
+            sqe->off = m_currentPosition ? static_cast<uint64_t>(-1) : 0;
+            sqe->user_data = makeUserData(&stream, kTagRead);
+            stream.inFlightTag = kTagRead;
+        } else {
+            preparePoll(sqe, stream.fd, makeUserData(&stream, kTagPoll),
+                        stream.writable ? POLLOUT : POLLIN);
+            stream.inFlightTag = kTagPoll;
+        }
+        stream.inFlight = true;
+        stream.registered = true;
+        return true;
+    }
+
+    void cancelStream(IoStream& stream) override {
+        if (!stream.inFlight) {
+            return;
+        }
+        struct io_uring_sqe* sqe = nextSqe();
+        if (!sqe) {
+            return;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = makeUserData(&stream, static_cast<OpTag>(stream.inFlightTag));
+        sqe->user_data = makeUserData(nullptr, kTagCancel);
+    }
+
+    void removeStream(IoStream& stream) override {
+        stream.registered = false;
+    }
+
+    bool watchProcess(IoProcess& process) override {
+        if (process.pidfd == -1) {
+            return false;
+        }
+        if (process.inFlight) {
+            return true;
+        }
+        struct io_uring_sqe* sqe = nextSqe();
+        if (!sqe) {
+            return false;
+        }
+        preparePoll(sqe, process.pidfd, makeUserData(&process, kTagProcess), POLLIN);
+        process.inFlight = true;
+        process.registered = true;
+        return true;
+    }
+
+    void removeProcess(IoProcess& process) override {
+        if (process.inFlight) {
+            struct io_uring_sqe* sqe = nextSqe();
+            if (sqe) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = makeUserData(&process, kTagProcess);
+                sqe->user_data = makeUserData(nullptr, kTagCancel);
+            }
+        }
+        process.registered = false;
+    }
+
+    void wake() override {
+        uint64_t one = 1;
+        ssize_t ignored = write(m_wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    void wait(int timeoutMs, std::vector<IoEvent>& events) override {
+        size_t before = events.size();
+        // 上一轮之后到达的唤醒也要立即返回，否则其他线程提交的工作要等到超时
+        bool woken = reap(events);
+
+        if (events.size() != before || woken || timeoutMs == 0) {
+            submit(0);
+            reap(events);
+            return;
+        }
+
+        if (timeoutMs > 0) {
+            // off = 1：任意一个其他完成事件到达时该超时也随之完成，不会残留
+            struct io_uring_sqe* sqe = nextSqe();
+            if (sqe) {
+                m_timeout.tv_sec = timeoutMs / 1000;
+                m_timeout.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+                sqe->opcode = IORING_OP_TIMEOUT;
+                sqe->fd = -1;
+                sqe->addr = reinterpret_cast<uint64_t>(&m_timeout);
+                sqe->len = 1;
+                sqe->off = 1;
+                sqe->user_data = makeUserData(nullptr, kTagTimeout);
+            }
+        }
+        submit(1);
+        reap(events);
+    }
+
+private:
+    static constexpr unsigned kRingEntries = 1024;
+
+    // 检查所需的操作码（需要 5.6 以上内核的 IORING_REGISTER_PROBE）
+    bool probeOps(std::string& error) {
+        const size_t probeSize = sizeof(struct io_uring_probe) +
+                                 IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+        std::vector<unsigned char> storage(probeSize, 0);
+        auto* probe = reinterpret_cast<struct io_uring_probe*>(storage.data());
+        if (sysIoUringRegister(m_ringFd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == -1) {
+            error = "IORING_REGISTER_PROBE failed: " + std::string(strerror(errno));
+            return false;
+        }
+        const int required[] = {IORING_OP_READV, IORING_OP_POLL_ADD, IORING_OP_TIMEOUT,
+                                IORING_OP_ASYNC_CANCEL};
+        for (int op : required) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                error = "io_uring opcode " + std::to_string(op) + " not supported";
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    bool mapRings(const struct io_uring_params& params, std::string& error) {
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            m_sqRing = nullptr;
+            error = "mmap SQ ring failed: " + std::string(strerror(errno));
+            return false;
+        }
+        if (singleMmap) {
+            m_cqRing = m_sqRing;
+        } else {
+            m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+            if (m_cqRing == MAP_FAILED) {
+                m_cqRing = nullptr;
+                error = "mmap CQ ring failed: " + std::string(strerror(errno));
+                return false;
+            }
+        }
+
+        m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            error = "mmap SQEs failed: " + std::string(strerror(errno));
+            return false;
+        }
+        m_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+        auto* sq = static_cast<char*>(m_sqRing);
+        m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqEntries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        auto* cq = static_cast<char*>(m_cqRing);
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    struct io_uring_sqe* nextSqe() {
+        unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_sqLocalTail - head >= m_sqEntries) {
+            // 提交队列已满，先提交一批
+            submit(0);
+            head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+            if (m_sqLocalTail - head >= m_sqEntries) {
+                return nullptr;
+            }
+        }
+        unsigned index = m_sqLocalTail & m_sqMask;
+        struct io_uring_sqe* sqe = &m_sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[index] = index;
+        ++m_sqLocalTail;
+        return sqe;
+    }
+
+    void preparePoll(struct io_uring_sqe* sqe, int fd, uint64_t userData, unsigned events) {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        sqe->poll32_events = __builtin_bswap32(events);
+#else
+        sqe->poll32_events = events;
+#endif
+        sqe->user_data = userData;
+    }
+
+    void armWake() {
+        struct io_uring_sqe* sqe = nextSqe();
+        if (sqe) {
+            preparePoll(sqe, m_wakeFd, makeUserData(nullptr, kTagWake), POLLIN);
+        }
+    }
+
+    void submit(unsigned minComplete) {
+        unsigned tail = *m_sqTail;
+        unsigned toSubmit = m_sqLocalTail - tail;
+        __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+        unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        if (toSubmit == 0 && minComplete == 0) {
+            return;
+        }
+        int result;
+        do {
+            result = sysIoUringEnter(m_ringFd, toSubmit, minComplete, flags);
+            // 被信号中断时已提交的 SQE 仍然有效，只需不再等待
+        } while (result == -1 && errno == EINTR && minComplete == 0);
+    }
+
+    // 返回是否收到了 wake() 的唤醒
+    bool reap(std::vector<IoEvent>& events) {
+        unsigned head = *m_cqHead;
+        unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        bool rearmWake = false;
+
+        while (head != tail) {
+            const struct io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+            uint64_t data = cqe.user_data;
+            int res = cqe.res;
+            ++head;
+
+            switch (userDataTag(data)) {
+            case kTagRead: {
+                IoStream* stream = userDataObject<IoStream>(data);
+                stream->inFlight = false;
+                if (res == -EAGAIN) {
+                    // 旧内核对非阻塞管道直接返回 EAGAIN：下一次改为等待可读
+                    stream->waitReadable = true;
+                    events.push_back(IoEvent{IoEvent::Kind::ReadCompleted, stream, -1});
+                } else if (res == -ECANCELED || res == -EINTR) {
+                    events.push_back(IoEvent{IoEvent::Kind::ReadCompleted, stream, -1});
+                } else {
+                    events.push_back(IoEvent{IoEvent::Kind::ReadCompleted, stream,
+                                             res < 0 ? 0 : static_cast<long>(res)});
+                }
+                break;
+            }
+            case kTagPoll: {
+                IoStream* stream = userDataObject<IoStream>(data);
+                stream->inFlight = false;
+                stream->waitReadable = false;
+                events.push_back(IoEvent{stream->writable ? IoEvent::Kind::Writable
+                                                          : IoEvent::Kind::Readable,
+                                         stream, 0});
+                break;
+            }
+            case kTagProcess: {
+                IoProcess* process = userDataObject<IoProcess>(data);
+                process->inFlight = false;
+                events.push_back(IoEvent{IoEvent::Kind::ProcessExited, process, 0});
+                break;
+            }
+            case kTagWake: {
+                uint64_t value;
+                ssize_t ignored = read(m_wakeFd, &value, sizeof(value));
+                (void)ignored;
+                rearmWake = true;
+                break;
+            }
+            default:
+                // 超时与取消操作本身的完成事件无需处理
+                break;
+            }
+        }
+
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        if (rearmWake) {
+            armWake();
+        }
+        return rearmWake;
+    }
+
+    int m_ringFd = -1;
+    int m_wakeFd = -1;
+    bool m_currentPosition = false;
+
+    void* m_sqRing = nullptr;
+    void* m_cqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    size_t m_cqRingSize = 0;
+    struct io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned* m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned m_sqLocalTail = 0;
+
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    struct io_uring_cqe* m_cqes = nullptr;
+
+    struct __kernel_timespec m_timeout = {0, 0};
+};
+
+} // namespace
+
+std::unique_ptr<IoBackend> createIoUringBackend(std::string& error) {
+    auto backend = std::make_unique<IoUringBackend>();
+    if (!backend->init(error)) {
+        return nullptr;
+    }
+    return backend;
+}
+
+#elif defined(__linux__)
+
+std::unique_ptr<IoBackend> createIoUringBackend(std::string& error) {
+    error = "built without <linux/io_uring.h>";
+    return nullptr;
+}
+
+#endif
+
+} // namespace Zrun
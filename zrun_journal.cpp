@@ -0,0 +1,672 @@
+#include "zrun_journal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace Zrun {
+
+namespace {
+// 文件格式：文件头（魔数和 u64 used）之后依次追加记录，used 之后的数据无效。
+// 记录：u32 总长度, u8 类型, 内容, u32 校验和（类型和内容的 FNV-1a）。
+// 系统崩溃时已更新的 used 可能先于记录本身落盘，校验和不符的记录及其之后的数据被丢弃
+constexpr char kMagic[8] = {'Z', 'R', 'U', 'N', 'J', 'L', '1', '\0'};
+constexpr size_t kHeaderSize = 16;
+constexpr size_t kRecordOverhead = 4 + 1 + 4;
+constexpr size_t kMinMapSize = 64 * 1024;
+
+// Complete 记录的标志位
+constexpr uint8_t kTimedOut = 0x1;
+constexpr uint8_t kHedged = 0x2;
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(std::string& out, const std::string& value, size_t limit) {
+    uint32_t length = static_cast<uint32_t>(std::min(value.size(), limit));
+    put(out, length);
+    out.append(value.data(), length);
+}
+
+// 带边界检查的读取
+struct Reader {
+    const char* cursor;
+    const char* end;
+
+    template <typename T>
+    bool get(T& value) {
+        if (static_cast<size_t>(end - cursor) < sizeof(value)) {
+            return false;
+        }
+        std::memcpy(&value, cursor, sizeof(value));
+        cursor += sizeof(value);
+        return true;
+    }
+
+    bool getString(std::string& value) {
+        uint32_t length = 0;
+        if (!get(length) || static_cast<size_t>(end - cursor) < length) {
+            return false;
+        }
+        value.assign(cursor, length);
+        cursor += length;
+        return true;
+    }
+};
+
+uint32_t checksum(const char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+}
+
+Journal::~Journal() {
+    close();
+}
+
+bool Journal::isOpen() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_map != nullptr;
+}
+
+#ifdef _WIN32
+
+bool Journal::open(const JournalConfig&, std::vector<Recovered>&, std::string& error) {
+    error = "The execution journal is not supported on Windows";
+    return false;
+}
+
+void Journal::close() {}
+void Journal::recordSubmit(int, const std::string&) {}
+void Journal::recordStart(int, int) {}
+void Journal::recordComplete(int, AsyncState, const CommandResult&) {}
+void Journal::recordForget(int) {}
+bool Journal::alive(const Process&) { return false; }
+unsigned long long Journal::startTimeOf(int) { return 0; }
+bool Journal::append(RecordType, const std::string&) { return false; }
+bool Journal::reserve(size_t) { return false; }
+void Journal::setUsed(size_t) {}
+void Journal::replay(std::vector<Recovered>&) {}
+void Journal::compact() {}
+void Journal::unmap() {}
+void Journal::flushLoop() {}
+void Journal::syncNow() {}
+
+#else
+
+namespace {
+size_t roundMapSize(size_t bytes) {
+    return std::max(kMinMapSize, (bytes + kMinMapSize - 1) / kMinMapSize * kMinMapSize);
+}
+
+// 打开并独占锁定日志文件
+int openLocked(const std::string& path, int flags) {
+    int fd = ::open(path.c_str(), flags | O_RDWR | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int syncFile(int fd) {
+#ifdef __APPLE__
+    return fsync(fd);
+#else
+    return fdatasync(fd);
+#endif
+}
+
+// /proc/<pid>/stat 中的状态和启动时间，进程不存在或不是 Linux 时返回 false
+bool readProcessStat(int pid, char& state, unsigned long long& startTime) {
+#ifdef __linux__
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    char buffer[1024];
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    ::close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+    // 进程名可能包含空格和括号，从最后一个 ')' 之后开始按字段计数
+    const char* cursor = strrchr(buffer, ')');
+    if (!cursor || cursor[1] != ' ') {
+        return false;
+    }
+    cursor += 2;
+    state = *cursor;
+    // 第 3 个字段是状态，starttime 是第 22 个
+    for (int field = 3; field < 22; ++field) {
+        cursor = strchr(cursor, ' ');
+        if (!cursor) {
+            return false;
+        }
+        ++cursor;
+    }
+    startTime = strtoull(cursor, nullptr, 10);
+    return true;
+#else
+    (void)pid;
+    (void)state;
+    (void)startTime;
+    return false;
+#endif
+}
+}
+
+bool Journal::open(const JournalConfig& config, std::vector<Recovered>& recovered,
+                   std::string& error) {
+    close();
+    if (config.path.empty()) {
+        error = "No journal path";
+        return false;
+    }
+
+    int fd = openLocked(config.path, O_CREAT);
+    if (fd == -1) {
+        error = "Failed to open journal: " + std::string(strerror(errno));
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        error = "Failed to open journal: " + std::string(strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    size_t fileSize = static_cast<size_t>(info.st_size);
+    if (fileSize == 0) {
+        fileSize = kMinMapSize;
+        if (ftruncate(fd, static_cast<off_t>(fileSize)) == -1) {
+            error = "Failed to size journal: " + std::string(strerror(errno));
+            ::close(fd);
+            return false;
+        }
+    } else if (fileSize < kHeaderSize) {
+        error = "Not a journal file";
+        ::close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        error = "Failed to map journal: " + std::string(strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    char* data = static_cast<char*>(map);
+    uint64_t used = kHeaderSize;
+    if (info.st_size == 0) {
+        std::memcpy(data, kMagic, sizeof(kMagic));
+        std::memcpy(data + sizeof(kMagic), &used, sizeof(used));
+    } else {
+        std::memcpy(&used, data + sizeof(kMagic), sizeof(used));
+        // 不是日志文件时不覆盖
+        if (std::memcmp(data, kMagic, sizeof(kMagic)) != 0 || used < kHeaderSize ||
+            used > fileSize) {
+            error = "Not a journal file";
+            munmap(map, fileSize);
+            ::close(fd);
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_config = config;
+        m_fd = fd;
+        m_map = data;
+        m_mapSize = fileSize;
+        m_used = static_cast<size_t>(used);
+        m_dirty = false;
+        m_stopping = false;
+        replay(recovered);
+        compact();
+    }
+    if (m_config.syncIntervalMs > 0) {
+        m_flusher = std::thread(&Journal::flushLoop, this);
+    }
+    return true;
+}
+
+void Journal::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    if (m_flusher.joinable()) {
+        m_flusher.join();
+    }
+    syncNow();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    unmap();
+}
+
+void Journal::unmap() {
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+        m_map = nullptr;
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_mapSize = 0;
+    m_used = 0;
+    m_live.clear();
+    m_liveBytes = 0;
+}
+
+void Journal::recordSubmit(int id, const std::string& command) {
+    std::string payload;
+    put(payload, static_cast<int32_t>(id));
+    putString(payload, command, UINT32_MAX);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_map) {
+            return;
+        }
+        m_live[id];
+        if (!append(RecordType::Submit, payload)) {
+            m_live.erase(id);
+            return;
+        }
+    }
+    if (m_config.syncIntervalMs <= 0) {
+        syncNow();
+    }
+}
+
+void Journal::recordStart(int id, int pid) {
+    std::string payload;
+    put(payload, static_cast<int32_t>(id));
+    put(payload, static_cast<int32_t>(pid));
+    put(payload, static_cast<uint64_t>(startTimeOf(pid)));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_map || !m_live.count(id) || !append(RecordType::Start, payload)) {
+            return;
+        }
+    }
+    if (m_config.syncIntervalMs <= 0) {
+        syncNow();
+    }
+}
+
+void Journal::recordComplete(int id, AsyncState state, const CommandResult& result) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_map || !m_live.count(id)) {
+            return;
+        }
+    }
+    // 压缩保存的输出解压后记录
+    CommandResult inflated;
+    inflated.compressedOutput = result.compressedOutput;
+    inflated.compressedError = result.compressedError;
+    inflated.inflate();
+    const std::string& output = result.compressedOutput ? inflated.output : result.output;
+    const std::string& error = result.compressedError ? inflated.error : result.error;
+
+    uint8_t flags = (result.timedOut ? kTimedOut : 0) | (result.hedged ? kHedged : 0);
+    std::string payload;
+    put(payload, static_cast<int32_t>(id));
+    put(payload, static_cast<uint8_t>(state));
+    put(payload, static_cast<int32_t>(result.exitCode));
+    put(payload, static_cast<int64_t>(result.executionTime));
+    put(payload, flags);
+    put(payload, static_cast<uint8_t>(result.limitExceeded));
+    put(payload, static_cast<int32_t>(result.attempts));
+    put(payload, static_cast<int64_t>(result.outputBytes));
+    put(payload, static_cast<int64_t>(result.errorBytes));
+    putString(payload, output, m_config.maxOutputBytes);
+    putString(payload, error, m_config.maxOutputBytes);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_live.find(id);
+        if (!m_map || it == m_live.end()) {
+            return;
+        }
+        // 结束后不再需要启动的进程，重写时只保留提交和结果
+        std::vector<Span> spans;
+        if (!it->second.empty()) {
+            spans.push_back(it->second.front());
+        }
+        for (size_t i = 1; i < it->second.size(); ++i) {
+            m_liveBytes -= it->second[i].size;
+        }
+        it->second.swap(spans);
+        if (!append(RecordType::Complete, payload)) {
+            return;
+        }
+    }
+    if (m_config.syncIntervalMs <= 0) {
+        syncNow();
+    }
+}
+
+void Journal::recordForget(int id) {
+    std::string payload;
+    put(payload, static_cast<int32_t>(id));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_live.find(id);
+        if (!m_map || it == m_live.end()) {
+            return;
+        }
+        for (const auto& span : it->second) {
+            m_liveBytes -= span.size;
+        }
+        m_live.erase(it);
+        // Forget 记录本身不计入有效记录，重写时和该命令的其他记录一起丢弃
+        if (!append(RecordType::Forget, payload)) {
+            return;
+        }
+    }
+    if (m_config.syncIntervalMs <= 0) {
+        syncNow();
+    }
+}
+
+bool Journal::append(RecordType type, const std::string& payload) {
+    size_t size = kRecordOverhead + payload.size();
+    if (size > UINT32_MAX || !reserve(size)) {
+        return false;
+    }
+    char* out = m_map + m_used;
+    uint32_t length = static_cast<uint32_t>(size);
+    std::memcpy(out, &length, sizeof(length));
+    out[4] = static_cast<char>(type);
+    std::memcpy(out + 5, payload.data(), payload.size());
+    uint32_t sum = checksum(out + 4, 1 + payload.size());
+    std::memcpy(out + 5 + payload.size(), &sum, sizeof(sum));
+
+    int32_t id = 0;
+    std::memcpy(&id, payload.data(), sizeof(id));
+    if (type != RecordType::Forget) {
+        m_live[id].push_back(Span{m_used, size});
+        m_liveBytes += size;
+    }
+    // 记录写完之后才更新 used
+    setUsed(m_used + size);
+
+    if (!m_dirty) {
+        m_dirty = true;
+        m_cv.notify_all();
+    }
+    if (m_used > m_config.compactBytes) {
+        compact();
+    }
+    return true;
+}
+
+bool Journal::reserve(size_t bytes) {
+    if (m_used + bytes <= m_mapSize) {
+        return true;
+    }
+    size_t newSize = roundMapSize(std::max(m_mapSize * 2, m_used + bytes));
+    if (ftruncate(m_fd, static_cast<off_t>(newSize)) == -1) {
+        return false;
+    }
+    void* map = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    munmap(m_map, m_mapSize);
+    m_map = static_cast<char*>(map);
+    m_mapSize = newSize;
+    return true;
+}
+
+void Journal::setUsed(size_t used) {
+    m_used = used;
+    uint64_t header = used;
+    std::memcpy(m_map + sizeof(kMagic), &header, sizeof(header));
+}
+
+void Journal::replay(std::vector<Recovered>& recovered) {
+    std::map<int, Recovered> commands;
+    m_live.clear();
+    m_liveBytes = 0;
+
+    Reader reader{m_map + kHeaderSize, m_map + m_used};
+    while (reader.cursor < reader.end) {
+        const char* start = reader.cursor;
+        uint32_t size = 0;
+        if (!reader.get(size) || size < kRecordOverhead + sizeof(int32_t) ||
+            size > static_cast<size_t>(reader.end - start)) {
+            reader.cursor = start;
+            break;
+        }
+        uint32_t sum = 0;
+        std::memcpy(&sum, start + size - sizeof(sum), sizeof(sum));
+        if (checksum(start + 4, size - kRecordOverhead + 1) != sum) {
+            reader.cursor = start;
+            break;
+        }
+        reader.cursor = start + size;
+
+        auto type = static_cast<RecordType>(start[4]);
+        Reader record{start + 5, start + size - sizeof(sum)};
+        int32_t id = 0;
+        record.get(id);
+        Span span{static_cast<size_t>(start - m_map), size};
+        auto it = commands.find(id);
+
+        if (type == RecordType::Submit) {
+            Recovered command;
+            command.id = id;
+            if (!record.getString(command.command)) {
+                continue;
+            }
+            commands[id] = std::move(command);
+            m_live[id] = {span};
+        } else if (it == commands.end()) {
+            // 已取走结果或提交记录已丢失的命令
+            continue;
+        } else if (type == RecordType::Start) {
+            Process process;
+            int32_t pid = 0;
+            uint64_t startTime = 0;
+            if (it->second.finished || !record.get(pid) || !record.get(startTime)) {
+                continue;
+            }
+            process.pid = pid;
+            process.startTime = startTime;
+            it->second.processes.push_back(process);
+            m_live[id].push_back(span);
+        } else if (type == RecordType::Complete) {
+            CommandResult& result = it->second.result;
+            uint8_t state = 0, flags = 0, limit = 0;
+            int32_t exitCode = 0, attempts = 0;
+            int64_t executionTime = 0, outputBytes = 0, errorBytes = 0;
+            if (!record.get(state) || !record.get(exitCode) || !record.get(executionTime) ||
+                !record.get(flags) || !record.get(limit) || !record.get(attempts) ||
+                !record.get(outputBytes) || !record.get(errorBytes) ||
+                !record.getString(result.output) || !record.getString(result.error)) {
+                continue;
+            }
+            it->second.finished = true;
+            it->second.state = static_cast<AsyncState>(state);
+            it->second.processes.clear();
+            result.exitCode = exitCode;
+            result.executionTime = executionTime;
+            result.timedOut = (flags & kTimedOut) != 0;
+            result.hedged = (flags & kHedged) != 0;
+            result.limitExceeded = static_cast<ResourceLimitKind>(limit);
+            result.attempts = attempts;
+            result.outputBytes = outputBytes;
+            result.errorBytes = errorBytes;
+            std::vector<Span>& spans = m_live[id];
+            spans.resize(1);
+            spans.push_back(span);
+        } else if (type == RecordType::Forget) {
+            commands.erase(it);
+            m_live.erase(id);
+        }
+    }
+    // 截掉无法解析的尾部，之后的记录从最后一条有效记录之后开始写
+    setUsed(static_cast<size_t>(reader.cursor - m_map));
+
+    for (const auto& pair : m_live) {
+        for (const auto& span : pair.second) {
+            m_liveBytes += span.size;
+        }
+    }
+    recovered.clear();
+    for (auto& pair : commands) {
+        recovered.push_back(std::move(pair.second));
+    }
+}
+
+void Journal::compact() {
+    if (!m_map) {
+        return;
+    }
+    size_t garbage = m_used - kHeaderSize - m_liveBytes;
+    if (garbage == 0 || garbage < m_liveBytes) {
+        return;
+    }
+
+    // 按原来的顺序复制有效记录到临时文件，写入磁盘后替换
+    std::vector<std::pair<int, Span>> spans;
+    for (const auto& pair : m_live) {
+        for (const auto& span : pair.second) {
+            spans.emplace_back(pair.first, span);
+        }
+    }
+    std::sort(spans.begin(), spans.end(),
+              [](const std::pair<int, Span>& a, const std::pair<int, Span>& b) {
+                  return a.second.offset < b.second.offset;
+              });
+
+    std::string temporary = m_config.path + ".tmp";
+    int fd = openLocked(temporary, O_CREAT | O_TRUNC);
+    if (fd == -1) {
+        return;
+    }
+    size_t fileSize = roundMapSize(kHeaderSize + m_liveBytes);
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(fileSize)) == 0) {
+        map = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        ::close(fd);
+        unlink(temporary.c_str());
+        return;
+    }
+
+    char* data = static_cast<char*>(map);
+    std::unordered_map<int, std::vector<Span>> live;
+    size_t used = kHeaderSize;
+    for (const auto& entry : spans) {
+        std::memcpy(data + used, m_map + entry.second.offset, entry.second.size);
+        live[entry.first].push_back(Span{used, entry.second.size});
+        used += entry.second.size;
+    }
+    std::memcpy(data, kMagic, sizeof(kMagic));
+    uint64_t header = used;
+    std::memcpy(data + sizeof(kMagic), &header, sizeof(header));
+
+    // 新文件落盘之后再替换，崩溃时旧文件仍然完整
+    if (syncFile(fd) == -1 || rename(temporary.c_str(), m_config.path.c_str()) == -1) {
+        munmap(map, fileSize);
+        ::close(fd);
+        unlink(temporary.c_str());
+        return;
+    }
+    size_t liveBytes = m_liveBytes;
+    unmap();
+    m_fd = fd;
+    m_map = data;
+    m_mapSize = fileSize;
+    m_used = used;
+    m_live.swap(live);
+    m_liveBytes = liveBytes;
+}
+
+void Journal::flushLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        m_cv.wait(lock, [this]() { return m_dirty || m_stopping; });
+        if (m_stopping) {
+            break;
+        }
+        // 等待一个间隔，期间追加的记录由同一次 fsync 写入磁盘
+        m_cv.wait_for(lock, std::chrono::milliseconds(m_config.syncIntervalMs),
+                      [this]() { return m_stopping; });
+        lock.unlock();
+        syncNow();
+        lock.lock();
+    }
+}
+
+void Journal::syncNow() {
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_dirty || m_fd == -1) {
+            return;
+        }
+        m_dirty = false;
+        // fsync 期间不持有锁；重写文件会关闭 m_fd，因此使用副本
+        fd = dup(m_fd);
+    }
+    if (fd != -1) {
+        syncFile(fd);
+        ::close(fd);
+    }
+}
+
+bool Journal::alive(const Process& process) {
+    if (process.pid <= 0) {
+        return false;
+    }
+    if (kill(process.pid, 0) == -1 && errno != EPERM) {
+        return false;
+    }
+    char state = 0;
+    unsigned long long startTime = 0;
+    if (!readProcessStat(process.pid, state, startTime)) {
+        // 没有 /proc 时只能按 pid 判断
+        return process.startTime == 0;
+    }
+    return state != 'Z' && (process.startTime == 0 || startTime == process.startTime);
+}
+
+unsigned long long Journal::startTimeOf(int pid) {
+    char state = 0;
+    unsigned long long startTime = 0;
+    return readProcessStat(pid, state, startTime) ? startTime : 0;
+}
+
+#endif // _WIN32
+
+} // namespace Zrun
@@ -0,0 +1,100 @@
+#ifndef ZRUN_JOURNAL_H
+#define ZRUN_JOURNAL_H
+
+#include "zrun_types.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Zrun {
+
+// 异步命令的执行日志：追加写入内存映射文件，每条记录带校验和，
+// 进程或系统崩溃留下的不完整记录在打开时被截掉。fsync 由后台线程按间隔批量执行。
+// 只记录通过 recordSubmit 登记过的 id，已取走结果的命令在重写文件时被丢弃
+class Journal {
+public:
+    // 命令启动的一个进程。startTime 为进程的启动时间，用于识别被复用的 pid
+    struct Process {
+        int pid = -1;
+        unsigned long long startTime = 0;
+    };
+
+    // 打开时从文件中恢复的一条命令
+    struct Recovered {
+        int id = 0;
+        std::string command;
+        bool finished = false;
+        AsyncState state = AsyncState::Running;
+        CommandResult result;
+        // 未结束的命令启动过的进程
+        std::vector<Process> processes;
+    };
+
+    Journal() = default;
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // 打开（不存在时创建）并独占锁定日志文件，按 id 顺序返回其中的命令。
+    // 文件被其他进程锁定或不是日志文件时返回 false
+    bool open(const JournalConfig& config, std::vector<Recovered>& recovered,
+              std::string& error);
+    void close();
+    bool isOpen() const;
+
+    void recordSubmit(int id, const std::string& command);
+    void recordStart(int id, int pid);
+    void recordComplete(int id, AsyncState state, const CommandResult& result);
+    // 结果已被取走，之后不再恢复
+    void recordForget(int id);
+
+    // 进程仍然存在且就是记录的那一个（pid 没有被复用）
+    static bool alive(const Process& process);
+    // 进程的启动时间（Linux 上为 /proc/<pid>/stat 中的 starttime），无法取得时为 0
+    static unsigned long long startTimeOf(int pid);
+
+private:
+    enum class RecordType : uint8_t { Submit = 1, Start = 2, Complete = 3, Forget = 4 };
+
+    // 一条命令在文件中仍然有效的记录
+    struct Span {
+        size_t offset;
+        size_t size;
+    };
+
+    // 以下在 m_mutex 内调用
+    bool append(RecordType type, const std::string& payload);
+    bool reserve(size_t bytes);
+    void setUsed(size_t used);
+    void replay(std::vector<Recovered>& recovered);
+    void compact();
+    void unmap();
+
+    void flushLoop();
+    void syncNow();
+
+    mutable std::mutex m_mutex;
+    JournalConfig m_config;
+    int m_fd = -1;
+    char* m_map = nullptr;
+    size_t m_mapSize = 0;
+    size_t m_used = 0;
+    std::unordered_map<int, std::vector<Span>> m_live;
+    size_t m_liveBytes = 0;
+
+    // 批量 fsync
+    std::condition_variable m_cv;
+    std::thread m_flusher;
+    bool m_dirty = false;
+    bool m_stopping = false;
+};
+
+} // namespace Zrun
+
+#endif // ZRUN_JOURNAL_H
@@ -0,0 +1,82 @@
+#include "zrun_lines.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define ZRUN_LINES_SSE2 1
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define ZRUN_LINES_NEON 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Zrun {
+
+namespace {
+inline unsigned countTrailingZeros(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+}
+
+const char* findNewline(const char* begin, const char* end) {
+#ifdef __AVX2__
+    const __m256i newline32 = _mm256_set1_epi8('\n');
+    while (end - begin >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline32)));
+        if (mask) {
+            return begin + countTrailingZeros(mask);
+        }
+        begin += 32;
+    }
+#endif
+
+#if defined(ZRUN_LINES_SSE2)
+    const __m128i newline16 = _mm_set1_epi8('\n');
+    while (end - begin >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline16)));
+        if (mask) {
+            return begin + countTrailingZeros(mask);
+        }
+        begin += 16;
+    }
+#elif defined(ZRUN_LINES_NEON)
+    const uint8x16_t newline16 = vdupq_n_u8('\n');
+    while (end - begin >= 16) {
+        uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(begin));
+        uint8x16_t equal = vceqq_u8(block, newline16);
+        // 把 16 字节的比较结果压缩为 64 位掩码，每个字节对应 4 位
+        uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(equal), 4);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+        if (mask) {
+            return begin + (countTrailingZeros(mask) >> 2);
+        }
+        begin += 16;
+    }
+#endif
+
+    // 剩余不足一个向量的部分
+    if (begin < end) {
+        const void* found = std::memchr(begin, '\n', static_cast<size_t>(end - begin));
+        if (found) {
+            return static_cast<const char*>(found);
+        }
+    }
+    return end;
+}
+
+} // namespace Zrun
@@ -0,0 +1,82 @@
+#ifndef ZRUN_LINES_H
+#define ZRUN_LINES_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace Zrun {
+
+// 在 [begin, end) 中查找第一个 '\n'，没有时返回 end。
+// x86 上使用 SSE2/AVX2，ARM 上使用 NEON，一次比较 16/32 字节
+const char* findNewline(const char* begin, const char* end);
+
+// 增量分行器：按到达顺序输入数据块，逐行回调 (不含 '\n')。
+// 完整位于一个数据块内的行直接以 string_view 指向该块，不拷贝；
+// 只有跨越块边界的那一行会暂存到内部缓冲区。
+// 超过 maxLineLength 的行按该长度拆成多次回调，暂存的数据不会超过这个长度
+class LineSplitter {
+public:
+    static constexpr size_t kDefaultMaxLineLength = 1 << 20;
+
+    // maxLineLength 为 0 表示不限制
+    explicit LineSplitter(size_t maxLineLength = kDefaultMaxLineLength)
+        : m_maxLineLength(maxLineLength) {}
+
+    template <typename F>
+    void feed(std::string_view data, F&& onLine) {
+        const char* begin = data.data();
+        const char* end = begin + data.size();
+        const char* newline = findNewline(begin, end);
+        while (begin < end) {
+            if (newline < begin) {
+                newline = findNewline(begin, end);
+            }
+            size_t length = static_cast<size_t>(newline - begin);
+            size_t room = m_maxLineLength ? m_maxLineLength - m_partial.size() : length;
+            if (length > room) {
+                // 行超过上限：先交出上限长度的部分，剩余部分作为新的一行继续
+                emit(begin, room, onLine);
+                begin += room;
+                continue;
+            }
+            if (newline == end) {
+                m_partial.append(begin, length);
+                return;
+            }
+            emit(begin, length, onLine);
+            begin = newline + 1;
+        }
+    }
+
+    // 输出结束：最后一行没有换行符时也交给回调
+    template <typename F>
+    void finish(F&& onLine) {
+        if (!m_partial.empty()) {
+            onLine(std::string_view(m_partial));
+            m_partial.clear();
+        }
+    }
+
+    // 当前暂存的未完成行
+    std::string_view partial() const { return m_partial; }
+
+private:
+    template <typename F>
+    void emit(const char* begin, size_t length, F& onLine) {
+        if (m_partial.empty()) {
+            onLine(std::string_view(begin, length));
+        } else {
+            m_partial.append(begin, length);
+            onLine(std::string_view(m_partial));
+            m_partial.clear();
+        }
+    }
+
+    size_t m_maxLineLength;
+    std::string m_partial;
+};
+
+} // namespace Zrun
+
+#endif // ZRUN_LINES_H
@@ -0,0 +1,237 @@
+#include "zrun_prepared.h"
+
+#include <mutex>
+
+#ifndef _WIN32
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace Zrun {
+
+#ifndef _WIN32
+namespace {
+bool isExecutable(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode) &&
+           access(path.c_str(), X_OK) == 0;
+}
+
+// 子进程 chdir 之后所在的目录：为空时是当前目录，相对路径相对当前目录。
+// 取不到当前目录时返回空字符串，相对路径按原样使用
+std::string baseDirectory(const std::string& workingDirectory) {
+    if (!workingDirectory.empty() && workingDirectory[0] == '/') {
+        return workingDirectory;
+    }
+    char buffer[PATH_MAX];
+    if (!getcwd(buffer, sizeof(buffer))) {
+        return std::string();
+    }
+    std::string directory = buffer;
+    if (!workingDirectory.empty()) {
+        directory += '/';
+        directory += workingDirectory;
+    }
+    return directory;
+}
+
+std::string joinPath(const std::string& directory, const std::string& path) {
+    if (directory.empty()) {
+        return path;
+    }
+    if (path.compare(0, 2, "./") == 0) {
+        return directory + path.substr(1);
+    }
+    return directory + "/" + path;
+}
+}
+#endif
+
+struct PreparedCommand::State {
+    // 参数模板中的一段：字面文本或参数名
+    struct Segment {
+        std::string text;
+        bool parameter = false;
+    };
+
+    static bool parse(const std::string& text, std::vector<Segment>& segments, std::string& error);
+
+    std::string program;
+    std::vector<std::vector<Segment>> arguments;
+    std::string templateError;
+
+    // 上次查找时的 PATH 和结果；查找用到相对路径时结果还取决于工作目录
+    std::mutex mutex;
+    bool resolved = false;
+    std::string pathVariable;
+    bool relative = false;
+    std::string baseDirectory;
+    std::string executable;
+};
+
+bool PreparedCommand::State::parse(const std::string& text, std::vector<Segment>& segments,
+                                   std::string& error) {
+    std::string literal;
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if ((c == '{' || c == '}') && i + 1 < text.size() && text[i + 1] == c) {
+            literal += c;
+            ++i;
+            continue;
+        }
+        if (c == '}') {
+            error = "Invalid argument template: unmatched '}' in \"" + text + "\"";
+            return false;
+        }
+        if (c != '{') {
+            literal += c;
+            continue;
+        }
+        size_t close = text.find('}', i + 1);
+        if (close == std::string::npos || close == i + 1) {
+            error = "Invalid argument template: bad placeholder in \"" + text + "\"";
+            return false;
+        }
+        if (!literal.empty()) {
+            segments.push_back({std::move(literal), false});
+            literal.clear();
+        }
+        segments.push_back({text.substr(i + 1, close - i - 1), true});
+        i = close;
+    }
+    if (!literal.empty() || segments.empty()) {
+        segments.push_back({std::move(literal), false});
+    }
+    return true;
+}
+
+PreparedCommand::PreparedCommand(std::string program, std::vector<std::string> args)
+    : m_state(std::make_shared<State>()) {
+    m_state->program = std::move(program);
+    if (m_state->program.empty()) {
+        m_state->templateError = "Empty program name";
+    }
+    m_state->arguments.reserve(args.size());
+    for (const auto& arg : args) {
+        std::vector<State::Segment> segments;
+        if (m_state->templateError.empty() &&
+            !State::parse(arg, segments, m_state->templateError)) {
+            break;
+        }
+        m_state->arguments.push_back(std::move(segments));
+    }
+}
+
+const std::string& PreparedCommand::program() const {
+    static const std::string empty;
+    return m_state ? m_state->program : empty;
+}
+
+bool PreparedCommand::expand(const CommandParameters& parameters, std::vector<std::string>& argv,
+                             std::string& error) const {
+    if (!m_state) {
+        error = "Empty prepared command";
+        return false;
+    }
+    if (!m_state->templateError.empty()) {
+        error = m_state->templateError;
+        return false;
+    }
+
+    argv.clear();
+    argv.reserve(m_state->arguments.size() + 1);
+    argv.push_back(m_state->program);
+    for (const auto& segments : m_state->arguments) {
+        // 整个参数就是一段字面文本时直接拷贝
+        if (segments.size() == 1 && !segments[0].parameter) {
+            argv.push_back(segments[0].text);
+            continue;
+        }
+        std::string value;
+        for (const auto& segment : segments) {
+            if (!segment.parameter) {
+                value += segment.text;
+                continue;
+            }
+            auto it = parameters.find(segment.text);
+            if (it == parameters.end()) {
+                error = "Missing parameter: " + segment.text;
+                return false;
+            }
+            value += it->second;
+        }
+        argv.push_back(std::move(value));
+    }
+    return true;
+}
+
+bool PreparedCommand::resolve(const std::string& pathVariable,
+                              const std::string& workingDirectory, std::string& executable,
+                              std::string& error) const {
+    if (!m_state) {
+        error = "Empty prepared command";
+        return false;
+    }
+#ifdef _WIN32
+    // CreateProcess 自己按 PATH 查找
+    (void)pathVariable;
+    (void)workingDirectory;
+    executable = m_state->program;
+    return true;
+#else
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->resolved && m_state->pathVariable == pathVariable &&
+        (!m_state->relative || m_state->baseDirectory == baseDirectory(workingDirectory))) {
+        executable = m_state->executable;
+        return true;
+    }
+
+    // 相对的候选路径按子进程的工作目录检查，并记录为绝对路径
+    bool relative = false;
+    std::string base;
+    auto check = [&](const std::string& candidate) {
+        if (candidate[0] == '/') {
+            return isExecutable(candidate) ? candidate : std::string();
+        }
+        if (!relative) {
+            relative = true;
+            base = baseDirectory(workingDirectory);
+        }
+        std::string path = joinPath(base, candidate);
+        return isExecutable(path) ? path : std::string();
+    };
+
+    const std::string& program = m_state->program;
+    std::string found;
+    if (program.find('/') != std::string::npos) {
+        found = check(program);
+    } else {
+        // 与 execvp 相同，空的 PATH 项表示当前目录
+        size_t start = 0;
+        while (found.empty() && start <= pathVariable.size()) {
+            size_t end = pathVariable.find(':', start);
+            if (end == std::string::npos) {
+                end = pathVariable.size();
+            }
+            std::string directory = pathVariable.substr(start, end - start);
+            found = check((directory.empty() ? "." : directory) + "/" + program);
+            start = end + 1;
+        }
+    }
+    if (found.empty()) {
+        error = "Executable not found: " + program;
+        return false;
+    }
+
+    m_state->resolved = true;
+    m_state->pathVariable = pathVariable;
+    m_state->relative = relative;
+    m_state->baseDirectory = std::move(base);
+    m_state->executable = found;
+    executable = std::move(found);
+    return true;
+#endif
+}
+
+} // namespace Zrun
@@ -0,0 +1,45 @@
+#ifndef ZRUN_PREPARED_H
+#define ZRUN_PREPARED_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Zrun {
+
+// 执行 PreparedCommand 时替换参数模板中 {name} 的值
+using CommandParameters = std::map<std::string, std::string>;
+
+// 预先准备的命令：不经过 shell 直接启动可执行文件。
+// 参数模板在创建时解析，可执行文件按 PATH 查找一次并缓存，PATH 改变时重新查找
+// （用到相对路径时工作目录改变也重新查找）；
+// 每次执行只替换参数并启动进程。副本共享查找结果，可以在多个线程中同时使用
+class PreparedCommand {
+public:
+    PreparedCommand() = default;
+    // program 含 '/' 时直接使用，否则按 PATH 查找。args 中的 {name} 在执行时替换为参数值，
+    // {{ 和 }} 表示花括号本身
+    explicit PreparedCommand(std::string program, std::vector<std::string> args = {});
+
+    bool valid() const { return static_cast<bool>(m_state); }
+    const std::string& program() const;
+
+    // 按参数生成完整的 argv（argv[0] 为 program）；模板无效或缺少参数时返回 false 并设置 error
+    bool expand(const CommandParameters& parameters, std::vector<std::string>& argv,
+                std::string& error) const;
+
+    // 在 pathVariable（PATH 的值）中查找可执行文件，找不到时返回 false 并设置 error。
+    // 相对路径（含 '/' 的相对 program、空的或相对的 PATH 项）按子进程将要进入的
+    // workingDirectory 检查（为空时为当前目录），executable 为绝对路径
+    bool resolve(const std::string& pathVariable, const std::string& workingDirectory,
+                 std::string& executable, std::string& error) const;
+
+private:
+    struct State;
+    std::shared_ptr<State> m_state;
+};
+
+} // namespace Zrun
+
+#endif // ZRUN_PREPARED_H
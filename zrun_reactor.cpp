@@ -0,0 +1,684 @@
+#include "zrun_reactor.h"
+#include "zrun_reaper.h"
+#include "zrun_spawn.h"
+
+#ifndef _WIN32
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+namespace Zrun {
+
+namespace {
+// SIGTERM 之后等待多久再发送 SIGKILL
+constexpr auto kKillGrace = std::chrono::milliseconds(2000);
+// 需要轮询时 waitpid 和读取管道的间隔
+constexpr int kPollIntervalMs = 10;
+// 关闭事件循环时等待子进程退出的最长时间
+constexpr auto kShutdownTimeout = std::chrono::milliseconds(5000);
+}
+
+Execution::Execution(const OutputSink& stdoutSink, const OutputSink& stderrSink)
+    : streams{Stream(stdoutSink), Stream(stderrSink)} {
+    for (int i = 0; i < 2; ++i) {
+        streams[i].owner = this;
+        streams[i].isError = (i == 1);
+        streams[i].io.context = &streams[i];
+        streams[i].sinkIo.context = &streams[i];
+        streams[i].sinkIo.writable = true;
+    }
+    process.context = this;
+    deadline.context = this;
+}
+
+Execution::~Execution() {
+    for (auto& stream : streams) {
+        if (stream.io.fd != -1) {
+            close(stream.io.fd);
+        }
+        if (stream.sinkIo.fd != -1) {
+            close(stream.sinkIo.fd);
+        }
+    }
+    if (process.pidfd != -1) {
+        close(process.pidfd);
+    }
+}
+
+Reactor::Reactor(IoBackendType type, bool threaded) {
+    m_backend = createIoBackend(type, m_note);
+    if (threaded && m_backend) {
+        m_thread = std::thread(&Reactor::threadMain, this);
+    }
+}
+
+Reactor::~Reactor() {
+    if (m_thread.joinable()) {
+        m_stopping = true;
+        m_backend->wake();
+        m_thread.join();
+    } else if (m_backend) {
+        m_loopThreadId = std::this_thread::get_id();
+        shutdown();
+    }
+}
+
+const char* Reactor::backendName() const {
+    return m_backend ? m_backend->name() : "none";
+}
+
+void Reactor::submit(std::shared_ptr<Execution> execution) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(std::move(execution));
+    }
+    m_backend->wake();
+}
+
+void Reactor::cancel(std::shared_ptr<Execution> execution) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cancelRequests.push_back(std::move(execution));
+    }
+    m_backend->wake();
+}
+
+bool Reactor::inLoopThread() const {
+    return m_loopThreadId == std::this_thread::get_id();
+}
+
+void Reactor::runUntilComplete(const std::shared_ptr<Execution>& execution) {
+    m_loopThreadId = std::this_thread::get_id();
+    while (execution->phase != Execution::Phase::Finished) {
+        runOnce();
+    }
+}
+
+void Reactor::threadMain() {
+    m_loopThreadId = std::this_thread::get_id();
+    while (!m_stopping) {
+        runOnce();
+    }
+    shutdown();
+}
+
+void Reactor::runOnce() {
+    adoptPending();
+
+    m_events.clear();
+    m_backend->wait(nextTimeoutMs(), m_events);
+    for (const auto& event : m_events) {
+        dispatch(event);
+    }
+    processExits();
+
+    if (!m_unwatched.empty()) {
+        pollUnwatched();
+    }
+    if (!m_blockedSinks.empty()) {
+        retryBlockedSinks();
+    }
+    checkDeadlines();
+
+    // 本轮事件处理完之后才释放已完成的命令，事件中可能还引用它们
+    m_finished.clear();
+}
+
+void Reactor::adoptPending() {
+    std::vector<std::shared_ptr<Execution>> pending;
+    std::vector<std::shared_ptr<Execution>> cancels;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pending.swap(m_pending);
+        cancels.swap(m_cancelRequests);
+    }
+
+    for (auto& execution : pending) {
+        Execution& exec = *execution;
+        m_active[&exec] = execution;
+
+        bool armed = true;
+        for (auto& stream : exec.streams) {
+            if (stream.open && !m_backend->armStream(stream.io)) {
+                armed = false;
+            }
+        }
+        // 无法用 pidfd 等待时交给 ChildReaper，两者都不可用或管道注册失败时退回到定期轮询
+        bool watched = m_backend->watchProcess(exec.process);
+        if (!watched) {
+            watchWithReaper(exec);
+            watched = exec.reaperWatched;
+        }
+        if (!watched || !armed) {
+            exec.polled = true;
+            m_unwatched.push_back(&exec);
+        }
+        schedule(exec, exec.startTime + std::chrono::milliseconds(exec.timeoutMs));
+    }
+
+    for (auto& execution : cancels) {
+        if (m_active.count(execution.get()) &&
+            execution->phase == Execution::Phase::Running) {
+            execution->cancelled = true;
+            terminate(*execution, false);
+        }
+    }
+}
+
+void Reactor::dispatch(const IoEvent& event) {
+    if (event.kind == IoEvent::Kind::ProcessExited) {
+        auto* process = static_cast<IoProcess*>(event.object);
+        reap(*static_cast<Execution*>(process->context));
+        return;
+    }
+
+    auto* io = static_cast<IoStream*>(event.object);
+    auto& stream = *static_cast<Execution::Stream*>(io->context);
+    if (event.kind == IoEvent::Kind::Writable) {
+        onSinkWritable(stream);
+    } else {
+        onStreamEvent(stream, event);
+    }
+}
+
+void Reactor::onStreamEvent(Execution::Stream& stream, const IoEvent& event) {
+    Execution& exec = *stream.owner;
+    if (!stream.open) {
+        tryFinish(exec);
+        return;
+    }
+
+    if (event.kind == IoEvent::Kind::ReadCompleted) {
+        if (event.result > 0) {
+            stream.pump.commitDirectRead(stream.io.fd, static_cast<size_t>(event.result));
+        } else if (event.result == 0) {
+            closeStream(stream);
+            tryFinish(exec);
+            return;
+        }
+    } else if (!stream.closing) {
+        long result = stream.pump.pump(stream.io.fd);
+        if (result < 0 && stream.pump.sinkFull()) {
+            deliverChunks(stream);
+            waitForSink(stream);
+            return;
+        }
+        if (result == 0 || (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            closeStream(stream);
+            tryFinish(exec);
+            return;
+        }
+    }
+
+    if (stream.closing) {
+        drainAndClose(stream);
+        tryFinish(exec);
+        return;
+    }
+    deliverChunks(stream);
+    m_backend->armStream(stream.io);
+}
+
+void Reactor::waitForSink(Execution::Stream& stream) {
+    // 目标写满时继续关注管道可读会让水平触发的事件循环空转
+    m_backend->removeStream(stream.io);
+    stream.sinkWait = true;
+    if (stream.sinkIo.fd == -1) {
+        // 使用副本注册，同一个目标 fd 可以被多个流同时关注
+        stream.sinkIo.fd = fcntl(stream.pump.sinkFd(), F_DUPFD_CLOEXEC, 0);
+    }
+    if (stream.sinkIo.fd == -1 || !m_backend->armStream(stream.sinkIo)) {
+        m_blockedSinks.push_back(&stream);
+    }
+}
+
+void Reactor::onSinkWritable(Execution::Stream& stream) {
+    Execution& exec = *stream.owner;
+    if (!stream.open) {
+        // 流已关闭，等待的是取消操作的完成
+        closeStream(stream);
+        tryFinish(exec);
+        return;
+    }
+    if (!stream.pump.flushPending()) {
+        if (!m_backend->armStream(stream.sinkIo)) {
+            m_blockedSinks.push_back(&stream);
+        }
+        return;
+    }
+
+    m_backend->removeStream(stream.sinkIo);
+    stream.sinkWait = false;
+    if (stream.closing) {
+        drainAndClose(stream);
+        tryFinish(exec);
+        return;
+    }
+    // 目标已可写，恢复读取管道
+    if (!m_backend->armStream(stream.io) && !exec.polled) {
+        exec.polled = true;
+        m_unwatched.push_back(&exec);
+    }
+}
+
+void Reactor::retryBlockedSinks() {
+    std::vector<Execution::Stream*> blocked;
+    blocked.swap(m_blockedSinks);
+    for (Execution::Stream* stream : blocked) {
+        onSinkWritable(*stream);
+    }
+}
+
+void Reactor::drainAndClose(Execution::Stream& stream) {
+    if (stream.io.inFlight) {
+        stream.closing = true;
+        m_backend->cancelStream(stream.io);
+        return;
+    }
+    bool abandon = stream.owner->abandonOutput;
+    if (stream.sinkWait) {
+        if (abandon) {
+            closeStream(stream);
+        } else {
+            stream.closing = true;
+        }
+        return;
+    }
+    long result = stream.pump.pump(stream.io.fd);
+    if (result < 0 && stream.pump.sinkFull() && !abandon) {
+        // 管道中还有数据，目标可写后继续读取，读空之前不关闭
+        stream.closing = true;
+        deliverChunks(stream);
+        waitForSink(stream);
+        return;
+    }
+    closeStream(stream);
+}
+
+void Reactor::closeStream(Execution::Stream& stream) {
+    if (stream.sinkWait) {
+        m_blockedSinks.erase(std::remove(m_blockedSinks.begin(), m_blockedSinks.end(), &stream),
+                             m_blockedSinks.end());
+        m_backend->removeStream(stream.sinkIo);
+        m_backend->cancelStream(stream.sinkIo);
+        stream.sinkWait = false;
+    }
+    // 副本上的操作完成之后才能关闭，之后由 onSinkWritable 再次调用
+    if (stream.sinkIo.fd != -1 && !stream.sinkIo.inFlight) {
+        close(stream.sinkIo.fd);
+        stream.sinkIo.fd = -1;
+    }
+    if (!stream.open) {
+        return;
+    }
+    deliverChunks(stream);
+    if (stream.owner->onLine) {
+        stream.lines.finish([&](std::string_view line) {
+            stream.owner->onLine(line, stream.isError);
+        });
+    }
+    if (stream.filter) {
+        stream.filter->finish();
+    }
+    m_backend->removeStream(stream.io);
+    close(stream.io.fd);
+    stream.io.fd = -1;
+    stream.open = false;
+    stream.closing = false;
+}
+
+void Reactor::deliverChunks(Execution::Stream& stream) {
+    const Execution& exec = *stream.owner;
+    CaptureBuffer& capture = stream.pump.capture();
+    if ((!exec.onChunk && !exec.onLine && !stream.filter && !stream.compressed) ||
+        capture.size() <= stream.delivered) {
+        return;
+    }
+    capture.forEachChunkFrom(stream.delivered, [&](std::string_view data) {
+        if (exec.onChunk) {
+            exec.onChunk(data, stream.isError);
+        }
+        if (exec.onLine) {
+            stream.lines.feed(data, [&](std::string_view line) {
+                exec.onLine(line, stream.isError);
+            });
+        }
+        if (stream.filter) {
+            stream.filter->feed(data);
+        } else if (stream.compressed) {
+            stream.compressed->append(data);
+        }
+    });
+    if (stream.filter || stream.compressed) {
+        // 数据已交给过滤器或压缩，分块归还内存池，捕获缓冲区不随输出增长
+        capture.clear();
+        stream.delivered = 0;
+    } else {
+        stream.delivered = capture.size();
+    }
+}
+
+void Reactor::reap(Execution& exec) {
+    if (exec.exited) {
+        tryFinish(exec);
+        return;
+    }
+    if (exec.reaperWatched) {
+        // 由 ChildReaper 回收，这里再 waitpid 会和它竞争
+        return;
+    }
+
+    int status = 0;
+    pid_t result;
+    do {
+        result = waitpid(exec.pid, &status, WNOHANG);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == 0) {
+        return;
+    }
+    // 子进程已被其他代码回收时退出码未知
+    onExited(exec, result == exec.pid ? status : -1);
+}
+
+void Reactor::watchWithReaper(Execution& exec) {
+    Execution* target = &exec;
+    exec.reaperWatched = ChildReaper::instance().watch(exec.pid, [this, target](int status) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_exits.emplace_back(target, status);
+        }
+        m_backend->wake();
+    });
+}
+
+void Reactor::processExits() {
+    std::vector<std::pair<Execution*, int>> exits;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_exits.empty()) {
+            return;
+        }
+        exits.swap(m_exits);
+    }
+    for (const auto& exit : exits) {
+        auto it = m_active.find(exit.first);
+        if (it == m_active.end() || it->second->exited) {
+            continue;
+        }
+        it->second->reaperWatched = false;
+        onExited(*it->second, exit.second);
+    }
+}
+
+void Reactor::onExited(Execution& exec, int status) {
+    exec.status = status;
+    exec.exited = true;
+
+    // 终止过程中 shell 已经退出：组内剩余的进程（如忽略了 SIGTERM 的子进程）不再等待宽限期。
+    // 组内还有进程时组号不会被重用，这里不回退到按 pid 发送
+    if (exec.phase == Execution::Phase::Terminating && exec.pid > 0) {
+        kill(-exec.pid, SIGKILL);
+    }
+
+    m_backend->removeProcess(exec.process);
+    if (exec.polled) {
+        m_unwatched.erase(std::remove(m_unwatched.begin(), m_unwatched.end(), &exec),
+                          m_unwatched.end());
+        exec.polled = false;
+    }
+
+    // 进程退出后读出管道中剩余的数据；孙进程可能仍持有管道，不等待 EOF
+    for (auto& stream : exec.streams) {
+        if (stream.open) {
+            drainAndClose(stream);
+        }
+    }
+    tryFinish(exec);
+}
+
+void Reactor::pollUnwatched() {
+    std::vector<Execution*> polled = m_unwatched;
+    for (Execution* exec : polled) {
+        for (auto& stream : exec->streams) {
+            if (stream.open && !stream.sinkWait && !stream.io.inFlight &&
+                !stream.io.registered) {
+                long result = stream.pump.pump(stream.io.fd);
+                if (result == 0) {
+                    closeStream(stream);
+                } else {
+                    deliverChunks(stream);
+                    if (result < 0 && stream.pump.sinkFull()) {
+                        waitForSink(stream);
+                    }
+                }
+            }
+        }
+        reap(*exec);
+    }
+}
+
+void Reactor::terminate(Execution& exec, bool timedOut) {
+    exec.abandonOutput = true;
+    if (exec.exited) {
+        // 进程已退出，只剩输出在等待写满的目标：超时或取消后不再等待
+        if (exec.phase == Execution::Phase::Running) {
+            exec.timedOut = exec.timedOut || timedOut;
+            for (auto& stream : exec.streams) {
+                if (stream.open && stream.sinkWait) {
+                    closeStream(stream);
+                }
+            }
+            tryFinish(exec);
+        }
+        return;
+    }
+    if (exec.phase == Execution::Phase::Running) {
+        signalProcessGroup(exec.pid, SIGTERM);
+        exec.timedOut = exec.timedOut || timedOut;
+        exec.phase = Execution::Phase::Terminating;
+        schedule(exec, Clock::now() + kKillGrace);
+    } else if (exec.phase == Execution::Phase::Terminating) {
+        signalProcessGroup(exec.pid, SIGKILL);
+        if (exec.cgroup) {
+            exec.cgroup->killAll();
+        }
+        unschedule(exec);
+    }
+}
+
+void Reactor::checkDeadlines() {
+    m_timers.expire(Clock::now(), [this](TimerWheel::Node& node) {
+        Execution& exec = *static_cast<Execution*>(node.context);
+        terminate(exec, exec.phase == Execution::Phase::Running);
+    });
+}
+
+void Reactor::schedule(Execution& exec, Clock::time_point when) {
+    m_timers.schedule(exec.deadline, when);
+}
+
+void Reactor::unschedule(Execution& exec) {
+    m_timers.cancel(exec.deadline);
+}
+
+void Reactor::tryFinish(Execution& exec) {
+    if (exec.phase == Execution::Phase::Finished || !exec.exited || exec.process.inFlight) {
+        return;
+    }
+    for (const auto& stream : exec.streams) {
+        if (stream.open || stream.sinkIo.inFlight) {
+            return;
+        }
+    }
+
+    CommandResult result;
+    if (exec.status != -1 && WIFEXITED(exec.status)) {
+        result.exitCode = WEXITSTATUS(exec.status);
+    } else {
+        result.exitCode = -1;
+    }
+    result.timedOut = exec.timedOut;
+    result.limitExceeded = limitExceeded(exec);
+    collectStream(exec.streams[0], result.output, result.outputMatches, result.compressedOutput);
+    collectStream(exec.streams[1], result.error, result.errorMatches, result.compressedError);
+    result.outputBytes = exec.streams[0].pump.bytes();
+    result.errorBytes = exec.streams[1].pump.bytes();
+    result.executionTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                               Clock::now() - exec.startTime).count();
+
+    exec.phase = Execution::Phase::Finished;
+    unschedule(exec);
+
+    auto it = m_active.find(&exec);
+    if (it != m_active.end()) {
+        m_finished.push_back(std::move(it->second));
+        m_active.erase(it);
+    }
+
+    if (exec.onComplete) {
+        exec.onComplete(result);
+    }
+}
+
+ResourceLimitKind Reactor::limitExceeded(const Execution& exec) const {
+    if (exec.cgroup && exec.cgroup->oomKilled()) {
+        return ResourceLimitKind::Memory;
+    }
+    if (exec.cpuLimited && exec.status != -1) {
+        // shell 本身被终止，或者它的子命令被终止后 shell 以 128 + 信号值退出
+        if ((WIFSIGNALED(exec.status) && WTERMSIG(exec.status) == SIGXCPU) ||
+            (WIFEXITED(exec.status) && WEXITSTATUS(exec.status) == 128 + SIGXCPU)) {
+            return ResourceLimitKind::CpuTime;
+        }
+    }
+    return ResourceLimitKind::None;
+}
+
+void Reactor::collectStream(Execution::Stream& stream, std::string& text, long long& matches,
+                            std::shared_ptr<const CompressedText>& compressed) {
+    stream.pump.finish(text);
+    if (stream.filter) {
+        text = std::move(stream.filter->output());
+        matches = stream.filter->matches();
+    }
+    if (stream.compressed) {
+        stream.compressed->finish();
+        compressed = std::move(stream.compressed);
+    } else if (stream.filter && stream.owner->compressOutput) {
+        // 过滤后的数据在结束时一次压缩
+        compressed = compressText(text);
+    }
+}
+
+int Reactor::nextTimeoutMs() const {
+    int timeoutMs = m_timers.nextTimeoutMs(Clock::now());
+    if (timeoutMs > 60000) {
+        timeoutMs = 60000;
+    }
+    if ((!m_unwatched.empty() || !m_blockedSinks.empty()) &&
+        (timeoutMs < 0 || timeoutMs > kPollIntervalMs)) {
+        timeoutMs = kPollIntervalMs;
+    }
+    return timeoutMs;
+}
+
+void Reactor::shutdown() {
+    adoptPending();
+
+    // 终止所有仍在运行的子进程，并等待它们退出以便回收
+    for (auto& pair : m_active) {
+        Execution& exec = *pair.second;
+        exec.cancelled = true;
+        exec.abandonOutput = true;
+        if (!exec.exited) {
+            signalProcessGroup(exec.pid, SIGKILL);
+        }
+        for (auto& stream : exec.streams) {
+            if (stream.open && stream.sinkWait) {
+                closeStream(stream);
+            }
+        }
+        unschedule(exec);
+    }
+
+    auto giveUp = Clock::now() + kShutdownTimeout;
+    while (!m_active.empty() && Clock::now() < giveUp) {
+        m_events.clear();
+        m_backend->wait(kPollIntervalMs, m_events);
+        for (const auto& event : m_events) {
+            dispatch(event);
+        }
+        processExits();
+        std::vector<std::shared_ptr<Execution>> remaining;
+        for (auto& pair : m_active) {
+            remaining.push_back(pair.second);
+        }
+        for (auto& execution : remaining) {
+            if (!execution->polled) {
+                reap(*execution);
+            }
+        }
+        if (!m_unwatched.empty()) {
+            pollUnwatched();
+        }
+        m_finished.clear();
+    }
+
+    // 仍未结束的命令可能还有进行中的内核读取（io_uring），取消并等待完成事件之后
+    // 才能释放它们的缓冲区。管道读取和 poll 的取消总是会完成
+    while (true) {
+        bool inFlight = false;
+        for (auto& pair : m_active) {
+            Execution& exec = *pair.second;
+            for (auto& stream : exec.streams) {
+                for (IoStream* io : {&stream.io, &stream.sinkIo}) {
+                    if (io->inFlight) {
+                        m_backend->cancelStream(*io);
+                        inFlight = true;
+                    }
+                }
+            }
+            if (exec.process.inFlight) {
+                m_backend->removeProcess(exec.process);
+                inFlight = true;
+            }
+        }
+        if (!inFlight) {
+            break;
+        }
+        m_events.clear();
+        m_backend->wait(kPollIntervalMs, m_events);
+    }
+    m_events.clear();
+
+    for (auto& pair : m_active) {
+        Execution& exec = *pair.second;
+        for (auto& stream : exec.streams) {
+            m_backend->removeStream(stream.io);
+            m_backend->removeStream(stream.sinkIo);
+        }
+        m_backend->removeProcess(exec.process);
+        if (exec.reaperWatched) {
+            ChildReaper::instance().unwatch(exec.pid);
+        }
+        exec.phase = Execution::Phase::Finished;
+        if (exec.onComplete) {
+            CommandResult result;
+            result.exitCode = -1;
+            result.error = "Terminated during shutdown";
+            exec.onComplete(result);
+        }
+    }
+    m_active.clear();
+    m_unwatched.clear();
+    m_blockedSinks.clear();
+}
+
+} // namespace Zrun
+
+#endif // _WIN32
@@ -0,0 +1,176 @@
+#ifndef ZRUN_REACTOR_H
+#define ZRUN_REACTOR_H
+
+#include "zrun_types.h"
+#include "zrun_io_backend.h"
+#include "zrun_sink.h"
+#include "zrun_lines.h"
+#include "zrun_filter.h"
+#include "zrun_timer.h"
+#include "zrun_cgroup.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/types.h>
+
+namespace Zrun {
+
+// 一个已启动、由事件循环管理的子进程
+struct Execution {
+    using Clock = std::chrono::steady_clock;
+    using CompletionHandler = std::function<void(CommandResult& result)>;
+    using ChunkHandler = std::function<void(std::string_view data, bool isError)>;
+
+    struct Stream {
+        IoStream io;
+        StreamPump pump;
+        Execution* owner = nullptr;
+        bool isError = false;
+        bool open = false;
+        bool closing = false;
+        // 输出目标写满：不再读取管道，改为关注 sinkIo（目标 fd 的副本）可写
+        IoStream sinkIo;
+        bool sinkWait = false;
+        // 已通过 onChunk/onLine 转发的捕获字节数
+        size_t delivered = 0;
+        LineSplitter lines;
+        // 可选，设置后捕获缓冲区只作为读取缓冲，选中的数据保存在过滤器中
+        std::unique_ptr<StreamFilter> filter;
+        // 可选，没有过滤器时捕获的数据随读取压缩到这里
+        std::unique_ptr<CompressedText> compressed;
+
+        explicit Stream(const OutputSink& sink) : pump(sink) {}
+    };
+
+    Execution(const OutputSink& stdoutSink, const OutputSink& stderrSink);
+    ~Execution();
+
+    Execution(const Execution&) = delete;
+    Execution& operator=(const Execution&) = delete;
+
+    // 在事件循环线程调用，参数为最终结果
+    CompletionHandler onComplete;
+    // 可选，在事件循环线程转发新捕获的输出
+    ChunkHandler onChunk;
+    LineCallback onLine;
+
+    pid_t pid = -1;
+    IoProcess process;
+    Stream streams[2];
+    bool compressOutput = false;
+    // 可选，命令所在的 cgroup 子组，随 Execution 一起删除
+    std::unique_ptr<CommandCgroup> cgroup;
+    // 设置了 RLIMIT_CPU，SIGXCPU 终止视为超出限制
+    bool cpuLimited = false;
+    Clock::time_point startTime;
+    int timeoutMs = 30000;
+
+    // 以下字段只在事件循环线程访问
+    enum class Phase { Running, Terminating, Finished };
+    Phase phase = Phase::Running;
+    bool exited = false;
+    int status = 0;
+    bool timedOut = false;
+    bool cancelled = false;
+    // 超时或取消后不再等待写满的输出目标
+    bool abandonOutput = false;
+    bool polled = false;
+    // 由 ChildReaper 回收，退出状态通过 Reactor::m_exits 送回
+    bool reaperWatched = false;
+    // 超时或 SIGKILL 宽限期的定时器
+    TimerWheel::Node deadline;
+};
+
+// 事件循环：在一个线程中统一处理所有在途命令的管道读取、进程退出和超时
+class Reactor {
+public:
+    // threaded 为 false 时不启动线程，由调用方通过 runUntilComplete 驱动
+    Reactor(IoBackendType type, bool threaded = true);
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    // 所有后端都无法创建时为 false
+    bool valid() const { return m_backend != nullptr; }
+
+    const char* backendName() const;
+    const std::string& backendNote() const { return m_note; }
+
+    // 提交已启动的进程，可在任意线程调用
+    void submit(std::shared_ptr<Execution> execution);
+
+    // 终止进程（SIGTERM，宽限期后 SIGKILL），可在任意线程调用
+    void cancel(std::shared_ptr<Execution> execution);
+
+    bool inLoopThread() const;
+
+    // 在当前线程运行事件循环，直到 execution 完成
+    void runUntilComplete(const std::shared_ptr<Execution>& execution);
+
+private:
+    using Clock = Execution::Clock;
+
+    void threadMain();
+    void runOnce();
+    void adoptPending();
+    void dispatch(const IoEvent& event);
+    void onStreamEvent(Execution::Stream& stream, const IoEvent& event);
+    void waitForSink(Execution::Stream& stream);
+    void onSinkWritable(Execution::Stream& stream);
+    void retryBlockedSinks();
+    void drainAndClose(Execution::Stream& stream);
+    void closeStream(Execution::Stream& stream);
+    void deliverChunks(Execution::Stream& stream);
+    void reap(Execution& execution);
+    void watchWithReaper(Execution& execution);
+    void processExits();
+    void onExited(Execution& execution, int status);
+    void pollUnwatched();
+    void terminate(Execution& execution, bool timedOut);
+    void checkDeadlines();
+    void schedule(Execution& execution, Clock::time_point when);
+    void unschedule(Execution& execution);
+    void tryFinish(Execution& execution);
+    ResourceLimitKind limitExceeded(const Execution& execution) const;
+    void collectStream(Execution::Stream& stream, std::string& text, long long& matches,
+                       std::shared_ptr<const CompressedText>& compressed);
+    int nextTimeoutMs() const;
+    void shutdown();
+
+    std::unique_ptr<IoBackend> m_backend;
+    std::string m_note;
+
+    std::thread m_thread;
+    std::atomic<std::thread::id> m_loopThreadId;
+    std::atomic<bool> m_stopping{false};
+
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<Execution>> m_pending;
+    std::vector<std::shared_ptr<Execution>> m_cancelRequests;
+    // ChildReaper 报告的退出状态
+    std::vector<std::pair<Execution*, int>> m_exits;
+
+    std::unordered_map<Execution*, std::shared_ptr<Execution>> m_active;
+    std::vector<std::shared_ptr<Execution>> m_finished;
+    TimerWheel m_timers;
+    // 需要定期轮询的进程：管道无法注册，或者 pidfd 和 ChildReaper 都不可用
+    std::vector<Execution*> m_unwatched;
+    // 无法关注可写的输出目标，定期重试写入
+    std::vector<Execution::Stream*> m_blockedSinks;
+    std::vector<IoEvent> m_events;
+};
+
+} // namespace Zrun
+
+#endif // _WIN32
+
+#endif // ZRUN_REACTOR_H
@@ -0,0 +1,208 @@
+#include "zrun_reaper.h"
+
+#ifndef _WIN32
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace Zrun {
+
+namespace {
+// 没有收到 SIGCHLD 时（例如其他代码替换了处理函数）也定期检查一次
+constexpr int kSafetyScanMs = 1000;
+
+int g_wakeFd = -1;
+struct sigaction g_previous;
+
+void onChildSignal(int signo, siginfo_t* info, void* context) {
+    int savedErrno = errno;
+    if (g_wakeFd != -1) {
+        char byte = 1;
+        ssize_t ignored = write(g_wakeFd, &byte, 1);
+        (void)ignored;
+    }
+    // 保留原有的 SIGCHLD 处理
+    if (g_previous.sa_flags & SA_SIGINFO) {
+        if (g_previous.sa_sigaction) {
+            g_previous.sa_sigaction(signo, info, context);
+        }
+    } else if (g_previous.sa_handler != SIG_DFL && g_previous.sa_handler != SIG_IGN) {
+        g_previous.sa_handler(signo);
+    }
+    errno = savedErrno;
+}
+}
+
+ChildReaper& ChildReaper::instance() {
+    // 不析构：进程退出时回收线程和信号处理函数可能仍在使用它
+    static ChildReaper* reaper = new ChildReaper();
+    return *reaper;
+}
+
+bool ChildReaper::watch(pid_t pid, ExitHandler onExit) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!start()) {
+        return false;
+    }
+    m_watched[pid] = std::move(onExit);
+    // 子进程可能在登记之前就已退出，对应的 SIGCHLD 已经错过
+    reap(pid);
+    return true;
+}
+
+void ChildReaper::unwatch(pid_t pid) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_watched.erase(pid);
+}
+
+bool ChildReaper::start() {
+    if (m_started || m_failed) {
+        return m_started;
+    }
+
+    // 宿主把 SIGCHLD 设为忽略时由内核自动回收子进程，安装处理函数会让它自己的子进程变成僵尸。
+    // 这时不启动，调用方改为轮询；之后宿主恢复默认处理时仍可以启动
+    struct sigaction current;
+    if (sigaction(SIGCHLD, nullptr, &current) == -1) {
+        return false;
+    }
+    if ((!(current.sa_flags & SA_SIGINFO) && current.sa_handler == SIG_IGN) ||
+        (current.sa_flags & SA_NOCLDWAIT)) {
+        return false;
+    }
+
+    int fds[2];
+    if (pipe(fds) == -1) {
+        m_failed = true;
+        return false;
+    }
+    for (int fd : fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    m_readFd = fds[0];
+    g_wakeFd = fds[1];
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = onChildSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGCHLD, &action, &g_previous) == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        m_readFd = -1;
+        g_wakeFd = -1;
+        m_failed = true;
+        return false;
+    }
+
+    try {
+        std::thread(&ChildReaper::threadMain, this).detach();
+    } catch (const std::system_error&) {
+        sigaction(SIGCHLD, &g_previous, nullptr);
+        close(fds[0]);
+        close(fds[1]);
+        m_readFd = -1;
+        g_wakeFd = -1;
+        m_failed = true;
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+void ChildReaper::threadMain() {
+    // 调用方的线程可能都屏蔽了 SIGCHLD，至少让回收线程能收到它
+    sigset_t childSignal;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    pthread_sigmask(SIG_UNBLOCK, &childSignal, nullptr);
+
+    while (true) {
+        pollfd entry{m_readFd, POLLIN, 0};
+        int ready = poll(&entry, 1, kSafetyScanMs);
+        if (ready > 0) {
+            char buffer[64];
+            while (read(m_readFd, buffer, sizeof(buffer)) > 0) {
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        collect(ready == 0);
+    }
+}
+
+void ChildReaper::collect(bool scanAll) {
+    while (!scanAll && !m_watched.empty()) {
+        // 只查看不回收：不属于我们的子进程留给创建它的代码
+        siginfo_t info;
+        memset(&info, 0, sizeof(info));
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // ECHILD：登记的子进程已被其他代码回收
+            scanAll = true;
+            break;
+        }
+        if (info.si_pid == 0) {
+            return;
+        }
+        if (!m_watched.count(info.si_pid)) {
+            // 最早退出的是其他代码的子进程，无法越过它，改为逐个检查
+            scanAll = true;
+            break;
+        }
+        reap(info.si_pid);
+    }
+
+    if (scanAll) {
+        std::vector<pid_t> pids;
+        pids.reserve(m_watched.size());
+        for (const auto& pair : m_watched) {
+            pids.push_back(pair.first);
+        }
+        for (pid_t pid : pids) {
+            reap(pid);
+        }
+    }
+}
+
+bool ChildReaper::reap(pid_t pid) {
+    int status = 0;
+    pid_t result;
+    do {
+        result = waitpid(pid, &status, WNOHANG);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == 0) {
+        return false;
+    }
+    if (result != pid) {
+        status = -1;
+    }
+
+    auto it = m_watched.find(pid);
+    if (it == m_watched.end()) {
+        return true;
+    }
+    ExitHandler handler = std::move(it->second);
+    m_watched.erase(it);
+    if (handler) {
+        handler(status);
+    }
+    return true;
+}
+
+} // namespace Zrun
+
+#endif // _WIN32
@@ -0,0 +1,55 @@
+#ifndef ZRUN_REAPER_H
+#define ZRUN_REAPER_H
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/types.h>
+
+namespace Zrun {
+
+// 进程内共享的子进程回收器，用于无法通过 pidfd 等待的子进程。
+// SIGCHLD 处理函数（会继续调用原有的处理函数）唤醒回收线程，线程用 WNOWAIT 查看已退出的
+// 子进程，只回收登记过的 pid，不会抢走其他代码创建的子进程
+class ChildReaper {
+public:
+    // 参数为 waitpid 得到的状态；子进程已被其他代码回收时为 -1
+    using ExitHandler = std::function<void(int status)>;
+
+    static ChildReaper& instance();
+
+    ChildReaper(const ChildReaper&) = delete;
+    ChildReaper& operator=(const ChildReaper&) = delete;
+
+    // 登记子进程，退出后在回收线程（或当前线程）中调用 onExit 一次。
+    // onExit 在回收器的锁内调用，不能再调用 watch/unwatch。
+    // 无法安装 SIGCHLD 处理函数或启动线程时返回 false；宿主忽略 SIGCHLD（SIG_IGN 或
+    // SA_NOCLDWAIT）时也返回 false，不替换其处理方式
+    bool watch(pid_t pid, ExitHandler onExit);
+
+    // 取消登记，返回后不会再调用该 pid 的 onExit
+    void unwatch(pid_t pid);
+
+private:
+    ChildReaper() = default;
+
+    bool start();
+    void threadMain();
+    // 回收已退出的登记子进程；scanAll 为 true 时逐个检查所有登记的 pid
+    void collect(bool scanAll);
+    bool reap(pid_t pid);
+
+    std::mutex m_mutex;
+    std::unordered_map<pid_t, ExitHandler> m_watched;
+    int m_readFd = -1;
+    bool m_started = false;
+    bool m_failed = false;
+};
+
+} // namespace Zrun
+
+#endif // _WIN32
+
+#endif // ZRUN_REAPER_H
@@ -0,0 +1,156 @@
+#include "zrun_retry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace Zrun {
+
+DelayQueue::~DelayQueue() {
+    shutdown();
+}
+
+DelayQueue::Id DelayQueue::schedule(int delayMs, Task task) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopping) {
+        return 0;
+    }
+    if (!m_thread.joinable()) {
+        m_thread = std::thread(&DelayQueue::threadMain, this);
+    }
+
+    auto entry = std::make_unique<Entry>();
+    entry->id = m_nextId++;
+    entry->task = std::move(task);
+    entry->node.context = entry.get();
+    m_timers.schedule(entry->node, TimerWheel::Clock::now() +
+                                       std::chrono::milliseconds(std::max(delayMs, 0)));
+    Id id = entry->id;
+    m_entries.emplace(id, std::move(entry));
+    m_cv.notify_one();
+    return id;
+}
+
+void DelayQueue::cancel(Id id) {
+    // 任务在锁外析构，它持有的对象可能再调用 schedule/cancel
+    std::unique_ptr<Entry> entry;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(id);
+    if (it != m_entries.end()) {
+        m_timers.cancel(it->second->node);
+        entry = std::move(it->second);
+        m_entries.erase(it);
+    }
+}
+
+void DelayQueue::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_cv.notify_one();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    std::unordered_map<Id, std::unique_ptr<Entry>> entries;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& pair : m_entries) {
+            m_timers.cancel(pair.second->node);
+        }
+        entries.swap(m_entries);
+    }
+}
+
+void DelayQueue::threadMain() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        int timeoutMs = m_timers.nextTimeoutMs(TimerWheel::Clock::now());
+        if (timeoutMs < 0) {
+            m_cv.wait(lock);
+        } else if (timeoutMs > 0) {
+            m_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs));
+        }
+        if (m_stopping) {
+            break;
+        }
+
+        std::vector<Task> due;
+        m_timers.expire(TimerWheel::Clock::now(), [&](TimerWheel::Node& node) {
+            Id id = static_cast<Entry*>(node.context)->id;
+            auto it = m_entries.find(id);
+            due.push_back(std::move(it->second->task));
+            m_entries.erase(it);
+        });
+        // 任务可能再次调用 schedule/cancel，不能持有锁
+        lock.unlock();
+        for (auto& task : due) {
+            task();
+        }
+        due.clear();
+        lock.lock();
+    }
+}
+
+void LatencyTracker::record(const std::string& key, long long ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_samples.size() >= kMaxKeys && !m_samples.count(key)) {
+        m_samples.clear();
+    }
+    Samples& samples = m_samples[key];
+    if (samples.values.size() < kSamples) {
+        samples.values.push_back(ms);
+    } else {
+        samples.values[samples.next] = ms;
+        samples.next = (samples.next + 1) % kSamples;
+    }
+}
+
+long long LatencyTracker::percentile(const std::string& key, double percentile,
+                                     int minSamples) const {
+    std::vector<long long> values;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_samples.find(key);
+        if (it == m_samples.end() ||
+            it->second.values.size() < static_cast<size_t>(std::max(minSamples, 1))) {
+            return -1;
+        }
+        values = it->second.values;
+    }
+    double clamped = std::min(std::max(percentile, 0.0), 1.0);
+    size_t rank = static_cast<size_t>(std::ceil(clamped * values.size()));
+    size_t index = rank > 0 ? rank - 1 : 0;
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+bool retryable(const RetryPolicy& policy, const CommandResult& result) {
+    if (result.timedOut) {
+        return policy.retryOnTimeout;
+    }
+    if (result.exitCode == 0 || result.limitExceeded != ResourceLimitKind::None) {
+        return false;
+    }
+    if (policy.retryExitCodes.empty()) {
+        return true;
+    }
+    return std::find(policy.retryExitCodes.begin(), policy.retryExitCodes.end(),
+                     result.exitCode) != policy.retryExitCodes.end();
+}
+
+int retryBackoffMs(const RetryPolicy& policy, int retry) {
+    double delay = std::max(policy.initialBackoffMs, 0) *
+                   std::pow(std::max(policy.backoffMultiplier, 1.0), std::max(retry - 1, 0));
+    delay = std::min(delay, static_cast<double>(std::max(policy.maxBackoffMs, 0)));
+
+    double jitter = std::min(std::max(policy.jitter, 0.0), 1.0);
+    if (jitter > 0.0) {
+        thread_local std::mt19937 generator(std::random_device{}());
+        std::uniform_real_distribution<double> distribution(1.0 - jitter, 1.0 + jitter);
+        delay *= distribution(generator);
+    }
+    return static_cast<int>(delay);
+}
+
+} // namespace Zrun
@@ -0,0 +1,88 @@
+#ifndef ZRUN_RETRY_H
+#define ZRUN_RETRY_H
+
+#include "zrun_types.h"
+#include "zrun_timer.h"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Zrun {
+
+// 延迟执行的任务，用于重试前的退避和对冲副本的启动。
+// 后台线程在第一次使用时启动，任务在该线程中执行，应当很快返回
+class DelayQueue {
+public:
+    using Task = std::function<void()>;
+    using Id = uint64_t;
+
+    DelayQueue() = default;
+    ~DelayQueue();
+
+    DelayQueue(const DelayQueue&) = delete;
+    DelayQueue& operator=(const DelayQueue&) = delete;
+
+    // 停止后返回 0，任务不会执行
+    Id schedule(int delayMs, Task task);
+
+    // 取消尚未开始执行的任务
+    void cancel(Id id);
+
+    // 丢弃所有未执行的任务并停止后台线程
+    void shutdown();
+
+private:
+    struct Entry {
+        TimerWheel::Node node;
+        Id id = 0;
+        Task task;
+    };
+
+    void threadMain();
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    TimerWheel m_timers;
+    std::unordered_map<Id, std::unique_ptr<Entry>> m_entries;
+    Id m_nextId = 1;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+// 按命令记录最近的执行时间，对冲的延迟取其中的分位数
+class LatencyTracker {
+public:
+    void record(const std::string& key, long long ms);
+
+    // 最近样本的 percentile (0~1) 分位数，样本少于 minSamples 时返回 -1
+    long long percentile(const std::string& key, double percentile, int minSamples) const;
+
+private:
+    // 每条命令保留的样本数和最多跟踪的命令数（超出时清空重新开始）
+    static constexpr size_t kSamples = 128;
+    static constexpr size_t kMaxKeys = 4096;
+
+    struct Samples {
+        std::vector<long long> values;
+        size_t next = 0;
+    };
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Samples> m_samples;
+};
+
+// 结果是否属于 policy 指定的可重试失败（与剩余次数无关）
+bool retryable(const RetryPolicy& policy, const CommandResult& result);
+
+// 第 retry 次重试 (从 1 开始) 之前等待的毫秒数，包含随机抖动
+int retryBackoffMs(const RetryPolicy& policy, int retry);
+
+} // namespace Zrun
+
+#endif // ZRUN_RETRY_H
@@ -0,0 +1,368 @@
+#include "zrun_scheduler.h"
+#include "zrun_core.h"
+#include <algorithm>
+
+namespace Zrun {
+
+namespace {
+int priorityIndex(CommandPriority priority) {
+    int index = static_cast<int>(priority);
+    return std::min(std::max(index, 0), 2);
+}
+}
+
+AdmissionScheduler::AdmissionScheduler(Launch launch, Reject reject)
+    : m_launch(std::move(launch)), m_reject(std::move(reject)),
+    m_wakeup(std::make_shared<Wakeup>()) {}
+
+AdmissionScheduler::~AdmissionScheduler() {
+    shutdown();
+}
+
+void AdmissionScheduler::setMaxConcurrency(int limit) {
+    std::vector<std::shared_ptr<AsyncOperation>> launches;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_maxConcurrency = std::max(limit, 0);
+        pump(launches, nullptr);
+    }
+    launchAll(launches);
+}
+
+void AdmissionScheduler::setTagPolicy(const std::string& tag, int maxConcurrency, int weight) {
+    std::vector<std::shared_ptr<AsyncOperation>> launches;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Tag& entry = m_tags[tag];
+        entry.limit = std::max(maxConcurrency, 0);
+        entry.weight = std::max(weight, 1);
+        pump(launches, nullptr);
+    }
+    launchAll(launches);
+}
+
+void AdmissionScheduler::submit(const std::shared_ptr<AsyncOperation>& operation) {
+    std::vector<std::shared_ptr<AsyncOperation>> launches;
+    bool stopped = false;
+    bool needWake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            stopped = true;
+        } else {
+            Tag& tag = m_tags[operation->options.tag];
+            // 闲置的 tag 不能积累额度，重新活跃时从当前虚拟时间开始
+            if (tag.running == 0 && tag.queued == 0) {
+                tag.pass = std::max(tag.pass, m_virtualTime);
+            }
+
+            int priority = priorityIndex(operation->options.priority);
+            std::list<Ticket>& queue = tag.queues[priority];
+            Ticket& ticket = *queue.emplace(queue.end());
+            ticket.operation = operation;
+            ticket.enqueued = Clock::now();
+            ticket.timer.context = &ticket;
+            ticket.tag = &tag;
+            ticket.priority = priority;
+            ticket.position = std::prev(queue.end());
+            m_index[operation.get()] = &ticket;
+            ++tag.queued;
+            ++m_queued;
+
+            pump(launches, operation.get());
+            if (!operation->admitted) {
+                ensureThread();
+                if (operation->options.queueTimeoutMs >= 0) {
+                    auto deadline = ticket.enqueued +
+                                    std::chrono::milliseconds(operation->options.queueTimeoutMs);
+                    m_timers.schedule(ticket.timer, deadline);
+                    needWake = deadline < m_plannedWake;
+                }
+
+                std::weak_ptr<Wakeup> weakWakeup = m_wakeup;
+                const AsyncOperation* key = operation.get();
+                std::lock_guard<std::mutex> operationLock(operation->mutex);
+                operation->onCancel = [weakWakeup, key]() {
+                    if (auto wakeup = weakWakeup.lock()) {
+                        std::lock_guard<std::mutex> wakeupLock(wakeup->mutex);
+                        wakeup->cancelled.push_back(key);
+                        wakeup->pending = true;
+                        wakeup->cv.notify_one();
+                    }
+                };
+                if (operation->cancelled) {
+                    // 入队之前已经取消，钩子不会再被调用
+                    std::lock_guard<std::mutex> wakeupLock(m_wakeup->mutex);
+                    m_wakeup->cancelled.push_back(key);
+                    needWake = true;
+                }
+            }
+        }
+    }
+
+    if (stopped) {
+        operation->cancel();
+        CommandResult result;
+        result.exitCode = -1;
+        result.error = "Cancelled while queued";
+        m_reject(operation, result);
+        return;
+    }
+    if (needWake) {
+        wake();
+    }
+    launchAll(launches);
+}
+
+void AdmissionScheduler::release(const AsyncOperation& operation) {
+    std::vector<std::shared_ptr<AsyncOperation>> launches;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Tag& tag = m_tags[operation.options.tag];
+        --tag.running;
+        --m_running;
+        pump(launches, nullptr);
+    }
+    launchAll(launches);
+}
+
+void AdmissionScheduler::shutdown() {
+    Rejected rejected;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        auto now = Clock::now();
+        for (auto& pair : m_tags) {
+            for (auto& queue : pair.second.queues) {
+                while (!queue.empty()) {
+                    rejectTicket(queue.front(), false, now, rejected);
+                }
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> wakeupLock(m_wakeup->mutex);
+        m_wakeup->stopping = true;
+        m_wakeup->cv.notify_one();
+    }
+    if (m_thread.joinable()) {
+        if (m_thread.get_id() == std::this_thread::get_id()) {
+            m_thread.detach();
+        } else {
+            m_thread.join();
+        }
+    }
+
+    for (auto& entry : rejected) {
+        entry.first->cancel();
+    }
+    rejectAll(rejected);
+}
+
+void AdmissionScheduler::fillMetrics(Metrics& metrics) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    metrics.commandsRunning = m_running;
+    metrics.commandsQueued = static_cast<long long>(m_queued);
+    metrics.admittedImmediately = m_admittedImmediately;
+    metrics.admittedFromQueue = m_admittedFromQueue;
+    metrics.queueTimeouts = m_queueTimeouts;
+    metrics.queueCancellations = m_queueCancellations;
+    metrics.totalQueueWaitMs = m_totalQueueWaitMs;
+    metrics.maxQueueWaitMs = m_maxQueueWaitMs;
+    metrics.tags.clear();
+    for (const auto& pair : m_tags) {
+        Metrics::TagStats& stats = metrics.tags[pair.first];
+        stats.running = pair.second.running;
+        stats.queued = static_cast<long long>(pair.second.queued);
+        stats.admitted = pair.second.admitted;
+    }
+}
+
+void AdmissionScheduler::pump(std::vector<std::shared_ptr<AsyncOperation>>& launches,
+                              const AsyncOperation* submitting) {
+    if (m_stopping) {
+        return;
+    }
+    while (m_queued > 0 && (m_maxConcurrency == 0 || m_running < m_maxConcurrency)) {
+        Tag* tag = nullptr;
+        int priority = 0;
+        for (; priority < kPriorityCount && !tag; ++priority) {
+            tag = pick(priority);
+        }
+        if (!tag) {
+            // 有排队的命令，但它们所在的 tag 都已满
+            return;
+        }
+        admit(*tag, priority - 1, launches, submitting);
+    }
+}
+
+AdmissionScheduler::Tag* AdmissionScheduler::pick(int priority) {
+    Tag* best = nullptr;
+    for (auto& pair : m_tags) {
+        Tag& tag = pair.second;
+        if (tag.queues[priority].empty() || (tag.limit > 0 && tag.running >= tag.limit)) {
+            continue;
+        }
+        if (!best || tag.pass < best->pass) {
+            best = &tag;
+        }
+    }
+    return best;
+}
+
+void AdmissionScheduler::admit(Tag& tag, int priority,
+                               std::vector<std::shared_ptr<AsyncOperation>>& launches,
+                               const AsyncOperation* submitting) {
+    Ticket& ticket = tag.queues[priority].front();
+    if (ticket.operation.get() == submitting) {
+        ++m_admittedImmediately;
+    } else {
+        ++m_admittedFromQueue;
+        long long waitedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 Clock::now() - ticket.enqueued).count();
+        m_totalQueueWaitMs += waitedMs;
+        m_maxQueueWaitMs = std::max(m_maxQueueWaitMs, waitedMs);
+    }
+
+    ++tag.running;
+    ++m_running;
+    ++tag.admitted;
+    m_virtualTime = tag.pass;
+    tag.pass += 1.0 / tag.weight;
+
+    std::shared_ptr<AsyncOperation> operation = removeTicket(ticket);
+    operation->admitted = true;
+    launches.push_back(std::move(operation));
+}
+
+void AdmissionScheduler::launchAll(std::vector<std::shared_ptr<AsyncOperation>>& launches) {
+    // 启动失败的命令会立即结束并释放名额，再次启动排队的命令。
+    // 嵌套的启动追加到最外层的列表中依次处理，避免递归过深
+    struct Pending {
+        AdmissionScheduler* scheduler;
+        std::shared_ptr<AsyncOperation> operation;
+    };
+    thread_local std::vector<Pending>* active = nullptr;
+
+    if (active) {
+        for (auto& operation : launches) {
+            active->push_back(Pending{this, std::move(operation)});
+        }
+        return;
+    }
+
+    std::vector<Pending> pending;
+    for (auto& operation : launches) {
+        pending.push_back(Pending{this, std::move(operation)});
+    }
+    active = &pending;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        Pending next = std::move(pending[i]);
+        next.scheduler->m_launch(next.operation);
+    }
+    active = nullptr;
+}
+
+void AdmissionScheduler::ensureThread() {
+    if (!m_thread.joinable()) {
+        m_thread = std::thread(&AdmissionScheduler::threadMain, this);
+    }
+}
+
+void AdmissionScheduler::threadMain() {
+    std::shared_ptr<Wakeup> wakeup = m_wakeup;
+    while (true) {
+        int timeoutMs;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            timeoutMs = m_timers.nextTimeoutMs(Clock::now());
+            m_plannedWake = timeoutMs < 0 ? Clock::time_point::max()
+                                          : Clock::now() + std::chrono::milliseconds(timeoutMs);
+        }
+
+        std::vector<const AsyncOperation*> cancelled;
+        {
+            std::unique_lock<std::mutex> wakeupLock(wakeup->mutex);
+            auto ready = [&]() { return wakeup->pending || wakeup->stopping; };
+            if (timeoutMs < 0) {
+                wakeup->cv.wait(wakeupLock, ready);
+            } else {
+                wakeup->cv.wait_for(wakeupLock, std::chrono::milliseconds(timeoutMs), ready);
+            }
+            if (wakeup->stopping) {
+                return;
+            }
+            wakeup->pending = false;
+            cancelled.swap(wakeup->cancelled);
+        }
+
+        Rejected rejected;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto now = Clock::now();
+            for (const AsyncOperation* key : cancelled) {
+                auto it = m_index.find(key);
+                if (it == m_index.end()) {
+                    continue;
+                }
+                // 地址可能已被新的排队命令复用，只结束确实已取消的命令
+                Ticket& ticket = *it->second;
+                bool isCancelled;
+                {
+                    std::lock_guard<std::mutex> operationLock(ticket.operation->mutex);
+                    isCancelled = ticket.operation->cancelled;
+                }
+                if (isCancelled) {
+                    rejectTicket(ticket, false, now, rejected);
+                }
+            }
+            m_timers.expire(now, [&](TimerWheel::Node& node) {
+                rejectTicket(*static_cast<Ticket*>(node.context), true, now, rejected);
+            });
+        }
+        rejectAll(rejected);
+    }
+}
+
+std::shared_ptr<AsyncOperation> AdmissionScheduler::removeTicket(Ticket& ticket) {
+    std::shared_ptr<AsyncOperation> operation = std::move(ticket.operation);
+    m_timers.cancel(ticket.timer);
+    m_index.erase(operation.get());
+    --ticket.tag->queued;
+    --m_queued;
+    ticket.tag->queues[ticket.priority].erase(ticket.position);
+    return operation;
+}
+
+void AdmissionScheduler::rejectTicket(Ticket& ticket, bool timedOut, Clock::time_point now,
+                                      Rejected& rejected) {
+    CommandResult result;
+    result.exitCode = -1;
+    if (timedOut) {
+        result.error = "Timed out waiting for admission";
+        result.timedOut = true;
+        ++m_queueTimeouts;
+    } else {
+        result.error = "Cancelled while queued";
+        ++m_queueCancellations;
+    }
+    result.executionTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                               now - ticket.enqueued).count();
+    rejected.emplace_back(removeTicket(ticket), std::move(result));
+}
+
+void AdmissionScheduler::wake() {
+    std::lock_guard<std::mutex> wakeupLock(m_wakeup->mutex);
+    m_wakeup->pending = true;
+    m_wakeup->cv.notify_one();
+}
+
+void AdmissionScheduler::rejectAll(Rejected& rejected) {
+    for (auto& entry : rejected) {
+        m_reject(entry.first, entry.second);
+    }
+}
+
+} // namespace Zrun
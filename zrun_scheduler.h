@@ -0,0 +1,135 @@
+#ifndef ZRUN_SCHEDULER_H
+#define ZRUN_SCHEDULER_H
+
+#include "zrun_types.h"
+#include "zrun_timer.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Zrun {
+
+struct AsyncOperation;
+
+// 异步命令的准入调度：限制全局和每个 tag 的并发数。
+// 有空闲名额时按优先级从高到低选择命令，同一优先级内按 tag 的权重公平分配 (stride 调度)，
+// 同一 tag 内先进先出。排队超时（时间轮）和排队中取消由后台线程处理，只在第一次排队时启动
+class AdmissionScheduler {
+public:
+    using Launch = std::function<void(const std::shared_ptr<AsyncOperation>& operation)>;
+    using Reject = std::function<void(const std::shared_ptr<AsyncOperation>& operation,
+                                      CommandResult& result)>;
+
+    // launch 启动已准入的命令；reject 结束未能准入（超时或取消）的命令。两者都不在锁内调用
+    AdmissionScheduler(Launch launch, Reject reject);
+    ~AdmissionScheduler();
+
+    AdmissionScheduler(const AdmissionScheduler&) = delete;
+    AdmissionScheduler& operator=(const AdmissionScheduler&) = delete;
+
+    // 0 表示不限制
+    void setMaxConcurrency(int limit);
+    void setTagPolicy(const std::string& tag, int maxConcurrency, int weight);
+
+    // 提交命令：有空闲名额时立即在当前线程启动，否则排队
+    void submit(const std::shared_ptr<AsyncOperation>& operation);
+
+    // 已准入的命令结束，释放名额并启动排队的命令
+    void release(const AsyncOperation& operation);
+
+    // 结束所有排队的命令（按取消处理）并停止后台线程，之后不再启动新命令
+    void shutdown();
+
+    void fillMetrics(Metrics& metrics);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int kPriorityCount = 3;
+
+    struct Tag;
+
+    struct Ticket {
+        std::shared_ptr<AsyncOperation> operation;
+        Clock::time_point enqueued;
+        // 排队超时
+        TimerWheel::Node timer;
+        Tag* tag = nullptr;
+        int priority = 0;
+        std::list<Ticket>::iterator position;
+    };
+
+    struct Tag {
+        int limit = 0;
+        int weight = 1;
+        int running = 0;
+        size_t queued = 0;
+        // 已获得的虚拟服务量，越小越优先
+        double pass = 0.0;
+        long long admitted = 0;
+        std::list<Ticket> queues[kPriorityCount];
+    };
+
+    // 后台线程的唤醒信号，由 AsyncOperation 的取消钩子弱引用
+    struct Wakeup {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool pending = false;
+        bool stopping = false;
+        // 排队中被取消的命令，只用作查找的键
+        std::vector<const AsyncOperation*> cancelled;
+    };
+
+    using Rejected = std::vector<std::pair<std::shared_ptr<AsyncOperation>, CommandResult>>;
+
+    // 在 m_mutex 内调用；submitting 为本次提交的命令，用于区分立即准入和排队后准入
+    void pump(std::vector<std::shared_ptr<AsyncOperation>>& launches,
+              const AsyncOperation* submitting);
+    Tag* pick(int priority);
+    void admit(Tag& tag, int priority, std::vector<std::shared_ptr<AsyncOperation>>& launches,
+               const AsyncOperation* submitting);
+    void launchAll(std::vector<std::shared_ptr<AsyncOperation>>& launches);
+    // 从队列中移除并返回其命令
+    std::shared_ptr<AsyncOperation> removeTicket(Ticket& ticket);
+    void rejectTicket(Ticket& ticket, bool timedOut, Clock::time_point now, Rejected& rejected);
+    void wake();
+    void ensureThread();
+    void threadMain();
+    void rejectAll(Rejected& rejected);
+
+    Launch m_launch;
+    Reject m_reject;
+
+    std::mutex m_mutex;
+    std::map<std::string, Tag> m_tags;
+    std::unordered_map<const AsyncOperation*, Ticket*> m_index;
+    TimerWheel m_timers;
+    // 后台线程计划醒来的时刻，更早的排队截止时间才需要唤醒它
+    Clock::time_point m_plannedWake = Clock::time_point::max();
+    int m_maxConcurrency = 0;
+    int m_running = 0;
+    size_t m_queued = 0;
+    double m_virtualTime = 0.0;
+    bool m_stopping = false;
+
+    long long m_admittedImmediately = 0;
+    long long m_admittedFromQueue = 0;
+    long long m_queueTimeouts = 0;
+    long long m_queueCancellations = 0;
+    long long m_totalQueueWaitMs = 0;
+    long long m_maxQueueWaitMs = 0;
+
+    std::shared_ptr<Wakeup> m_wakeup;
+    std::thread m_thread;
+};
+
+} // namespace Zrun
+
+#endif // ZRUN_SCHEDULER_H
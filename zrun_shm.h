@@ -0,0 +1,173 @@
+#ifndef ZRUN_SHM_H
+#define ZRUN_SHM_H
+
+/*
+ * 共享内存输出通道的协议和写入端，供配合 Zrun 的子程序直接包含使用（C 和 C++ 均可，仅 Unix）。
+ *
+ * 设置了 CommandOptions::sharedChannel 的命令在启动时得到一个共享内存的 fd，
+ * 编号在环境变量 ZRUN_SHM_FD 中。内存开头是 zrun_shm_header，之后是 capacity 字节的环形缓冲区。
+ * 写入端只推进 head，读取端只推进 tail，都是累计的字节数。
+ *
+ *     zrun_shm_writer writer;
+ *     if (zrun_shm_open(&writer) == 0) {
+ *         zrun_shm_write(&writer, data, size);
+ *         zrun_shm_close(&writer);
+ *     }
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define ZRUN_SHM_MAGIC 0x4d53525aU     /* "ZRSM" */
+#define ZRUN_SHM_VERSION 1
+#define ZRUN_SHM_ENV "ZRUN_SHM_FD"
+#define ZRUN_SHM_CHILD_FD 3            /* 子进程中的 fd 编号 */
+#define ZRUN_SHM_HEADER_SIZE 4096      /* 数据区从这里开始，按页对齐 */
+
+/* flags */
+#define ZRUN_SHM_BLOCKING 0x1          /* 写满时等待读取方取走数据，否则写入失败 */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;      /* 数据区字节数 */
+    uint32_t flags;
+    uint32_t reserved;
+    uint8_t pad0[40];
+    /* 写入端独占的缓存行 */
+    uint64_t head;          /* 已写入的总字节数 */
+    uint32_t overflow;      /* 非阻塞模式下有写入因空间不足被丢弃 */
+    uint8_t pad1[52];
+    /* 读取端独占的缓存行 */
+    uint64_t tail;          /* 已读取的总字节数 */
+    uint32_t closed;        /* 读取方已不再读取，阻塞的写入应当放弃 */
+    uint8_t pad2[52];
+} zrun_shm_header;
+
+#ifndef _WIN32
+
+typedef struct {
+    zrun_shm_header* header;
+    char* data;
+    size_t mappedSize;
+} zrun_shm_writer;
+
+/* 按 ZRUN_SHM_FD 映射通道，没有通道或格式不符时返回 -1 */
+static inline int zrun_shm_open(zrun_shm_writer* writer) {
+    const char* value = getenv(ZRUN_SHM_ENV);
+    struct stat info;
+    void* memory;
+    int fd;
+
+    writer->header = NULL;
+    writer->data = NULL;
+    writer->mappedSize = 0;
+    if (!value || !*value) {
+        errno = ENOENT;
+        return -1;
+    }
+    fd = atoi(value);
+    if (fstat(fd, &info) == -1 || info.st_size < ZRUN_SHM_HEADER_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    memory = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        return -1;
+    }
+    writer->header = (zrun_shm_header*)memory;
+    if (writer->header->magic != ZRUN_SHM_MAGIC || writer->header->version != ZRUN_SHM_VERSION ||
+        writer->header->capacity + ZRUN_SHM_HEADER_SIZE > (uint64_t)info.st_size) {
+        munmap(memory, (size_t)info.st_size);
+        writer->header = NULL;
+        errno = EINVAL;
+        return -1;
+    }
+    writer->data = (char*)memory + ZRUN_SHM_HEADER_SIZE;
+    writer->mappedSize = (size_t)info.st_size;
+    return 0;
+}
+
+static inline void zrun_shm_close(zrun_shm_writer* writer) {
+    if (writer->header) {
+        munmap(writer->header, writer->mappedSize);
+        writer->header = NULL;
+        writer->data = NULL;
+    }
+}
+
+/* 当前可写的连续空间，*data 指向其起点。写入后用 zrun_shm_commit 提交，可以直接在其中生成数据 */
+static inline size_t zrun_shm_reserve(zrun_shm_writer* writer, void** data) {
+    zrun_shm_header* header = writer->header;
+    uint64_t head = header->head;
+    uint64_t tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+    uint64_t offset = head % header->capacity;
+    uint64_t space = header->capacity - (head - tail);
+    uint64_t contiguous = header->capacity - offset;
+    *data = writer->data + offset;
+    return (size_t)(space < contiguous ? space : contiguous);
+}
+
+static inline void zrun_shm_commit(zrun_shm_writer* writer, size_t size) {
+    __atomic_store_n(&writer->header->head, writer->header->head + size, __ATOMIC_RELEASE);
+}
+
+/*
+ * 写入 size 字节，成功返回 0。非阻塞模式下空间不足时整段丢弃并返回 -1 (ENOSPC)；
+ * 阻塞模式下等待读取方，读取方关闭时返回 -1 (EPIPE)
+ */
+static inline int zrun_shm_write(zrun_shm_writer* writer, const void* data, size_t size) {
+    zrun_shm_header* header = writer->header;
+    const char* bytes = (const char*)data;
+    long sleepNs = 20000;
+
+    if (!(header->flags & ZRUN_SHM_BLOCKING)) {
+        uint64_t tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+        if (size > header->capacity - (header->head - tail)) {
+            __atomic_store_n(&header->overflow, 1, __ATOMIC_RELAXED);
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+
+    while (size > 0) {
+        void* target;
+        size_t available = zrun_shm_reserve(writer, &target);
+        if (available == 0) {
+            struct timespec delay;
+            if (__atomic_load_n(&header->closed, __ATOMIC_ACQUIRE)) {
+                errno = EPIPE;
+                return -1;
+            }
+            /* 读取方没有唤醒机制，逐步延长轮询间隔，最长 1ms */
+            delay.tv_sec = 0;
+            delay.tv_nsec = sleepNs;
+            nanosleep(&delay, NULL);
+            sleepNs = sleepNs * 2 > 1000000 ? 1000000 : sleepNs * 2;
+            continue;
+        }
+        sleepNs = 20000;
+        if (available > size) {
+            available = size;
+        }
+        memcpy(target, bytes, available);
+        zrun_shm_commit(writer, available);
+        bytes += available;
+        size -= available;
+    }
+    return 0;
+}
+
+#endif /* _WIN32 */
+
+#endif /* ZRUN_SHM_H */
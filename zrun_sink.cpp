@@ -0,0 +1,389 @@
+#include "zrun_sink.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#endif
+
+namespace Zrun {
+
+namespace {
+// 单次 splice/tee 请求的字节数
+constexpr size_t kSpliceChunk = 1024 * 1024;
+// Linux 管道默认容量，单次读取达到该值说明输出量大
+constexpr size_t kDefaultPipeSize = 64 * 1024;
+constexpr int kLargePipeSize = 1024 * 1024;
+}
+
+StreamPump::StreamPump(const OutputSink& sink) : m_sink(sink) {}
+
+#ifdef _WIN32
+
+StreamPump::~StreamPump() {
+    if (m_ownsFile && m_fileHandle) {
+        CloseHandle(static_cast<HANDLE>(m_fileHandle));
+    }
+}
+
+bool StreamPump::open(std::string& error) {
+    if (m_sink.writesFile()) {
+        HANDLE file = CreateFileA(m_sink.path.c_str(),
+                                  GENERIC_WRITE,
+                                  FILE_SHARE_READ,
+                                  nullptr,
+                                  m_sink.append ? OPEN_ALWAYS : CREATE_ALWAYS,
+                                  FILE_ATTRIBUTE_NORMAL,
+                                  nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = "Failed to open output file '" + m_sink.path + "': " +
+                    std::to_string(GetLastError());
+            return false;
+        }
+        if (m_sink.append) {
+            SetFilePointer(file, 0, nullptr, FILE_END);
+        }
+        m_fileHandle = file;
+        m_ownsFile = true;
+    } else if (m_sink.writesFd()) {
+        intptr_t handle = _get_osfhandle(m_sink.fd);
+        if (handle == -1) {
+            error = "Invalid output fd: " + std::to_string(m_sink.fd);
+            return false;
+        }
+        m_fileHandle = reinterpret_cast<HANDLE>(handle);
+    }
+    return true;
+}
+
+void StreamPump::pumpHandle(void* handle) {
+    char scratch[64 * 1024];
+    DWORD bytesRead;
+    while (true) {
+        size_t available = sizeof(scratch);
+        char* dest = m_sink.captures() ? m_capture.prepare(available) : scratch;
+        if (!ReadFile(static_cast<HANDLE>(handle), dest, static_cast<DWORD>(available),
+                      &bytesRead, nullptr) || bytesRead == 0) {
+            break;
+        }
+        if (m_fileHandle) {
+            DWORD written = 0;
+            WriteFile(static_cast<HANDLE>(m_fileHandle), dest, bytesRead, &written, nullptr);
+        }
+        if (m_sink.captures()) {
+            m_capture.commit(bytesRead);
+        }
+        m_bytes += bytesRead;
+    }
+}
+
+#else
+
+StreamPump::~StreamPump() {
+    if (m_ownsFd && m_sinkFd != -1) {
+        close(m_sinkFd);
+    }
+    if (m_teePipe[0] != -1) {
+        close(m_teePipe[0]);
+        close(m_teePipe[1]);
+    }
+}
+
+bool StreamPump::open(std::string& error) {
+    if (m_sink.writesFile()) {
+        // splice 不支持 O_APPEND 打开的文件，追加模式改为定位到末尾
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (m_sink.append ? 0 : O_TRUNC);
+        m_sinkFd = ::open(m_sink.path.c_str(), flags, 0644);
+        if (m_sinkFd == -1) {
+            error = "Failed to open output file '" + m_sink.path + "': " +
+                    std::string(strerror(errno));
+            return false;
+        }
+        m_ownsFd = true;
+        if (m_sink.append) {
+            lseek(m_sinkFd, 0, SEEK_END);
+        }
+    } else if (m_sink.writesFd()) {
+        if (m_sink.fd < 0) {
+            error = "Invalid output fd: " + std::to_string(m_sink.fd);
+            return false;
+        }
+        m_sinkFd = m_sink.fd;
+    }
+
+#ifdef __linux__
+    if (m_sinkFd != -1 && m_sink.captures()) {
+        if (pipe2(m_teePipe, O_CLOEXEC) == -1) {
+            error = "Failed to create pipe: " + std::string(strerror(errno));
+            return false;
+        }
+    }
+#else
+    // 其他 Unix 没有 splice/tee，始终使用读写拷贝
+    m_spliceSupported = false;
+#endif
+    return true;
+}
+
+long StreamPump::pump(int pipeFd) {
+    if (m_sinkFd == -1) {
+        size_t before = m_capture.size();
+        long result = m_capture.drain(pipeFd);
+        size_t bytesRead = m_capture.size() - before;
+        m_bytes += static_cast<long long>(bytesRead);
+        tuneAfterRead(pipeFd, bytesRead);
+        return result;
+    }
+
+    // 上次留下的数据写出之前不读取源管道，保证写入顺序
+    if (!flushPending()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (!m_spliceSupported) {
+        return copyToSink(pipeFd);
+    }
+    return m_sink.captures() ? teeToSink(pipeFd) : spliceToSink(pipeFd);
+}
+
+bool StreamPump::flushPending() {
+#ifdef __linux__
+    while (m_teePending > 0) {
+        ssize_t n = splice(m_teePipe[0], nullptr, m_sinkFd, nullptr, m_teePending,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            m_teePending -= static_cast<size_t>(n);
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            m_sinkFull = true;
+            return false;
+        }
+        // 目标不支持 splice：取出中转管道中剩余的数据，之后改用 write
+        m_spliceSupported = false;
+        char scratch[16 * 1024];
+        while (m_teePending > 0) {
+            ssize_t r = read(m_teePipe[0], scratch, std::min(m_teePending, sizeof(scratch)));
+            if (r <= 0) {
+                break;
+            }
+            m_pending.append(scratch, static_cast<size_t>(r));
+            m_teePending -= static_cast<size_t>(r);
+        }
+        m_teePending = 0;
+    }
+#endif
+    while (m_pendingOffset < m_pending.size()) {
+        ssize_t n = write(m_sinkFd, m_pending.data() + m_pendingOffset,
+                          m_pending.size() - m_pendingOffset);
+        if (n > 0) {
+            m_pendingOffset += static_cast<size_t>(n);
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            m_sinkFull = true;
+            return false;
+        }
+        // 写入出错（如读端已关闭），丢弃剩余数据
+        break;
+    }
+    m_pending.clear();
+    m_pendingOffset = 0;
+    m_sinkFull = false;
+    return true;
+}
+
+bool StreamPump::sinkWritable() const {
+    struct pollfd target;
+    target.fd = m_sinkFd;
+    target.events = POLLOUT;
+    target.revents = 0;
+    // 出错或挂断时也视为可写，由下一次写入报告错误
+    return poll(&target, 1, 0) != 0;
+}
+
+void StreamPump::commitDirectRead(int pipeFd, size_t bytes) {
+    m_capture.commitRead(bytes);
+    m_bytes += static_cast<long long>(bytes);
+    tuneAfterRead(pipeFd, bytes);
+}
+
+void StreamPump::tuneAfterRead(int pipeFd, size_t bytesRead) {
+    // 一次读到的数据超过默认管道容量时再增大管道，
+    // 小输出的命令不占用额外的内核内存
+    if (!m_tuned && bytesRead >= kDefaultPipeSize) {
+        tunePipe(pipeFd, kLargePipeSize);
+        m_tuned = true;
+    }
+}
+
+long StreamPump::spliceToSink(int pipeFd) {
+#ifndef __linux__
+    return copyToSink(pipeFd);
+#else
+    size_t moved = 0;
+    while (true) {
+        ssize_t n = splice(pipeFd, nullptr, m_sinkFd, nullptr, kSpliceChunk,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            moved += static_cast<size_t>(n);
+            m_bytes += n;
+            continue;
+        }
+        if (n == 0) {
+            tuneAfterRead(pipeFd, moved);
+            return 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        int savedErrno = errno;
+        tuneAfterRead(pipeFd, moved);
+        if (savedErrno != EAGAIN) {
+            // 目标不支持 splice（如终端）或写入出错，退回到读写拷贝，保证管道被读空
+            m_spliceSupported = false;
+            return copyToSink(pipeFd);
+        }
+        // EAGAIN 既可能是源管道已空，也可能是目标写满
+        m_sinkFull = !sinkWritable();
+        errno = EAGAIN;
+        return -1;
+    }
+#endif
+}
+
+long StreamPump::teeToSink(int pipeFd) {
+#ifndef __linux__
+    return copyToSink(pipeFd);
+#else
+    size_t moved = 0;
+    while (true) {
+        // 中转管道每轮都会被清空，所以 EAGAIN 只可能意味着源管道暂无数据
+        ssize_t n = tee(pipeFd, m_teePipe[1], kSpliceChunk, SPLICE_F_NONBLOCK);
+        if (n == 0) {
+            tuneAfterRead(pipeFd, moved);
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int savedErrno = errno;
+            tuneAfterRead(pipeFd, moved);
+            if (savedErrno != EAGAIN) {
+                m_spliceSupported = false;
+                return copyToSink(pipeFd);
+            }
+            errno = savedErrno;
+            return -1;
+        }
+
+        // 复制出来的数据从中转管道送往目标，目标写满时留在中转管道中
+        m_teePending = static_cast<size_t>(n);
+        bool flushed = flushPending();
+
+        // 从源管道读出同样多的字节到捕获缓冲区
+        size_t need = static_cast<size_t>(n);
+        while (need > 0) {
+            long r = m_capture.readFrom(pipeFd, need);
+            if (r <= 0) {
+                break;
+            }
+            need -= static_cast<size_t>(r);
+        }
+        moved += static_cast<size_t>(n);
+        m_bytes += n;
+
+        if (!flushed) {
+            tuneAfterRead(pipeFd, moved);
+            errno = EAGAIN;
+            return -1;
+        }
+        if (!m_spliceSupported) {
+            tuneAfterRead(pipeFd, moved);
+            return copyToSink(pipeFd);
+        }
+    }
+#endif
+}
+
+long StreamPump::copyToSink(int pipeFd) {
+    ChunkPool& pool = ChunkPool::instance();
+    const int sizeClass = 2;
+    char* scratch = pool.acquire(sizeClass);
+    size_t scratchSize = ChunkPool::chunkSize(sizeClass);
+
+    ssize_t n;
+    while (true) {
+        n = read(pipeFd, scratch, scratchSize);
+        if (n > 0) {
+            if (m_sink.captures()) {
+                m_capture.append(scratch, static_cast<size_t>(n));
+            }
+            m_bytes += n;
+            if (!writeToSink(scratch, static_cast<size_t>(n))) {
+                m_sinkFull = true;
+                n = -1;
+                errno = EAGAIN;
+                break;
+            }
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        break;
+    }
+
+    int savedErrno = errno;
+    pool.release(scratch, sizeClass);
+    errno = savedErrno;
+    return static_cast<long>(n);
+}
+
+bool StreamPump::writeToSink(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(m_sinkFd, data, size);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                m_pending.append(data, size);
+                return false;
+            }
+            return true;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+#endif
+
+void StreamPump::finish(std::string& out) {
+    if (out.empty()) {
+        m_capture.moveTo(out);
+        return;
+    }
+    out.reserve(out.size() + m_capture.size());
+    m_capture.forEachChunk([&out](std::string_view piece) {
+        out.append(piece.data(), piece.size());
+    });
+    m_capture.clear();
+}
+
+} // namespace Zrun
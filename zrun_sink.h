@@ -0,0 +1,86 @@
+#ifndef ZRUN_SINK_H
+#define ZRUN_SINK_H
+
+#include "zrun_types.h"
+#include "zrun_capture.h"
+#include <string>
+
+namespace Zrun {
+
+// 单个输出流的搬运器：把子进程管道中的数据送往捕获缓冲区和/或文件。
+// 只写文件时用 splice 直接从管道搬到文件，数据不经过用户态内存；
+// 同时捕获时先用 tee 复制一份到中转管道再 splice 到文件。
+class StreamPump {
+public:
+    explicit StreamPump(const OutputSink& sink);
+    ~StreamPump();
+
+    StreamPump(const StreamPump&) = delete;
+    StreamPump& operator=(const StreamPump&) = delete;
+
+    // 打开文件与中转管道，失败时写入 error
+    bool open(std::string& error);
+
+#ifdef _WIN32
+    // 读取句柄直到 EOF
+    void pumpHandle(void* handle);
+#else
+    // 搬运管道中当前可读的数据，返回值语义同 read(2)。
+    // 输出目标（管道、套接字）写满时也返回 -1 且 errno 为 EAGAIN，此时 sinkFull() 为 true，
+    // 源管道中可能仍有数据，应等待 sinkFd() 可写后再调用
+    long pump(int pipeFd);
+
+    bool sinkFull() const { return m_sinkFull; }
+    int sinkFd() const { return m_sinkFd; }
+
+    // 写出目标写满时留下的数据，全部写出后返回 true
+    bool flushPending();
+
+    // 只捕获、没有其他去向时，I/O 后端可以直接读入捕获缓冲区
+    bool directRead() const { return m_sinkFd == -1; }
+
+    // 提交后端直接读入捕获缓冲区的字节数
+    void commitDirectRead(int pipeFd, size_t bytes);
+#endif
+
+    CaptureBuffer& capture() { return m_capture; }
+    long long bytes() const { return m_bytes; }
+
+    // 把捕获的数据追加到 out
+    void finish(std::string& out);
+
+private:
+#ifndef _WIN32
+    long spliceToSink(int pipeFd);
+    long teeToSink(int pipeFd);
+    long copyToSink(int pipeFd);
+    // 目标写满时把剩余部分留到 m_pending 并返回 false；写入出错时丢弃数据
+    bool writeToSink(const char* data, size_t size);
+    bool sinkWritable() const;
+    void tuneAfterRead(int pipeFd, size_t bytesRead);
+#endif
+
+    OutputSink m_sink;
+    CaptureBuffer m_capture;
+    long long m_bytes = 0;
+#ifdef _WIN32
+    void* m_fileHandle = nullptr;
+    bool m_ownsFile = false;
+#else
+    int m_sinkFd = -1;
+    bool m_ownsFd = false;
+    int m_teePipe[2] = {-1, -1};
+    bool m_spliceSupported = true;
+    bool m_tuned = false;
+    bool m_sinkFull = false;
+    // 已复制到中转管道、还未送往目标的字节数
+    size_t m_teePending = 0;
+    // 退回读写拷贝后还未写出的数据
+    std::string m_pending;
+    size_t m_pendingOffset = 0;
+#endif
+};
+
+} // namespace Zrun
+
+#endif // ZRUN_SINK_H
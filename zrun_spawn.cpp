@@ -0,0 +1,307 @@
+#include "zrun_spawn.h"
+#include "zrun_shm.h"
+
+#ifndef _WIN32
+#include <cstring>
+#include <mutex>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <stdlib.h>
+#include <termios.h>
+
+extern char** environ;
+
+namespace Zrun {
+
+namespace {
+bool setLimit(int resource, long long value) {
+    struct rlimit limit;
+    if (getrlimit(resource, &limit) == -1) {
+        return false;
+    }
+    rlim_t soft = static_cast<rlim_t>(value);
+    if (limit.rlim_max != RLIM_INFINITY && soft > limit.rlim_max) {
+        soft = limit.rlim_max;
+    }
+    limit.rlim_cur = soft;
+    limit.rlim_max = soft;
+    return setrlimit(resource, &limit) == 0;
+}
+
+// 在子进程中调用，只使用异步信号安全的系统调用
+bool applyLimits(const ResourceLimits& limits, int cgroupProcsFd) {
+    if (cgroupProcsFd != -1 && write(cgroupProcsFd, "0", 1) != 1) {
+        return false;
+    }
+
+    if (limits.cpuSeconds >= 0) {
+        // 软限制发送 SIGXCPU，忽略该信号的进程在一秒后由硬限制 SIGKILL
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_CPU, &limit) == -1) {
+            return false;
+        }
+        rlim_t soft = static_cast<rlim_t>(limits.cpuSeconds);
+        rlim_t hard = soft + 1;
+        if (limit.rlim_max != RLIM_INFINITY && hard > limit.rlim_max) {
+            hard = limit.rlim_max;
+            soft = hard > 0 ? hard - 1 : 0;
+        }
+        limit.rlim_cur = soft;
+        limit.rlim_max = hard;
+        if (setrlimit(RLIMIT_CPU, &limit) == -1) {
+            return false;
+        }
+    }
+    if ((limits.addressSpaceBytes >= 0 && !setLimit(RLIMIT_AS, limits.addressSpaceBytes)) ||
+        (limits.openFiles >= 0 && !setLimit(RLIMIT_NOFILE, limits.openFiles))) {
+        return false;
+    }
+#ifdef RLIMIT_NPROC
+    if (limits.processes >= 0 && !setLimit(RLIMIT_NPROC, limits.processes)) {
+        return false;
+    }
+#endif
+
+    if (limits.niceIncrement != 0) {
+        errno = 0;
+        int current = getpriority(PRIO_PROCESS, 0);
+        if ((current == -1 && errno != 0) ||
+            setpriority(PRIO_PROCESS, 0, current + limits.niceIncrement) == -1) {
+            return false;
+        }
+    }
+
+#if defined(__linux__) && defined(SYS_ioprio_set)
+    if (limits.ioClass != IoPriorityClass::Default) {
+        // IOPRIO_WHO_PROCESS = 1，优先级值为 (class << 13) | level
+        int ioClass = limits.ioClass == IoPriorityClass::RealTime ? 1 :
+                      limits.ioClass == IoPriorityClass::BestEffort ? 2 : 3;
+        int level = limits.ioClass == IoPriorityClass::Idle ? 0 :
+                    (limits.ioLevel < 0 ? 0 : (limits.ioLevel > 7 ? 7 : limits.ioLevel));
+        if (syscall(SYS_ioprio_set, 1, 0, (ioClass << 13) | level) == -1) {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+bool applyPlacement(const SpawnPlacement& placement) {
+#if defined(__linux__) && defined(SYS_sched_setaffinity) && defined(SYS_set_mempolicy)
+    if (!placement.cpuMask.empty() &&
+        syscall(SYS_sched_setaffinity, 0, placement.cpuMask.size() * sizeof(unsigned long),
+                placement.cpuMask.data()) == -1) {
+        return false;
+    }
+    if (!placement.memoryNodes.empty()) {
+        // MPOL_PREFERRED = 1，MPOL_BIND = 2；内核把 maxnode 减一后使用
+        int mode = placement.strictMemory ? 2 : 1;
+        unsigned long maxNode = placement.memoryNodes.size() * sizeof(unsigned long) * 8 + 1;
+        if (syscall(SYS_set_mempolicy, mode, placement.memoryNodes.data(), maxNode) == -1) {
+            return false;
+        }
+    }
+#else
+    (void)placement;
+#endif
+    return true;
+}
+}
+
+pid_t spawnProcess(const SpawnRequest& request, std::string& error) {
+    // fork 之前准备好所有指针数组，子进程中不再分配内存
+    std::vector<char*> argv;
+    argv.reserve(request.argv.size() + 1);
+    for (const auto& arg : request.argv) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    std::vector<char*> envp;
+    if (!request.inheritEnvironment && !request.envp) {
+        envp.reserve(request.environment.size() + 1);
+        for (const auto& entry : request.environment) {
+            envp.push_back(const_cast<char*>(entry.c_str()));
+        }
+        envp.push_back(nullptr);
+    }
+
+    const char* path = request.path.c_str();
+    const char* workingDirectory =
+        request.workingDirectory.empty() ? nullptr : request.workingDirectory.c_str();
+    char** environment = request.inheritEnvironment ? environ :
+                         request.envp ? const_cast<char**>(request.envp) : envp.data();
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        error = "Fork failed: " + std::string(strerror(errno));
+        return -1;
+    }
+
+    if (pid == 0) { // 子进程
+        if (request.terminalFd != -1) {
+            // 新会话没有控制终端，打开的第一个终端需要显式设置
+            if (setsid() == -1 || ioctl(request.terminalFd, TIOCSCTTY, 0) == -1) {
+                _exit(127);
+            }
+            dup2(request.terminalFd, STDIN_FILENO);
+            dup2(request.terminalFd, STDOUT_FILENO);
+            dup2(request.terminalFd, STDERR_FILENO);
+        } else {
+            // 单独的进程组，超时或取消时 shell 启动的进程一起终止
+            setpgid(0, 0);
+            // 重定向标准输出和错误（dup2 会清除 FD_CLOEXEC）
+            if (request.stdoutFd != -1) {
+                dup2(request.stdoutFd, STDOUT_FILENO);
+            }
+            if (request.stderrFd != -1) {
+                dup2(request.stderrFd, STDERR_FILENO);
+            }
+        }
+
+        // 设置工作目录
+        if (workingDirectory && chdir(workingDirectory) == -1) {
+            _exit(127);
+        }
+
+        if (request.limits && !applyLimits(*request.limits, request.cgroupProcsFd)) {
+            static const char message[] = "zrun: failed to apply resource limits\n";
+            ssize_t ignored = write(STDERR_FILENO, message, sizeof(message) - 1);
+            (void)ignored;
+            _exit(127);
+        }
+        if (request.placement && !applyPlacement(*request.placement)) {
+            static const char message[] = "zrun: failed to apply CPU placement\n";
+            ssize_t ignored = write(STDERR_FILENO, message, sizeof(message) - 1);
+            (void)ignored;
+            _exit(127);
+        }
+
+        // 最后复制共享通道，之前用到的 fd 可能正好占用目标编号
+        if (request.sharedFd != -1) {
+            int moved = request.sharedFd == ZRUN_SHM_CHILD_FD ?
+                            fcntl(request.sharedFd, F_SETFD, 0) :
+                            dup2(request.sharedFd, ZRUN_SHM_CHILD_FD);
+            if (moved == -1) {
+                _exit(127);
+            }
+        }
+
+        execve(path, argv.data(), environment);
+        _exit(127); // execve失败
+    }
+
+    // 父进程也设置一次，返回之后立即发送的信号不会因子进程尚未调用 setpgid 而漏掉进程组。
+    // 伪终端模式下子进程自己调用 setsid，组长不能再建立会话，这里不设置
+    if (request.terminalFd == -1) {
+        setpgid(pid, pid);
+    }
+    return pid;
+}
+
+int signalProcessGroup(pid_t pid, int signal) {
+    if (pid <= 0) {
+        return -1;
+    }
+    if (kill(-pid, signal) == 0) {
+        return 0;
+    }
+    return kill(pid, signal);
+}
+
+std::vector<std::string> mergeEnvironment(const std::map<std::string, std::string>& overrides) {
+    std::vector<std::string> result;
+    for (char** entry = environ; entry && *entry; ++entry) {
+        const char* equals = std::strchr(*entry, '=');
+        if (equals && overrides.count(std::string(*entry, equals - *entry))) {
+            continue;
+        }
+        result.emplace_back(*entry);
+    }
+    for (const auto& pair : overrides) {
+        result.push_back(pair.first + "=" + pair.second);
+    }
+    return result;
+}
+
+int openPidfd(pid_t pid) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    int fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (fd != -1) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+bool createPipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) == -1) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+bool openTerminal(int& master, int& slave, unsigned short columns, unsigned short rows,
+                  std::string& error) {
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1) {
+        error = "Failed to open pseudo-terminal: " + std::string(strerror(errno));
+        return false;
+    }
+    fcntl(master, F_SETFD, FD_CLOEXEC);
+
+    char name[128];
+    bool ready = grantpt(master) == 0 && unlockpt(master) == 0;
+#if defined(__linux__) || defined(__APPLE__)
+    ready = ready && ptsname_r(master, name, sizeof(name)) == 0;
+#else
+    // 没有 ptsname_r 时 ptsname 的静态缓冲区需要加锁
+    static std::mutex nameMutex;
+    if (ready) {
+        std::lock_guard<std::mutex> lock(nameMutex);
+        const char* path = ptsname(master);
+        ready = path && std::strlen(path) < sizeof(name);
+        if (ready) {
+            std::strcpy(name, path);
+        }
+    }
+#endif
+    slave = ready ? open(name, O_RDWR | O_NOCTTY | O_CLOEXEC) : -1;
+    if (slave == -1) {
+        error = "Failed to open pseudo-terminal: " + std::string(strerror(errno));
+        close(master);
+        master = -1;
+        return false;
+    }
+
+    // 输出与管道模式保持一致：不回显，换行不加 \r
+    struct termios attributes;
+    if (tcgetattr(slave, &attributes) == 0) {
+        attributes.c_lflag &= ~static_cast<tcflag_t>(ECHO | ECHONL);
+        attributes.c_oflag &= ~static_cast<tcflag_t>(ONLCR);
+        tcsetattr(slave, TCSANOW, &attributes);
+    }
+    struct winsize size = {};
+    size.ws_col = columns;
+    size.ws_row = rows;
+    ioctl(slave, TIOCSWINSZ, &size);
+    return true;
+}
+
+} // namespace Zrun
+
+#endif // _WIN32
@@ -0,0 +1,73 @@
+#ifndef ZRUN_SPAWN_H
+#define ZRUN_SPAWN_H
+
+#include "zrun_types.h"
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/types.h>
+
+namespace Zrun {
+
+// 已解析为位掩码的 CPU/NUMA 放置，子进程直接传给系统调用
+struct SpawnPlacement {
+    std::vector<unsigned long> cpuMask;       // 为空时不修改亲和性
+    std::vector<unsigned long> memoryNodes;   // 为空时不修改内存策略
+    bool strictMemory = false;
+
+    bool empty() const { return cpuMask.empty() && memoryNodes.empty(); }
+};
+
+// 启动子进程所需的全部参数，均在父进程中准备好
+struct SpawnRequest {
+    std::string path;                       // 可执行文件路径
+    std::vector<std::string> argv;
+    std::vector<std::string> environment;   // "KEY=VALUE"，inheritEnvironment 为 false 时生效
+    bool inheritEnvironment = true;
+    // 可选，预先构建的环境变量指针数组（以 nullptr 结尾），设置时代替 environment
+    char* const* envp = nullptr;
+    std::string workingDirectory;
+    int stdoutFd = -1;
+    int stderrFd = -1;
+    // 可选，伪终端从设备：子进程建立新会话，把它设为控制终端和标准输入/输出/错误
+    // （此时忽略 stdoutFd/stderrFd）
+    int terminalFd = -1;
+    // 可选，在子进程中复制为 ZRUN_SHM_CHILD_FD 的共享内存通道
+    int sharedFd = -1;
+    // 可选，在 exec 之前设置的资源限制（cgroup 部分由 cgroupProcsFd 完成）
+    const ResourceLimits* limits = nullptr;
+    // 可选，子进程向其写入 "0" 以加入对应的 cgroup
+    int cgroupProcsFd = -1;
+    // 可选，CPU 亲和性和内存节点
+    const SpawnPlacement* placement = nullptr;
+};
+
+// fork 并执行命令。子进程中只调用异步信号安全的函数，
+// 因此可以在多线程环境（事件循环线程运行时）中安全使用。
+// 子进程是新进程组的组长（伪终端模式下是新会话的首进程），终止时信号发给整个组
+pid_t spawnProcess(const SpawnRequest& request, std::string& error);
+
+// 向以 pid 为组长的进程组发送信号，连同命令启动的子进程。
+// 该进程组不存在时（子进程尚未建立会话，或由旧版本启动）只发给 pid
+int signalProcessGroup(pid_t pid, int signal);
+
+// 当前环境叠加覆盖项，生成完整的环境列表
+std::vector<std::string> mergeEnvironment(const std::map<std::string, std::string>& overrides);
+
+// 打开进程的 pidfd，不支持时返回 -1
+int openPidfd(pid_t pid);
+
+// 创建两端都带 FD_CLOEXEC 的管道
+bool createPipe(int fds[2]);
+
+// 创建伪终端，两端都带 FD_CLOEXEC。从设备设置窗口大小并关闭回显和 \n 到 \r\n 的转换
+bool openTerminal(int& master, int& slave, unsigned short columns, unsigned short rows,
+                  std::string& error);
+
+} // namespace Zrun
+
+#endif // _WIN32
+
+#endif // ZRUN_SPAWN_H
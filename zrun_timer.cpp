@@ -0,0 +1,183 @@
+#include "zrun_timer.h"
+#include <algorithm>
+#include <climits>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Zrun {
+
+namespace {
+inline unsigned lowestBit(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+// from 及以上的位
+inline uint64_t bitsFrom(uint64_t mask, unsigned from) {
+    return from >= 64 ? 0 : mask & (~uint64_t(0) << from);
+}
+}
+
+TimerWheel::TimerWheel(Clock::time_point origin) : m_origin(origin) {
+    for (auto& level : m_slots) {
+        for (auto& head : level) {
+            head.prev = &head;
+            head.next = &head;
+        }
+    }
+}
+
+void TimerWheel::schedule(Node& node, Clock::time_point when) {
+    if (node.scheduled()) {
+        unlink(node);
+    }
+    node.expires = toTick(when, true);
+    insert(node);
+}
+
+void TimerWheel::cancel(Node& node) {
+    if (node.scheduled()) {
+        unlink(node);
+    }
+}
+
+int TimerWheel::nextTimeoutMs(Clock::time_point now) const {
+    if (m_count == 0) {
+        return -1;
+    }
+
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < kLevels; ++level) {
+        if (!m_occupied[level]) {
+            continue;
+        }
+        unsigned shift = static_cast<unsigned>(kSlotBits * level);
+        unsigned index = static_cast<unsigned>((m_current >> shift) & kSlotMask);
+        uint64_t roundStart = (m_current >> (shift + kSlotBits)) << (shift + kSlotBits);
+        uint64_t roundSize = uint64_t(1) << (shift + kSlotBits);
+        // 第 0 层从当前槽开始；更高层的当前槽已经下放，节点在之后的槽中，到达槽的起点时下放
+        uint64_t bits = bitsFrom(m_occupied[level], level == 0 ? index : index + 1);
+        uint64_t tick;
+        if (bits) {
+            tick = roundStart + (uint64_t(lowestBit(bits)) << shift);
+        } else {
+            // 只有最高层会有属于下一轮的槽
+            tick = roundStart + roundSize + (uint64_t(lowestBit(m_occupied[level])) << shift);
+        }
+        next = std::min(next, tick);
+    }
+
+    uint64_t nowTick = toTick(now, false);
+    if (next <= nowTick) {
+        return 0;
+    }
+    return static_cast<int>(std::min<uint64_t>(next - nowTick, INT_MAX));
+}
+
+uint64_t TimerWheel::toTick(Clock::time_point when, bool roundUp) const {
+    if (when <= m_origin) {
+        return 0;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(when - m_origin).count();
+    uint64_t ticks = static_cast<uint64_t>(elapsed) / 1000;
+    // 安排时向上取整，保证不会提前到期
+    if (roundUp && static_cast<uint64_t>(elapsed) % 1000 != 0) {
+        ++ticks;
+    }
+    return ticks;
+}
+
+void TimerWheel::insert(Node& node) {
+    if (node.expires < m_current) {
+        node.expires = m_current;
+    }
+
+    // 放在与当前时刻只有本层及以下不同的最低一层；最高层还容纳下一轮中
+    // 不超过 64 个槽之后到期的节点
+    int level = 0;
+    while (level < kLevels - 1 &&
+           (node.expires >> (kSlotBits * (level + 1))) != (m_current >> (kSlotBits * (level + 1)))) {
+        ++level;
+    }
+    unsigned shift = static_cast<unsigned>(kSlotBits * level);
+    unsigned slot;
+    if ((node.expires >> shift) - (m_current >> shift) >= kSlots) {
+        // 超出时间轮范围：放在最高层最后下放的槽，下放时按实际到期时间重新放置
+        slot = static_cast<unsigned>(((m_current >> shift) + kSlots - 1) & kSlotMask);
+    } else {
+        slot = static_cast<unsigned>((node.expires >> shift) & kSlotMask);
+    }
+
+    Node& head = m_slots[level][slot];
+    node.bucket = static_cast<unsigned>(level) * kSlots + slot;
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+    m_occupied[level] |= uint64_t(1) << slot;
+    ++m_count;
+}
+
+void TimerWheel::unlink(Node& node) {
+    node.prev->next = node.next;
+    node.next->prev = node.prev;
+    node.prev = nullptr;
+    node.next = nullptr;
+    --m_count;
+
+    unsigned level = node.bucket / kSlots;
+    unsigned slot = node.bucket % kSlots;
+    Node& head = m_slots[level][slot];
+    if (head.next == &head) {
+        m_occupied[level] &= ~(uint64_t(1) << slot);
+    }
+}
+
+void TimerWheel::cascade() {
+    for (int level = 1; level < kLevels; ++level) {
+        unsigned index = static_cast<unsigned>((m_current >> (kSlotBits * level)) & kSlotMask);
+        Node& head = m_slots[level][index];
+        Node* node = head.next;
+        head.prev = &head;
+        head.next = &head;
+        m_occupied[level] &= ~(uint64_t(1) << index);
+
+        // 按当前时刻重新放置到更低的层
+        while (node != &head) {
+            Node* next = node->next;
+            node->prev = nullptr;
+            node->next = nullptr;
+            --m_count;
+            insert(*node);
+            node = next;
+        }
+        if (index != 0) {
+            break;
+        }
+    }
+}
+
+void TimerWheel::advance(uint64_t tick) {
+    m_current = tick;
+    if ((m_current & kSlotMask) == 0) {
+        cascade();
+    }
+}
+
+uint64_t TimerWheel::nextTick(uint64_t target) const {
+    // 跳过本轮中剩余的空槽，但每个轮次边界都要停下来下放高层的节点
+    unsigned index = static_cast<unsigned>(m_current & kSlotMask);
+    uint64_t bits = bitsFrom(m_occupied[0], index + 1);
+    uint64_t next = bits ? (m_current & ~kSlotMask) + lowestBit(bits)
+                         : (m_current | kSlotMask) + 1;
+    return std::min(next, target + 1);
+}
+
+} // namespace Zrun
@@ -0,0 +1,89 @@
+#ifndef ZRUN_TIMER_H
+#define ZRUN_TIMER_H
+
+#include <chrono>
+#include <cstdint>
+
+namespace Zrun {
+
+// 分层时间轮：毫秒精度，4 层、每层 64 个槽，插入和取消都是 O(1)。
+// 定时器节点嵌入在调用方的对象中，时间轮不分配内存。
+// 不是线程安全的，由拥有它的线程（事件循环、调度线程）驱动
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Node {
+        Node* prev = nullptr;
+        Node* next = nullptr;
+        uint64_t expires = 0;
+        // 调用方自定义，通常指向包含该节点的对象
+        void* context = nullptr;
+        // 所在的层和槽，由时间轮维护
+        unsigned bucket = 0;
+
+        bool scheduled() const { return prev != nullptr; }
+    };
+
+    // origin 为第 0 毫秒，默认为构造时刻
+    explicit TimerWheel(Clock::time_point origin = Clock::now());
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // 在 when 时刻（或之后）到期；已在时间轮中的节点会被重新安排
+    void schedule(Node& node, Clock::time_point when);
+
+    // 取消，未安排的节点不受影响
+    void cancel(Node& node);
+
+    // 推进到 now，依次对到期的节点调用 onExpired(Node&)。
+    // 回调中可以安排或取消任意节点
+    template <typename F>
+    void expire(Clock::time_point now, F&& onExpired) {
+        uint64_t target = toTick(now, false);
+        while (m_current <= target) {
+            unsigned slot = static_cast<unsigned>(m_current & kSlotMask);
+            Node& head = m_slots[0][slot];
+            // 回调可能把节点重新安排到当前槽，直到槽为空为止
+            while (head.next != &head) {
+                Node& node = *head.next;
+                unlink(node);
+                onExpired(node);
+            }
+            advance(nextTick(target));
+        }
+    }
+
+    // 距离下一个需要处理的时刻的毫秒数，没有定时器时返回 -1
+    int nextTimeoutMs(Clock::time_point now) const;
+
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 6;
+    static constexpr unsigned kSlots = 1u << kSlotBits;
+    static constexpr uint64_t kSlotMask = kSlots - 1;
+
+    uint64_t toTick(Clock::time_point when, bool roundUp) const;
+    void insert(Node& node);
+    void unlink(Node& node);
+    void cascade();
+    uint64_t nextTick(uint64_t target) const;
+    // 移动到 tick，到达槽的起点时立即下放，高层的当前槽因此总是空的
+    void advance(uint64_t tick);
+
+    Clock::time_point m_origin;
+    // 早于 m_current 的定时器都已处理
+    uint64_t m_current = 0;
+    size_t m_count = 0;
+    Node m_slots[kLevels][kSlots];
+    // 每层非空槽的位图
+    uint64_t m_occupied[kLevels] = {};
+};
+
+} // namespace Zrun
+
+#endif // ZRUN_TIMER_H
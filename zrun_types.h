@@ -1,8 +1,13 @@
 #ifndef ZRUN_TYPES_H
 #define ZRUN_TYPES_H
 
+#include "zrun_compress.h"
 #include <string>
+#include <string_view>
 #include <functional>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace Zrun {
 
@@ -13,12 +18,348 @@ enum class ShellType {
     Sh
 };
 
+// I/O 后端（仅 Unix 有效）
+enum class IoBackendType {
+    Default,    // Linux 上使用 epoll，其他平台使用 poll
+    Epoll,
+    IoUring,    // 内核不支持时回退到 epoll
+    Poll
+};
+
+// 异步命令的优先级：准入调度时总是先启动高优先级的命令
+enum class CommandPriority {
+    High,       // 交互式命令
+    Normal,
+    Low         // 批处理任务
+};
+
 enum class AsyncState {
     Running,
     Completed,
     Failed,
     TimedOut,
-    Cancelled
+    Cancelled,
+    ResourceExceeded    // 超出 ResourceLimits 中的限制而被终止
+};
+
+// I/O 调度类 (ionice)
+enum class IoPriorityClass {
+    Default,    // 不修改
+    RealTime,
+    BestEffort,
+    Idle
+};
+
+// 命令因超出哪一项资源限制而被终止
+enum class ResourceLimitKind {
+    None,
+    CpuTime,    // RLIMIT_CPU
+    Memory      // cgroup 的 memory.max（发生了 OOM 终止）
+};
+
+// 子进程的资源限制，在 exec 之前设置（仅 Unix，Windows 上忽略）。数值为 -1 表示不限制
+struct ResourceLimits {
+    long long cpuSeconds = -1;          // RLIMIT_CPU，超出时子进程收到 SIGXCPU
+    long long addressSpaceBytes = -1;   // RLIMIT_AS
+    long long openFiles = -1;           // RLIMIT_NOFILE
+    long long processes = -1;           // RLIMIT_NPROC（按用户统计）
+    int niceIncrement = 0;              // 在当前进程的 nice 值上增加
+    IoPriorityClass ioClass = IoPriorityClass::Default;  // 仅 Linux
+    int ioLevel = 4;                    // RealTime/BestEffort 的级别 0-7，越小越优先
+
+    // cgroup v2（仅 Linux）：在 cgroupParent 下为每条命令创建子组，命令结束后删除。
+    // cgroupParent 必须可写，并已在其 cgroup.subtree_control 中启用所需的控制器
+    std::string cgroupParent;
+    long long cpuQuotaMicros = -1;      // cpu.max：每个周期内可用的 CPU 时间
+    long long cpuPeriodMicros = 100000;
+    long long memoryMaxBytes = -1;      // memory.max
+
+    bool active() const {
+        return cpuSeconds >= 0 || addressSpaceBytes >= 0 || openFiles >= 0 || processes >= 0 ||
+               niceIncrement != 0 || ioClass != IoPriorityClass::Default || usesCgroup();
+    }
+
+    bool usesCgroup() const { return !cgroupParent.empty(); }
+};
+
+// 单个输出流的去向
+struct OutputSink {
+    enum class Type {
+        Capture,        // 捕获到 CommandResult
+        File,           // 只写入文件
+        Fd,             // 只写入已有的文件描述符（不会被关闭）
+        CaptureAndFile, // 捕获并写入文件
+        CaptureAndFd    // 捕获并写入已有的文件描述符
+    };
+
+    Type type = Type::Capture;
+    std::string path;
+    int fd = -1;
+    bool append = false;
+
+    static OutputSink capture() { return OutputSink(); }
+
+    static OutputSink toFile(const std::string& filePath, bool appendMode = false,
+                             bool alsoCapture = false) {
+        OutputSink sink;
+        sink.type = alsoCapture ? Type::CaptureAndFile : Type::File;
+        sink.path = filePath;
+        sink.append = appendMode;
+        return sink;
+    }
+
+    static OutputSink toFd(int targetFd, bool alsoCapture = false) {
+        OutputSink sink;
+        sink.type = alsoCapture ? Type::CaptureAndFd : Type::Fd;
+        sink.fd = targetFd;
+        return sink;
+    }
+
+    bool captures() const {
+        return type == Type::Capture || type == Type::CaptureAndFile || type == Type::CaptureAndFd;
+    }
+
+    bool writesFile() const {
+        return type == Type::File || type == Type::CaptureAndFile;
+    }
+
+    bool writesFd() const {
+        return type == Type::Fd || type == Type::CaptureAndFd;
+    }
+};
+
+// 输出过滤：在读取的同时筛选捕获的数据，未选中的部分立即丢弃
+struct OutputFilter {
+    enum class Mode {
+        None,
+        Literal,    // 保留包含 pattern 的行
+        Regex,      // 保留匹配正则表达式 pattern 的行 (ECMAScript 语法)
+        ByteRange,  // 保留从 first 开始的 count 个字节
+        LineRange   // 保留从第 first 行 (从 0 开始) 开始的 count 行
+    };
+
+    Mode mode = Mode::None;
+    std::string pattern;
+    // Literal/Regex：保留不匹配的行
+    bool invert = false;
+    long long first = 0;
+    // -1 表示直到输出结束
+    long long count = -1;
+    // Literal/Regex：最多保留的行数，-1 表示不限制（匹配计数不受影响）
+    long long maxMatches = -1;
+    // Regex：表达式含反向引用或标准库不是 libstdc++ 时只能按字符递归匹配，
+    // 超过这个长度的行视为不匹配，以免耗尽事件循环线程的栈。-1 表示不限制
+    long long maxRegexLineLength = 2048;
+
+    static OutputFilter literal(const std::string& text, bool invertMatch = false) {
+        OutputFilter filter;
+        filter.mode = Mode::Literal;
+        filter.pattern = text;
+        filter.invert = invertMatch;
+        return filter;
+    }
+
+    static OutputFilter regex(const std::string& expression, bool invertMatch = false) {
+        OutputFilter filter;
+        filter.mode = Mode::Regex;
+        filter.pattern = expression;
+        filter.invert = invertMatch;
+        return filter;
+    }
+
+    static OutputFilter bytes(long long offset, long long length = -1) {
+        OutputFilter filter;
+        filter.mode = Mode::ByteRange;
+        filter.first = offset;
+        filter.count = length;
+        return filter;
+    }
+
+    static OutputFilter lines(long long firstLine, long long lineCount = -1) {
+        OutputFilter filter;
+        filter.mode = Mode::LineRange;
+        filter.first = firstLine;
+        filter.count = lineCount;
+        return filter;
+    }
+
+    bool active() const { return mode != Mode::None; }
+};
+
+// 子进程的 CPU 和 NUMA 放置，在 exec 之前设置（仅 Linux，其他平台忽略）
+struct CpuPlacement {
+    enum class Mode {
+        Inherit,        // 不修改，继承当前进程
+        Cpus,           // 绑定到 cpus 中列出的 CPU
+        NumaNode,       // 绑定到 numaNode 上的 CPU，并优先在该节点分配内存
+        RoundRobinCore, // 每条命令依次绑定到一个 CPU（在 cpus 中轮转，为空时在所有可用 CPU 中
+                        // 按节点交错轮转），内存优先分配在该 CPU 所在的节点
+        RoundRobinNode  // 每条命令依次绑定到一个 NUMA 节点
+    };
+
+    Mode mode = Mode::Inherit;
+    std::vector<int> cpus;
+    int numaNode = -1;
+    // NumaNode/RoundRobinCore/RoundRobinNode：只允许在所选节点分配内存 (MPOL_BIND)，
+    // 否则只是优先在该节点分配 (MPOL_PREFERRED)
+    bool strictMemory = false;
+
+    static CpuPlacement onCpus(std::vector<int> cpuList) {
+        CpuPlacement placement;
+        placement.mode = Mode::Cpus;
+        placement.cpus = std::move(cpuList);
+        return placement;
+    }
+
+    static CpuPlacement onNode(int node, bool strict = false) {
+        CpuPlacement placement;
+        placement.mode = Mode::NumaNode;
+        placement.numaNode = node;
+        placement.strictMemory = strict;
+        return placement;
+    }
+
+    static CpuPlacement roundRobinCores(std::vector<int> cpuList = {}) {
+        CpuPlacement placement;
+        placement.mode = Mode::RoundRobinCore;
+        placement.cpus = std::move(cpuList);
+        return placement;
+    }
+
+    static CpuPlacement roundRobinNodes(bool strict = false) {
+        CpuPlacement placement;
+        placement.mode = Mode::RoundRobinNode;
+        placement.strictMemory = strict;
+        return placement;
+    }
+
+    bool active() const { return mode != Mode::Inherit; }
+};
+
+// 结果缓存的配置（ZRun::enableResultCache）
+struct ResultCacheConfig {
+    size_t maxEntries = 1024;
+    // 所有条目的键和输出的总字节数上限
+    size_t maxBytes = 64 * 1024 * 1024;
+    // 默认有效期，< 0 表示永不过期
+    long long defaultTtlMs = 60000;
+    // 可选，持久化到内存映射文件（仅 Unix，单个进程独占），重启后仍可命中
+    std::string persistPath;
+};
+
+// 异步命令的执行日志（仅 Unix）：按 id 查询的异步命令的提交、启动的进程和结果追加到
+// 内存映射文件中。新的实例打开同一个文件时恢复已结束命令的结果，并接管仍在运行的进程
+struct JournalConfig {
+    std::string path;
+    // 批量 fsync 的间隔，0 表示每条记录写入后立即 fsync
+    int syncIntervalMs = 50;
+    // 文件超过这个大小且无效记录多于有效记录时重写
+    size_t compactBytes = 64 * 1024 * 1024;
+    // 每条命令的每个输出流最多记录的字节数，超出部分在恢复的结果中被截掉
+    size_t maxOutputBytes = 1024 * 1024;
+    // 恢复时终止上一个实例留下的仍在运行的进程，而不是等待它们结束
+    bool killOrphans = false;
+};
+
+// 单条命令的结果缓存选项：只应用于结果只取决于命令、工作目录和环境变量的命令。
+// 只有同步执行、输出全部捕获且没有过滤器/分行回调/压缩的命令会使用缓存
+struct CachePolicy {
+    bool enabled = false;
+    // 0 表示使用 ResultCacheConfig::defaultTtlMs，< 0 表示永不过期
+    long long ttlMs = 0;
+    // 依赖的文件：修改时间或大小与执行时不同时缓存的结果失效
+    std::vector<std::string> dependencies;
+    // 同时缓存退出码非零的结果（超时、被终止和启动失败的结果总是不缓存）
+    bool cacheFailures = false;
+};
+
+// 失败后重新执行的策略。第 n 次重试前等待
+// min(initialBackoffMs * backoffMultiplier^(n-1), maxBackoffMs)，再乘以 1±jitter 的随机因子
+struct RetryPolicy {
+    int maxAttempts = 1;                // 包括第一次执行，<= 1 表示不重试
+    int initialBackoffMs = 100;
+    double backoffMultiplier = 2.0;
+    int maxBackoffMs = 10000;
+    double jitter = 0.2;                // 0~1
+    bool retryOnTimeout = true;
+    // 需要重试的退出码，为空表示所有非零退出码（包括启动失败的 -1）。
+    // 超出资源限制而被终止的命令不重试
+    std::vector<int> retryExitCodes;
+
+    bool active() const { return maxAttempts > 1; }
+};
+
+// 对冲执行：第一份进程在延迟时间内没有结束时再启动一份相同的命令，
+// 采用最先结束的结果并终止其余的进程。只应用于没有副作用、可以重复执行的命令
+struct HedgePolicy {
+    bool enabled = false;
+    // 延迟取该命令最近成功执行时间的分位数，样本不足 minSamples 时使用 delayMs
+    double percentile = 0.95;
+    int minSamples = 20;
+    int delayMs = -1;                   // < 0 表示样本不足时不对冲
+    int maxCopies = 2;                  // 同时执行的最多份数（包括第一份）
+};
+
+class SharedChannel;
+
+// 伪终端模式 (仅 Unix)：子进程在新的会话中运行，以伪终端为控制终端和标准输入/输出/错误，
+// 按行缓冲的工具会立即输出。标准输出和错误合并到 CommandResult::output，
+// 使用 stdoutSink/stdoutFilter，stderr 的选项不起作用。终端不回显，也不把 \n 转换为 \r\n
+struct TerminalOptions {
+    bool enabled = false;
+    unsigned short columns = 80;
+    unsigned short rows = 24;
+};
+
+// 分行回调：line 不含换行符，只在回调期间有效
+using LineCallback = std::function<void(std::string_view line, bool isError)>;
+
+// 单条命令的执行选项
+struct CommandOptions {
+    ShellType shellType = ShellType::PowerShell;
+    int timeoutMs = 30000;
+    OutputSink stdoutSink;
+    OutputSink stderrSink;
+    // 可选，捕获的输出按行回调（Unix 上在事件循环线程中随读取进行）
+    LineCallback lineCallback;
+    // lineCallback 和按行过滤的最大行长度（字节）：更长的行按这个长度拆成多行交出，
+    // 不含换行符的输出不会无限暂存。0 表示不限制
+    size_t maxLineLength = 1 << 20;
+    // 可选，只作用于捕获到 CommandResult 的数据；lineCallback 和分块回调仍收到全部输出
+    OutputFilter stdoutFilter;
+    OutputFilter stderrFilter;
+    // 捕获的数据在读取时分块压缩，结果保存在 CommandResult::compressedOutput/compressedError，
+    // 适合需要长时间保留大量输出的异步命令
+    bool compressOutput = false;
+    // 准入调度（只对异步命令生效）：同一 tag 共享并发上限和权重
+    std::string tag;
+    CommandPriority priority = CommandPriority::Normal;
+    // 在准入队列中最多等待的时间，-1 表示不限
+    int queueTimeoutMs = -1;
+    // 资源限制
+    ResourceLimits limits;
+    // CPU/NUMA 放置；为 Inherit 时使用 ZRun::setDefaultPlacement 设置的默认值
+    CpuPlacement placement;
+    // 结果缓存（需要先启用 ZRun::enableResultCache）
+    CachePolicy cache;
+    // 异步命令合并执行：命令、shell、工作目录和环境变量都相同的命令仍在执行时，
+    // 新的请求不再启动进程，而是共享它的结果和之后的输出块。
+    // 只用于输出全部捕获且没有过滤器/分行回调/压缩的命令；超时、资源限制和调度
+    // 选项取自第一个请求
+    bool singleFlight = false;
+    // 重试和对冲。设置了分块回调的异步命令只收到最终采用的那次执行的输出，
+    // 并在命令结束时一次性送达
+    RetryPolicy retry;
+    HedgePolicy hedge;
+    // 在伪终端而不是管道中执行
+    TerminalOptions terminal;
+    // 可选，共享内存输出通道 (仅 Unix)：子进程的 fd 3 映射到它，编号也在环境变量 ZRUN_SHM_FD 中。
+    // 使用通道的命令不缓存结果，也不对冲执行
+    std::shared_ptr<SharedChannel> sharedChannel;
+
+    CommandOptions() = default;
+    CommandOptions(ShellType type, int timeout)
+        : shellType(type), timeoutMs(timeout) {}
 };
 
 struct CommandResult {
@@ -27,15 +368,122 @@ struct CommandResult {
     std::string error;
     long long executionTime = 0;
     bool timedOut = false;
+    // 各输出流产生的总字节数（包括只写入文件、未捕获的部分）
+    long long outputBytes = 0;
+    long long errorBytes = 0;
+    // 设置了过滤器时，各输出流中选中的行数（ByteRange 模式为字节数）
+    long long outputMatches = 0;
+    long long errorMatches = 0;
+    // 设置了 compressOutput 时，捕获的数据压缩保存在这里，对应的 output/error 为空
+    std::shared_ptr<const CompressedText> compressedOutput;
+    std::shared_ptr<const CompressedText> compressedError;
+    // 超出资源限制而被终止时的原因
+    ResourceLimitKind limitExceeded = ResourceLimitKind::None;
+    // 结果来自结果缓存，命令没有实际执行
+    bool fromCache = false;
+    // 启动的进程数（包括重试和对冲副本），来自缓存时为 0
+    int attempts = 1;
+    // 采用的结果来自对冲副本
+    bool hedged = false;
 
     CommandResult() = default;
     CommandResult(int code, std::string out, std::string err, long long time, bool timeout)
         : exitCode(code), output(std::move(out)), error(std::move(err)),
         executionTime(time), timedOut(timeout) {}
+
+    // 把压缩保存的数据解压到 output/error
+    void inflate() {
+        if (compressedOutput) {
+            compressedOutput->decompressTo(output);
+            compressedOutput.reset();
+        }
+        if (compressedError) {
+            compressedError->decompressTo(error);
+            compressedError.reset();
+        }
+    }
+};
+
+// 运行统计
+struct Metrics {
+    long long commandsCompleted = 0;
+    // 压缩保存的捕获数据：原始字节数和压缩后的字节数
+    long long compressedRawBytes = 0;
+    long long compressedBytes = 0;
+
+    // 准入调度
+    struct TagStats {
+        long long running = 0;
+        long long queued = 0;
+        long long admitted = 0;
+    };
+    long long commandsRunning = 0;      // 已准入、尚未结束
+    long long commandsQueued = 0;       // 正在排队
+    long long admittedImmediately = 0;
+    long long admittedFromQueue = 0;
+    long long queueTimeouts = 0;
+    long long queueCancellations = 0;
+    long long totalQueueWaitMs = 0;
+    long long maxQueueWaitMs = 0;
+    std::map<std::string, TagStats> tags;
+
+    // 合并到已在执行的相同命令的异步请求数
+    long long singleFlightJoined = 0;
+
+    // 结果缓存
+    long long cacheHits = 0;
+    long long cacheMisses = 0;
+    long long cacheEvictions = 0;       // 因容量上限、过期或依赖变化移除的条目
+    long long cacheEntries = 0;
+    long long cacheBytes = 0;
+
+    // 重试和对冲
+    long long retries = 0;              // 因失败而再次启动的进程数
+    long long hedgesLaunched = 0;
+    long long hedgeWins = 0;            // 对冲副本先结束并被采用
+
+    double compressionRatio() const {
+        return compressedBytes > 0 ? static_cast<double>(compressedRawBytes) / compressedBytes : 0.0;
+    }
 };
 
 using OutputCallback = std::function<void(const std::string& output, bool isError)>;
 
+// 分块输出回调：命令运行期间每读到一批数据调用一次，data 只在回调期间有效
+using ChunkCallback = std::function<void(std::string_view data, bool isError)>;
+
+// 完成回调：命令结束后调用一次，可以移走 result 中的数据
+using CompletionCallback = std::function<void(AsyncState state, CommandResult& result)>;
+
+// parallelMap 的选项
+struct ParallelMapOptions {
+    // 同时执行的最大命令数，<= 0 表示 CPU 数
+    int concurrency = 0;
+    // 按输入顺序回调结果；为 false 时每条命令结束后立即回调
+    bool ordered = true;
+    // 第一条命令失败（退出码非零、超时、超出资源限制或无法启动）后不再启动新的命令，
+    // 并终止仍在运行的命令
+    bool stopOnFailure = false;
+    // 每条命令的执行选项（同样经过准入调度）
+    CommandOptions command;
+};
+
+// parallelMap 的结果回调，index 为输入的下标；在调用 parallelMap 的线程中执行
+using ParallelResultCallback = std::function<void(size_t index, CommandResult& result)>;
+
+// parallelMap 的统计
+struct ParallelMapSummary {
+    size_t started = 0;
+    size_t succeeded = 0;
+    size_t failed = 0;
+    // 因 stopOnFailure 没有启动或被终止的输入
+    size_t skipped = 0;
+    bool stopped = false;
+    long long elapsedMs = 0;
+    // 各命令执行时间之和
+    long long totalExecutionMs = 0;
+};
+
 } // namespace Zrun
 
 #endif // ZRUN_TYPES_H